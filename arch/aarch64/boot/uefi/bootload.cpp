@@ -18,6 +18,7 @@ extern "C" EFI_STATUS EFIAPI efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE*
         .mem_upper_min = 0,
         .kernel_alloc_base = 0x40080000ULL,
         .kernel_alloc_pages = 256, /* 1 MB */
+        .ramdisk_max_addr = 0x7FFFFFFFULL, /* head.S maps phys 0..2 GB */
     };
 
     BootInfo* bi = nullptr;
@@ -94,6 +94,21 @@ static inline void arch_idle(void) {
     __asm__ volatile("wfi");
 }
 
+/* Virtual counter (CNTVCT_EL0); isb keeps the read from being speculated early */
+static inline uint64_t arch_read_counter(void) {
+    uint64_t v = 0;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(v)::"memory");
+    return v;
+}
+
+/* Let EL0 read CNTVCT_EL0 (CNTKCTL_EL1.EL0VCTEN) */
+static inline void arch_enable_user_counter(void) {
+    uint64_t v = 0;
+    __asm__ volatile("mrs %0, cntkctl_el1" : "=r"(v));
+    v |= (1UL << 1);
+    __asm__ volatile("msr cntkctl_el1, %0; isb" ::"r"(v));
+}
+
 [[noreturn]] static inline void arch_halt(void) {
     while (true) {
         __asm__ volatile("wfi");
@@ -129,6 +144,7 @@ int arch_pci_intx_to_irq(uint8_t dev, uint8_t int_pin); /* PCI INTx → platform
 void arch_setup_kthread_tf(TrapFrame* tf, uintptr_t entry, uintptr_t fn, uintptr_t arg);
 void arch_fixup_fork_tf(TrapFrame* tf, uintptr_t sp);
 void arch_setup_user_tf(TrapFrame* tf, uintptr_t entry, uintptr_t usp);
+uint64_t arch_counter_freq(); /* arch_read_counter() frequency in Hz (CNTFRQ_EL0) */
 
 static inline void* arch_memset(void* s, int c, size_t n) {
     auto* p = static_cast<uint8_t*>(s);
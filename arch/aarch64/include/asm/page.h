@@ -35,6 +35,10 @@
 /* Convenience combo: user-accessible read/write */
 #define VM_USER_RW (VM_USER | VM_PRESENT)
 
+/* User read-only (EL1 read-only too); only VM_USER_RX is executable */
+#define VM_USER_RO (PTE_AP_RO_ALL | VM_PRESENT | VM_NOEXEC)
+#define VM_USER_RX (PTE_AP_RO_ALL | VM_PRESENT)
+
 #ifndef __ASSEMBLY__
 
 #include <base/types.h>
@@ -74,7 +78,7 @@ static inline uintptr_t make_pte_table(uintptr_t pa) {
     return pa | PTE_VALID | PTE_TABLE;
 }
 
-static inline uintptr_t make_pte_page(uintptr_t pa, uint32_t perm) {
+static inline uintptr_t make_pte_page(uintptr_t pa, uintptr_t perm) {
     return pa | PTE_VALID | PTE_PAGE | PTE_AF | perm;
 }
 
@@ -17,18 +17,29 @@ struct TrapFrame {
     void print() const;
     void print_pgfault() const;
 
+    [[nodiscard]] uint64_t ip() const { return pc; }
+    void set_ip(uint64_t addr) { pc = addr; }
+
     [[nodiscard]] uint64_t syscall_nr() const { return regs[8]; }
+    void set_syscall_nr(uint64_t nr) { regs[8] = nr; }
     [[nodiscard]] uint64_t syscall_arg(int n) const {
         if (n >= 0 && n <= 5) {
             return regs[n];
         }
         return 0;
     }
+    void set_syscall_arg(int n, uint64_t val) {
+        if (n >= 0 && n <= 5) {
+            regs[n] = val;
+        }
+    }
 
+    [[nodiscard]] uint64_t return_value() const { return regs[0]; }
     void set_return(uint64_t val) { regs[0] = val; }
 };
 
 extern "C" void trap_dispatch(TrapFrame* tf);
+extern "C" void syscall_dispatch(TrapFrame* tf);
 extern "C" void trapret(void);
 
 #endif /* !__ASSEMBLY__ */
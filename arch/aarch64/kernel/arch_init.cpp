@@ -99,3 +99,7 @@ void arch_setup_user_tf(TrapFrame* tf, uintptr_t entry, uintptr_t usp) {
     tf->sp = usp;
     tf->pstate = 0x00000000;  // EL0t, all exceptions unmasked
 }
+
+uint64_t arch_counter_freq() {
+    return timer::freq();
+}
@@ -1,9 +1,22 @@
 #include "block/blk.h"
+#include "drivers/virtio_blk.h"
 
 namespace blk {
 
+namespace {
+
+// QEMU virt: 32 virtio-mmio windows of 512 bytes, slot i on GIC SPI 16 + i.
+constexpr uintptr_t VIRTIO_MMIO_PHYS = 0x0a000000;
+constexpr size_t VIRTIO_MMIO_STRIDE = 0x200;
+constexpr int VIRTIO_MMIO_COUNT = 32;
+constexpr int VIRTIO_MMIO_INTID = 32 + 16;
+
+}  // namespace
+
 int probe_backends() {
     // PCI-backed drivers are registered/probed in the global init flow.
+    const virtio::MmioWindow window = {VIRTIO_MMIO_PHYS, VIRTIO_MMIO_STRIDE, VIRTIO_MMIO_COUNT, VIRTIO_MMIO_INTID};
+    static_cast<void>(virtio_blk::probe_mmio(window));
     return 0;
 }
 
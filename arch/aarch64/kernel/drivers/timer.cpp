@@ -15,13 +15,18 @@ namespace timer {
 
 volatile int64_t ticks = 0;
 
+uint64_t freq() {
+    uint64_t hz{};
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(hz));
+    return hz;
+}
+
 int init() {
-    uint64_t freq{};
-    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(freq));
-    if (freq == 0)
+    uint64_t hz = freq();
+    if (hz == 0)
         return -1;
 
-    cached_interval = freq / 100;  // 100 Hz = 10ms per tick
+    cached_interval = hz / 100;  // 100 Hz = 10ms per tick
     if (cached_interval == 0)
         return -1;
 
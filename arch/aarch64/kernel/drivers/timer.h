@@ -6,6 +6,7 @@ namespace timer {
 
 int init();
 void set_next();
+uint64_t freq();  // CNTFRQ_EL0, the counter frequency in Hz
 extern volatile int64_t ticks;
 
 }  // namespace timer
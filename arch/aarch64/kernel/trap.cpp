@@ -15,6 +15,8 @@
 #include "drivers/gic.h"
 #include "drivers/pl011.h"
 #include "drivers/timer.h"
+#include "drivers/sdhci.h"
+#include "drivers/virtio_blk.h"
 #include "drivers/virtio_kbd.h"
 
 namespace {
@@ -68,10 +70,13 @@ bool arch_try_handle_irq(TrapFrame* tf) {
     } else if (intid == TRAP_INTID_UART) {
         pl011::intr();
         gic::send_eoi(iar);
-    } else if (intid == static_cast<uint32_t>(virtio_kbd::irq())) {
-        virtio_kbd::intr();
-        gic::send_eoi(iar);
     } else if (intid != TRAP_INTID_SPURIOUS) {
+        // PCI INTx lines are shared between the virtio and SD devices.
+        if (intid == static_cast<uint32_t>(virtio_kbd::irq())) {
+            virtio_kbd::intr();
+        }
+        virtio_blk::intr(static_cast<int>(intid));
+        sdhci::intr(static_cast<int>(intid));
         gic::send_eoi(iar);
     }
 
@@ -115,12 +120,8 @@ bool arch_is_syscall(const TrapFrame* tf) {
 }
 
 void arch_on_syscall_entry(TrapFrame* tf) {
-    if (!tf) {
-        return;
-    }
-
-    // Advance PC past SVC instruction (4 bytes)
-    tf->pc += 4;
+    // ELR_EL1 already points past the SVC instruction.
+    static_cast<void>(tf);
 }
 
 void arch_on_unhandled(TrapFrame* tf) {
@@ -17,6 +17,7 @@ extern "C" EFI_STATUS EFIAPI efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE*
         .mem_upper_min = 0,
         .kernel_alloc_base = BOARD_KERNEL_PHYS,
         .kernel_alloc_pages = 512, /* 2 MB */
+        .ramdisk_max_addr = BOARD_DRAM_BASE + 0x3FFFFFFFUL, /* The DRAM gigapage */
     };
 
     BootInfo* bi = nullptr;
@@ -142,6 +142,22 @@ static inline void arch_idle(void) {
     __asm__ volatile("wfi");
 }
 
+/* ------------------------------------------------------------------ */
+/* Cycle counter                                                       */
+/* ------------------------------------------------------------------ */
+
+/* The `time` CSR, ticking at the board timebase frequency */
+static inline uint64_t arch_read_counter(void) {
+    uint64_t t;
+    __asm__ volatile("rdtime %0" : "=r"(t));
+    return t;
+}
+
+/* Let U-mode use rdtime (scounteren.TM) */
+static inline void arch_enable_user_counter(void) {
+    __asm__ volatile("csrs scounteren, %0" ::"r"(1UL << 1));
+}
+
 [[noreturn]] static inline void arch_halt(void) {
     while (true) {
         __asm__ volatile("wfi");
@@ -202,4 +218,7 @@ void arch_setup_kthread_tf(TrapFrame* tf, uintptr_t entry, uintptr_t fn, uintptr
 void arch_fixup_fork_tf(TrapFrame* tf, uintptr_t sp);
 void arch_setup_user_tf(TrapFrame* tf, uintptr_t entry, uintptr_t usp);
 
+/* arch_read_counter() frequency in Hz (board timebase) */
+uint64_t arch_counter_freq();
+
 #endif /* !__ASSEMBLY__ */
@@ -31,3 +31,9 @@
 
 /* PCI ECAM size (1 MB, bus 0 only) */
 #define BOARD_PCI_ECAM_SIZE 0x00100000UL
+
+/* virtio-mmio slots: 8 windows of 4 KB, slot i on PLIC IRQ 1 + i */
+#define BOARD_VIRTIO_MMIO_PHYS   0x10001000UL
+#define BOARD_VIRTIO_MMIO_STRIDE 0x1000UL
+#define BOARD_VIRTIO_MMIO_COUNT  8
+#define BOARD_VIRTIO_MMIO_IRQ    1
@@ -31,3 +31,9 @@
 
 /* PCI ECAM size */
 #define BOARD_PCI_ECAM_SIZE 0UL
+
+/* No virtio-mmio slots */
+#define BOARD_VIRTIO_MMIO_PHYS   0UL
+#define BOARD_VIRTIO_MMIO_STRIDE 0UL
+#define BOARD_VIRTIO_MMIO_COUNT  0
+#define BOARD_VIRTIO_MMIO_IRQ    0
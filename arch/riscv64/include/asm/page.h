@@ -54,6 +54,8 @@
 #define VM_NOEXEC    0UL /* absence of PTE_X = no-execute   */
 
 #define VM_USER_RW (VM_PRESENT | VM_WRITE | VM_USER)
+#define VM_USER_RO (VM_PRESENT | VM_USER) /* R is implied by make_pte_page() */
+#define VM_USER_RX (VM_PRESENT | VM_USER | PTE_X)
 
 /* Page size */
 #define PG_SIZE  4096
@@ -67,6 +69,7 @@
 /* satp register: MODE=8 (Sv39), ASID=0, PPN=root page table */
 #define SATP_SV39           (8UL << 60)
 #define MAKE_SATP(pgdir_pa) (SATP_SV39 | ((pgdir_pa) >> PG_SHIFT))
+#define SATP_PGDIR(satp)    (((satp) & ((1UL << 44) - 1)) << PG_SHIFT)
 
 #ifndef __ASSEMBLY__
 
@@ -133,7 +136,7 @@ static inline uintptr_t make_pte_table(uintptr_t pa) {
     return ((pa >> PG_SHIFT) << PTE_PPN_SHIFT) | PTE_V;
 }
 
-static inline uintptr_t make_pte_page(uintptr_t pa, uint32_t perm) {
+static inline uintptr_t make_pte_page(uintptr_t pa, uintptr_t perm) {
     return ((pa >> PG_SHIFT) << PTE_PPN_SHIFT) | PTE_V | PTE_R | PTE_A | PTE_D | perm;
 }
 
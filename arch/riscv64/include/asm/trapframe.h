@@ -59,14 +59,24 @@ struct TrapFrame {
     void print() const;
     void print_pgfault() const;
 
+    [[nodiscard]] uint64_t ip() const { return sepc; }
+    void set_ip(uint64_t addr) { sepc = addr; }
+
     /* Syscall interface */
     [[nodiscard]] uint64_t syscall_nr() const { return regs[17]; } /* a7 */
+    void set_syscall_nr(uint64_t nr) { regs[17] = nr; } /* a7 */
     [[nodiscard]] uint64_t syscall_arg(int n) const {
         if (n >= 0 && n <= 5) {
             return regs[10 + n]; /* a0–a5 */
         }
         return 0;
     }
+    void set_syscall_arg(int n, uint64_t val) {
+        if (n >= 0 && n <= 5) {
+            regs[10 + n] = val;
+        }
+    }
+    [[nodiscard]] uint64_t return_value() const { return regs[10]; } /* a0 */
     void set_return(uint64_t val) { regs[10] = val; } /* a0 */
 };
 
@@ -110,6 +120,7 @@ struct TrapFrame {
 #define TF_SIZE    288 /* total frame size (must be 16-byte aligned) */
 
 extern "C" void trap_dispatch(TrapFrame* tf);
+extern "C" void syscall_dispatch(TrapFrame* tf);
 extern "C" void trapret(void);
 
 #else /* __ASSEMBLY__ */
@@ -120,3 +120,7 @@ void arch_setup_user_tf(TrapFrame* tf, uintptr_t entry, uintptr_t usp) {
     tf->sstatus = SSTATUS_SPIE; /* U-mode (SPP=0), IRQs enabled after sret */
     tf->regs[2] = usp;          /* x2 = sp */
 }
+
+uint64_t arch_counter_freq() {
+    return timer::TIMER_FREQ_HZ;
+}
@@ -2,17 +2,28 @@
  * @file blk_backends.cpp
  * @brief RISC-V block device backend probe.
  *
- * On RISC-V QEMU virt, block devices are exposed as virtio-blk PCI
- * devices and probed automatically by the generic PCI layer in
- * kernel/drivers/pci.cpp.  No arch-specific work is needed here.
+ * On RISC-V QEMU virt, block devices are virtio-blk: PCI devices bind in
+ * the generic PCI probe, and the board's virtio-mmio slots are probed
+ * here.
  */
 
 #include "block/blk.h"
+#include "drivers/virtio_blk.h"
+
+#include <asm/board.h>
 
 namespace blk {
 
 int probe_backends() {
-    /* PCI-backed drivers are registered/probed in the global init flow */
+#if BOARD_VIRTIO_MMIO_COUNT > 0
+    const virtio::MmioWindow window = {
+        BOARD_VIRTIO_MMIO_PHYS,
+        BOARD_VIRTIO_MMIO_STRIDE,
+        BOARD_VIRTIO_MMIO_COUNT,
+        BOARD_VIRTIO_MMIO_IRQ,
+    };
+    static_cast<void>(virtio_blk::probe_mmio(window));
+#endif
     return 0;
 }
 
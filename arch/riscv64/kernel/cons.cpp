@@ -24,7 +24,8 @@ constexpr size_t INPUT_BUF_SIZE = 128;
 char input_buf[INPUT_BUF_SIZE];
 volatile int input_read = 0;
 volatile int input_write = 0;
-WaitQueue input_waitq;
+LockClass input_class{"cons_input"};
+WaitQueue input_waitq{input_class};
 
 }  // namespace
 
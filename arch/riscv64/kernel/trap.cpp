@@ -17,7 +17,10 @@
 #include "drivers/plic.h"
 #include "drivers/timer.h"
 #include "drivers/uart16550.h"
+#include "drivers/sdhci.h"
+#include "drivers/virtio_blk.h"
 #include "drivers/virtio_kbd.h"
+#include "mm/pmm.h"
 
 void TrapFrame::print() const {
     cprintf("TrapFrame at %p\n", this);
@@ -67,8 +70,13 @@ bool arch_try_handle_irq(TrapFrame* tf) {
         uint32_t irq = plic::claim();
         if (irq == static_cast<uint32_t>(IRQ_UART)) {
             uart16550::intr();
-        } else if (irq == static_cast<uint32_t>(virtio_kbd::irq())) {
-            virtio_kbd::intr();
+        } else if (irq != 0) {
+            /* PCI INTx lines are shared between the virtio and SD devices */
+            if (irq == static_cast<uint32_t>(virtio_kbd::irq())) {
+                virtio_kbd::intr();
+            }
+            virtio_blk::intr(static_cast<int>(irq));
+            sdhci::intr(static_cast<int>(irq));
         }
         if (irq != 0) {
             plic::complete(irq);
@@ -104,6 +112,13 @@ uint32_t arch_page_fault_error(const TrapFrame* tf) {
     if ((tf->sstatus & (1 << 8)) == 0) {
         err |= 4; /* user mode (SPP = 0) */
     }
+
+    /* scause does not tell a missing page from a forbidden access: a valid
+     * leaf PTE means the access itself was not allowed. */
+    pte_t* ptep = pmm::get_pte(phys_to_virt<pde_t>(SATP_PGDIR(arch_read_cr3())), tf->stval, false);
+    if (ptep && (*ptep & PTE_V)) {
+        err |= 1; /* protection fault */
+    }
     return err;
 }
 
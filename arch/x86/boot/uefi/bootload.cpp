@@ -17,6 +17,7 @@ extern "C" EFI_STATUS EFIAPI efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE*
         .mem_upper_min = 0x100000,
         .kernel_alloc_base = 0,
         .kernel_alloc_pages = 0,
+        .ramdisk_max_addr = 0x37FFFFFFULL, /* KERNEL_MEM_SIZE */
     };
 
     BootInfo* bi = nullptr;
@@ -100,6 +100,17 @@ static inline bool arch_irq_is_enabled(void) {
     return (read_eflags() & FL_IF) != 0;
 }
 
+/* Free-running cycle counter (TSC); frequency is calibrated against the PIT */
+static inline uint64_t arch_read_counter(void) {
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+/* rdtsc is allowed at CPL 3 as long as CR4.TSD stays clear */
+static inline void arch_enable_user_counter(void) {}
+
 static inline void arch_idle(void) {
     __asm__ volatile("sti; hlt");
 }
@@ -130,6 +141,7 @@ int arch_pci_intx_to_irq(uint8_t dev, uint8_t int_pin); /* PCI INTx → platform
 void arch_setup_kthread_tf(TrapFrame* tf, uintptr_t entry, uintptr_t fn, uintptr_t arg);
 void arch_fixup_fork_tf(TrapFrame* tf, uintptr_t esp);
 void arch_setup_user_tf(TrapFrame* tf, uintptr_t entry, uintptr_t usp);
+uint64_t arch_counter_freq(); /* arch_read_counter() frequency in Hz, 0 if uncalibrated */
 
 [[noreturn]] static inline void arch_halt_forever(void) {
     while (true)
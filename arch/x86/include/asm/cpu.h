@@ -37,4 +37,25 @@ static inline void cli(void) {
     asm volatile("cli" ::: "memory");
 }
 
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile("wrmsr" : : "c"(msr), "a"(static_cast<uint32_t>(val)), "d"(static_cast<uint32_t>(val >> 32)));
+}
+
+struct CpuidRegs {
+    uint32_t eax, ebx, ecx, edx;
+};
+
+static inline CpuidRegs cpuid(uint32_t leaf, uint32_t subleaf = 0) {
+    CpuidRegs r{};
+    asm volatile("cpuid" : "=a"(r.eax), "=b"(r.ebx), "=c"(r.ecx), "=d"(r.edx) : "a"(leaf), "c"(subleaf));
+    return r;
+}
+
 #endif /* !__ASSEMBLY__ */
@@ -12,13 +12,18 @@
 #define CR0_CD 0x40000000  // Cache Disable
 #define CR0_PG 0x80000000  // Paging
 
-#define CR4_PSE 0x00000010  // Page Size Extension
-#define CR4_PAE 0x00000020  // Physical Address Extension
-#define CR4_PGE 0x00000080  // Page Global Enable
+#define CR4_PSE  0x00000010  // Page Size Extension
+#define CR4_PAE  0x00000020  // Physical Address Extension
+#define CR4_PGE  0x00000080  // Page Global Enable
+#define CR4_SMAP 0x00200000  // Supervisor Mode Access Prevention
 
 /* Model Specific Registers (MSR) */
 #define MSR_EFER 0xC0000080  // Extended Feature Enable Register
 #define EFER_SCE 0x001       // System Call Extensions
 #define EFER_LME 0x100       // Long Mode Enable
 #define EFER_LMA 0x400       // Long Mode Active
-#define EFER_NXE 0x800       // No-Execute Enable
\ No newline at end of file
+#define EFER_NXE 0x800       // No-Execute Enable
+
+#define MSR_STAR  0xC0000081  // SYSCALL/SYSRET segment selectors
+#define MSR_LSTAR 0xC0000082  // SYSCALL target rip (64-bit mode)
+#define MSR_FMASK 0xC0000084  // rflags bits cleared by SYSCALL
\ No newline at end of file
@@ -25,9 +25,11 @@ static inline void write_eflags(uint64_t eflags) __attribute__((always_inline));
 
 static inline void lcr0(uintptr_t cr0) __attribute__((always_inline));
 static inline void lcr3(uintptr_t cr3) __attribute__((always_inline));
+static inline void lcr4(uintptr_t cr4) __attribute__((always_inline));
 
 static inline uintptr_t rcr2(void) __attribute__((always_inline));
 static inline uintptr_t rcr3(void) __attribute__((always_inline));
+static inline uintptr_t rcr4(void) __attribute__((always_inline));
 
 static inline void invlpg(void* addr) __attribute__((always_inline));
 
@@ -130,6 +132,10 @@ static inline void lcr3(uintptr_t cr3) {
     asm volatile("mov %0, %%cr3" ::"r"(cr3) : "memory");
 }
 
+static inline void lcr4(uintptr_t cr4) {
+    asm volatile("mov %0, %%cr4" ::"r"(cr4) : "memory");
+}
+
 static inline uintptr_t rcr2(void) {
     uintptr_t cr2 = 0;
     asm volatile("mov %%cr2, %0" : "=r"(cr2)::"memory");
@@ -142,6 +148,12 @@ static inline uintptr_t rcr3(void) {
     return cr3;
 }
 
+static inline uintptr_t rcr4(void) {
+    uintptr_t cr4 = 0;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4)::"memory");
+    return cr4;
+}
+
 static inline void invlpg(void* addr) {
     asm volatile("invlpg (%0)" ::"r"(addr) : "memory");
 }
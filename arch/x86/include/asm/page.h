@@ -25,6 +25,8 @@
 #define VM_NOEXEC PTE_NX /* no-execute                          */
 
 #define VM_USER_RW (VM_USER | VM_WRITE | VM_PRESENT)
+#define VM_USER_RO (VM_USER | VM_PRESENT)
+#define VM_USER_RX (VM_USER | VM_PRESENT)
 
 #ifndef __ASSEMBLY__
 
@@ -71,7 +73,7 @@ static inline uintptr_t make_pte_table(uintptr_t pa) {
     return pa | VM_USER_RW;
 }
 
-static inline uintptr_t make_pte_page(uintptr_t pa, uint32_t perm) {
+static inline uintptr_t make_pte_page(uintptr_t pa, uintptr_t perm) {
     return pa | VM_PRESENT | perm;
 }
 
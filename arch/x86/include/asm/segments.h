@@ -23,10 +23,12 @@
 #define DPL_KERNEL 0
 #define DPL_USER   3
 
+// SYSRET loads SS from STAR[63:48] + 8 and CS from STAR[63:48] + 16, so
+// user data must sit directly below user text.
 #define SEG_KTEXT 1
 #define SEG_KDATA 2
-#define SEG_UTEXT 3
-#define SEG_UDATA 4
+#define SEG_UDATA 3
+#define SEG_UTEXT 4
 #define SEG_TSS   5
 
 #define GD_KTEXT ((SEG_KTEXT) << 3)  // kernel text
@@ -38,7 +38,11 @@ struct TrapFrame {
     void print() const;
     void print_pgfault() const;
 
+    [[nodiscard]] uint64_t ip() const { return rip; }
+    void set_ip(uint64_t addr) { rip = addr; }
+
     [[nodiscard]] uint64_t syscall_nr() const { return regs.rax; }
+    void set_syscall_nr(uint64_t nr) { regs.rax = nr; }
     [[nodiscard]] uint64_t syscall_arg(int n) const {
         switch (n) {
             case 0: return regs.rdi;
@@ -50,12 +54,25 @@ struct TrapFrame {
             default: return 0;
         }
     }
+    void set_syscall_arg(int n, uint64_t val) {
+        switch (n) {
+            case 0: regs.rdi = val; break;
+            case 1: regs.rsi = val; break;
+            case 2: regs.rdx = val; break;
+            case 3: regs.r10 = val; break;
+            case 4: regs.r8 = val; break;
+            case 5: regs.r9 = val; break;
+            default: break;
+        }
+    }
 
+    [[nodiscard]] uint64_t return_value() const { return regs.rax; }
     void set_return(uint64_t val) { regs.rax = val; }
 };
 
 // Trap handling functions
 extern "C" void trap_dispatch(TrapFrame* tf);
+extern "C" void syscall_dispatch(TrapFrame* tf);
 extern "C" void trapret(void);
 
 #endif /* !__ASSEMBLY__ */
@@ -11,9 +11,13 @@
 #include <asm/cpu.h>
 #include <base/types.h>
 
+#include "fast_syscall.h"
+#include "smap.h"
 #include "idt.h"
 #include "tss.h"
 #include "drivers/ahci.h"
+#include "drivers/nvme.h"
+#include "drivers/ide.h"
 #include "drivers/i8259.h"
 #include "drivers/i8253.h"
 
@@ -28,10 +32,14 @@ const InitStep ARCH_STEPS[] = {
     {"i8253", i8253::init, true},
     {"idt", idt::init, true},
     {"tss", tss::init, true},
+    {"syscall", fast_syscall::init, true},
+    {"smap", smap::init, true},
 };
 
 const InitStep PCI_STEPS[] = {
     {"ahci", AhciManager::init, false},
+    {"nvme", NvmeManager::init, false},
+    {"ide", IdeManager::register_pci, false},
 };
 
 }  // namespace
@@ -104,3 +112,7 @@ void arch_setup_user_tf(TrapFrame* tf, uintptr_t entry, uintptr_t usp) {
     tf->rip = entry;
     tf->rsp = usp;
 }
+
+uint64_t arch_counter_freq() {
+    return i8253::tsc_freq();
+}
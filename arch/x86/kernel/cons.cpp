@@ -21,7 +21,8 @@ constexpr size_t INPUT_BUF_SIZE = 128;
 char input_buf[INPUT_BUF_SIZE]{};
 volatile int input_read{};
 volatile int input_write{};
-WaitQueue input_waitq{};
+LockClass input_class{"cons_input"};
+WaitQueue input_waitq{input_class};
 
 }  // namespace
 
@@ -4,6 +4,7 @@
 #include "lib/stdio.h"
 #include "lib/string.h"
 #include "lib/memory.h"
+#include "lib/math.h"
 
 #include <asm/arch.h>
 #include <asm/page.h>
@@ -14,11 +15,55 @@
 #include "drivers/intr.h"
 #include "mm/vmm.h"
 #include "mm/pmm.h"
+#include "time/clocksource.h"
 
 namespace {
 
 constexpr size_t MAX_SECTORS = PG_SIZE / ahci::SECTOR_SIZE;
 
+constexpr uint64_t PORT_STOP_TIMEOUT_US = 500000;  // AHCI 1.3: CR/FR clear within 500 ms
+constexpr uint64_t FRE_SETTLE_US = 1000;
+constexpr uint64_t PORT_IDLE_TIMEOUT_US = 100000;
+constexpr uint64_t COMRESET_US = 1000;          // AHCI 1.3: hold DET=1 for at least 1 ms
+constexpr uint64_t CMD_TIMEOUT_US = 1000000;    // Polled completion, per command
+
+void complete_work(Work* work) {
+    static_cast<AhciDevice*>(work->data)->complete();
+}
+
+// Copy blocks [first, first + count) of the request chain, counted from its
+// first block, between the chain's segments and the bounce buffer `buf`.
+void copy_chunk(const blk::Request* req, uint32_t first, uint32_t count, uint8_t* buf, bool to_buf) {
+    uint32_t begin = req->block + first;
+    uint32_t end = begin + count;
+    static_cast<void>(req->for_each_segment([&](uint32_t block, uint8_t* seg, size_t blocks) {
+        uint32_t from = max(block, begin);
+        uint32_t to = min(block + static_cast<uint32_t>(blocks), end);
+        if (from < to) {
+            uint8_t* mem = seg + (from - block) * ahci::SECTOR_SIZE;
+            uint8_t* bounce = buf + (from - begin) * ahci::SECTOR_SIZE;
+            size_t bytes = (to - from) * ahci::SECTOR_SIZE;
+            if (to_buf) {
+                memcpy(bounce, mem, bytes);
+            } else {
+                memcpy(mem, bounce, bytes);
+            }
+        }
+        return Error::None;
+    }));
+}
+
+// One PRDT entry per segment of the chain; returns the entry count.
+int fill_prdt(AhciCmdTable& table, const blk::Request* req) {
+    int n = 0;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            table.prdt[n++].set_data_buffer(r->segs[i].phys(), r->segs[i].len);
+        }
+    }
+    return n;
+}
+
 const pci::DriverId AHCI_IDS[] = {
     {pci::ANY_ID, pci::ANY_ID, pci::CLASS_MASS_STORAGE, pci::SUBCLASS_SATA, pci::INTERFACE_AHCI},
 };
@@ -54,9 +99,18 @@ void FisRegH2D::set_command(uint8_t cmd, uint32_t lba, uint16_t count) {
     counth = static_cast<uint8_t>(count >> 8);
 }
 
+void FisRegH2D::set_ncq(uint8_t cmd, uint32_t lba, uint16_t count, uint8_t tag) {
+    set_command(cmd, lba, 0);
+
+    featurel = static_cast<uint8_t>(count);
+    featureh = static_cast<uint8_t>(count >> 8);
+    countl = static_cast<uint8_t>(tag << 3);
+}
+
 int AhciDevice::detect(const AhciPortConfig* cfg, uintptr_t mmio_base) {
     this->config = cfg;
     port_base_ = mmio_base + ahci::PORT_BASE_OFFSET + (cfg->port_num * ahci::PORT_REG_SIZE);
+    hba_cap_ = mmio::read32(mmio_base, ahci::AHCI_CAP);
 
     strncpy(name, cfg->name, sizeof(name));
     if (setup_memory() != 0) {
@@ -92,6 +146,9 @@ int AhciDevice::identify() {
     info.sectors = id[6];
     info.size = *reinterpret_cast<uint32_t*>(&id[60]);  // Total LBA28 sectors
     size = info.size;
+    if (id[ahci::ID_SATA_CAP] & ahci::SATA_CAP_NCQ) {
+        info.ncq_depth = (id[ahci::ID_QUEUE_DEPTH] & 0x1F) + 1;
+    }
     info.valid = 1;
 
     return 0;
@@ -100,18 +157,8 @@ int AhciDevice::identify() {
 int AhciDevice::setup_memory() {
     uintptr_t cmd_phys = virt_to_phys(cmd_list_);
     uintptr_t fis_phys = virt_to_phys(fis_base_);
-    uintptr_t table_phys = virt_to_phys(&cmd_table_);
 
-    uint32_t cmd = mmio::read32(port_base_, ahci::PORT_CMD_STAT);
-    cmd &= ~(ahci::CMD_ST | ahci::CMD_FRE);
-    mmio::write32(port_base_, ahci::PORT_CMD_STAT, cmd);
-
-    for (int i = 0; i < 500000; i++) {
-        cmd = mmio::read32(port_base_, ahci::PORT_CMD_STAT);
-        if (!(cmd & (ahci::CMD_CR | ahci::CMD_FR))) {
-            break;
-        }
-    }
+    stop_port();
 
     mmio::write32(port_base_, ahci::PORT_CLB, static_cast<uint32_t>(cmd_phys));
     mmio::write32(port_base_, ahci::PORT_CLBU, static_cast<uint32_t>(cmd_phys >> 32));
@@ -119,27 +166,50 @@ int AhciDevice::setup_memory() {
     mmio::write32(port_base_, ahci::PORT_FB, static_cast<uint32_t>(fis_phys));
     mmio::write32(port_base_, ahci::PORT_FBU, static_cast<uint32_t>(fis_phys >> 32));
 
-    cmd_list_[0].ctba = static_cast<uint32_t>(table_phys);
-    cmd_list_[0].ctbau = static_cast<uint32_t>(table_phys >> 32);
+    for (size_t i = 0; i < ahci::CMD_SLOT_COUNT; i++) {
+        uintptr_t table_phys = virt_to_phys(&cmd_tables_[i]);
+        cmd_list_[i].ctba = static_cast<uint32_t>(table_phys);
+        cmd_list_[i].ctbau = static_cast<uint32_t>(table_phys >> 32);
+    }
 
-    // Clear pending interrupts
+    // Clear pending errors and interrupts
+    mmio::write32(port_base_, ahci::PORT_SERR, 0xFFFFFFFF);
     mmio::write32(port_base_, ahci::PORT_IS, 0xFFFFFFFF);
 
-    cmd = mmio::read32(port_base_, ahci::PORT_CMD_STAT);
-    cmd |= ahci::CMD_FRE;
-    mmio::write32(port_base_, ahci::PORT_CMD_STAT, cmd);
+    start_port();
 
-    // Wait a bit
-    for (int i = 0; i < 100000; i++) {}
+    return 0;
+}
 
-    cmd |= ahci::CMD_ST;
-    mmio::write32(port_base_, ahci::PORT_CMD_STAT, cmd);
+// Slot 0 bounces through dma_buf_; with NCQ every further slot the HBA and
+// the drive both support gets a page of its own.  Without an interrupt line
+// there is no NCQ: commands are issued one at a time and polled.
+void AhciDevice::setup_queue(bool irq) {
+    irq_ = irq;
+    slots_[0].buf = dma_buf_;
+    nr_slots_ = 1;
+
+    int hba_slots = static_cast<int>((hba_cap_ >> ahci::CAP_NCS_SHIFT) & ahci::CAP_NCS_MASK) + 1;
+    if (irq && (hba_cap_ & ahci::CAP_SNCQ) && info.ncq_depth > 0) {
+        int want = min(hba_slots, static_cast<int>(info.ncq_depth));
+        while (nr_slots_ < want) {
+            auto* buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+            if (!buf) {
+                break;
+            }
+            slots_[nr_slots_++].buf = buf;
+        }
+    }
+    ncq_ = nr_slots_ > 1;
 
-    uint32_t ie = mmio::read32(port_base_, ahci::PORT_IE);
-    ie |= (ahci::IS_DHRS | ahci::IS_PSS | ahci::IS_DPS | ahci::IS_UFS);
-    mmio::write32(port_base_, ahci::PORT_IE, ie);
+    work_.fn = complete_work;
+    work_.data = this;
 
-    return 0;
+    mmio::write32(port_base_, ahci::PORT_IS, 0xFFFFFFFF);
+    mmio::write32(port_base_, ahci::PORT_IE, irq ? (ahci::IS_DHRS | ahci::IS_SDBS | ahci::IS_ERROR) : 0);
+
+    queue.set_depth(nr_slots_);
+    queue.set_limits(blk::Queue::DEFAULT_MAX_BLOCKS, static_cast<int>(ahci::PRDT_ENTRIES));
 }
 
 void AhciDevice::interrupt() {
@@ -147,30 +217,24 @@ void AhciDevice::interrupt() {
 
     mmio::write32(port_base_, ahci::PORT_IS, is);
 
-    if (is & ahci::IS_DHRS) {
-        if (request.op == AhciRequest::Op::Read) {
-            // Data is ready in buffer
-        } else if (request.op == AhciRequest::Op::Write) {
-            // Write completed
-        }
-    }
+    irq_status_ |= is;
+    static_cast<void>(workqueue::queue_work(&work_));
+}
 
-    if (is & ahci::IS_PSS) {
-        cprintf("ahci%d: [DEBUG] PSS (PIO Setup FIS) interrupt received. Implementation pending.\n", config->port_num);
-    }
+void AhciDevice::complete() {
+    uint32_t is = take_status();
 
     if (is & ahci::IS_PCS) {
         cprintf("ahci%d: port connect change detected\n", config->port_num);
+        mmio::write32(port_base_, ahci::PORT_SERR, 0xFFFFFFFF);  // PCS follows SERR.DIAG.X
     }
 
-    if (is & ahci::IS_OFS) {
-        request.err = -1;
+    if (is & ahci::IS_ERROR) {
+        recover(Error::IO);
+        return;
     }
 
-    request.done = 1;
-    if (request.waiting) {
-        request.waiting->wakeup();
-    }
+    reap();
 }
 
 int AhciManager::init() {
@@ -198,6 +262,12 @@ Error AhciManager::probe_callback(const pci::DeviceInfo* pdev, const pci::Driver
                pdev->dev, pdev->func, bar5);
 
     pci::enable_bus_master(pdev->bus, pdev->dev, pdev->func);
+
+    // Legacy INTx routing as left by the firmware; without a usable line
+    // the ports fall back to polling.
+    uint32_t line = pci::config_read32(pdev->bus, pdev->dev, pdev->func, pci::INTERRUPT) & 0xFF;
+    bool irq_ok = line > 0 && line < IRQ_COUNT && line != IRQ_SLAVE;
+
     uint32_t phys_base = bar5 & 0xFFFFFFF0;
     cprintf("ahci: Found controller at PCI %02x:%02x.%x, ABAR=0x%08x\n", pdev->bus, pdev->dev, pdev->func, phys_base);
 
@@ -240,13 +310,21 @@ Error AhciManager::probe_callback(const pci::DeviceInfo* pdev, const pci::Driver
             continue;
         }
 
-        blk::register_device(&s_devices[s_devices_count]);
+        AhciDevice& dev = s_devices[s_devices_count];
+        dev.setup_queue(irq_ok);
+        blk::register_device(&dev);
 
-        cprintf("ahci: port %d: '%s' ready (%d sectors, %d MB)\n", i, s_devices[s_devices_count].name,
-                s_devices[s_devices_count].info.size, s_devices[s_devices_count].info.size / 2048);
+        cprintf("ahci: port %d: '%s' ready (%d sectors, %d MB, %d slot(s)%s)\n", i, dev.name, dev.info.size,
+                dev.info.size / 2048, dev.nr_slots_, dev.ncq_ ? ", NCQ" : "");
         s_devices_count++;
     }
 
+    if (irq_ok && s_devices_count > 0) {
+        s_irq = static_cast<int>(line);
+        i8259::enable(line);
+        cprintf("ahci: using IRQ %d\n", s_irq);
+    }
+
     cprintf("ahci: initialization complete, %d device(s)\n", s_devices_count);
     s_ctrl_ready = true;
     return Error::None;
@@ -270,65 +348,266 @@ void AhciDevice::print_info() {
     cprintf("Device: %s (AHCI port %d)\n", name, config->port_num);
     cprintf("  Size: %d sectors (%d MB)\n", info.size, info.size / 2048);
     cprintf("  CHS: %d/%d/%d\n", info.cylinders, info.heads, info.sectors);
+    cprintf("  Queue: %d slot(s), %s, %s completion\n", nr_slots_, ncq_ ? "NCQ" : "no NCQ", irq_ ? "IRQ" : "polled");
     cprintf("\n");
 }
 
-Error AhciDevice::transfer_blocks(uint32_t block_number, size_t block_count, void* buf, bool write) {
-    const char* op_name = write ? "write" : "read";
+// One slot per request.  The request completes from complete() once the
+// HBA reports its last command done, or before queue_rq() returns when
+// polled().
+void AhciDevice::queue_rq(blk::Request* req) {
+    const char* op_name = req->op == blk::Op::Write ? "write" : "read";
+    uint32_t total = req->total_blocks();
 
     if (!present_) {
         cprintf("AhciDevice::%s: device %s not present\n", op_name, name);
-        return Error::NoDevice;
+        req->end(Error::NoDevice);
+        return;
     }
 
-    if (block_number + block_count > info.size) {
-        cprintf("AhciDevice::%s: out of range (block %d + %d > %d)\n", op_name, block_number, block_count, info.size);
-        return Error::Invalid;
+    if (req->block + total > info.size) {
+        cprintf("AhciDevice::%s: out of range (block %d + %d > %d)\n", op_name, req->block, total, info.size);
+        req->end(Error::Invalid);
+        return;
     }
 
-    uint8_t* data = static_cast<uint8_t*>(buf);
-    size_t remaining = block_count;
-    uint32_t lba = block_number;
+    int slot = alloc_slot();
+    if (slot < 0) {  // The queue depth keeps this from happening
+        req->end(Error::Busy);
+        return;
+    }
 
-    const uint8_t command = write ? ahci::ATA_CMD_WRITE_DMA_EXT : ahci::ATA_CMD_READ_DMA_EXT;
+    AhciSlot& s = slots_[slot];
+    s.req = req;
+    s.total = total;
+    s.done = 0;
+    s.bounce = !dma_reachable(req);
+    start_chunk(slot);
 
-    while (remaining > 0) {
-        size_t count = (remaining > MAX_SECTORS) ? MAX_SECTORS : remaining;
-        size_t bytes = count * ahci::SECTOR_SIZE;
+    if (polled()) {
+        poll(slot);
+    }
+}
 
+bool AhciDevice::polled() const {
+    // Early boot mounts the root filesystem before interrupts and the
+    // completion workqueue are running.
+    return !irq_ || !arch_irq_is_enabled() || !workqueue::system().worker();
+}
+
+int AhciDevice::alloc_slot() {
+    LockGuard<Spinlock> guard(lock_);
+    uint32_t mask = nr_slots_ >= 32 ? 0xFFFFFFFF : (1U << nr_slots_) - 1;
+    uint32_t free = ~busy_ & mask;
+    if (!free) {
+        return -1;
+    }
+    int slot = __builtin_ctz(free);
+    busy_ |= 1U << slot;
+    return slot;
+}
+
+// PRDT entries need word-aligned addresses, below 4 GB unless the HBA
+// does 64-bit DMA.
+bool AhciDevice::dma_reachable(const blk::Request* req) const {
+    if (req->total_segments() > static_cast<int>(ahci::PRDT_ENTRIES)) {
+        return false;
+    }
+
+    bool s64a = hba_cap_ & ahci::CAP_S64A;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            uint64_t phys = r->segs[i].phys();
+            if ((phys & 1) || (!s64a && phys + r->segs[i].len > 0x100000000ULL)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Issue the whole chain, or its next page worth of blocks when bouncing.
+void AhciDevice::start_chunk(int slot) {
+    AhciSlot& s = slots_[slot];
+    bool write = s.req->op == blk::Op::Write;
+    uint32_t lba = s.req->block + s.done;
+    AhciCmdTable& table = cmd_tables_[slot].table;
+    int prdtl = 1;
+
+    if (s.bounce) {
+        s.chunk = min(s.total - s.done, static_cast<uint32_t>(MAX_SECTORS));
         if (write) {
-            memcpy(dma_buf_, data, bytes);
+            copy_chunk(s.req, s.done, s.chunk, s.buf, true);
         }
+        table.prdt[0].set_data_buffer(virt_to_phys(s.buf), s.chunk * ahci::SECTOR_SIZE);
+    } else {
+        s.chunk = s.total;
+        prdtl = fill_prdt(table, s.req);
+    }
 
-        if (issue_cmd(command, lba, count, write) != 0) {
-            cprintf("AhciDevice::%s: failed to issue command for LBA %d\n", op_name, lba);
-            return Error::IO;
+    auto& cmd = cmd_list_[slot];
+    cmd.cfl = sizeof(FisRegH2D) / 4;
+    cmd.write = write ? 1 : 0;
+    cmd.prdtl = static_cast<uint16_t>(prdtl);
+    cmd.prdbc = 0;
+
+    memset(table.cfis, 0, sizeof(table.cfis));
+
+    auto* fis = reinterpret_cast<FisRegH2D*>(table.cfis);
+    if (ncq_) {
+        fis->set_ncq(write ? ahci::ATA_CMD_WRITE_FPDMA : ahci::ATA_CMD_READ_FPDMA, lba, s.chunk, slot);
+    } else {
+        fis->set_command(write ? ahci::ATA_CMD_WRITE_DMA_EXT : ahci::ATA_CMD_READ_DMA_EXT, lba, s.chunk);
+    }
+
+    LockGuard<Spinlock> guard(lock_);
+    uint32_t bit = 1U << slot;
+    active_ |= bit;
+    if (ncq_) {
+        mmio::write32(port_base_, ahci::PORT_SACT, bit);
+    }
+    mmio::write32(port_base_, ahci::PORT_CI, bit);
+}
+
+// The slot's command finished: copy bounced data out, then continue with
+// the next chunk or end the request and free the slot.
+void AhciDevice::chunk_done(int slot, Error err) {
+    AhciSlot& s = slots_[slot];
+
+    if (err == Error::None) {
+        if (s.bounce && s.req->op == blk::Op::Read) {
+            copy_chunk(s.req, s.done, s.chunk, s.buf, false);
+        }
+        s.done += s.chunk;
+        if (s.done < s.total) {
+            start_chunk(slot);
+            return;
         }
+    }
+
+    blk::Request* req = s.req;
+    s.req = nullptr;
+    {
+        LockGuard<Spinlock> guard(lock_);
+        busy_ &= ~(1U << slot);
+    }
+    req->end(err);
+}
+
+// A slot is done once the HBA has cleared it from PORT_CI and, for NCQ,
+// the drive has cleared it from PORT_SACT.
+void AhciDevice::reap() {
+    uint32_t done{};
+    {
+        LockGuard<Spinlock> guard(lock_);
+        uint32_t running = mmio::read32(port_base_, ahci::PORT_CI) | mmio::read32(port_base_, ahci::PORT_SACT);
+        done = active_ & ~running;
+        active_ &= ~done;
+    }
 
-        if (wait_cmd_complete(1000) != 0) {
-            cprintf("AhciDevice::%s: timeout %s LBA %d %s %s\n", op_name, write ? "writing" : "reading", lba,
-                    write ? "to" : "from", name);
-            return Error::Timeout;
+    while (done) {
+        int slot = __builtin_ctz(done);
+        done &= done - 1;
+        chunk_done(slot, Error::None);
+    }
+}
+
+// An error aborts every outstanding NCQ command, so whatever has not
+// finished by now fails: retire the finished slots, restart the port with
+// its error state cleared, and end the rest with `err`.
+void AhciDevice::recover(Error err) {
+    reap();
+
+    uint32_t failed{};
+    uint32_t tfd{};
+    uint32_t serr{};
+    {
+        LockGuard<Spinlock> guard(lock_);
+        tfd = mmio::read32(port_base_, ahci::PORT_TFD);
+        serr = mmio::read32(port_base_, ahci::PORT_SERR);
+
+        stop_port();
+        if (tfd & (ahci::TFD_STS_BSY | ahci::TFD_STS_DRQ)) {
+            // Device stuck: COMRESET
+            uint32_t sctl = mmio::read32(port_base_, ahci::PORT_SATA_CTL);
+            mmio::write32(port_base_, ahci::PORT_SATA_CTL, (sctl & ~0xFU) | 1);
+            clocksource::delay_us(COMRESET_US);
+            mmio::write32(port_base_, ahci::PORT_SATA_CTL, sctl & ~0xFU);
         }
+        mmio::write32(port_base_, ahci::PORT_SERR, 0xFFFFFFFF);
+        mmio::write32(port_base_, ahci::PORT_IS, 0xFFFFFFFF);
+        start_port();
+
+        failed = active_;
+        active_ = 0;
+    }
+
+    cprintf("ahci%d: port error (TFD 0x%02x, SERR 0x%08x), failing slots 0x%08x\n", config->port_num, tfd & 0xFF, serr,
+            failed);
+
+    while (failed) {
+        int slot = __builtin_ctz(failed);
+        failed &= failed - 1;
+        chunk_done(slot, err);
+    }
+}
+
+void AhciDevice::poll(int slot) {
+    clocksource::Deadline deadline(CMD_TIMEOUT_US);
+    uint32_t progress = slots_[slot].done;
 
-        if (!write) {
-            memcpy(data, dma_buf_, bytes);
+    while (slots_[slot].req) {
+        if (take_status() & ahci::IS_ERROR) {
+            recover(Error::IO);
+            continue;
         }
 
-        data += bytes;
-        lba += count;
-        remaining -= count;
+        reap();
+
+        if (slots_[slot].done != progress) {
+            progress = slots_[slot].done;
+            deadline = clocksource::Deadline(CMD_TIMEOUT_US);
+        } else if (deadline.expired()) {
+            cprintf("AhciDevice: timeout on %s (LBA %d)\n", name, slots_[slot].req->block + progress);
+            recover(Error::Timeout);
+            continue;
+        }
+        arch_spin_hint();
     }
+}
 
-    return Error::None;
+uint32_t AhciDevice::take_status() {
+    intr::Guard guard;
+    uint32_t is = irq_status_ | mmio::read32(port_base_, ahci::PORT_IS);
+    mmio::write32(port_base_, ahci::PORT_IS, is);
+    irq_status_ = 0;
+    return is;
 }
 
-Error AhciDevice::read(uint32_t block_number, void* buf, size_t block_count) {
-    return transfer_blocks(block_number, block_count, buf, false);
+void AhciDevice::stop_port() {
+    uint32_t cmd = mmio::read32(port_base_, ahci::PORT_CMD_STAT);
+    cmd &= ~(ahci::CMD_ST | ahci::CMD_FRE);
+    mmio::write32(port_base_, ahci::PORT_CMD_STAT, cmd);
+
+    clocksource::Deadline stop_deadline(PORT_STOP_TIMEOUT_US);
+    while (!stop_deadline.expired()) {
+        cmd = mmio::read32(port_base_, ahci::PORT_CMD_STAT);
+        if (!(cmd & (ahci::CMD_CR | ahci::CMD_FR))) {
+            break;
+        }
+        arch_spin_hint();
+    }
 }
 
-Error AhciDevice::write(uint32_t block_number, const void* buf, size_t block_count) {
-    return transfer_blocks(block_number, block_count, const_cast<void*>(buf), true);
+void AhciDevice::start_port() {
+    uint32_t cmd = mmio::read32(port_base_, ahci::PORT_CMD_STAT);
+    cmd |= ahci::CMD_FRE;
+    mmio::write32(port_base_, ahci::PORT_CMD_STAT, cmd);
+
+    clocksource::delay_us(FRE_SETTLE_US);
+
+    cmd |= ahci::CMD_ST;
+    mmio::write32(port_base_, ahci::PORT_CMD_STAT, cmd);
 }
 
 int AhciDevice::issue_cmd(uint8_t command, uint32_t lba, uint16_t count, bool write) {
@@ -336,12 +615,13 @@ int AhciDevice::issue_cmd(uint8_t command, uint32_t lba, uint16_t count, bool wr
         return -1;
     }
 
-    for (int timeout = 100000; timeout > 0; --timeout) {
+    clocksource::Deadline idle_deadline(PORT_IDLE_TIMEOUT_US);
+    while (true) {
         uint32_t tfd = mmio::read32(port_base_, ahci::PORT_TFD);
         if ((tfd & (ahci::TFD_STS_BSY | ahci::TFD_STS_DRQ)) == 0) {
             break;
         }
-        if (timeout == 1) {
+        if (idle_deadline.expired()) {
             return -1;
         }
         arch_spin_hint();
@@ -360,12 +640,13 @@ int AhciDevice::issue_cmd(uint8_t command, uint32_t lba, uint16_t count, bool wr
     cmd.prdtl = 1;
     cmd.prdbc = 0;
 
-    cmd_table_ = {};
+    AhciCmdTable& table = cmd_tables_[0].table;
+    table = {};
 
-    auto* fis = reinterpret_cast<FisRegH2D*>(cmd_table_.cfis);
+    auto* fis = reinterpret_cast<FisRegH2D*>(table.cfis);
     fis->set_command(command, lba, count);
 
-    auto& prdt = cmd_table_.prdt[0];
+    auto& prdt = table.prdt[0];
     prdt.set_data_buffer(buf_phys, data_bytes);
 
     // Clear port interrupt status
@@ -377,9 +658,9 @@ int AhciDevice::issue_cmd(uint8_t command, uint32_t lba, uint16_t count, bool wr
 }
 
 int AhciDevice::wait_cmd_complete(int timeout_ms) const {
-    int timeout = timeout_ms * 10000;
+    clocksource::Deadline deadline(static_cast<uint64_t>(timeout_ms) * 1000);
 
-    while (timeout-- > 0) {
+    while (!deadline.expired()) {
         uint32_t ci = mmio::read32(port_base_, ahci::PORT_CI);
         if ((ci & 1) == 0) {
             uint32_t is = mmio::read32(port_base_, ahci::PORT_IS);
@@ -394,22 +675,33 @@ int AhciDevice::wait_cmd_complete(int timeout_ms) const {
         if (tfd & ahci::TFD_STS_ERR) {
             return -1;
         }
+        arch_spin_hint();
     }
 
     return -1;  // Timeout
 }
 
-void AhciManager::interrupt_handler(int port) {
+int AhciManager::irq() {
+    return s_irq;
+}
+
+// One line for the whole HBA: AHCI_IS names the ports that want service.
+void AhciManager::interrupt_handler() {
+    if (!s_base) {
+        return;
+    }
+
+    uint32_t is = mmio::read32(s_base, ahci::AHCI_IS);
+    if (!is) {
+        return;
+    }
+
     for (int i = 0; i < s_devices_count; i++) {
         AhciDevice& dev = s_devices[i];
-
-        if (!dev.present_ || dev.config->port_num != port) {
-            continue;
+        if (dev.present_ && (is & (1U << dev.config->port_num))) {
+            dev.interrupt();
         }
-        if (dev.request.op == AhciRequest::Op::None) {
-            continue;
-        }
-
-        dev.interrupt();
     }
+
+    mmio::write32(s_base, ahci::AHCI_IS, is);
 }
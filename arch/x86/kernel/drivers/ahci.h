@@ -3,6 +3,7 @@
 #include <base/types.h>
 #include "block/blk.h"
 #include "lib/result.h"
+#include "sched/workqueue.h"
 #include "asm/trap_numbers.h"
 
 namespace pci {
@@ -16,6 +17,7 @@ inline constexpr size_t SECTOR_SIZE = 512;  // Bytes per sector
 inline constexpr int MAX_DEVICES = 4;       // Maximum AHCI ports/devices
 inline constexpr size_t DMA_PAGE_SIZE = 4096;
 inline constexpr size_t CMD_SLOT_COUNT = 32;
+inline constexpr size_t PRDT_ENTRIES = 64;  // Per command table; one per request segment
 
 inline constexpr uint32_t AHCI_BAR_BASE = 0xFEBF1000;  // Default MMIO base (may vary)
 inline constexpr size_t AHCI_BAR_SIZE = 0x10000;       // AHCI MMIO region size (64KB)
@@ -26,6 +28,11 @@ inline constexpr uint32_t AHCI_IS = 0x08;   // Interrupt Status
 inline constexpr uint32_t AHCI_PI = 0x0C;   // Ports Implemented
 inline constexpr uint32_t AHCI_VS = 0x10;   // Version
 
+inline constexpr uint32_t CAP_S64A = 0x80000000;  // Supports 64-bit addressing
+inline constexpr uint32_t CAP_SNCQ = 0x40000000;  // Supports native command queuing
+inline constexpr uint32_t CAP_NCS_SHIFT = 8;      // Command slots - 1, bits 12:8
+inline constexpr uint32_t CAP_NCS_MASK = 0x1F;
+
 inline constexpr uint32_t PORT_BASE_OFFSET = 0x100;  // Offset to first port's registers
 inline constexpr uint32_t PORT_REG_SIZE = 0x80;      // Size of each port's register block (128 bytes)
 
@@ -45,6 +52,8 @@ inline constexpr uint32_t PORT_CMD_STAT = 0x18;  // Command and status
 inline constexpr uint32_t PORT_SATA_CTL = 0x2C;  // SATA control
 inline constexpr uint32_t PORT_SATA_STS = 0x28;  // SATA status
 inline constexpr uint32_t PORT_TFD = 0x20;       // Task file data
+inline constexpr uint32_t PORT_SERR = 0x30;      // SATA error
+inline constexpr uint32_t PORT_SACT = 0x34;      // SATA active (NCQ tags outstanding)
 
 inline constexpr uint32_t CMD_ST = 0x0001;   // Start (command processing)
 inline constexpr uint32_t CMD_FRE = 0x0010;  // FIS receive enable
@@ -62,6 +71,11 @@ inline constexpr uint32_t IS_DMPS = 0x00000080;  // Device mechanical presence
 inline constexpr uint32_t IS_PRCS = 0x00400000;  // PhyRdy change
 inline constexpr uint32_t IS_IPMS = 0x00800000;  // Incorrect port multiplier
 inline constexpr uint32_t IS_OFS = 0x01000000;   // Overflow
+inline constexpr uint32_t IS_IFS = 0x08000000;   // Interface fatal error
+inline constexpr uint32_t IS_HBDS = 0x10000000;  // Host bus data error
+inline constexpr uint32_t IS_HBFS = 0x20000000;  // Host bus fatal error
+inline constexpr uint32_t IS_TFES = 0x40000000;  // Task file error
+inline constexpr uint32_t IS_ERROR = IS_OFS | IS_IFS | IS_HBDS | IS_HBFS | IS_TFES;
 
 inline constexpr uint32_t SATA_STS_DET_MASK = 0x0000000F;     // Device detection
 inline constexpr uint32_t SATA_STS_DET_PRESENT = 0x00000003;  // Device present
@@ -73,6 +87,12 @@ inline constexpr uint8_t ATA_CMD_READ_DMA = 0xC8;       // Read DMA (28-bit)
 inline constexpr uint8_t ATA_CMD_READ_DMA_EXT = 0x25;   // Read DMA extended (48-bit)
 inline constexpr uint8_t ATA_CMD_WRITE_DMA = 0xCA;      // Write DMA (28-bit)
 inline constexpr uint8_t ATA_CMD_WRITE_DMA_EXT = 0x35;  // Write DMA extended (48-bit)
+inline constexpr uint8_t ATA_CMD_READ_FPDMA = 0x60;     // Read FPDMA queued (NCQ)
+inline constexpr uint8_t ATA_CMD_WRITE_FPDMA = 0x61;    // Write FPDMA queued (NCQ)
+
+inline constexpr int ID_QUEUE_DEPTH = 75;         // IDENTIFY word: NCQ depth - 1, bits 4:0
+inline constexpr int ID_SATA_CAP = 76;            // IDENTIFY word: SATA capabilities
+inline constexpr uint16_t SATA_CAP_NCQ = 0x0100;  // Device supports NCQ
 
 inline constexpr uint8_t FIS_TYPE_REG_H2D = 0x27;    // Register FIS - host to device
 inline constexpr uint8_t FIS_TYPE_REG_D2H = 0x34;    // Register FIS - device to host
@@ -155,20 +175,26 @@ struct FisRegH2D {
     uint8_t rsv1[4]{};
 
     void set_command(uint8_t cmd, uint32_t lba, uint16_t count);
+    // READ/WRITE FPDMA QUEUED: the count moves to the feature field and
+    // the sector count field carries the tag.
+    void set_ncq(uint8_t cmd, uint32_t lba, uint16_t count, uint8_t tag);
 } __attribute__((packed));
 
 struct AhciCmdTable {
     uint8_t cfis[64]{};  // Command FIS
     uint8_t acmd[16]{};  // ATAPI command (if needed)
     uint8_t rsv[48]{};   // Reserved
-    AhciPrdt prdt[1]{};  // PRDT entries (variable, at least 1)
+    AhciPrdt prdt[ahci::PRDT_ENTRIES]{};  // PRDT entries, `prdtl` of them in use
 } __attribute__((packed));
 
+// One command table per slot; CTBA must be 128-byte aligned.
+struct alignas(128) AhciSlotTable {
+    AhciCmdTable table{};
+};
+
 static_assert(sizeof(AhciCmdHeader) == 32, "AhciCmdHeader must be 32 bytes");
 static_assert(sizeof(AhciCmdTable) <= ahci::DMA_PAGE_SIZE, "AhciCmdTable must fit in one DMA page");
 
-struct TaskStruct;
-
 struct AhciPortConfig {
     uint8_t port_num{};
     uint16_t irq{};
@@ -182,53 +208,71 @@ struct AhciDeviceInfo {
     uint16_t cylinders{};  // CHS: cylinders
     uint16_t heads{};      // CHS: heads
     uint16_t sectors{};    // CHS: sectors per track
+    uint16_t ncq_depth{};  // NCQ queue depth, 0 without NCQ
     int valid{};           // Device is valid
 };
 
-struct AhciRequest {
-    enum class Op : int8_t { None = 0, Read = 1, Write = 2 };
-
-    volatile int done{};    // Set to 1 by ISR when operation completes
-    volatile int err{};     // Error flag set by ISR
-    uint8_t* buffer{};      // Pointer to buffer for current transfer
-    Op op{Op::None};        // Operation type
-    TaskStruct* waiting{};  // Sleeping task waiting for completion
-
-    void reset() {
-        done = 0;
-        err = 0;
-        buffer = nullptr;
-        op = Op::None;
-        waiting = nullptr;
-    }
+// A block request owns one command slot until it completes.  Normally one
+// command moves the whole chain, its segments as PRDT entries.  A chain the
+// HBA cannot reach directly goes through the slot's bounce page instead,
+// one page-sized command after another.
+struct AhciSlot {
+    blk::Request* req{};  // Request chain, nullptr when free
+    uint32_t total{};     // Blocks in the chain
+    uint32_t done{};      // Blocks finished
+    uint32_t chunk{};     // Blocks in the command in flight
+    bool bounce{};        // Data copied through `buf`
+    uint8_t* buf{};       // DMA bounce page
 };
 
 struct AhciDevice : public BlockDevice {
     const AhciPortConfig* config{};  // Port configuration
 
     AhciDeviceInfo info{};  // Device information
-    AhciRequest request{};  // Current I/O request state
 
     int detect(const AhciPortConfig* cfg, uintptr_t mmio_base);
     int setup_memory();
     int identify();
-    void interrupt();
+    void setup_queue(bool irq);  // Slots, queue depth and completion mode
+    void interrupt();            // Hard-IRQ half: acknowledge PORT_IS and defer
+    void complete();             // Workqueue half: retire finished slots
 
-    Error read(uint32_t block_number, void* buf, size_t block_count) override;
-    Error write(uint32_t block_number, const void* buf, size_t block_count) override;
     void print_info() override;
 
 private:
+    void queue_rq(blk::Request* req) override;
     int issue_cmd(uint8_t command, uint32_t lba, uint16_t count, bool write);
     int wait_cmd_complete(int timeout_ms) const;
-    Error transfer_blocks(uint32_t block_number, size_t block_count, void* buf, bool write);
+
+    void stop_port();
+    void start_port();
+    int alloc_slot();
+    [[nodiscard]] bool dma_reachable(const blk::Request* req) const;
+    void start_chunk(int slot);
+    void chunk_done(int slot, Error err);
+    void reap();              // Retire every slot the HBA has finished
+    void recover(Error err);  // Restart the port and fail what was in flight
+    void poll(int slot);      // Spin until `slot` is free again
+    uint32_t take_status();   // PORT_IS plus what the ISR latched; acknowledges both
+    [[nodiscard]] bool polled() const;
 
     int present_{};
     uintptr_t port_base_{};
+    uint32_t hba_cap_{};
+
+    bool irq_{};             // Completion by interrupt rather than polling
+    bool ncq_{};             // READ/WRITE FPDMA QUEUED
+    int nr_slots_{1};        // Slots in use
+    uint32_t busy_{};        // Slots owned by a request
+    uint32_t active_{};      // Slots with a command issued to the HBA
+    uint32_t irq_status_{};  // PORT_IS bits latched by the ISR, not yet handled
+    Work work_{};            // Completion bottom half
+    Spinlock lock_{};        // busy_, active_ and the issue registers
+    AhciSlot slots_[ahci::CMD_SLOT_COUNT]{};
 
     alignas(1024) AhciCmdHeader cmd_list_[ahci::CMD_SLOT_COUNT]{};
     alignas(256) uint8_t fis_base_[256]{};
-    alignas(128) AhciCmdTable cmd_table_{};
+    AhciSlotTable cmd_tables_[ahci::CMD_SLOT_COUNT]{};
     alignas(ahci::DMA_PAGE_SIZE) uint8_t dma_buf_[ahci::DMA_PAGE_SIZE]{};
 
     friend class AhciManager;
@@ -242,12 +286,14 @@ public:
     static AhciDevice* get_device(int device_id);
     static int get_device_count();
 
-    static void interrupt_handler(int port);
+    static int irq();  // Legacy PIC line, -1 when completion is polled
+    static void interrupt_handler();
 
 private:
     inline static uintptr_t s_base{};  // AHCI controller MMIO virtual base
     inline static AhciDevice s_devices[ahci::MAX_DEVICES]{};
     inline static int s_devices_count{};
+    inline static int s_irq{-1};
 
     inline static bool s_ctrl_ready{};
     inline static bool s_registered{};
@@ -1,6 +1,7 @@
 #include "drivers/i8253.h"
 #include "drivers/i8259.h"
 #include "lib/stdio.h"
+#include "time/clocksource.h"
 
 #include <asm/arch.h>
 #include <asm/drivers/i8254.h>
@@ -35,6 +36,61 @@ constexpr uint8_t bcd_to_bin(uint8_t val) {
     return (val & 0xF) + (val >> 4) * 10;
 }
 
+// Seconds since 1970-01-01 for a CMOS date (two-digit year, 2000-based).
+uint64_t to_epoch(const Timer& t) {
+    int64_t year = 2000 + t.tm_year;
+    int64_t mon = t.tm_mon;
+    if (mon <= 2) {
+        year--;
+        mon += 12;
+    }
+
+    // Days from civil (proleptic Gregorian), shifted so March is month 3.
+    int64_t era = year / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (mon - 3) + 2) / 5 + t.tm_mday - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = era * 146097 + doe - 719468;
+
+    return static_cast<uint64_t>(days * 86400 + t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec);
+}
+
+// Port 0x61 gates PIT channel 2 and exposes its OUT pin, which lets us
+// time a known PIT interval with the TSC.
+constexpr uint16_t PIT_GATE_PORT = 0x61;
+constexpr uint8_t PIT_GATE_CH2 = 0x01;
+constexpr uint8_t PIT_SPEAKER = 0x02;
+constexpr uint8_t PIT_OUT_CH2 = 0x20;
+constexpr uint32_t CALIBRATE_HZ = 20;  // 50 ms window
+
+uint64_t tsc_hz = 0;
+
+uint64_t calibrate_tsc() {
+    constexpr uint32_t latch = TIMER_FREQ / CALIBRATE_HZ;
+    constexpr uint64_t MAX_POLLS = 100000000;
+
+    uint8_t gate = arch_port_inb(PIT_GATE_PORT);
+    arch_port_outb(PIT_GATE_PORT, static_cast<uint8_t>((gate & ~PIT_SPEAKER) | PIT_GATE_CH2));
+
+    // Channel 2, mode 0 (interrupt on terminal count): OUT goes high when the count expires.
+    arch_port_outb(PIT_CTRL_REG, PIT_SEL_TIMER2 | PIT_16BIT | PIT_BINARY);
+    arch_port_outb(PIT_TIMER2_REG, latch & 0xFF);
+    arch_port_outb(PIT_TIMER2_REG, latch >> 8);
+
+    uint64_t start = arch_read_counter();
+    uint64_t polls = 0;
+    while ((arch_port_inb(PIT_GATE_PORT) & PIT_OUT_CH2) == 0) {
+        if (++polls > MAX_POLLS) {
+            arch_port_outb(PIT_GATE_PORT, gate);
+            return 0;
+        }
+    }
+    uint64_t end = arch_read_counter();
+
+    arch_port_outb(PIT_GATE_PORT, gate);
+    return (end - start) * CALIBRATE_HZ;
+}
+
 }  // namespace
 
 namespace timer {
@@ -70,6 +126,13 @@ int init() {
     time.tm_mon = bcd_to_bin(static_cast<uint8_t>(time.tm_mon));
     time.tm_year = bcd_to_bin(static_cast<uint8_t>(time.tm_year));
 
+    clocksource::set_boot_time(to_epoch(time));
+
+    tsc_hz = calibrate_tsc();
+    if (tsc_hz == 0) {
+        cprintf("i8253: TSC calibration failed, falling back to tick clock\n");
+    }
+
     arch_port_outb(PIT_CTRL_REG, PIT_SEL_TIMER0 | PIT_RATE_GEN | PIT_16BIT);
 
     arch_port_outb(PIT_TIMER0_REG, timer_div(100) % 256);
@@ -80,4 +143,8 @@ int init() {
     return 0;
 }
 
+uint64_t tsc_freq() {
+    return tsc_hz;
+}
+
 }  // namespace i8253
\ No newline at end of file
@@ -5,6 +5,7 @@
 namespace i8253 {
 
 int init();
+uint64_t tsc_freq();  // Calibrated TSC frequency in Hz (0 if calibration failed)
 
 }  // namespace i8253
 
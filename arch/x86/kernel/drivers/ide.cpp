@@ -1,15 +1,21 @@
 #include "ide.h"
+#include "drivers/pci.h"
+#include "lib/math.h"
 #include "lib/result.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
 
 #include <asm/arch.h>
+#include <asm/mmu.h>
 #include <asm/drivers/i8259.h>
 #include "drivers/i8259.h"
 #include "drivers/intr.h"
+#include "sched/sched.h"
+#include "time/clocksource.h"
 
 // Global IDE devices
 IdeDevice IdeManager::s_devices[ide::MAX_DEVICES] = {};
+IdeChannel IdeManager::s_channels[ide::MAX_CHANNELS] = {};
 int IdeManager::s_devices_count = 0;
 
 IdeConfig IdeManager::s_configs[ide::MAX_DEVICES] = {
@@ -19,6 +25,33 @@ IdeConfig IdeManager::s_configs[ide::MAX_DEVICES] = {
     {1, 1, ide::IDE1_BASE, ide::IDE1_CTRL, IRQ_IDE2, "hdd"},  // Secondary Slave
 };
 
+namespace {
+
+constexpr uint64_t DMA_TIMEOUT_US = 1000000;
+
+const pci::DriverId IDE_IDS[] = {
+    {pci::ANY_ID, pci::ANY_ID, pci::CLASS_MASS_STORAGE, pci::SUBCLASS_IDE, pci::ANY_CLASS},
+};
+
+const pci::Driver IDE_DRIVER = {
+    "ide",
+    IDE_IDS,
+    static_cast<int>(array_size(IDE_IDS)),
+    IdeManager::probe_callback,
+};
+
+}  // namespace
+
+static void ide_complete_work(Work* work) {
+    static_cast<IdeChannel*>(work->data)->complete();
+}
+
+// Early boot mounts the root filesystem before interrupts and the
+// completion workqueue are running.
+static bool ide_polled() {
+    return !arch_irq_is_enabled() || !workqueue::system().worker();
+}
+
 static int hd_wait_ready_on_base(uint16_t base) {
     int timeout = 100000;
 
@@ -64,44 +97,38 @@ void IdeDevice::detect(const IdeConfig* cfg) {
     info.heads = identify_data[3];
     info.sectors = identify_data[6];
     info.size = *reinterpret_cast<uint32_t*>(&identify_data[60]);
+    info.multiple = identify_data[ide::ID_MAX_MULTIPLE] & 0xFF;
+    info.dma = (identify_data[ide::ID_CAPABILITIES] & ide::ID_CAP_DMA) ? 1 : 0;
     size = info.size;
     info.valid = 1;
 
     strncpy(name, cfg->name, sizeof(name));
-}
 
-void IdeDevice::interrupt() {
-    do {
-        uint8_t status = arch_port_inb(config->base + ide::REG_STATUS);
-        if (status & ide::STATUS_ERR) {
-            uint8_t err = arch_port_inb(config->base + ide::REG_ERROR);
-            cprintf("hd_intr: disk error on %s (status=0x%02x, error=0x%02x)\n", name, status, err);
-            request.err = -1;
-            break;
-        }
+    set_multiple();
+}
 
-        // Read operation: read data when DRQ is set
-        if (request.op == IdeRequest::Op::Read) {
-            if (!(status & ide::STATUS_DRQ)) {
-                break;
-            }
-            if (request.buffer) {
-                arch_port_insw(config->base + ide::REG_DATA, request.buffer, ide::SECTOR_SIZE / 2);
-            }
-            break;
-        }
-        if (request.op == IdeRequest::Op::Write) {
-            if (!(status & ide::STATUS_DRQ)) {
-                break;
-            }
-            if (request.buffer) {
-                arch_port_outsw(config->base + ide::REG_DATA, request.buffer, ide::SECTOR_SIZE / 2);
-            }
-        }
-    } while (false);
+// Largest DRQ block the drive offers; left at 0 (one sector per DRQ) if
+// the drive has none or refuses it.
+void IdeDevice::set_multiple() {
+    if (info.multiple == 0) {
+        return;
+    }
 
-    request.done = 1;
-    request.waitq.wakeup_one();
+    uint8_t drive_sel = config->drive ? ide::DEV_SLAVE : ide::DEV_MASTER;
+    arch_port_outb(config->base + ide::REG_DEVICE, drive_sel);
+    arch_io_wait();
+
+    arch_port_outb(config->ctrl, ide::CTRL_nIEN);
+    arch_port_outb(config->base + ide::REG_SECTOR_COUNT, static_cast<uint8_t>(info.multiple));
+    arch_port_outb(config->base + ide::REG_COMMAND, ide::CMD_SET_MULTIPLE);
+    arch_io_wait();
+
+    if (hd_wait_ready_on_base(config->base) != 0 ||
+        (arch_port_inb(config->base + ide::REG_STATUS) & ide::STATUS_ERR)) {
+        cprintf("ide: %s: SET MULTIPLE %d rejected, using single-sector PIO\n", name, info.multiple);
+        info.multiple = 0;
+    }
+    arch_port_outb(config->ctrl, 0);
 }
 
 void IdeManager::init() {
@@ -110,6 +137,13 @@ void IdeManager::init() {
 
     cprintf("ide: probing %d channels (%d possible devices)...\n", ide::MAX_DEVICES / 2, ide::MAX_DEVICES);
 
+    for (int c = 0; c < ide::MAX_CHANNELS; c++) {
+        s_channels[c].base = c == 0 ? ide::IDE0_BASE : ide::IDE1_BASE;
+        s_channels[c].ctrl = c == 0 ? ide::IDE0_CTRL : ide::IDE1_CTRL;
+        s_channels[c].work_.fn = ide_complete_work;
+        s_channels[c].work_.data = &s_channels[c];
+    }
+
     // Try to detect all 4 possible devices
     for (int i = 0; i < ide::MAX_DEVICES; i++) {
         auto& config = s_configs[i];
@@ -142,6 +176,7 @@ void IdeManager::init() {
             continue;  // Not an ATA device (could be ATAPI or absent)
         }
 
+        s_devices[s_devices_count].channel = &s_channels[config.channel];
         s_devices[s_devices_count].detect(&config);
 
         if (s_devices[s_devices_count].info.size == 0) {
@@ -159,6 +194,42 @@ void IdeManager::init() {
     cprintf("ide: found %d device(s)\n", s_devices_count);
 }
 
+int IdeManager::register_pci() {
+    if (pci::register_driver(&IDE_DRIVER) != Error::None) {
+        cprintf("ide: failed to register PCI driver\n");
+        return -1;
+    }
+    return 0;
+}
+
+// The legacy channels found by init() belong to this function; its BAR4
+// adds the bus-master registers for both.
+Error IdeManager::probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*) {
+    ENSURE(s_channels[0].bmide == 0, Error::Busy);
+    ENSURE_LOG(pdev->iface & pci::INTERFACE_IDE_BUS_MASTER, Error::NoDevice,
+               "ide: PCI %02x:%02x.%x has no bus-master DMA", pdev->bus, pdev->dev, pdev->func);
+
+    uint32_t bar4 = pci::read_bar(pdev->bus, pdev->dev, pdev->func, 4);
+    ENSURE_LOG(bar4 & 1, Error::Invalid, "ide: invalid BAR4 for PCI %02x:%02x.%x = 0x%08x", pdev->bus, pdev->dev,
+               pdev->func, bar4);
+
+    uint32_t cmd = pci::config_read32(pdev->bus, pdev->dev, pdev->func, pci::COMMAND);
+    pci::config_write32(pdev->bus, pdev->dev, pdev->func, pci::COMMAND, cmd | pci::CMD_IO_SPACE);
+    pci::enable_bus_master(pdev->bus, pdev->dev, pdev->func);
+
+    auto bmide = static_cast<uint16_t>(bar4 & 0xFFFC);
+    for (int c = 0; c < ide::MAX_CHANNELS; c++) {
+        s_channels[c].bmide = static_cast<uint16_t>(bmide + c * ide::BM_CHANNEL_STRIDE);
+    }
+    cprintf("ide: bus-master DMA at I/O 0x%x (PCI %02x:%02x.%x)\n", bmide, pdev->bus, pdev->dev, pdev->func);
+
+    for (int i = 0; i < s_devices_count; i++) {
+        IdeDevice& dev = s_devices[i];
+        cprintf("ide: %s: %s\n", dev.name, dev.uses_dma() ? "DMA" : "PIO (drive has no DMA)");
+    }
+    return Error::None;
+}
+
 IdeDevice* IdeManager::get_device(int device_id) {
     if (device_id < 0 || device_id >= s_devices_count) {
         return nullptr;
@@ -173,6 +244,25 @@ int IdeManager::get_device_count() {
     return s_devices_count;
 }
 
+void IdeDevice::queue_rq(blk::Request* req) {
+    uint32_t total = req->total_blocks();
+    const char* op_name = req->op == blk::Op::Write ? "write" : "read";
+
+    if (!present) {
+        cprintf("IdeDevice::%s: device %s not present\n", op_name, name);
+        req->end(Error::NoDevice);
+        return;
+    }
+
+    if (req->block + total > info.size) {
+        cprintf("IdeDevice::%s: out of range (block %d + %d > %d)\n", op_name, req->block, total, info.size);
+        req->end(Error::Invalid);
+        return;
+    }
+
+    channel->submit(this, req);
+}
+
 void IdeDevice::print_info() {
     cprintf("Device: %s (IDE)\n", name);
     cprintf("  Channel: %s, Drive: %s\n", config->channel == 0 ? "Primary" : "Secondary",
@@ -180,111 +270,275 @@ void IdeDevice::print_info() {
     cprintf("  Base I/O: 0x%x, IRQ: %d\n", config->base, config->irq);
     cprintf("  Size: %d sectors (%d MB)\n", info.size, info.size / 2048);
     cprintf("  CHS: %d/%d/%d\n", info.cylinders, info.heads, info.sectors);
+    if (uses_dma()) {
+        cprintf("  Transfer: bus-master DMA (BMIDE 0x%x)\n", channel->bmide);
+    } else {
+        cprintf("  Transfer: PIO, %d sector(s) per DRQ\n", info.multiple ? info.multiple : 1);
+    }
     cprintf("\n");
 }
 
-Error IdeDevice::read(uint32_t block_number, void* buf, size_t block_count) {
-    ENSURE_LOG(present, Error::NoDevice, "IdeDevice::read: device %s not present", name);
-    ENSURE_LOG(block_number + block_count <= info.size, Error::Invalid,
-               "IdeDevice::read: out of range (block %d + %d > %d)", block_number, block_count, info.size);
+void IdeDevice::issue_cmd(uint8_t command, uint32_t lba, size_t count) {
+    uint8_t drive_sel = config->drive ? ide::DEV_SLAVE : ide::DEV_MASTER;
+
+    arch_port_outb(config->base + ide::REG_SECTOR_COUNT, static_cast<uint8_t>(count));  // 256 -> 0
+    arch_port_outb(config->base + ide::REG_LBA_LOW, lba & 0xFF);
+    arch_port_outb(config->base + ide::REG_LBA_MID, (lba >> 8) & 0xFF);
+    arch_port_outb(config->base + ide::REG_LBA_HIGH, (lba >> 16) & 0xFF);
+    arch_port_outb(config->base + ide::REG_DEVICE, drive_sel | ((lba >> 24) & 0x0F));
+    arch_port_outb(config->base + ide::REG_COMMAND, command);
+}
+
+Error IdeDevice::pio(const blk::Request* req) {
+    bool write = req->op == blk::Op::Write;
+    return req->for_each_segment([&](uint32_t block, uint8_t* buf, size_t count) {
+        return pio_blocks(block, buf, count, write);
+    });
+}
 
+// PIO with the drive's interrupt masked (no scheduler dependency): up to 256
+// sectors per command, moved one DRQ block of `info.multiple` sectors (or
+// one sector without MULTIPLE) at a time.
+Error IdeDevice::pio_blocks(uint32_t block_number, uint8_t* buf, size_t block_count, bool write) {
+    const char* op_name = write ? "write" : "read";
     uint8_t drive_sel = config->drive ? ide::DEV_SLAVE : ide::DEV_MASTER;
+    size_t per_drq = info.multiple ? info.multiple : 1;
+    uint8_t command = info.multiple ? (write ? ide::CMD_WRITE_MULTIPLE : ide::CMD_READ_MULTIPLE)
+                                    : (write ? ide::CMD_WRITE : ide::CMD_READ);
 
-    // Read blocks one by one using PIO polling (no scheduler dependency)
-    for (size_t i = 0; i < block_count; i++) {
-        uint32_t lba = block_number + i;
+    while (block_count > 0) {
+        uint32_t lba = block_number;
+        size_t count = min(block_count, ide::MAX_SECTORS);
 
         // Select drive first, then wait for it to become ready
         arch_port_outb(config->base + ide::REG_DEVICE, drive_sel);
         arch_io_wait();
-        ENSURE_LOG(hd_wait_ready_on_base(config->base) == 0, Error::IO, "IdeDevice::read: device %s not ready", name);
+        ENSURE_LOG(hd_wait_ready_on_base(config->base) == 0, Error::IO, "IdeDevice::%s: device %s not ready", op_name,
+                   name);
 
         // Disable IDE interrupt for this PIO transfer (nIEN bit)
         arch_port_outb(config->ctrl, ide::CTRL_nIEN);
+        issue_cmd(command, lba, count);
 
-        arch_port_outb(config->base + ide::REG_SECTOR_COUNT, 1);
-        arch_port_outb(config->base + ide::REG_LBA_LOW, lba & 0xFF);
-        arch_port_outb(config->base + ide::REG_LBA_MID, (lba >> 8) & 0xFF);
-        arch_port_outb(config->base + ide::REG_LBA_HIGH, (lba >> 16) & 0xFF);
-        arch_port_outb(config->base + ide::REG_DEVICE, drive_sel | ((lba >> 24) & 0x0F));
-        arch_port_outb(config->base + ide::REG_COMMAND, ide::CMD_READ);
+        for (size_t done = 0; done < count;) {
+            size_t n = min(per_drq, count - done);
+
+            if (hd_wait_drq(config->base) != 0) {
+                arch_port_outb(config->ctrl, 0);
+                cprintf("IdeDevice::%s: DRQ timeout on %s (LBA %d)\n", op_name, name, lba + done);
+                return Error::Timeout;
+            }
+
+            if (write) {
+                arch_port_outsw(config->base + ide::REG_DATA, buf, n * ide::SECTOR_SIZE / 2);
+            } else {
+                arch_port_insw(config->base + ide::REG_DATA, buf, n * ide::SECTOR_SIZE / 2);
+            }
+            buf += n * ide::SECTOR_SIZE;
+            done += n;
+        }
 
-        if (hd_wait_drq(config->base) != 0) {
+        // Wait for write to complete
+        if (write && hd_wait_ready_on_base(config->base) != 0) {
             arch_port_outb(config->ctrl, 0);
-            cprintf("IdeDevice::read: DRQ timeout on %s (LBA %d)\n", name, lba);
+            cprintf("IdeDevice::write: completion timeout on %s (LBA %d)\n", name, lba);
             return Error::Timeout;
         }
 
-        arch_port_insw(config->base + ide::REG_DATA, reinterpret_cast<uint8_t*>(buf) + i * ide::SECTOR_SIZE,
-                       ide::SECTOR_SIZE / 2);
-
         arch_port_outb(config->ctrl, 0);  // Re-enable IDE interrupt
+        block_number += count;
+        block_count -= count;
+        sched::cond_resched();
     }
 
     return Error::None;
 }
 
-Error IdeDevice::write(uint32_t block_number, const void* buf, size_t block_count) {
-    ENSURE_LOG(present, Error::NoDevice, "IdeDevice::write: device %s not present", name);
-    ENSURE_LOG(block_number + block_count <= info.size, Error::Invalid,
-               "IdeDevice::write: out of range (block %d + %d > %d)", block_number, block_count, info.size);
-
-    uint8_t drive_sel = config->drive ? ide::DEV_SLAVE : ide::DEV_MASTER;
+// ============================================================================
+// IdeChannel
+// ============================================================================
+
+void IdeChannel::submit(IdeDevice* dev, blk::Request* req) {
+    {
+        LockGuard<Spinlock> guard(lock_);
+        if (owner_) {
+            int drive = dev->config->drive;
+            parked_dev_[drive] = dev;
+            parked_[drive] = req;
+            return;
+        }
+        owner_ = dev;
+        current_ = req;
+    }
+    run(dev, req);
+}
 
-    // Write blocks one by one using PIO polling (no scheduler dependency)
-    for (size_t i = 0; i < block_count; i++) {
-        uint32_t lba = block_number + i;
+// Run `req`, then whatever was parked behind it, for as long as requests
+// finish here; a DMA transfer completing by interrupt continues from
+// complete() instead.
+void IdeChannel::run(IdeDevice* dev, blk::Request* req) {
+    while (req) {
+        Error err{};
+        if (start_dma(dev, req)) {
+            if (!ide_polled()) {
+                return;
+            }
+            err = poll_dma();
+        } else {
+            err = dev->pio(req);
+        }
+        req = finish(err, dev);
+    }
+}
 
-        // Select drive first, then wait for it to become ready
-        arch_port_outb(config->base + ide::REG_DEVICE, drive_sel);
-        arch_io_wait();
-        ENSURE_LOG(hd_wait_ready_on_base(config->base) == 0, Error::IO, "IdeDevice::write: device %s not ready", name);
+// End the owner's request and hand the channel on, preferring the other
+// drive; returns the new owner's request, if any, to start.
+blk::Request* IdeChannel::finish(Error err, IdeDevice*& dev) {
+    blk::Request* done{};
+    blk::Request* next_req{};
+    {
+        LockGuard<Spinlock> guard(lock_);
+        done = current_;
+        int other = owner_->config->drive ^ 1;
+        int next = parked_[other] ? other : owner_->config->drive;
+
+        dev = parked_dev_[next];
+        next_req = parked_[next];
+        owner_ = dev;
+        current_ = next_req;
+        parked_dev_[next] = nullptr;
+        parked_[next] = nullptr;
+    }
 
-        // Disable IDE interrupt for this PIO transfer (nIEN bit)
-        arch_port_outb(config->ctrl, ide::CTRL_nIEN);
+    // With the channel idle, end_io may submit and run the next request
+    // from in here.
+    done->end(err);
+    return next_req;
+}
 
-        arch_port_outb(config->base + ide::REG_SECTOR_COUNT, 1);
-        arch_port_outb(config->base + ide::REG_LBA_LOW, lba & 0xFF);
-        arch_port_outb(config->base + ide::REG_LBA_MID, (lba >> 8) & 0xFF);
-        arch_port_outb(config->base + ide::REG_LBA_HIGH, (lba >> 16) & 0xFF);
-        arch_port_outb(config->base + ide::REG_DEVICE, drive_sel | ((lba >> 24) & 0x0F));
-        arch_port_outb(config->base + ide::REG_COMMAND, ide::CMD_WRITE);
+// One PRD per physically contiguous run, split at 64 KB boundaries; -1 if
+// the chain is out of the engine's reach.
+int IdeChannel::build_prdt(const blk::Request* req) {
+    int n = 0;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            uint64_t phys = r->segs[i].phys();
+            uint64_t len = r->segs[i].len;
+            if ((phys & 1) || phys + len > ide::PRD_ADDR_LIMIT) {
+                return -1;
+            }
 
-        // Wait for drive to signal it is ready to accept data
-        if (hd_wait_drq(config->base) != 0) {
-            arch_port_outb(config->ctrl, 0);
-            cprintf("IdeDevice::write: DRQ timeout on %s (LBA %d)\n", name, lba);
-            return Error::Timeout;
+            while (len > 0) {
+                if (n == static_cast<int>(ide::PRD_ENTRIES)) {
+                    return -1;
+                }
+                uint64_t part = min(len, ide::PRD_BOUNDARY - (phys & (ide::PRD_BOUNDARY - 1)));
+                prdt_[n].addr = static_cast<uint32_t>(phys);
+                prdt_[n].bytes = static_cast<uint16_t>(part);  // 64 KB -> 0
+                prdt_[n].flags = 0;
+                n++;
+                phys += part;
+                len -= part;
+            }
         }
+    }
+    if (n > 0) {
+        prdt_[n - 1].flags = ide::PRD_EOT;
+    }
+    return n;
+}
 
-        arch_port_outsw(config->base + ide::REG_DATA,
-                        const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(buf)) + i * ide::SECTOR_SIZE,
-                        ide::SECTOR_SIZE / 2);
+// Program the engine and the drive for the whole chain.  False, with
+// nothing started, when the request has to go by PIO.
+bool IdeChannel::start_dma(IdeDevice* dev, blk::Request* req) {
+    if (!dev->uses_dma() || req->total_blocks() > ide::MAX_SECTORS || build_prdt(req) <= 0) {
+        return false;
+    }
 
-        // Wait for write to complete
-        if (hd_wait_ready_on_base(config->base) != 0) {
-            arch_port_outb(config->ctrl, 0);
-            cprintf("IdeDevice::write: completion timeout on %s (LBA %d)\n", name, lba);
-            return Error::Timeout;
-        }
+    bool write = req->op == blk::Op::Write;
+    uint8_t drive_sel = dev->config->drive ? ide::DEV_SLAVE : ide::DEV_MASTER;
 
-        arch_port_outb(config->ctrl, 0);  // Re-enable IDE interrupt
+    arch_port_outb(base + ide::REG_DEVICE, drive_sel);
+    arch_io_wait();
+    if (hd_wait_ready_on_base(base) != 0) {
+        return false;  // PIO reports the error
     }
 
-    return Error::None;
+    arch_port_outl(bmide + ide::BM_PRDT, static_cast<uint32_t>(virt_to_phys(prdt_)));
+    arch_port_outb(bmide + ide::BM_CMD, write ? 0 : ide::BM_CMD_READ);
+    uint8_t bm = arch_port_inb(bmide + ide::BM_STATUS);
+    arch_port_outb(bmide + ide::BM_STATUS, bm | ide::BM_STATUS_IRQ | ide::BM_STATUS_ERR);
+
+    dma_active_ = true;
+    arch_port_outb(ctrl, 0);  // Completion by interrupt
+    dev->issue_cmd(write ? ide::CMD_WRITE_DMA : ide::CMD_READ_DMA, req->block, req->total_blocks());
+    arch_port_outb(bmide + ide::BM_CMD, (write ? 0 : ide::BM_CMD_READ) | ide::BM_CMD_START);
+    return true;
 }
 
-void IdeManager::interrupt_handler(int channel) {
-    for (int i = 0; i < s_devices_count; i++) {
-        IdeDevice& dev = s_devices[i];
+bool IdeChannel::dma_stop(Error& err) {
+    if (!dma_active_) {
+        return false;
+    }
 
-        if (!dev.present || dev.config->channel != channel) {
-            continue;
+    uint8_t bm = arch_port_inb(bmide + ide::BM_STATUS);
+    if (!(bm & ide::BM_STATUS_IRQ)) {
+        return false;
+    }
+
+    arch_port_outb(bmide + ide::BM_CMD, 0);
+    uint8_t status = arch_port_inb(base + ide::REG_STATUS);  // Acknowledges the drive
+    arch_port_outb(bmide + ide::BM_STATUS, bm | ide::BM_STATUS_IRQ | ide::BM_STATUS_ERR);
+    dma_active_ = false;
+
+    err = Error::None;
+    if ((bm & ide::BM_STATUS_ERR) || (status & (ide::STATUS_ERR | ide::STATUS_DF))) {
+        uint8_t error = arch_port_inb(base + ide::REG_ERROR);
+        cprintf("ide: DMA error (status=0x%02x, error=0x%02x, bm=0x%02x)\n", status, error, bm);
+        err = Error::IO;
+    }
+    return true;
+}
+
+Error IdeChannel::poll_dma() {
+    clocksource::Deadline deadline(DMA_TIMEOUT_US);
+
+    while (true) {
+        {
+            intr::Guard guard;
+            Error err{};
+            if (dma_stop(err)) {
+                return err;
+            }
         }
-        if (dev.request.op == IdeRequest::Op::None) {
-            continue;
+        if (deadline.expired()) {
+            arch_port_outb(bmide + ide::BM_CMD, 0);
+            dma_active_ = false;
+            cprintf("ide: DMA timeout on %s (LBA %d)\n", owner_->name, current_->block);
+            return Error::Timeout;
         }
+        arch_spin_hint();
+    }
+}
+
+// The drive interrupted with the engine running: stop it here, finish in
+// complete().  Anything else only needs STATUS read to acknowledge it.
+void IdeChannel::interrupt() {
+    if (dma_stop(dma_err_)) {
+        static_cast<void>(workqueue::queue_work(&work_));
+    } else if (!dma_active_) {
+        static_cast<void>(arch_port_inb(base + ide::REG_STATUS));
+    }
+}
 
-        dev.interrupt();
+void IdeChannel::complete() {
+    IdeDevice* dev{};
+    blk::Request* next = finish(dma_err_, dev);
+    run(dev, next);
+}
+
+void IdeManager::interrupt_handler(int channel) {
+    if (channel >= 0 && channel < ide::MAX_CHANNELS) {
+        s_channels[channel].interrupt();
     }
 }
@@ -4,7 +4,13 @@
 
 #include "block/blk.h"
 #include "lib/result.h"
-#include "lib/waitqueue.h"
+#include "lib/spinlock.h"
+#include "sched/workqueue.h"
+
+namespace pci {
+struct DeviceInfo;
+struct DriverId;
+}  // namespace pci
 
 // IDE/ATA disk constants
 namespace ide {
@@ -15,6 +21,8 @@ inline constexpr uint16_t IDE1_BASE = 0x170;  // Secondary IDE controller base
 inline constexpr uint16_t IDE0_CTRL = 0x3F6;  // Primary IDE control register
 inline constexpr uint16_t IDE1_CTRL = 0x376;  // Secondary IDE control register
 inline constexpr int MAX_DEVICES = 4;         // Maximum IDE devices (2 channels × 2 drives)
+inline constexpr int MAX_CHANNELS = 2;
+inline constexpr size_t MAX_SECTORS = 256;    // Per LBA28 command (count 0)
 
 // IDE registers (relative to base)
 inline constexpr int REG_DATA = 0x0;          // Data register
@@ -42,9 +50,37 @@ inline constexpr uint8_t STATUS_DRQ = 0x08;   // Data request
 inline constexpr uint8_t STATUS_ERR = 0x01;   // Error
 
 // IDE commands
-inline constexpr uint8_t CMD_READ = 0x20;      // Read sectors
-inline constexpr uint8_t CMD_WRITE = 0x30;     // Write sectors
-inline constexpr uint8_t CMD_IDENTIFY = 0xEC;  // Identify device
+inline constexpr uint8_t CMD_READ = 0x20;            // Read sectors
+inline constexpr uint8_t CMD_WRITE = 0x30;           // Write sectors
+inline constexpr uint8_t CMD_READ_MULTIPLE = 0xC4;   // Read, one DRQ per block of sectors
+inline constexpr uint8_t CMD_WRITE_MULTIPLE = 0xC5;  // Write, one DRQ per block of sectors
+inline constexpr uint8_t CMD_SET_MULTIPLE = 0xC6;    // Set sectors per DRQ block
+inline constexpr uint8_t CMD_READ_DMA = 0xC8;        // Read DMA (28-bit)
+inline constexpr uint8_t CMD_WRITE_DMA = 0xCA;       // Write DMA (28-bit)
+inline constexpr uint8_t CMD_IDENTIFY = 0xEC;        // Identify device
+
+// IDENTIFY words
+inline constexpr int ID_MAX_MULTIPLE = 47;      // Bits 7:0: largest DRQ block
+inline constexpr int ID_CAPABILITIES = 49;      // Capabilities
+inline constexpr uint16_t ID_CAP_DMA = 0x0100;  // DMA supported
+
+// Bus-master IDE registers (PCI BAR4, relative to the channel's block)
+inline constexpr int BM_CHANNEL_STRIDE = 8;  // Secondary channel offset
+inline constexpr int BM_CMD = 0x0;           // Command
+inline constexpr int BM_STATUS = 0x2;        // Status
+inline constexpr int BM_PRDT = 0x4;          // PRD table physical address
+
+inline constexpr uint8_t BM_CMD_START = 0x01;  // Start/stop bus master
+inline constexpr uint8_t BM_CMD_READ = 0x08;   // Transfer to memory (device read)
+
+inline constexpr uint8_t BM_STATUS_ACTIVE = 0x01;  // Engine running
+inline constexpr uint8_t BM_STATUS_ERR = 0x02;     // DMA error (write 1 to clear)
+inline constexpr uint8_t BM_STATUS_IRQ = 0x04;     // Drive interrupt (write 1 to clear)
+
+inline constexpr size_t PRD_ENTRIES = 512;               // One 4 KB table per channel
+inline constexpr uint16_t PRD_EOT = 0x8000;              // Last entry
+inline constexpr uint64_t PRD_BOUNDARY = 0x10000;        // Regions may not cross 64 KB
+inline constexpr uint64_t PRD_ADDR_LIMIT = 0x100000000;  // 32-bit addresses only
 
 // Device selection
 inline constexpr uint8_t DEV_MASTER = 0xE0;  // Master device (LBA mode)
@@ -68,45 +104,86 @@ struct DiskInfo {
     uint16_t cylinders{};  // Number of cylinders
     uint16_t heads{};      // Number of heads
     uint16_t sectors{};    // Sectors per track
+    uint16_t multiple{};   // Sectors per READ/WRITE MULTIPLE block, 0 if unsupported
+    int dma{};             // Drive supports DMA
     int valid{};           // Device is valid
 };
 
-struct IdeRequest {
-    enum class Op : uint8_t { None = 0, Read = 1, Write = 2 };
-
-    volatile int done{};  // Set to 1 by ISR when operation completes
-    volatile int err{};   // Error flag set by ISR
-    uint8_t* buffer{};    // Pointer to buffer for current transfer
-    Op op{Op::None};      // Operation type
-    WaitQueue waitq{};    // Wait queue for I/O completion
-
-    void reset() {
-        done = 0;
-        err = 0;
-        buffer = nullptr;
-        op = Op::None;
-    }
+// Physical Region Descriptor: one run of memory for the bus-master engine,
+// below 4 GB and not crossing a 64 KB boundary.
+struct IdePrd {
+    uint32_t addr{};   // Physical address
+    uint16_t bytes{};  // Byte count, 0 = 64 KB
+    uint16_t flags{};  // PRD_EOT on the last entry
+} __attribute__((packed));
+
+static_assert(sizeof(IdePrd) == 8, "IdePrd must be 8 bytes");
+
+struct IdeDevice;
+
+// Master and slave share a channel's task file and DMA engine, so a
+// channel runs one command at a time; a request for the other drive waits
+// on the channel until the current one finishes.
+struct IdeChannel {
+    uint16_t base{};   // Task file
+    uint16_t ctrl{};   // Device control
+    uint16_t bmide{};  // Bus-master registers, 0 without PCI DMA
+
+    void submit(IdeDevice* dev, blk::Request* req);
+    void interrupt();  // Hard-IRQ half: stop the engine and defer
+    void complete();   // Workqueue half: end the request, start the next
+
+private:
+    void run(IdeDevice* dev, blk::Request* req);
+    blk::Request* finish(Error err, IdeDevice*& dev);
+    bool start_dma(IdeDevice* dev, blk::Request* req);
+    int build_prdt(const blk::Request* req);
+    bool dma_stop(Error& err);  // Interrupts off; false while still running
+    Error poll_dma();
+
+    Spinlock lock_{};
+    IdeDevice* owner_{};          // Drive whose command is running
+    blk::Request* current_{};     // Its request
+    IdeDevice* parked_dev_[2]{};  // Per drive: waiting for the channel
+    blk::Request* parked_[2]{};   // Their requests
+    volatile bool dma_active_{};  // Engine started, completion not yet seen
+    Error dma_err_{};             // Outcome latched by the ISR
+    Work work_{};                 // Completion bottom half
+
+    alignas(4096) IdePrd prdt_[ide::PRD_ENTRIES]{};
+
+    friend class IdeManager;
 };
 
 // IDE device structure
 struct IdeDevice : public BlockDevice {
     int present{};              // Device is present
     const IdeConfig* config{};  // Pointer to device configuration
+    IdeChannel* channel{};      // Shared with the other drive
     DiskInfo info{};            // Disk information
-    IdeRequest request{};       // Current I/O request state
 
     void detect(const IdeConfig* cfg);
-    void interrupt();
 
-    Error read(uint32_t block_number, void* buf, size_t block_count) override;
-    Error write(uint32_t block_number, const void* buf, size_t block_count) override;
+    [[nodiscard]] bool uses_dma() const { return channel->bmide && info.dma; }
+
     void print_info() override;
+
+private:
+    friend struct IdeChannel;
+
+    void queue_rq(blk::Request* req) override;
+    void set_multiple();
+    void issue_cmd(uint8_t command, uint32_t lba, size_t count);
+    Error pio(const blk::Request* req);
+    Error pio_blocks(uint32_t block_number, uint8_t* buf, size_t block_count, bool write);
 };
 
 // IDE device manager class
 class IdeManager {
 public:
     static void init();
+    static int register_pci();  // Bus-master DMA from the PCI IDE function
+    static Error probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*);
 
     static IdeDevice* get_device(int device_id);
     static int get_device_count();
@@ -116,5 +193,6 @@ public:
 private:
     static IdeConfig s_configs[ide::MAX_DEVICES];
     static IdeDevice s_devices[ide::MAX_DEVICES];
+    static IdeChannel s_channels[ide::MAX_CHANNELS];
     static int s_devices_count;
 };
@@ -0,0 +1,656 @@
+/**
+ * @file nvme.cpp
+ * @brief NVMe PCI driver.
+ *
+ * Bring-up follows NVMe 1.4 §7.6.1: disable the controller, hand it the
+ * admin queue, enable it, then identify the controller and its first
+ * active namespace and create one I/O submission/completion queue pair per
+ * CPU.  Admin commands are polled; I/O commands carry the request chain's
+ * pages in PRP entries and complete from the system workqueue after the
+ * interrupt, or by polling the completion queue while polled().
+ */
+
+#include "nvme.h"
+#include "drivers/pci.h"
+#include "drivers/mmio.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "lib/memory.h"
+#include "lib/math.h"
+
+#include <asm/arch.h>
+#include <asm/page.h>
+#include <asm/mmu.h>
+#include <asm/drivers/i8259.h>
+#include "drivers/i8259.h"
+#include "mm/vmm.h"
+#include "mm/pmm.h"
+#include "time/clocksource.h"
+
+namespace {
+
+constexpr int NR_CPUS = 1;  // The kernel runs on the boot CPU only
+constexpr uint32_t BOUNCE_BLOCKS = PG_SIZE / blk::BLOCK_SIZE;
+constexpr int PRP_LIST_ENTRIES = static_cast<int>(nvme::PRP_LIST_SIZE / sizeof(uint64_t));
+
+constexpr uint64_t ADMIN_TIMEOUT_US = 1000000;
+constexpr uint64_t REQUEST_TIMEOUT_US = 1000000;  // Polled completion, per command
+constexpr uint64_t READY_UNIT_US = 500000;        // CAP.TO granularity
+
+// Identify data offsets (NVMe 1.4 Figures 247 and 249)
+constexpr size_t ID_CTRL_MODEL = 24;
+constexpr size_t ID_CTRL_MODEL_LEN = 40;
+constexpr size_t ID_CTRL_MDTS = 77;
+constexpr size_t ID_NS_NSZE = 0;
+constexpr size_t ID_NS_FLBAS = 26;
+constexpr size_t ID_NS_LBAF = 128;
+constexpr int LBAF_LBADS_SHIFT = 16;
+
+int this_cpu() {
+    return 0;
+}
+
+void complete_work(Work* work) {
+    static_cast<NvmeDevice*>(work->data)->complete();
+}
+
+uint32_t doorbell_stride(uint64_t cap) {
+    return 4U << ((cap >> nvme::CAP_DSTRD_SHIFT) & 0xF);
+}
+
+// Copy blocks [first, first + count) of the request chain, counted from its
+// first block, between the chain's segments and the bounce page `buf`.
+void copy_chunk(const blk::Request* req, uint32_t first, uint32_t count, uint8_t* buf, bool to_buf) {
+    uint32_t begin = req->block + first;
+    uint32_t end = begin + count;
+    static_cast<void>(req->for_each_segment([&](uint32_t block, uint8_t* seg, size_t blocks) {
+        uint32_t from = max(block, begin);
+        uint32_t to = min(block + static_cast<uint32_t>(blocks), end);
+        if (from < to) {
+            uint8_t* mem = seg + (from - block) * blk::BLOCK_SIZE;
+            uint8_t* bounce = buf + (from - begin) * blk::BLOCK_SIZE;
+            size_t bytes = (to - from) * blk::BLOCK_SIZE;
+            if (to_buf) {
+                memcpy(bounce, mem, bytes);
+            } else {
+                memcpy(mem, bounce, bytes);
+            }
+        }
+        return Error::None;
+    }));
+}
+
+// PRPs describe one run of whole pages: only the first segment may start
+// inside a page and only the last may end inside one.  The addresses must
+// be dword aligned, and the pages must fit the slot's PRP list.
+bool prp_compatible(const blk::Request* req) {
+    bool first = true;
+    bool prev_ends_page = true;
+    int pages = 0;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            uint64_t phys = r->segs[i].phys();
+            uint64_t end = phys + r->segs[i].len;
+            if ((phys & 3) || !prev_ends_page || (!first && (phys & PG_MASK))) {
+                return false;
+            }
+            pages += static_cast<int>((round_up(end, PG_SIZE) - round_down(phys, PG_SIZE)) >> PG_SHIFT);
+            prev_ends_page = (end & PG_MASK) == 0;
+            first = false;
+        }
+    }
+    return pages <= 1 + PRP_LIST_ENTRIES;
+}
+
+// PRP1 takes the first (possibly offset) address; PRP2 the second page, or
+// the PRP list holding every page after the first.
+void fill_prps(NvmeCommand& cmd, const blk::Request* req, uint64_t* list) {
+    bool first = true;
+    int n = 0;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            uint64_t addr = r->segs[i].phys();
+            uint64_t end = addr + r->segs[i].len;
+            while (addr < end) {
+                if (first) {
+                    cmd.prp1 = addr;
+                    first = false;
+                } else {
+                    list[n++] = addr;
+                }
+                addr = round_down(addr, PG_SIZE) + PG_SIZE;
+            }
+        }
+    }
+
+    if (n == 0) {
+        cmd.prp2 = 0;
+    } else if (n == 1) {
+        cmd.prp2 = list[0];
+    } else {
+        cmd.prp2 = virt_to_phys(list);
+    }
+}
+
+const pci::DriverId NVME_IDS[] = {
+    {pci::ANY_ID, pci::ANY_ID, pci::CLASS_MASS_STORAGE, pci::SUBCLASS_NVM, pci::INTERFACE_NVME},
+};
+
+const pci::Driver NVME_DRIVER = {
+    "nvme",
+    NVME_IDS,
+    static_cast<int>(array_size(NVME_IDS)),
+    NvmeManager::probe_callback,
+};
+
+}  // namespace
+
+// ============================================================================
+// Bring-up
+// ============================================================================
+
+Error NvmeDevice::init(const pci::DeviceInfo* pdev, int index) {
+    uint32_t bar0 = pci::read_bar(pdev->bus, pdev->dev, pdev->func, 0);
+    ENSURE_LOG(bar0 != 0 && !(bar0 & 1), Error::Invalid, "nvme: invalid BAR0 for PCI %02x:%02x.%x = 0x%08x",
+               pdev->bus, pdev->dev, pdev->func, bar0);
+
+    uint64_t phys = bar0 & 0xFFFFFFF0;
+    if (((bar0 >> 1) & 3) == 2) {  // 64-bit BAR
+        phys |= static_cast<uint64_t>(pci::read_bar(pdev->bus, pdev->dev, pdev->func, 1)) << 32;
+    }
+
+    pci::enable_bus_master(pdev->bus, pdev->dev, pdev->func);
+
+    base_ = vmm::mmio_map(phys, nvme::BAR_SIZE, VM_WRITE | VM_NOCACHE);
+    ENSURE_LOG(base_ != 0, Error::NoMem, "nvme: failed to map MMIO region at phys=0x%lx",
+               static_cast<unsigned long>(phys));
+
+    version_ = mmio::read32(base_, nvme::REG_VS);
+    ENSURE_LOG(version_ != 0 && version_ != 0xFFFFFFFF, Error::NoDevice,
+               "nvme: controller not responding (version: 0x%08x)", version_);
+
+    cap_ = mmio::read64(base_, nvme::REG_CAP);
+    stride_ = doorbell_stride(cap_);
+    uint64_t to = (cap_ >> nvme::CAP_TO_SHIFT) & 0xFF;
+    ready_timeout_us_ = max(to, static_cast<uint64_t>(1)) * READY_UNIT_US;
+
+    // Legacy INTx routing as left by the firmware; without a usable line
+    // completion is polled.
+    uint32_t line = pci::config_read32(pdev->bus, pdev->dev, pdev->func, pci::INTERRUPT) & 0xFF;
+    irq_ = line > 0 && line < IRQ_COUNT && line != IRQ_SLAVE ? static_cast<int>(line) : -1;
+
+    TRY(enable(false));
+    TRY(alloc_queue(admin_, 0, nvme::ADMIN_QUEUE_SIZE, false));
+
+    mmio::write32(base_, nvme::REG_AQA, (nvme::ADMIN_QUEUE_SIZE - 1U) << 16 | (nvme::ADMIN_QUEUE_SIZE - 1U));
+    mmio::write64(base_, nvme::REG_ASQ, virt_to_phys(admin_.sq));
+    mmio::write64(base_, nvme::REG_ACQ, virt_to_phys(const_cast<NvmeCompletion*>(admin_.cq)));
+    TRY(enable(true));
+
+    auto* id = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    ENSURE(id, Error::NoMem);
+    Error err = identify(id);
+    kfree(id);
+    TRY(err);
+
+    TRY_LOG(setup_io_queues(), "nvme: I/O queue setup failed");
+
+    type = blk::DeviceType::Disk;
+    strncpy(name, "nvme0n1", sizeof(name));
+    name[4] = static_cast<char>('0' + index);
+
+    work_.fn = complete_work;
+    work_.data = this;
+
+    queue.set_depth((io_[0].size - 1) * nr_queues_);
+    queue.set_limits(min(max_blocks_, blk::Queue::DEFAULT_MAX_BLOCKS), blk::Queue::DEFAULT_MAX_SEGMENTS);
+
+    if (irq_ >= 0) {
+        i8259::enable(irq_);
+    }
+    return Error::None;
+}
+
+// CC.EN and CSTS.RDY follow each other within CAP.TO.
+Error NvmeDevice::enable(bool on) {
+    uint32_t cc = mmio::read32(base_, nvme::REG_CC);
+    if (on) {
+        cc = nvme::CC_EN | nvme::CC_IOSQES | nvme::CC_IOCQES;  // NVM command set, 4 KB pages
+    } else {
+        cc &= ~nvme::CC_EN;
+    }
+    mmio::write32(base_, nvme::REG_CC, cc);
+
+    clocksource::Deadline deadline(ready_timeout_us_);
+    while (true) {
+        uint32_t csts = mmio::read32(base_, nvme::REG_CSTS);
+        if (on && (csts & nvme::CSTS_CFS)) {
+            cprintf("nvme: controller fatal status (CSTS 0x%08x)\n", csts);
+            return Error::IO;
+        }
+        if (((csts & nvme::CSTS_RDY) != 0) == on) {
+            return Error::None;
+        }
+        if (deadline.expired()) {
+            cprintf("nvme: controller did not %s (CSTS 0x%08x)\n", on ? "become ready" : "stop", csts);
+            return Error::Timeout;
+        }
+        arch_spin_hint();
+    }
+}
+
+// The rings take a page each.  I/O queues also get their slots and a PRP
+// list per slot, carved out of one allocation so no list crosses a page.
+Error NvmeDevice::alloc_queue(NvmeQueue& q, uint16_t qid, uint16_t size, bool io) {
+    ENSURE(nvme::REG_DOORBELL + (2U * qid + 2) * stride_ <= nvme::BAR_SIZE, Error::NotSupported);
+
+    q.qid = qid;
+    q.size = size;
+    q.sq = static_cast<NvmeCommand*>(kmalloc(PG_SIZE));
+    auto* cq = static_cast<NvmeCompletion*>(kmalloc(PG_SIZE));
+    ENSURE(q.sq && cq, Error::NoMem);
+    memset(q.sq, 0, PG_SIZE);
+    memset(cq, 0, PG_SIZE);
+    q.cq = cq;
+
+    q.sq_doorbell = base_ + nvme::REG_DOORBELL + (2U * qid) * stride_;
+    q.cq_doorbell = base_ + nvme::REG_DOORBELL + (2U * qid + 1) * stride_;
+    q.sq_tail = 0;
+    q.cq_head = 0;
+    q.phase = 1;
+
+    if (!io) {
+        return Error::None;
+    }
+
+    int nr_slots = size - 1;
+    q.slots = static_cast<NvmeSlot*>(kmalloc(sizeof(NvmeSlot) * nr_slots));
+    auto* prps = static_cast<uint8_t*>(kmalloc(nvme::PRP_LIST_SIZE * nr_slots));
+    ENSURE(q.slots && prps, Error::NoMem);
+
+    q.free = nullptr;
+    for (int i = nr_slots - 1; i >= 0; i--) {
+        q.slots[i] = {};
+        q.slots[i].prp_list = reinterpret_cast<uint64_t*>(prps + nvme::PRP_LIST_SIZE * i);
+        q.slots[i].next = q.free;
+        q.free = &q.slots[i];
+    }
+    return Error::None;
+}
+
+void NvmeDevice::submit(NvmeQueue& q, const NvmeCommand& cmd) {
+    q.sq[q.sq_tail] = cmd;
+    q.sq_tail = static_cast<uint16_t>((q.sq_tail + 1) % q.size);
+    arch_wmb();  // The entry before the doorbell
+    mmio::write32(q.sq_doorbell, q.sq_tail);
+}
+
+// Admin commands run one at a time during bring-up, polled.
+Error NvmeDevice::admin(NvmeCommand& cmd, uint32_t* result) {
+    NvmeQueue& q = admin_;
+    cmd.cid = q.sq_tail;
+    submit(q, cmd);
+
+    clocksource::Deadline deadline(ADMIN_TIMEOUT_US);
+    while ((q.cq[q.cq_head].status & 1) != q.phase) {
+        if (deadline.expired()) {
+            cprintf("nvme: admin command 0x%02x timed out\n", cmd.opcode);
+            return Error::Timeout;
+        }
+        arch_spin_hint();
+    }
+    arch_mb();  // Phase tag before the rest of the entry
+
+    uint16_t status = q.cq[q.cq_head].status >> 1;
+    if (result) {
+        *result = q.cq[q.cq_head].result;
+    }
+    if (++q.cq_head == q.size) {
+        q.cq_head = 0;
+        q.phase ^= 1;
+    }
+    mmio::write32(q.cq_doorbell, q.cq_head);
+
+    ENSURE_LOG(status == 0, Error::IO, "nvme: admin command 0x%02x failed (status 0x%04x)", cmd.opcode, status);
+    return Error::None;
+}
+
+// Identify the controller, then the first active namespace; `buf` is a page.
+Error NvmeDevice::identify(uint8_t* buf) {
+    NvmeCommand cmd{};
+    cmd.opcode = nvme::ADMIN_IDENTIFY;
+    cmd.prp1 = virt_to_phys(buf);
+    cmd.cdw10 = nvme::CNS_CONTROLLER;
+    TRY(admin(cmd));
+
+    memcpy(model_, buf + ID_CTRL_MODEL, ID_CTRL_MODEL_LEN);
+    for (int i = static_cast<int>(ID_CTRL_MODEL_LEN) - 1; i >= 0 && (model_[i] == ' ' || model_[i] == '\0'); i--) {
+        model_[i] = '\0';
+    }
+
+    // MDTS: a power of two in minimum pages, 0 for no limit.
+    uint8_t mdts = min(buf[ID_CTRL_MDTS], static_cast<uint8_t>(16));
+    max_blocks_ = mdts ? static_cast<uint32_t>(BOUNCE_BLOCKS << mdts) : __UINT32_MAX__;
+
+    // Controllers before NVMe 1.1 have no active namespace list.
+    cmd = {};
+    cmd.opcode = nvme::ADMIN_IDENTIFY;
+    cmd.prp1 = virt_to_phys(buf);
+    cmd.cdw10 = nvme::CNS_ACTIVE_NS_LIST;
+    nsid_ = admin(cmd) == Error::None ? *reinterpret_cast<uint32_t*>(buf) : 1;
+    ENSURE_LOG(nsid_ != 0, Error::NoDevice, "nvme: no active namespace");
+
+    cmd = {};
+    cmd.opcode = nvme::ADMIN_IDENTIFY;
+    cmd.nsid = nsid_;
+    cmd.prp1 = virt_to_phys(buf);
+    cmd.cdw10 = nvme::CNS_NAMESPACE;
+    TRY(admin(cmd));
+
+    uint64_t nsze = *reinterpret_cast<uint64_t*>(buf + ID_NS_NSZE);
+    uint8_t flbas = buf[ID_NS_FLBAS] & 0xF;
+    uint32_t lbaf = *reinterpret_cast<uint32_t*>(buf + ID_NS_LBAF + 4 * flbas);
+    uint32_t lbads = (lbaf >> LBAF_LBADS_SHIFT) & 0xFF;
+    ENSURE_LOG(lbads == 9, Error::NotSupported, "nvme: namespace %u uses %u-byte blocks", nsid_, 1U << lbads);
+
+    size = static_cast<uint32_t>(min(nsze, static_cast<uint64_t>(__UINT32_MAX__)));
+    return Error::None;
+}
+
+// One queue pair per CPU, as many as the controller grants.  Queue IDs
+// start at 1; every completion queue raises interrupt vector 0.
+Error NvmeDevice::setup_io_queues() {
+    int want = min(NR_CPUS, nvme::MAX_IO_QUEUES);
+
+    NvmeCommand cmd{};
+    cmd.opcode = nvme::ADMIN_SET_FEATURES;
+    cmd.cdw10 = nvme::FEAT_NUM_QUEUES;
+    cmd.cdw11 = static_cast<uint32_t>(want - 1) << 16 | static_cast<uint32_t>(want - 1);
+    uint32_t granted{};
+    TRY(admin(cmd, &granted));
+    int nsq = static_cast<int>(granted & 0xFFFF) + 1;
+    int ncq = static_cast<int>(granted >> 16) + 1;
+    want = min(want, min(nsq, ncq));
+
+    uint16_t size = static_cast<uint16_t>(min((cap_ & nvme::CAP_MQES_MASK) + 1, static_cast<uint64_t>(nvme::IO_QUEUE_SIZE)));
+
+    for (int i = 0; i < want; i++) {
+        NvmeQueue& q = io_[i];
+        auto qid = static_cast<uint16_t>(i + 1);
+        TRY(alloc_queue(q, qid, size, true));
+
+        cmd = {};
+        cmd.opcode = nvme::ADMIN_CREATE_CQ;
+        cmd.prp1 = virt_to_phys(const_cast<NvmeCompletion*>(q.cq));
+        cmd.cdw10 = static_cast<uint32_t>(size - 1) << 16 | qid;
+        cmd.cdw11 = nvme::QUEUE_PHYS_CONTIG | (irq_ >= 0 ? nvme::CQ_IRQ_ENABLED : 0);
+        TRY(admin(cmd));
+
+        cmd = {};
+        cmd.opcode = nvme::ADMIN_CREATE_SQ;
+        cmd.prp1 = virt_to_phys(q.sq);
+        cmd.cdw10 = static_cast<uint32_t>(size - 1) << 16 | qid;
+        cmd.cdw11 = static_cast<uint32_t>(qid) << 16 | nvme::QUEUE_PHYS_CONTIG;
+        TRY(admin(cmd));
+
+        nr_queues_ = i + 1;
+    }
+    return Error::None;
+}
+
+void NvmeDevice::print_info() {
+    cprintf("Device: %s (NVMe %d.%d, namespace %u)\n", name, version_ >> 16, (version_ >> 8) & 0xFF, nsid_);
+    cprintf("  Model: %s\n", model_);
+    cprintf("  Size: %d sectors (%d MB)\n", size, size / 2048);
+    cprintf("  Queues: %d x %d entries, %s completion\n", nr_queues_, io_[0].size, irq_ >= 0 ? "IRQ" : "polled");
+    cprintf("\n");
+}
+
+// ============================================================================
+// I/O
+// ============================================================================
+
+// The chain takes a slot of this CPU's queue pair and completes from
+// complete() after the interrupt, or before queue_rq() returns when
+// polled().
+void NvmeDevice::queue_rq(blk::Request* req) {
+    uint32_t total = req->total_blocks();
+
+    if (req->block + total > size) {
+        cprintf("nvme: %s out of range (block %d + %d > %d)\n", name, req->block, total, size);
+        req->end(Error::Invalid);
+        return;
+    }
+
+    uint8_t* bounce{};
+    if (!prp_compatible(req)) {
+        bounce = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+        if (!bounce) {
+            req->end(Error::NoMem);
+            return;
+        }
+    }
+
+    NvmeQueue& q = io_[this_cpu() % nr_queues_];
+    NvmeSlot* slot{};
+    uint32_t seq{};  // The slot's seq before the controller can complete it
+    {
+        LockGuard<Spinlock> guard(q.lock);
+        slot = q.free;
+        if (slot) {
+            q.free = slot->next;
+            seq = slot->seq;
+        }
+    }
+    if (!slot) {  // The queue depth keeps this from happening
+        kfree(bounce);
+        req->end(Error::Busy);
+        return;
+    }
+
+    slot->req = req;
+    slot->total = total;
+    slot->done = 0;
+    slot->bounce = bounce;
+    start_chunk(q, slot);
+
+    if (polled()) {
+        poll(q, slot, seq);
+    }
+}
+
+bool NvmeDevice::polled() const {
+    // Early boot mounts the root filesystem before interrupts and the
+    // completion workqueue are running.
+    return irq_ < 0 || !arch_irq_is_enabled() || !workqueue::system().worker();
+}
+
+// Issue the whole chain, or its next page worth of blocks when bouncing.
+void NvmeDevice::start_chunk(NvmeQueue& q, NvmeSlot* slot) {
+    bool write = slot->req->op == blk::Op::Write;
+    uint32_t lba = slot->req->block + slot->done;
+
+    NvmeCommand cmd{};
+    cmd.opcode = write ? nvme::CMD_WRITE : nvme::CMD_READ;
+    cmd.cid = static_cast<uint16_t>(slot - q.slots);
+    cmd.nsid = nsid_;
+
+    if (slot->bounce) {
+        slot->chunk = min(slot->total - slot->done, BOUNCE_BLOCKS);
+        if (write) {
+            copy_chunk(slot->req, slot->done, slot->chunk, slot->bounce, true);
+        }
+        cmd.prp1 = virt_to_phys(slot->bounce);
+    } else {
+        slot->chunk = slot->total;
+        fill_prps(cmd, slot->req, slot->prp_list);
+    }
+
+    cmd.cdw10 = lba;
+    cmd.cdw11 = 0;
+    cmd.cdw12 = slot->chunk - 1;  // 0-based block count
+
+    LockGuard<Spinlock> guard(q.lock);
+    submit(q, cmd);
+}
+
+// The slot's command finished: copy bounced data out, then continue with
+// the next chunk or end the request and free the slot.
+void NvmeDevice::chunk_done(NvmeQueue& q, NvmeSlot* slot, Error err) {
+    if (err == Error::None) {
+        if (slot->bounce && slot->req->op == blk::Op::Read) {
+            copy_chunk(slot->req, slot->done, slot->chunk, slot->bounce, false);
+        }
+        slot->done += slot->chunk;
+        if (slot->done < slot->total) {
+            start_chunk(q, slot);
+            return;
+        }
+    }
+
+    blk::Request* req = slot->req;
+    kfree(slot->bounce);
+    slot->bounce = nullptr;
+    slot->req = nullptr;
+    {
+        LockGuard<Spinlock> guard(q.lock);
+        __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+        slot->next = q.free;
+        q.free = slot;
+    }
+    req->end(err);
+}
+
+// Take completions one at a time and retire them outside the lock: end()
+// may submit the next request straight back into queue_rq().
+void NvmeDevice::reap(NvmeQueue& q) {
+    while (true) {
+        NvmeSlot* slot{};
+        Error err{};
+        {
+            LockGuard<Spinlock> guard(q.lock);
+            volatile NvmeCompletion& cqe = q.cq[q.cq_head];
+            if ((cqe.status & 1) != q.phase) {
+                break;
+            }
+            arch_mb();  // Phase tag before the rest of the entry
+
+            uint16_t cid = cqe.cid;
+            uint16_t status = cqe.status >> 1;
+            if (++q.cq_head == q.size) {
+                q.cq_head = 0;
+                q.phase ^= 1;
+            }
+            mmio::write32(q.cq_doorbell, q.cq_head);
+
+            if (cid >= q.size - 1 || !q.slots[cid].req) {
+                cprintf("nvme: %s: completion for idle command %d\n", name, cid);
+                continue;
+            }
+            slot = &q.slots[cid];
+            if (status != 0) {
+                cprintf("nvme: %s: I/O error (status 0x%04x, LBA %d)\n", name, status, slot->req->block + slot->done);
+                err = Error::IO;
+            }
+        }
+        chunk_done(q, slot, err);
+    }
+}
+
+// `seq` was read before the doorbell: another poller may reap the slot,
+// and bump it, before we get here.
+void NvmeDevice::poll(NvmeQueue& q, const NvmeSlot* slot, uint32_t seq) {
+    clocksource::Deadline deadline(REQUEST_TIMEOUT_US);
+    bool warned = false;
+
+    // Aborting would take an admin command racing the completion; a slow
+    // command is waited out instead.
+    while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == seq) {
+        reap(q);
+        if (!warned && deadline.expired()) {
+            cprintf("nvme: %s slow to complete\n", name);
+            warned = true;
+        }
+        arch_spin_hint();
+    }
+}
+
+// The line may be shared: claim it only when a completion queue has a new
+// entry, and mask the controller's interrupt until complete() has run.
+void NvmeDevice::interrupt() {
+    bool pending = false;
+    for (int i = 0; i < nr_queues_; i++) {
+        const NvmeQueue& q = io_[i];
+        pending |= (q.cq[q.cq_head].status & 1) == q.phase;
+    }
+    if (pending) {
+        mmio::write32(base_, nvme::REG_INTMS, 1);
+        static_cast<void>(workqueue::queue_work(&work_));
+    }
+}
+
+// Unmasking re-asserts the interrupt if entries arrived after the drain.
+void NvmeDevice::complete() {
+    for (int i = 0; i < nr_queues_; i++) {
+        reap(io_[i]);
+    }
+    mmio::write32(base_, nvme::REG_INTMC, 1);
+}
+
+// ============================================================================
+// NvmeManager
+// ============================================================================
+
+int NvmeManager::init() {
+    if (s_registered) {
+        return 0;
+    }
+
+    cprintf("nvme: registering PCI driver...\n");
+
+    if (pci::register_driver(&NVME_DRIVER) != Error::None) {
+        cprintf("nvme: failed to register PCI driver\n");
+        return -1;
+    }
+
+    s_registered = true;
+
+    return 0;
+}
+
+Error NvmeManager::probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*) {
+    ENSURE_LOG(s_devices_count < nvme::MAX_DEVICES, Error::Full, "nvme: too many controllers, max=%d",
+               nvme::MAX_DEVICES);
+
+    cprintf("nvme: found controller at PCI %02x:%02x.%x\n", pdev->bus, pdev->dev, pdev->func);
+
+    NvmeDevice& dev = s_devices[s_devices_count];
+    new (&dev) NvmeDevice();
+    TRY_LOG(dev.init(pdev, s_devices_count), "nvme: controller setup failed");
+
+    s_devices_count++;
+    blk::register_device(&dev);
+
+    cprintf("nvme: '%s' ready (%s, %d sectors, %d MB, %d queue(s), %s)\n", dev.name, dev.model_, dev.size,
+            dev.size / 2048, dev.nr_queues_, dev.irq_ >= 0 ? "IRQ" : "polled");
+    return Error::None;
+}
+
+NvmeDevice* NvmeManager::get_device(int device_id) {
+    if (device_id < 0 || device_id >= s_devices_count) {
+        return nullptr;
+    }
+    return &s_devices[device_id];
+}
+
+int NvmeManager::get_device_count() {
+    return s_devices_count;
+}
+
+void NvmeManager::interrupt_handler(int irq) {
+    for (int i = 0; i < s_devices_count; i++) {
+        if (s_devices[i].irq() == irq) {
+            s_devices[i].interrupt();
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <base/types.h>
+#include "block/blk.h"
+#include "lib/result.h"
+#include "lib/spinlock.h"
+#include "sched/workqueue.h"
+
+namespace pci {
+struct DeviceInfo;
+struct DriverId;
+}  // namespace pci
+
+namespace nvme {
+
+inline constexpr int MAX_DEVICES = 4;           // Controllers, one namespace each
+inline constexpr int MAX_IO_QUEUES = 4;         // Queue pairs per controller
+inline constexpr uint16_t ADMIN_QUEUE_SIZE = 32;
+inline constexpr uint16_t IO_QUEUE_SIZE = 64;   // Entries; one stays empty
+inline constexpr size_t BAR_SIZE = 0x2000;      // Registers and the first doorbells
+inline constexpr size_t PRP_LIST_SIZE = 512;    // Per slot: 64 entries
+
+// Controller registers (NVMe 1.4 §3.1)
+inline constexpr uint32_t REG_CAP = 0x00;    // Capabilities (64-bit)
+inline constexpr uint32_t REG_VS = 0x08;     // Version
+inline constexpr uint32_t REG_INTMS = 0x0C;  // Interrupt mask set
+inline constexpr uint32_t REG_INTMC = 0x10;  // Interrupt mask clear
+inline constexpr uint32_t REG_CC = 0x14;     // Controller configuration
+inline constexpr uint32_t REG_CSTS = 0x1C;   // Controller status
+inline constexpr uint32_t REG_AQA = 0x24;    // Admin queue attributes
+inline constexpr uint32_t REG_ASQ = 0x28;    // Admin submission queue base (64-bit)
+inline constexpr uint32_t REG_ACQ = 0x30;    // Admin completion queue base (64-bit)
+inline constexpr uint32_t REG_DOORBELL = 0x1000;
+
+inline constexpr uint64_t CAP_MQES_MASK = 0xFFFF;  // Max queue entries - 1
+inline constexpr int CAP_TO_SHIFT = 24;            // Ready timeout, 500 ms units
+inline constexpr int CAP_DSTRD_SHIFT = 32;         // Doorbell stride, 4 << DSTRD bytes
+
+inline constexpr uint32_t CC_EN = 1U << 0;
+inline constexpr uint32_t CC_IOSQES = 6U << 16;  // 64-byte submission entries
+inline constexpr uint32_t CC_IOCQES = 4U << 20;  // 16-byte completion entries
+
+inline constexpr uint32_t CSTS_RDY = 1U << 0;
+inline constexpr uint32_t CSTS_CFS = 1U << 1;  // Controller fatal status
+
+inline constexpr uint8_t ADMIN_CREATE_SQ = 0x01;
+inline constexpr uint8_t ADMIN_CREATE_CQ = 0x05;
+inline constexpr uint8_t ADMIN_IDENTIFY = 0x06;
+inline constexpr uint8_t ADMIN_SET_FEATURES = 0x09;
+
+inline constexpr uint8_t CMD_WRITE = 0x01;
+inline constexpr uint8_t CMD_READ = 0x02;
+
+inline constexpr uint32_t CNS_NAMESPACE = 0x00;
+inline constexpr uint32_t CNS_CONTROLLER = 0x01;
+inline constexpr uint32_t CNS_ACTIVE_NS_LIST = 0x02;
+
+inline constexpr uint32_t FEAT_NUM_QUEUES = 0x07;
+
+inline constexpr uint32_t QUEUE_PHYS_CONTIG = 1U << 0;
+inline constexpr uint32_t CQ_IRQ_ENABLED = 1U << 1;
+
+}  // namespace nvme
+
+// Submission queue entry (64 bytes)
+struct NvmeCommand {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t cid;  // Command identifier, echoed in the completion
+    uint32_t nsid;
+    uint64_t rsvd;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+};
+
+// Completion queue entry (16 bytes)
+struct NvmeCompletion {
+    uint32_t result;
+    uint32_t rsvd;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;  // Bit 0: phase tag
+};
+
+static_assert(sizeof(NvmeCommand) == 64, "NvmeCommand must be 64 bytes");
+static_assert(sizeof(NvmeCompletion) == 16, "NvmeCompletion must be 16 bytes");
+
+// A block request owns one command identifier until it completes.  The
+// chain normally goes out as one command, its pages in the PRP entries.  A
+// chain PRPs cannot describe goes through a bounce page instead, one
+// page-sized command after another.
+struct NvmeSlot {
+    blk::Request* req{};  // Request chain, nullptr when free
+    uint32_t total{};     // Blocks in the chain
+    uint32_t done{};      // Blocks finished
+    uint32_t chunk{};     // Blocks in the command in flight
+    uint32_t seq{};       // Bumped when the request completes
+    uint8_t* bounce{};    // DMA bounce page, only while bouncing
+    uint64_t* prp_list{};
+    NvmeSlot* next{};  // Free list
+};
+
+// A submission/completion queue pair with its doorbells.
+struct NvmeQueue {
+    uint16_t qid{};
+    uint16_t size{};
+    NvmeCommand* sq{};
+    volatile NvmeCompletion* cq{};
+    uintptr_t sq_doorbell{};
+    uintptr_t cq_doorbell{};
+    uint16_t sq_tail{};
+    uint16_t cq_head{};
+    uint16_t phase{1};  // Expected phase tag of the next new completion
+    NvmeSlot* slots{};  // size - 1 of them, indexed by command identifier
+    NvmeSlot* free{};
+    Spinlock lock{};  // Submission tail, completion head and the free list
+};
+
+struct NvmeDevice : public BlockDevice {
+    Error init(const pci::DeviceInfo* pdev, int index);
+    void interrupt();  // Hard-IRQ half: mask the controller's interrupt and defer
+    void complete();   // Workqueue half: drain every completion queue, unmask
+
+    [[nodiscard]] int irq() const { return irq_; }
+    void print_info() override;
+
+private:
+    void queue_rq(blk::Request* req) override;
+
+    Error enable(bool on);
+    Error admin(NvmeCommand& cmd, uint32_t* result = nullptr);
+    Error identify(uint8_t* buf);
+    Error setup_io_queues();
+    Error alloc_queue(NvmeQueue& q, uint16_t qid, uint16_t size, bool io);
+    void submit(NvmeQueue& q, const NvmeCommand& cmd);
+
+    void start_chunk(NvmeQueue& q, NvmeSlot* slot);
+    void chunk_done(NvmeQueue& q, NvmeSlot* slot, Error err);
+    void reap(NvmeQueue& q);
+    void poll(NvmeQueue& q, const NvmeSlot* slot, uint32_t seq);
+    [[nodiscard]] bool polled() const;
+
+    uintptr_t base_{};
+    uint64_t cap_{};
+    uint32_t stride_{};            // Doorbell stride in bytes
+    uint32_t version_{};
+    uint32_t nsid_{};
+    uint32_t max_blocks_{};        // Per command (MDTS)
+    uint64_t ready_timeout_us_{};  // CAP.TO
+    int irq_{-1};                  // Legacy PIC line, -1 when completion is polled
+    int nr_queues_{};
+    char model_[41]{};
+    NvmeQueue admin_{};
+    NvmeQueue io_[nvme::MAX_IO_QUEUES]{};
+    Work work_{};  // Completion bottom half
+
+    friend class NvmeManager;
+};
+
+class NvmeManager {
+public:
+    static int init();
+    static Error probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*);
+
+    static NvmeDevice* get_device(int device_id);
+    static int get_device_count();
+
+    static void interrupt_handler(int irq);
+
+private:
+    inline static NvmeDevice s_devices[nvme::MAX_DEVICES]{};
+    inline static int s_devices_count{};
+    inline static bool s_registered{};
+};
@@ -0,0 +1,43 @@
+/**
+ * SYSCALL/SYSRET setup.
+ *
+ * SYSCALL enters at MSR_LSTAR with CS = STAR[47:32] and SS = CS + 8;
+ * SYSRET returns with SS = STAR[63:48] + 8 and CS = STAR[63:48] + 16,
+ * which is why the GDT places USER_DS right below USER_CS.  The flags in
+ * MSR_FMASK are cleared on entry, so syscall_entry starts with interrupts
+ * off until it is on the kernel stack.
+ */
+
+#include "fast_syscall.h"
+
+#include <asm/cpu.h>
+#include <asm/cr.h>
+#include <asm/segments.h>
+#include <base/types.h>
+
+#include "lib/stdio.h"
+
+extern "C" void syscall_entry();
+
+// Read by syscall_entry: the task's kernel stack top (kept equal to
+// TSS.rsp0 by tss::set_rsp0()) and the user rsp parked during the switch.
+extern "C" {
+uintptr_t syscall_rsp0;
+uintptr_t syscall_user_rsp;
+}
+
+namespace fast_syscall {
+
+int init() {
+    constexpr uint64_t SYSRET_BASE = GD_KDATA | DPL_USER;  // + 8 = USER_DS, + 16 = USER_CS
+
+    wrmsr(MSR_STAR, (SYSRET_BASE << 48) | (static_cast<uint64_t>(KERNEL_CS) << 32));
+    wrmsr(MSR_LSTAR, reinterpret_cast<uintptr_t>(syscall_entry));
+    wrmsr(MSR_FMASK, FL_TF | FL_IF | FL_DF | FL_IOPL_MASK | FL_NT | FL_AC);
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+
+    cprintf("syscall: SYSCALL/SYSRET enabled (entry=%p)\n", reinterpret_cast<void*>(syscall_entry));
+    return 0;
+}
+
+}  // namespace fast_syscall
@@ -0,0 +1,8 @@
+#pragma once
+
+namespace fast_syscall {
+
+// Point SYSCALL at syscall_entry (trapentry.S) and enable it in EFER.
+int init();
+
+}  // namespace fast_syscall
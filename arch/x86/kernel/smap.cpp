@@ -0,0 +1,45 @@
+/**
+ * Supervisor Mode Access Prevention.
+ *
+ * With CR4.SMAP set, a kernel-mode load or store to a user page faults
+ * unless rflags.AC is set.  STAC and CLAC toggle AC but raise #UD on CPUs
+ * without SMAP, so uaccess.S only issues them when uaccess_smap says the
+ * feature is on.
+ */
+
+#include "smap.h"
+
+#include <asm/cpu.h>
+#include <asm/cr.h>
+#include <asm/io.h>
+#include <base/types.h>
+
+#include "lib/stdio.h"
+
+namespace {
+
+constexpr uint32_t CPUID_EXT_FEATURES = 7;  // Leaf 7, subleaf 0
+constexpr uint32_t CPUID_7_EBX_SMAP = 1 << 20;
+
+}  // namespace
+
+// Read by uaccess.S.
+extern "C" {
+uint8_t uaccess_smap;
+}
+
+namespace smap {
+
+int init() {
+    if (cpuid(0).eax < CPUID_EXT_FEATURES || !(cpuid(CPUID_EXT_FEATURES).ebx & CPUID_7_EBX_SMAP)) {
+        cprintf("smap: not supported\n");
+        return 0;
+    }
+
+    lcr4(rcr4() | CR4_SMAP);
+    uaccess_smap = 1;
+    cprintf("smap: enabled\n");
+    return 0;
+}
+
+}  // namespace smap
@@ -0,0 +1,9 @@
+#pragma once
+
+namespace smap {
+
+// Turn on SMAP when the CPU has it, so the kernel faults on any user access
+// outside the uaccess routines, which bracket theirs with STAC/CLAC.
+int init();
+
+}  // namespace smap
@@ -8,6 +8,10 @@
 
 #include "drivers/i8042.h"
 #include "drivers/ide.h"
+#include "drivers/ahci.h"
+#include "drivers/nvme.h"
+#include "drivers/sdhci.h"
+#include "drivers/virtio_blk.h"
 
 namespace {
 
@@ -89,6 +93,15 @@ bool arch_try_handle_irq(TrapFrame* tf) {
         return false;
     }
 
+    // The AHCI, NVMe, virtio-blk and SDHCI lines come from PCI config space
+    // and may be shared.
+    if (static_cast<int>(tf->trapno - IRQ_OFFSET) == AhciManager::irq()) {
+        AhciManager::interrupt_handler();
+    }
+    NvmeManager::interrupt_handler(static_cast<int>(tf->trapno - IRQ_OFFSET));
+    virtio_blk::intr(static_cast<int>(tf->trapno - IRQ_OFFSET));
+    sdhci::intr(static_cast<int>(tf->trapno - IRQ_OFFSET));
+
     switch (tf->trapno) {
         case TRAP_VECTOR_IRQ_TIMER: trap::handle_timer_tick(); break;
         case TRAP_VECTOR_IRQ_KBD: i8042::intr(); break;
@@ -3,8 +3,8 @@
  *   Slot 0  = NULL
  *   Slot 1  = KERNEL_CS   (64-bit code, DPL 0)
  *   Slot 2  = KERNEL_DS   (data, DPL 0)
- *   Slot 3  = USER_CS     (64-bit code, DPL 3)
- *   Slot 4  = USER_DS     (data, DPL 3)
+ *   Slot 3  = USER_DS     (data, DPL 3)
+ *   Slot 4  = USER_CS     (64-bit code, DPL 3; SYSRET wants it after USER_DS)
  *   Slot 5  = TSS low     ← we fill this
  *   Slot 6  = TSS high    ← and this (16-byte system descriptor)
  */
@@ -21,6 +21,9 @@ extern uint64_t __gdt[];
 // The single, static TSS for this CPU.
 static TssDesc s_tss;
 
+// SYSCALL does not switch stacks; syscall_entry loads this copy of rsp0.
+extern "C" uintptr_t syscall_rsp0;
+
 namespace tss {
 
 int init() {
@@ -47,6 +50,7 @@ int init() {
 
 void set_rsp0(uintptr_t rsp0) {
     s_tss.rsp0 = rsp0;
+    syscall_rsp0 = rsp0;
 }
 
 }  // namespace tss
@@ -166,7 +166,9 @@ static EFI_STATUS uefi_get_memory_map(EFI_BOOT_SERVICES* bs, struct BootInfo* bi
     return EFI_SUCCESS;
 }
 
-static EFI_STATUS uefi_load_kernel_file(EFI_BOOT_SERVICES* bs, EFI_HANDLE image_handle, void** buf, uintptr_t* size) {
+// Open the first of `paths` that exists on the volume the loader came from.
+static EFI_STATUS uefi_open_file(EFI_BOOT_SERVICES* bs, EFI_HANDLE image_handle, const wchar_t* const* paths,
+                                 EFI_FILE_PROTOCOL** out_root, EFI_FILE_PROTOCOL** out_file, uintptr_t* size) {
     EFI_LOADED_IMAGE_PROTOCOL* loaded_image{};
     EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* fs{};
     EFI_FILE_PROTOCOL* root{};
@@ -190,8 +192,6 @@ static EFI_STATUS uefi_load_kernel_file(EFI_BOOT_SERVICES* bs, EFI_HANDLE image_
         return status;
     }
 
-    const wchar_t* paths[] = {UEFI_STR(L"\\EFI\\ZONIX\\KERNEL.ELF"), UEFI_STR(L"\\KERNEL.ELF"),
-                              UEFI_STR(L"\\KERNEL.SYS"), nullptr};
     for (int i = 0; paths[i]; i++) {
         status = root->Open(root, &file, const_cast<wchar_t*>(paths[i]), EFI_FILE_MODE_READ, 0);
         if (!EFI_ERROR(status)) {
@@ -225,16 +225,58 @@ static EFI_STATUS uefi_load_kernel_file(EFI_BOOT_SERVICES* bs, EFI_HANDLE image_
     *size = static_cast<uintptr_t>(file_info->FileSize);
     bs->FreePool(file_info);
 
+    *out_root = root;
+    *out_file = file;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS uefi_load_kernel_file(EFI_BOOT_SERVICES* bs, EFI_HANDLE image_handle, void** buf, uintptr_t* size) {
+    const wchar_t* const paths[] = {UEFI_STR(L"\\EFI\\ZONIX\\KERNEL.ELF"), UEFI_STR(L"\\KERNEL.ELF"),
+                                    UEFI_STR(L"\\KERNEL.SYS"), nullptr};
+    EFI_FILE_PROTOCOL* root{};
+    EFI_FILE_PROTOCOL* file{};
+
+    EFI_STATUS status = uefi_open_file(bs, image_handle, paths, &root, &file, size);
+    if (EFI_ERROR(status)) {
+        return status;
+    }
+
     status = bs->AllocatePool(EfiLoaderData, *size, buf);
+    if (!EFI_ERROR(status)) {
+        status = file->Read(file, size, *buf);
+    }
+    file->Close(file);
+    root->Close(root);
+    return status;
+}
+
+// Read the optional ramdisk image into pages below `max_addr`.  It must be
+// loaded before the memory map is taken, so the map reports its pages as
+// loader data and the kernel leaves them alone.
+static EFI_STATUS uefi_load_ramdisk(EFI_BOOT_SERVICES* bs, EFI_HANDLE image_handle, struct BootInfo* bi,
+                                    uint64_t max_addr) {
+    const wchar_t* const paths[] = {UEFI_STR(L"\\EFI\\ZONIX\\RAMDISK.IMG"), UEFI_STR(L"\\RAMDISK.IMG"), nullptr};
+    EFI_FILE_PROTOCOL* root{};
+    EFI_FILE_PROTOCOL* file{};
+    uintptr_t size = 0;
+
+    EFI_STATUS status = uefi_open_file(bs, image_handle, paths, &root, &file, &size);
     if (EFI_ERROR(status)) {
-        file->Close(file);
-        root->Close(root);
         return status;
     }
 
-    status = file->Read(file, size, *buf);
+    EFI_PHYSICAL_ADDRESS addr = max_addr;
+    status = bs->AllocatePages(AllocateMaxAddress, EfiLoaderData, (size + 4095) / 4096, &addr);
+    if (!EFI_ERROR(status)) {
+        status = file->Read(file, &size, reinterpret_cast<void*>(static_cast<uintptr_t>(addr)));
+    }
     file->Close(file);
     root->Close(root);
+
+    if (!EFI_ERROR(status)) {
+        bi->ramdisk_addr = addr;
+        bi->ramdisk_size = size;
+    }
     return status;
 }
 
@@ -296,6 +338,15 @@ EFI_STATUS uefi_boot_setup(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
     bi->magic = BOOT_INFO_MAGIC;
     bi->mmap_addr = cfg.mmap_addr;
 
+    if (cfg.ramdisk_max_addr != 0) {
+        if (EFI_ERROR(uefi_load_ramdisk(bs, image_handle, bi, cfg.ramdisk_max_addr))) {
+            uefi_print(st, UEFI_STR(L"No ramdisk image\r\n"));
+        } else {
+            uefi_print(st, UEFI_STR(L"Ramdisk loaded at "));
+            uefi_print_hex(st, bi->ramdisk_addr);
+        }
+    }
+
     uefi_print(st, UEFI_STR(L"Getting memory map...\r\n"));
     EFI_STATUS status =
         uefi_get_memory_map(bs, bi, cfg.mmap_addr, cfg.mmap_max_entries, cfg.mem_lower, cfg.mem_upper_min);
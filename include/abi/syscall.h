@@ -14,12 +14,27 @@
 #define _ZONIX_ABI_SYSCALL_H
 
 /* ---- Syscall numbers ---- */
-#define NR_EXIT     1
-#define NR_READ     3
-#define NR_WRITE    4
-#define NR_OPEN     5
-#define NR_CLOSE    6
-#define NR_PAUSE    29
+#define NR_EXIT             1
+#define NR_READ             3
+#define NR_WRITE            4
+#define NR_OPEN             5
+#define NR_CLOSE            6
+#define NR_WAITPID          7   /* waitpid(pid, status, 0); *status = exit code */
+#define NR_SPAWN            11  /* spawn(path, argv, envp) in execve's slot */
+#define NR_GETPID           20
+#define NR_PAUSE            29
+#define NR_CLONE            120
+#define NR_NANOSLEEP        162
+#define NR_FUTEX            240
+#define NR_CLOCK_GETTIME    265
+
+/* ---- clone() flags ---- */
+#define CLONE_VM        0x00000100  /* Share the address space */
+#define CLONE_FILES     0x00000400  /* Share the file descriptor table */
+
+/* ---- futex() operations ---- */
+#define FUTEX_WAIT      0   /* Sleep if *uaddr == val */
+#define FUTEX_WAKE      1   /* Wake up to val waiters on uaddr */
 
 /* ---- Stdout / Stderr fd constants ---- */
 #define STDIN_FD    0
@@ -0,0 +1,33 @@
+/*
+ * Zonix OS — Time ABI Definitions
+ *
+ * Clock ids and the timespec layout used by NR_CLOCK_GETTIME and
+ * NR_NANOSLEEP.  Shared between the kernel and user-space toolchains.
+ *
+ * Rules:
+ *   - C-compatible only (no C++).
+ *   - Must be includable from .S assembly files via #include.
+ */
+
+#ifndef _ZONIX_ABI_TIME_H
+#define _ZONIX_ABI_TIME_H
+
+/* ---- Clock ids ---- */
+#define CLOCK_REALTIME   0
+#define CLOCK_MONOTONIC  1
+
+/* ---- struct abi_timespec layout (16 bytes) ---- */
+#define TIMESPEC_SEC     0
+#define TIMESPEC_NSEC    8
+#define TIMESPEC_SIZE    16
+
+#ifndef __ASSEMBLY__
+
+struct abi_timespec {
+    long long tv_sec;
+    long long tv_nsec;
+};
+
+#endif /* !__ASSEMBLY__ */
+
+#endif /* _ZONIX_ABI_TIME_H */
@@ -0,0 +1,62 @@
+/*
+ * Zonix OS — vDSO ABI Definitions
+ *
+ * Every user address space maps two read-only pages from the kernel:
+ * the vDSO text, whose entry points sit at fixed offsets, and right below
+ * it the vvar page, holding the clocksource parameters as
+ * struct abi_vdso_data.  The text page's address is passed to the
+ * program in the auxiliary vector (AT_ZONIX_VDSO), which follows the
+ * NULL that ends envp[] on the initial stack.  The page is raw code, not
+ * an ELF image, so it is not offered as AT_SYSINFO_EHDR.
+ *
+ * Rules:
+ *   - C-compatible only (no C++).
+ *   - Must be includable from .S assembly files via #include.
+ */
+
+#ifndef _ZONIX_ABI_VDSO_H
+#define _ZONIX_ABI_VDSO_H
+
+/* ---- Auxiliary vector: (type, value) pairs ending with AT_NULL ---- */
+#define AT_NULL          0
+#define AT_PAGESZ        6
+#define AT_ZONIX_VDSO    0x5a00  /* vDSO text page; private, outside Linux's range */
+
+/* ---- vDSO entry points, as offsets from the text page ---- */
+#define VDSO_CLOCK_GETTIME  0x000  /* long clock_gettime(int clock_id, struct abi_timespec* ts) */
+
+/*
+ * ---- struct abi_vdso_data layout (vvar page, text page - 4096) ----
+ *
+ * Readers retry while `seq` is odd or changed across the read.  With
+ * `freq` = 0 there is no usable counter and callers must make the syscall.
+ * Monotonic ns = base_ns + (((counter - base_cycles) * mult + frac) >> shift);
+ * realtime adds boot_ns.
+ */
+#define VVAR_SEQ          0
+#define VVAR_MULT         4
+#define VVAR_SHIFT        8
+#define VVAR_FREQ         16
+#define VVAR_BASE_CYCLES  24
+#define VVAR_BASE_NS      32
+#define VVAR_FRAC         40
+#define VVAR_BOOT_NS      48
+#define VVAR_SIZE         56
+
+#ifndef __ASSEMBLY__
+
+struct abi_vdso_data {
+    unsigned int seq;
+    unsigned int mult;
+    unsigned int shift;
+    unsigned int pad;
+    unsigned long long freq;
+    unsigned long long base_cycles;
+    unsigned long long base_ns;
+    unsigned long long frac;
+    unsigned long long boot_ns;
+};
+
+#endif /* !__ASSEMBLY__ */
+
+#endif /* _ZONIX_ABI_VDSO_H */
@@ -14,6 +14,7 @@ struct UefiBootConfig {
     uint64_t mem_upper_min;                  // min addr for upper memory accounting
     EFI_PHYSICAL_ADDRESS kernel_alloc_base;  // 0 to skip AllocatePages
     uintptr_t kernel_alloc_pages;            // number of pages to allocate
+    uint64_t ramdisk_max_addr;               // last byte for RAMDISK.IMG in the kernel's boot map; 0 to skip
 };
 
 EFI_STATUS uefi_boot_setup(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_table, const UefiBootConfig& cfg,
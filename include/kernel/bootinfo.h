@@ -41,6 +41,13 @@ struct BootInfo {
     uint8_t  framebuffer_type;       // 0=text, 1=rgb
 
     char     loader_name[32];        // "Zonix BIOS" or "Zonix UEFI"
+
+    // Ramdisk image the loader read into memory (0 when none)
+    uint64_t ramdisk_addr;           // Physical address, inside the boot direct map
+    uint64_t ramdisk_size;           // Size in bytes
 } __attribute__((packed));
 
+// Each architecture's head.S copies the first 128 bytes.
+static_assert(sizeof(BootInfo) <= 128, "BootInfo outgrew the kernel's copy");
+
 using kernel_entry_t = void (*)(BootInfo *info);
@@ -60,3 +60,13 @@
 
 // Swap to disk support.
 #define CONFIG_SWAP 1
+
+// ==========================================================================
+// Debugging
+// ==========================================================================
+
+// Lock contention statistics (lockstat): per-class acquisition, contention,
+// wait and hold counters for Spinlock, Mutex, Semaphore and WaitQueue.
+// Costs a cycle-counter read per acquisition; see the `lockstat` command.
+// `make LOCKSTAT=1` turns it on without editing this file.
+// #define CONFIG_LOCKSTAT 1
@@ -0,0 +1,355 @@
+#include "bcache.h"
+#include "blk.h"
+
+#include "lib/lock_guard.h"
+#include "lib/memory.h"
+#include "lib/spinlock.h"
+#include "lib/stdio.h"
+#include "mm/pmm.h"
+
+#include <asm/page.h>
+
+namespace bcache {
+namespace {
+
+constexpr int BUFFERS_PER_PAGE = PG_SIZE / BlockDevice::SIZE;
+constexpr int FLUSH_BATCH = 32;  // Dirty buffers written back per Batch
+
+Buffer s_buffers[NR_BUFFERS]{};
+int s_nr_buffers{};  // Buffers with data, a prefix of s_buffers
+ListNode s_buckets[NR_BUCKETS]{};
+ListNode s_lru{};  // Unreferenced buffers, the next to reuse first
+CacheStats s_stats{};
+Spinlock s_lock{};  // Keys, chains, the LRU, refs, dirty flags and stats
+
+size_t bucket_of(const BlockDevice* dev, uint32_t block) {
+    uintptr_t key = (reinterpret_cast<uintptr_t>(dev) >> 4) ^ (block * 2654435761U);
+    return key % NR_BUCKETS;
+}
+
+// The rest of these run under s_lock.
+
+Buffer* lookup(const BlockDevice* dev, uint32_t block) {
+    for (ListNode* node : s_buckets[bucket_of(dev, block)]) {
+        Buffer* buf = to_struct<Buffer>(node, &Buffer::hash_node);
+        if (buf->dev == dev && buf->block == block) {
+            return buf;
+        }
+    }
+    return nullptr;
+}
+
+void hold(Buffer* buf) {
+    if (buf->refs++ == 0) {
+        buf->lru_node.unlink();
+    }
+}
+
+// `front` puts a buffer whose contents no longer matter up for reuse first.
+void put(Buffer* buf, bool front) {
+    if (--buf->refs > 0) {
+        return;
+    }
+    if (front) {
+        s_lru.add_after(buf->lru_node);
+    } else {
+        s_lru.add_before(buf->lru_node);
+    }
+}
+
+void unhash(Buffer* buf) {
+    buf->hash_node.unlink();
+    buf->hash_node.prev = buf->hash_node.next = &buf->hash_node;
+    buf->dev = nullptr;
+    buf->valid = false;
+    buf->dirty = false;
+}
+
+// Forget what `buf` holds; an unreferenced buffer goes to the LRU front.
+void drop(Buffer* buf) {
+    if (buf->refs > 0) {
+        buf->valid = false;
+        buf->dirty = false;
+        return;
+    }
+    unhash(buf);
+    buf->lru_node.unlink();
+    s_lru.add_after(buf->lru_node);
+}
+
+// Rekey the clean, unreferenced `buf` to (dev, block) and reference it.
+void claim(Buffer* buf, BlockDevice* dev, uint32_t block) {
+    if (buf->dev) {
+        unhash(buf);
+        s_stats.evictions++;
+    }
+    buf->dev = dev;
+    buf->block = block;
+    s_buckets[bucket_of(dev, block)].add_before(buf->hash_node);
+    hold(buf);
+}
+
+// Carve a page into buffers, up for reuse first.  False without memory.
+bool grow() {
+    auto* page = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    if (!page) {
+        return false;
+    }
+
+    {
+        LockGuard<Spinlock> guard(s_lock);
+        if (s_nr_buffers + BUFFERS_PER_PAGE <= NR_BUFFERS) {
+            for (int i = 0; i < BUFFERS_PER_PAGE; i++) {
+                Buffer* buf = &s_buffers[s_nr_buffers++];
+                buf->data = page + i * BlockDevice::SIZE;
+                s_lru.add_after(buf->lru_node);
+            }
+            return true;
+        }
+    }
+    kfree(page);  // Another task filled the pool meanwhile
+    return true;
+}
+
+// Write a referenced buffer back, with buf->lock held.
+Error write_locked(Buffer* buf) {
+    {
+        LockGuard<Spinlock> guard(s_lock);
+        if (!buf->dirty) {
+            return Error::None;
+        }
+        buf->dirty = false;
+    }
+
+    Error err = buf->dev->write(buf->block, buf->data, 1);
+
+    LockGuard<Spinlock> guard(s_lock);
+    if (err != Error::None) {
+        buf->dirty = true;
+    } else {
+        s_stats.writebacks++;
+    }
+    return err;
+}
+
+// Write back the referenced buffers `bufs` of `dev` under one plug, so the
+// queue merges runs of adjacent blocks.  Locks are taken in s_buffers order.
+Error write_batch(BlockDevice* dev, Buffer* const* bufs, int count) {
+    bool queued[FLUSH_BATCH]{};
+    for (int i = 0; i < count; i++) {
+        bufs[i]->lock.lock();
+    }
+    {
+        LockGuard<Spinlock> guard(s_lock);
+        for (int i = 0; i < count; i++) {
+            queued[i] = bufs[i]->dirty;  // Unless written back meanwhile
+            bufs[i]->dirty = false;
+        }
+    }
+
+    Error err = Error::None;
+    {
+        blk::Batch batch(dev);
+        for (int i = 0; i < count && err == Error::None; i++) {
+            if (queued[i]) {
+                err = batch.add(blk::Op::Write, bufs[i]->block, bufs[i]->data, 1);
+            }
+        }
+        Error done = batch.finish();
+        if (err == Error::None) {
+            err = done;
+        }
+    }
+
+    {
+        LockGuard<Spinlock> guard(s_lock);
+        for (int i = 0; i < count; i++) {
+            if (!queued[i]) {
+                continue;
+            }
+            if (err != Error::None) {
+                bufs[i]->dirty = true;
+            } else {
+                s_stats.writebacks++;
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        bufs[i]->lock.unlock();
+    }
+    return err;
+}
+
+}  // namespace
+
+Result<Buffer*> get(BlockDevice* dev, uint32_t block) {
+    ENSURE(dev);
+
+    bool can_grow = true;
+    while (true) {
+        Buffer* victim{};
+        {
+            LockGuard<Spinlock> guard(s_lock);
+            Buffer* buf = lookup(dev, block);
+            if (buf) {
+                hold(buf);
+                s_stats.hits++;
+                return buf;
+            }
+
+            victim = s_lru.empty() ? nullptr : to_struct<Buffer>(s_lru.next, &Buffer::lru_node);
+            bool in_use = !victim || victim->dev;
+            if (!in_use || !can_grow || s_nr_buffers == NR_BUFFERS) {
+                ENSURE(victim, Error::Busy);
+                if (!victim->dirty) {
+                    claim(victim, dev, block);
+                    s_stats.misses++;
+                    return victim;
+                }
+                hold(victim);
+            } else {
+                victim = nullptr;
+            }
+        }
+
+        if (!victim) {
+            can_grow = grow();
+            continue;
+        }
+
+        // Write the dirty victim back outside s_lock and look again: another
+        // task may have brought the block in meanwhile.
+        Error err = writeback(victim);
+        {
+            LockGuard<Spinlock> guard(s_lock);
+            put(victim, true);
+        }
+        TRY(err);
+    }
+}
+
+Result<Buffer*> read(BlockDevice* dev, uint32_t block) {
+    Buffer* buf = TRY(get(dev, block));
+
+    Error err = Error::None;
+    {
+        LockGuard<Mutex> guard(buf->lock);
+        if (!buf->valid) {
+            err = dev->read(block, buf->data, 1);
+            buf->valid = err == Error::None;
+        }
+    }
+    if (err != Error::None) {
+        release(buf);
+        return err;
+    }
+    return buf;
+}
+
+// Also marks the buffer valid: a caller that filled the whole block after
+// get() needs no read.
+void mark_dirty(Buffer* buf) {
+    LockGuard<Spinlock> guard(s_lock);
+    buf->valid = true;
+    buf->dirty = true;
+}
+
+void release(Buffer* buf) {
+    if (!buf) {
+        return;
+    }
+    LockGuard<Spinlock> guard(s_lock);
+    put(buf, false);
+}
+
+Error writeback(Buffer* buf) {
+    ENSURE(buf);
+
+    LockGuard<Mutex> guard(buf->lock);
+    return write_locked(buf);
+}
+
+Error flush(BlockDevice* dev) {
+    while (true) {
+        Buffer* bufs[FLUSH_BATCH]{};
+        int count{};
+        BlockDevice* target = dev;
+        {
+            LockGuard<Spinlock> guard(s_lock);
+            for (int i = 0; i < s_nr_buffers && count < FLUSH_BATCH; i++) {
+                Buffer* buf = &s_buffers[i];
+                if (!buf->dirty || (target && buf->dev != target)) {
+                    continue;
+                }
+                target = buf->dev;
+                hold(buf);
+                bufs[count++] = buf;
+            }
+        }
+        if (count == 0) {
+            return Error::None;
+        }
+
+        Error err = write_batch(target, bufs, count);
+        {
+            LockGuard<Spinlock> guard(s_lock);
+            for (int i = 0; i < count; i++) {
+                put(bufs[i], false);
+            }
+        }
+        TRY(err);
+    }
+}
+
+void invalidate(BlockDevice* dev) {
+    LockGuard<Spinlock> guard(s_lock);
+    for (int i = 0; i < s_nr_buffers; i++) {
+        if (s_buffers[i].dev == dev && s_buffers[i].refs == 0) {
+            drop(&s_buffers[i]);
+        }
+    }
+}
+
+void discard(BlockDevice* dev, uint32_t block, uint32_t count) {
+    LockGuard<Spinlock> guard(s_lock);
+    for (int i = 0; i < s_nr_buffers; i++) {
+        Buffer* buf = &s_buffers[i];
+        if (buf->dev == dev && buf->block >= block && buf->block - block < count) {
+            drop(buf);
+        }
+    }
+}
+
+CacheStats stats() {
+    LockGuard<Spinlock> guard(s_lock);
+    return s_stats;
+}
+
+void reset_stats() {
+    LockGuard<Spinlock> guard(s_lock);
+    s_stats = {};
+}
+
+void print() {
+    int cached{};
+    int dirty{};
+    int busy{};
+    CacheStats s{};
+    {
+        LockGuard<Spinlock> guard(s_lock);
+        for (int i = 0; i < s_nr_buffers; i++) {
+            cached += s_buffers[i].dev ? 1 : 0;
+            dirty += s_buffers[i].dirty ? 1 : 0;
+            busy += s_buffers[i].refs > 0 ? 1 : 0;
+        }
+        s = s_stats;
+    }
+
+    uint64_t lookups = s.hits + s.misses;
+    uint64_t rate = lookups ? s.hits * 1000 / lookups : 0;
+    cprintf("bcache: %d/%d buffers, %d cached, %d dirty, %d in use\n", s_nr_buffers, NR_BUFFERS, cached, dirty, busy);
+    cprintf("  hits %lu  misses %lu (%lu.%lu%% hit)  evictions %lu  writebacks %lu\n", s.hits, s.misses, rate / 10,
+            rate % 10, s.evictions, s.writebacks);
+}
+
+}  // namespace bcache
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <base/types.h>
+#include "lib/list.h"
+#include "lib/mutex.h"
+#include "lib/result.h"
+
+struct BlockDevice;
+
+// Block buffer cache: one BlockDevice::SIZE buffer per (device, block),
+// found through a hash of NR_BUCKETS chains.
+//
+// get()/read() hand out a referenced buffer; release() drops the reference.
+// Unreferenced buffers sit on an LRU list and the oldest is reused when the
+// pool (NR_BUFFERS, grown a page at a time) is exhausted, written back first
+// if dirty.  Writes stay in the cache after mark_dirty() until flush(),
+// eviction or writeback().
+//
+// Buffer::lock serializes filling and writing back a buffer.  Writers change
+// data in place, so a caller holds it to read data as well as to change it,
+// and takes no other buffer while it does.  The cache does not order writes:
+// a filesystem that needs one block on disk before another writes it back
+// itself.
+
+namespace bcache {
+
+inline constexpr int NR_BUFFERS = 256;  // 128 KB of blocks
+inline constexpr int NR_BUCKETS = 64;
+
+struct Buffer {
+    BlockDevice* dev{};  // nullptr while the buffer holds nothing
+    uint32_t block{};
+    uint8_t* data{};
+    int refs{};
+    bool valid{};  // data holds the block's contents
+    bool dirty{};  // data is newer than the block on disk
+    Mutex lock{};
+
+    ListNode hash_node{};  // Bucket chain while dev is set
+    ListNode lru_node{};   // LRU list while refs is 0
+};
+
+struct CacheStats {
+    uint64_t hits{};
+    uint64_t misses{};
+    uint64_t evictions{};   // Blocks dropped to make room
+    uint64_t writebacks{};  // Dirty blocks written to disk
+};
+
+// The buffer for `block` on `dev`, referenced; its contents are not read.
+// Busy when every buffer is referenced.
+Result<Buffer*> get(BlockDevice* dev, uint32_t block);
+// As get(), with the block read in if the buffer does not hold it yet.
+Result<Buffer*> read(BlockDevice* dev, uint32_t block);
+
+void mark_dirty(Buffer* buf);
+void release(Buffer* buf);
+
+// Write `buf` back now if it is dirty.
+Error writeback(Buffer* buf);
+// Write back every dirty buffer of `dev` (every device when nullptr), in
+// batches the request queue can merge.
+Error flush(BlockDevice* dev);
+// Forget `dev`'s unreferenced buffers without writing them back.
+void invalidate(BlockDevice* dev);
+// Forget cached copies of `count` blocks about to be written around the
+// cache.
+void discard(BlockDevice* dev, uint32_t block, uint32_t count);
+
+// Releases a buffer at the end of a scope.
+class BufferRef {
+public:
+    explicit BufferRef(Buffer* buf) : buf_(buf) {}
+    ~BufferRef() { release(buf_); }
+
+    BufferRef(const BufferRef&) = delete;
+    BufferRef& operator=(const BufferRef&) = delete;
+
+    [[nodiscard]] Buffer* get() const { return buf_; }
+    Buffer* operator->() const { return buf_; }
+    explicit operator bool() const { return buf_ != nullptr; }
+
+private:
+    Buffer* buf_;
+};
+
+[[nodiscard]] CacheStats stats();
+void reset_stats();
+void print();
+
+}  // namespace bcache
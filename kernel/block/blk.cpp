@@ -52,6 +52,26 @@ void BlockDevice::print_info() {
     cprintf("\n");
 }
 
+namespace {
+
+Error transfer(BlockDevice* dev, blk::Op op, uint32_t block_number, const void* buf, size_t block_count) {
+    ENSURE(buf && block_count > 0, Error::Invalid);
+
+    blk::Request req(op, block_number);
+    TRY(req.add_buffer(const_cast<void*>(buf), block_count * BlockDevice::SIZE));
+    return blk::submit_wait(dev, &req);
+}
+
+}  // namespace
+
+Error BlockDevice::read(uint32_t block_number, void* buf, size_t block_count) {
+    return transfer(this, blk::Op::Read, block_number, buf, block_count);
+}
+
+Error BlockDevice::write(uint32_t block_number, const void* buf, size_t block_count) {
+    return transfer(this, blk::Op::Write, block_number, buf, block_count);
+}
+
 void BlockManager::print() {
     cprintf("NAME   MAJ:MIN RM  SIZE RO TYPE MOUNTPOINTS\n");
 
@@ -3,6 +3,8 @@
 #include <base/types.h>
 #include "lib/array.h"
 #include "lib/result.h"
+#include "queue.h"
+#include "request.h"
 
 namespace blk {
 
@@ -15,20 +17,34 @@ enum class DeviceType : uint8_t {
 }  // namespace blk
 
 struct BlockDevice {
-    static constexpr size_t SIZE = 512;
+    static constexpr size_t SIZE = blk::BLOCK_SIZE;
 
     blk::DeviceType type{};  // Device type
     uint32_t size{};         // Size in blocks
     char name[8]{};          // Device name
+    blk::Queue queue{this};  // Requests on their way to queue_rq()
 
-    virtual Error read(uint32_t block_number, void* buf, size_t block_count) = 0;
-    virtual Error write(uint32_t block_number, const void* buf, size_t block_count) = 0;
+    // Start `req` through the queue; req->end() runs when it completes,
+    // possibly before submit() returns.
+    void submit(blk::Request* req) { queue.submit(req); }
     virtual void print_info();
+
+    // Synchronous I/O on a kernel buffer: one request, waited for.
+    Error read(uint32_t block_number, void* buf, size_t block_count);
+    Error write(uint32_t block_number, const void* buf, size_t block_count);
+
+protected:
+    friend class blk::Queue;
+
+    // Driver entry: start the (possibly merged) request chain `req` and
+    // call req->end() when it completes.  At most queue.set_depth() chains
+    // are outstanding at once.
+    virtual void queue_rq(blk::Request* req) = 0;
 };
 
 class BlockManager {
 public:
-    static constexpr int MAX_DEV = 4;
+    static constexpr int MAX_DEV = 8;
 
     static void init();
     static void register_device(BlockDevice* device);
@@ -0,0 +1,378 @@
+#include "queue.h"
+#include "blk.h"
+
+#include "lib/lock_guard.h"
+#include "lib/memory.h"
+#include "lib/stdio.h"
+#include "mm/pmm.h"
+#include "sched/preempt.h"
+#include "sched/sched.h"
+#include "time/clocksource.h"
+
+#include <asm/page.h>
+
+namespace {
+
+blk::Request* from_fifo(ListNode* node) {
+    return reinterpret_cast<blk::Request*>(reinterpret_cast<char*>(node) - __builtin_offsetof(blk::Request, fifo_node));
+}
+
+blk::Request* from_sorted(ListNode* node) {
+    return reinterpret_cast<blk::Request*>(reinterpret_cast<char*>(node) - __builtin_offsetof(blk::Request, sort_node));
+}
+
+uint32_t chain_end(const blk::Request* head) {
+    return head->block + head->merge_blocks;
+}
+
+// The calling task's active plug, if submissions should be held on it.
+blk::Plug* current_plug() {
+    if (preempt::in_interrupt()) {
+        return nullptr;
+    }
+    TaskStruct* task = sched::current();
+    return task ? task->blk_plug : nullptr;
+}
+
+}  // namespace
+
+namespace blk {
+
+// ============================================================================
+// Queue
+// ============================================================================
+
+void Queue::submit(Request* req) {
+    req->queue = this;
+    req->merge_next = nullptr;
+    req->merge_last = req;
+    req->merge_blocks = req->count;
+    req->merge_segs = req->nr_segs;
+
+    {
+        LockGuard<Spinlock> guard(lock_);
+        stats_.submitted++;
+    }
+
+    Plug* plug = current_plug();
+    if (plug) {
+        plug->hold(req);
+        return;
+    }
+
+    insert(req);
+    run();
+}
+
+void Queue::set_depth(int depth) {
+    LockGuard<Spinlock> guard(lock_);
+    depth_ = depth > 0 ? depth : 1;
+}
+
+void Queue::set_limits(uint32_t max_blocks, int max_segments) {
+    LockGuard<Spinlock> guard(lock_);
+    max_blocks_ = max_blocks > 0 ? max_blocks : 1;
+    max_segments_ = max_segments > 0 ? max_segments : 1;
+}
+
+QueueStats Queue::stats() const {
+    LockGuard<Spinlock> guard(lock_);
+    return stats_;
+}
+
+void Queue::reset_stats() {
+    LockGuard<Spinlock> guard(lock_);
+    stats_ = {};
+}
+
+void Queue::print() const {
+    QueueStats s = stats();
+    uint64_t avg = s.avg_blocks_x10();
+    cprintf("%-6s %8lu %8lu %6lu %6lu %4lu.%lu %6lu %4lu\n", dev_->name, s.submitted, s.dispatched, s.back_merges,
+            s.front_merges, avg / 10, avg % 10, s.expired, s.errors);
+}
+
+void Queue::insert(Request* req) {
+    LockGuard<Spinlock> guard(lock_);
+
+    if (try_merge(req)) {
+        return;
+    }
+
+    uint64_t expire = req->op == Op::Read ? READ_EXPIRE_NS : WRITE_EXPIRE_NS;
+    req->deadline_ns = clocksource::now_ns() + expire;
+    fifo(req->op).add_before(req->fifo_node);
+    add_sorted(req);
+    queued_++;
+}
+
+void Queue::run() {
+    while (true) {
+        Request* req{};
+        {
+            LockGuard<Spinlock> guard(lock_);
+            if (running_ || in_flight_ >= depth_) {
+                return;
+            }
+            req = pick();
+            if (!req) {
+                return;
+            }
+            running_ = true;
+            in_flight_++;
+            stats_.dispatched++;
+            stats_.blocks += req->merge_blocks;
+        }
+
+        // A synchronous driver completes the request in here; complete()
+        // sees running_ and leaves the next dispatch to this loop.
+        dev_->queue_rq(req);
+
+        LockGuard<Spinlock> guard(lock_);
+        running_ = false;
+    }
+}
+
+void Queue::complete(Request* req, Error err) {
+    {
+        LockGuard<Spinlock> guard(lock_);
+        in_flight_--;
+        if (err != Error::None) {
+            stats_.errors++;
+        }
+    }
+
+    req->end_chain(err);
+    run();
+}
+
+bool Queue::can_merge(const Request* head, const Request* req) const {
+    return head->op == req->op && head->merge_blocks + req->merge_blocks <= max_blocks_ &&
+           head->merge_segs + req->merge_segs <= max_segments_;
+}
+
+// Caller holds lock_.  `req` is a lone request, not yet queued.
+bool Queue::try_merge(Request* req) {
+    for (ListNode* node : sorted(req->op)) {
+        Request* head = from_sorted(node);
+
+        if (chain_end(head) == req->block && can_merge(head, req)) {
+            head->merge_last->merge_next = req;
+            head->merge_last = req;
+            head->merge_blocks += req->merge_blocks;
+            head->merge_segs += req->merge_segs;
+            stats_.back_merges++;
+            return true;
+        }
+
+        if (chain_end(req) == head->block && can_merge(head, req)) {
+            // `req` takes over the head's place in both lists, keeping the
+            // older deadline.
+            req->merge_next = head;
+            req->merge_last = head->merge_last;
+            req->merge_blocks += head->merge_blocks;
+            req->merge_segs += head->merge_segs;
+            req->deadline_ns = head->deadline_ns;
+            head->fifo_node.add_before(req->fifo_node);
+            head->fifo_node.unlink();
+            head->sort_node.add_before(req->sort_node);
+            head->sort_node.unlink();
+            if (next_ == head) {
+                next_ = req;
+            }
+            stats_.front_merges++;
+            return true;
+        }
+
+        if (head->block > req->block) {
+            break;
+        }
+    }
+    return false;
+}
+
+// Caller holds lock_.  Mostly ascending, so search from the tail.
+void Queue::add_sorted(Request* req) {
+    ListNode& list = sorted(req->op);
+    ListNode* pos = &list;
+    while (pos->get_prev() != &list && from_sorted(pos->get_prev())->block > req->block) {
+        pos = pos->get_prev();
+    }
+    pos->add_before(req->sort_node);
+}
+
+// Caller holds lock_.
+void Queue::remove(Request* req) {
+    ListNode& list = sorted(req->op);
+    ListNode* next = req->sort_node.get_next();
+    next_ = next != &list ? from_sorted(next) : nullptr;
+
+    req->fifo_node.unlink();
+    req->sort_node.unlink();
+    queued_--;
+}
+
+// Caller holds lock_.
+Request* Queue::pick() {
+    if (queued_ == 0) {
+        return nullptr;
+    }
+
+    Request* req{};
+    if (next_ && batch_ < FIFO_BATCH) {
+        req = next_;
+    } else {
+        bool reads = !fifo(Op::Read).empty();
+        bool writes = !fifo(Op::Write).empty();
+
+        Op op = Op::Write;
+        if (reads && (!writes || starved_ < WRITES_STARVED)) {
+            op = Op::Read;
+            starved_ = writes ? starved_ + 1 : 0;
+        } else {
+            starved_ = 0;
+        }
+
+        // Resume the sweep in this direction unless its oldest request is
+        // overdue.
+        Request* oldest = from_fifo(fifo(op).get_next());
+        bool overdue = clocksource::now_ns() >= oldest->deadline_ns;
+        if (next_ && next_->op == op && !overdue) {
+            req = next_;
+        } else {
+            req = oldest;
+            if (overdue) {
+                stats_.expired++;
+            }
+        }
+        batch_ = 0;
+    }
+
+    remove(req);
+    batch_++;
+    return req;
+}
+
+// ============================================================================
+// Plug
+// ============================================================================
+
+Plug::Plug() {
+    TaskStruct* task = sched::current();
+    if (task && !task->blk_plug) {
+        task->blk_plug = this;
+        active_ = true;
+    }
+}
+
+Plug::~Plug() {
+    if (!active_) {
+        return;
+    }
+    flush();
+    sched::current()->blk_plug = nullptr;
+}
+
+// Queue every held request, then dispatch: merging sees the whole burst.
+void Plug::flush() {
+    Queue* queues[BlockManager::MAX_DEV]{};
+    int nr_queues = 0;
+
+    while (!list_.empty()) {
+        Request* req = from_fifo(list_.get_next());
+        req->fifo_node.unlink();
+        req->queue->insert(req);
+
+        int i = 0;
+        while (i < nr_queues && queues[i] != req->queue) {
+            i++;
+        }
+        if (i == nr_queues && nr_queues < BlockManager::MAX_DEV) {
+            queues[nr_queues++] = req->queue;
+        }
+    }
+    held_ = 0;
+
+    for (int i = 0; i < nr_queues; i++) {
+        queues[i]->run();
+    }
+}
+
+void Plug::flush_current() {
+    Plug* plug = current_plug();
+    if (plug) {
+        plug->flush();
+    }
+}
+
+void Plug::hold(Request* req) {
+    list_.add_before(req->fifo_node);
+    if (++held_ >= MAX_HELD) {
+        flush();
+    }
+}
+
+// ============================================================================
+// Batch
+// ============================================================================
+
+Batch::Batch(BlockDevice* dev)
+    : dev_(dev), reqs_(static_cast<Request*>(kmalloc(PG_SIZE))), capacity_(reqs_ ? PG_SIZE / sizeof(Request) : 0) {}
+
+Batch::~Batch() {
+    static_cast<void>(finish());
+    kfree(reqs_);
+}
+
+Error Batch::add(Op op, uint32_t block, const void* buf, size_t count) {
+    if (!reqs_) {
+        return op == Op::Read ? dev_->read(block, const_cast<void*>(buf), count) : dev_->write(block, buf, count);
+    }
+    if (used_ == capacity_) {
+        TRY(finish());
+    }
+
+    Request* req = new (&reqs_[used_]) Request(op, block);
+    TRY(req->add_buffer(const_cast<void*>(buf), count * BLOCK_SIZE));
+    req->end_io = end_io;
+    req->private_data = this;
+    used_++;
+    return Error::None;
+}
+
+Error Batch::finish() {
+    if (used_ > 0) {
+        // One extra count until everything is submitted, so a request that
+        // completes inside submit() cannot signal done early.
+        __atomic_store_n(&pending_, used_ + 1, __ATOMIC_RELAXED);
+        {
+            Plug plug;
+            for (int i = 0; i < used_; i++) {
+                dev_->submit(&reqs_[i]);
+            }
+        }
+        Plug::flush_current();  // Under an outer plug, ours did not flush
+        if (__atomic_sub_fetch(&pending_, 1, __ATOMIC_ACQ_REL) == 0) {
+            waitq_.complete_all(done_);
+        }
+        waitq_.wait_for(done_);
+        done_ = false;
+        used_ = 0;
+    }
+
+    Error err = status_;
+    status_ = Error::None;
+    return err;
+}
+
+void Batch::end_io(Request* req) {
+    auto* batch = static_cast<Batch*>(req->private_data);
+    if (req->status != Error::None && batch->status_ == Error::None) {
+        batch->status_ = req->status;
+    }
+    if (__atomic_sub_fetch(&batch->pending_, 1, __ATOMIC_ACQ_REL) == 0) {
+        batch->waitq_.complete_all(batch->done_);
+    }
+}
+
+}  // namespace blk
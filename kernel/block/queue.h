@@ -0,0 +1,161 @@
+#pragma once
+
+#include <base/types.h>
+#include "lib/list.h"
+#include "lib/result.h"
+#include "lib/spinlock.h"
+#include "lib/waitqueue.h"
+#include "request.h"
+
+struct BlockDevice;
+
+// Per-device request queue between BlockDevice::submit() and the driver.
+//
+// Requests wait here, sorted by block, until the driver has room for them
+// (set_depth(); 1 for the synchronous drivers).  A new request that
+// continues a queued one on disk is merged into it instead, at the back or
+// the front, so the driver sees one larger transfer.
+//
+// Dispatch follows the deadline scheduler: reads and writes each keep a
+// FIFO of arrival order and a list in block order.  The queue sweeps one
+// direction in block order for up to FIFO_BATCH requests, prefers reads,
+// serves writes after WRITES_STARVED read batches, and restarts a sweep at
+// the oldest request once that request's deadline has passed.
+//
+// A Plug on the calling task holds its submissions back until the plug
+// goes away, so a burst of small requests reaches the queue together and
+// merges before anything is dispatched.
+
+namespace blk {
+
+struct QueueStats {
+    uint64_t submitted{};     // Requests from callers
+    uint64_t dispatched{};    // Requests handed to the driver, after merging
+    uint64_t back_merges{};   // Merged behind a queued request
+    uint64_t front_merges{};  // Merged in front of a queued request
+    uint64_t blocks{};        // Blocks dispatched
+    uint64_t expired{};       // Dispatched past their deadline
+    uint64_t errors{};        // Dispatched requests that failed
+
+    // Average dispatched request size, in tenths of a block.
+    [[nodiscard]] uint64_t avg_blocks_x10() const { return dispatched ? blocks * 10 / dispatched : 0; }
+};
+
+class Queue {
+public:
+    static constexpr uint64_t READ_EXPIRE_NS = 50ULL * 1000 * 1000;
+    static constexpr uint64_t WRITE_EXPIRE_NS = 500ULL * 1000 * 1000;
+    static constexpr int FIFO_BATCH = 16;
+    static constexpr int WRITES_STARVED = 2;
+
+    static constexpr uint32_t DEFAULT_MAX_BLOCKS = 256;  // 128 KB
+    static constexpr int DEFAULT_MAX_SEGMENTS = 64;
+
+    explicit Queue(BlockDevice* dev) : dev_(dev) {}
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    // Queue `req` (or hold it on the caller's plug) and dispatch what the
+    // driver has room for.
+    void submit(Request* req);
+
+    // Driver setup: requests in flight at once, and the largest merged
+    // request in blocks and segments.
+    void set_depth(int depth);
+    void set_limits(uint32_t max_blocks, int max_segments);
+
+    [[nodiscard]] QueueStats stats() const;
+    void reset_stats();
+    void print() const;
+
+private:
+    friend class Plug;
+    friend struct Request;
+
+    void insert(Request* req);  // Merge or queue; no dispatch
+    void run();                 // Dispatch while the driver has room
+    void complete(Request* req, Error err);
+
+    bool try_merge(Request* req);
+    void add_sorted(Request* req);
+    void remove(Request* req);
+    Request* pick();
+    [[nodiscard]] bool can_merge(const Request* head, const Request* req) const;
+
+    ListNode& fifo(Op op) { return fifo_[static_cast<int>(op)]; }
+    ListNode& sorted(Op op) { return sorted_[static_cast<int>(op)]; }
+
+    BlockDevice* dev_;
+    ListNode fifo_[2]{};
+    ListNode sorted_[2]{};
+    Request* next_{};  // Continues the current sweep
+    int batch_{};      // Requests dispatched in the current sweep
+    int starved_{};    // Read sweeps since writes were last served
+    int queued_{};
+    int in_flight_{};
+    int depth_{1};
+    bool running_{};  // Someone is in run()'s dispatch loop
+    uint32_t max_blocks_{DEFAULT_MAX_BLOCKS};
+    int max_segments_{DEFAULT_MAX_SEGMENTS};
+    QueueStats stats_{};
+    mutable Spinlock lock_{};
+};
+
+// Holds the current task's submissions until destroyed or flushed.  Nested
+// plugs leave the outermost in charge.  A plugged task must not sleep on
+// its own held requests: submit_wait() flushes first, and so should any
+// other wait.
+class Plug {
+public:
+    static constexpr int MAX_HELD = 32;  // Flush early beyond this
+
+    Plug();
+    ~Plug();
+
+    Plug(const Plug&) = delete;
+    Plug& operator=(const Plug&) = delete;
+
+    void flush();
+    static void flush_current();
+
+private:
+    friend class Queue;
+
+    void hold(Request* req);
+
+    ListNode list_{};
+    int held_{};
+    bool active_{};
+};
+
+// Several transfers in flight together under a plug and waited for as a
+// group: the way to let the queue merge a run of small adjacent requests.
+// Buffers must stay valid until finish().  Without memory for the requests
+// it degrades to synchronous transfers.
+class Batch {
+public:
+    explicit Batch(BlockDevice* dev);
+    ~Batch();
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    Error add(Op op, uint32_t block, const void* buf, size_t count);
+    // Submit everything added so far and wait for it; the first error.
+    [[nodiscard]] Error finish();
+
+private:
+    static void end_io(Request* req);
+
+    BlockDevice* dev_;
+    Request* reqs_{};
+    int capacity_{};
+    int used_{};
+    int pending_{};
+    Error status_{};
+    volatile bool done_{};
+    WaitQueue waitq_{};
+};
+
+}  // namespace blk
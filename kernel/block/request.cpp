@@ -0,0 +1,105 @@
+#include "request.h"
+#include "blk.h"
+
+#include "lib/waitqueue.h"
+#include "mm/pmm.h"
+
+#include <asm/page.h>
+
+namespace {
+
+struct SyncWait {
+    WaitQueue waitq{};
+    volatile bool done{};
+};
+
+void sync_end_io(blk::Request* req) {
+    auto* wait = static_cast<SyncWait*>(req->private_data);
+    wait->waitq.complete_all(wait->done);
+}
+
+}  // namespace
+
+namespace blk {
+
+uint8_t* Segment::kva() const {
+    return static_cast<uint8_t*>(pmm::page_to_kva(page)) + offset;
+}
+
+uintptr_t Segment::phys() const {
+    return pmm::page_to_phys(page) + offset;
+}
+
+Error Request::add_page(Page* page, uint32_t offset, uint32_t len) {
+    ENSURE(page && len > 0 && len % BLOCK_SIZE == 0, Error::Invalid);
+
+    if (nr_segs > 0) {
+        Segment& last = segs[nr_segs - 1];
+        if (last.kva() + last.len == static_cast<uint8_t*>(pmm::page_to_kva(page)) + offset) {
+            last.len += len;
+            count += len / BLOCK_SIZE;
+            return Error::None;
+        }
+    }
+
+    ENSURE(nr_segs < MAX_SEGMENTS, Error::NoMem);
+    segs[nr_segs++] = {page, offset, len};
+    count += len / BLOCK_SIZE;
+    return Error::None;
+}
+
+Error Request::add_buffer(void* buf, size_t len) {
+    ENSURE(buf && len <= __UINT32_MAX__, Error::Invalid);
+    uintptr_t offset = reinterpret_cast<uintptr_t>(buf) & PG_MASK;
+    return add_page(pmm::kva_to_page(buf), static_cast<uint32_t>(offset), static_cast<uint32_t>(len));
+}
+
+void Request::end(Error err) {
+    if (queue) {
+        queue->complete(this, err);
+    } else {
+        end_chain(err);
+    }
+}
+
+void Request::end_chain(Error err) {
+    Request* req = this;
+    while (req) {
+        Request* next = req->merge_next;  // end_io may free req
+        req->status = err;
+        if (req->end_io) {
+            req->end_io(req);
+        }
+        req = next;
+    }
+}
+
+uint32_t Request::total_blocks() const {
+    uint32_t total = 0;
+    for (const Request* req = this; req; req = req->merge_next) {
+        total += req->count;
+    }
+    return total;
+}
+
+int Request::total_segments() const {
+    int total = 0;
+    for (const Request* req = this; req; req = req->merge_next) {
+        total += req->nr_segs;
+    }
+    return total;
+}
+
+Error submit_wait(BlockDevice* dev, Request* req) {
+    ENSURE(dev && req && req->count > 0, Error::Invalid);
+
+    SyncWait wait{};
+    req->end_io = sync_end_io;
+    req->private_data = &wait;
+    dev->submit(req);
+    Plug::flush_current();
+    wait.waitq.wait_for(wait.done);
+    return req->status;
+}
+
+}  // namespace blk
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <base/types.h>
+#include "lib/list.h"
+#include "lib/result.h"
+
+struct BlockDevice;
+struct Page;
+
+// Asynchronous block I/O.
+//
+// A Request names a run of blocks and the memory they move to or from, as
+// a scatter-gather list of page segments.  BlockDevice::submit() starts it
+// and returns; the driver reports completion with end(), which runs the
+// caller's end_io callback from whatever context finished the transfer
+// (IRQ, workqueue, or submit() itself for a synchronous driver).  Callers
+// that want to block use submit_wait(), which sleeps on a WaitQueue.
+//
+// On its way to the driver a request may absorb others that continue it on
+// disk (queue.h): the driver then sees the head of a chain, walks every
+// segment of it with for_each_segment(), and ends the whole chain at once.
+
+namespace blk {
+
+class Queue;
+
+inline constexpr size_t BLOCK_SIZE = 512;
+
+enum class Op : uint8_t {
+    Read,
+    Write,
+};
+
+// `len` bytes at `offset` into `page`.  A segment may run on into the
+// following pages when they are physically contiguous (a multi-page kmalloc
+// block, a kernel stack); its length is a whole number of blocks.
+struct Segment {
+    Page* page{};
+    uint32_t offset{};
+    uint32_t len{};
+
+    [[nodiscard]] uint8_t* kva() const;
+    [[nodiscard]] uintptr_t phys() const;  // For DMA; contiguous for `len`
+};
+
+struct Request {
+    static constexpr int MAX_SEGMENTS = 16;
+
+    using EndIo = void (*)(Request* req);
+
+    Op op{Op::Read};
+    uint32_t block{};  // First block
+    uint32_t count{};  // Blocks, the sum of the segments
+    Segment segs[MAX_SEGMENTS]{};
+    int nr_segs{};
+
+    EndIo end_io{};         // Completion callback; owns the request from then on
+    void* private_data{};   // For end_io
+    Error status{};         // Set by end()
+
+    // Queue bookkeeping (queue.cpp)
+    Queue* queue{};           // Set by submit()
+    ListNode fifo_node{};     // Arrival order; the plug list before that
+    ListNode sort_node{};     // Block order
+    uint64_t deadline_ns{};   // Dispatch by this time
+    Request* merge_next{};    // Next request of the chain
+    Request* merge_last{};    // Last request of the chain (head only)
+    uint32_t merge_blocks{};  // Blocks in the whole chain (head only)
+    int merge_segs{};         // Segments in the whole chain (head only)
+
+    Request() = default;
+    Request(Op req_op, uint32_t first_block) : op(req_op), block(first_block) {}
+
+    // Append a segment; merged into the previous one when it continues it.
+    Error add_page(Page* page, uint32_t offset, uint32_t len);
+    // Append a buffer in the kernel's direct map (heap, stack or image).
+    Error add_buffer(void* buf, size_t len);
+
+    // Driver side: record the outcome and run end_io for every request of
+    // the chain.  The driver must not touch them afterwards.
+    void end(Error err);
+
+    // Blocks and segments from here to the end of the chain.
+    [[nodiscard]] uint32_t total_blocks() const;
+    [[nodiscard]] int total_segments() const;
+
+    // Run fn(block, kva, block_count) over the segments of the chain in
+    // order, stopping at the first error: for drivers that move one
+    // contiguous buffer at a time.
+    template<typename Fn>
+    Error for_each_segment(Fn&& fn) const {
+        uint32_t next = block;
+        for (const Request* req = this; req; req = req->merge_next) {
+            for (int i = 0; i < req->nr_segs; i++) {
+                size_t blocks = req->segs[i].len / BLOCK_SIZE;
+                TRY(fn(next, req->segs[i].kva(), blocks));
+                next += static_cast<uint32_t>(blocks);
+            }
+        }
+        return Error::None;
+    }
+
+private:
+    friend class Queue;
+
+    void end_chain(Error err);
+};
+
+// Submit `req` and sleep until it completes; returns its status.  Takes
+// over end_io and private_data, and flushes the caller's plug first.
+Error submit_wait(BlockDevice* dev, Request* req);
+
+}  // namespace blk
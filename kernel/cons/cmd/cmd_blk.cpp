@@ -1,5 +1,6 @@
 #include "cmd.h"
 
+#include "block/bcache.h"
 #include "block/blk.h"
 #include "fs/vfs.h"
 #include "lib/memory.h"
@@ -76,6 +77,36 @@ static void cmd_hdparm(int argc, char** argv) {
     }
 }
 
+static void cmd_iostat(int argc, char** argv) {
+    bool reset = argc > 1 && strcmp(argv[1], "-r") == 0;
+
+    cprintf("DEVICE REQUESTS DISPATCH BMERGE FMERGE AVGBLK EXPIRE ERRS\n");
+    for (int i = 0; i < BlockManager::get_device_count(); i++) {
+        BlockDevice* dev = BlockManager::get_device(i);
+        if (!dev) {
+            continue;
+        }
+        dev->queue.print();
+        if (reset) {
+            dev->queue.reset_stats();
+        }
+    }
+}
+
+static void cmd_bcache(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+        Error err = bcache::flush(nullptr);
+        if (err != Error::None) {
+            cprintf("bcache: flush failed: %s\n", error_str(err));
+        }
+    }
+
+    bcache::print();
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        bcache::reset_stats();
+    }
+}
+
 static void cmd_dd(int argc, char** argv) {
     static_cast<void>(argc);
     static_cast<void>(argv);
@@ -174,6 +205,8 @@ static void cmd_info(int argc, char** argv) {
 void register_blk_commands() {
     shell::register_command("lsblk", "List block devices", cmd_lsblk);
     shell::register_command("hdparm", "Show disk information", cmd_hdparm);
+    shell::register_command("iostat", "Show block queue statistics (usage: iostat [-r])", cmd_iostat);
+    shell::register_command("bcache", "Show buffer cache statistics (usage: bcache [-r|-f])", cmd_bcache);
     shell::register_command("dd", "Disk dump/copy (info only)", cmd_dd);
     shell::register_command("mount", "Mount device to /mnt (usage: mount <device>)", cmd_mount);
     shell::register_command("umount", "Unmount /mnt", cmd_umount);
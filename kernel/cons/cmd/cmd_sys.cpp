@@ -3,11 +3,14 @@
 #include "cons/cons.h"
 #include "exec/exec.h"
 #include "fs/vfs.h"
+#include "lib/lockstat.h"
 #include "lib/result.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
 #include "mm/vmm.h"
 #include "sched/sched.h"
+#include "sched/sched_trace.h"
+#include "time/clocksource.h"
 
 #include <kernel/sysinfo.h>
 #include "lib/cons_defs.h"
@@ -57,6 +60,60 @@ static void cmd_schedstat(int argc, char** argv) {
     static_cast<void>(argc);
     static_cast<void>(argv);
     sched::print_stats();
+    cprintf("\n");
+    sched::print_acct();
+}
+
+static void cmd_schedtrace(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "clear") == 0) {
+        sched_trace::reset();
+        cprintf("schedtrace: cleared\n");
+        return;
+    }
+    if (argc >= 2) {
+        cprintf("Usage: schedtrace [clear]\n");
+        return;
+    }
+    sched_trace::dump();
+}
+
+// Decimal argument; -1 if `str` is not a non-negative number.
+static int parse_count(const char* str) {
+    int val = 0;
+    if (*str == '\0') {
+        return -1;
+    }
+    for (; *str; str++) {
+        if (*str < '0' || *str > '9' || val > 100000) {
+            return -1;
+        }
+        val = val * 10 + (*str - '0');
+    }
+    return val;
+}
+
+static void cmd_lockstat(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        lockstat::reset();
+        cprintf("lockstat: reset\n");
+        return;
+    }
+
+    int top_n = lockstat::DEFAULT_TOP;
+    if (argc >= 2) {
+        top_n = parse_count(argv[1]);
+        if (top_n <= 0) {
+            cprintf("Usage: lockstat [N|reset]\n");
+            return;
+        }
+    }
+    lockstat::print(top_n);
+}
+
+static void cmd_uptime(int argc, char** argv) {
+    static_cast<void>(argc);
+    static_cast<void>(argv);
+    clocksource::print();
 }
 
 static void cmd_exec(int argc, char** argv) {
@@ -114,7 +171,10 @@ void register_sys_commands() {
     shell::register_command("clear", "Clear the screen", cmd_clear);
     shell::register_command("uname", "Print system information (-a for all)", cmd_uname);
     shell::register_command("ps", "List all processes", cmd_ps);
-    shell::register_command("schedstat", "Show scheduler statistics", cmd_schedstat);
+    shell::register_command("schedstat", "Show scheduler statistics and per-task CPU accounting", cmd_schedstat);
+    shell::register_command("schedtrace", "Dump sched_switch/sched_wakeup trace (clear to reset)", cmd_schedtrace);
+    shell::register_command("lockstat", "Show the top-N contended lock classes (reset to clear)", cmd_lockstat);
+    shell::register_command("uptime", "Show clocksource and time since boot", cmd_uptime);
     shell::register_command("exec", "Run ELF binary (usage: exec <file> [/mnt])", cmd_exec);
 }
 
@@ -1,4 +1,5 @@
 #include "intr.h"
+#include "sched/preempt.h"
 
 #include <asm/arch.h>
 
@@ -28,8 +29,12 @@ static inline void restore_impl(int flag) {
     }
 }
 
-Guard::Guard() : flag_(save_impl()) {}
+Guard::Guard() : flag_(save_impl()) {
+    preempt::disable();
+}
+
 Guard::~Guard() {
+    preempt::enable();
     restore_impl(flag_);
 }
 
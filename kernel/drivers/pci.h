@@ -26,8 +26,12 @@ inline constexpr uint16_t CMD_BUS_MASTER = 0x0004;
 inline constexpr uint16_t CMD_INTX_DISABLE = 0x0400;
 
 inline constexpr uint8_t CLASS_MASS_STORAGE = 0x01;
+inline constexpr uint8_t SUBCLASS_IDE = 0x01;
+inline constexpr uint8_t INTERFACE_IDE_BUS_MASTER = 0x80;  // Prog-if bit: bus-master DMA
 inline constexpr uint8_t SUBCLASS_SATA = 0x06;
 inline constexpr uint8_t INTERFACE_AHCI = 0x01;
+inline constexpr uint8_t SUBCLASS_NVM = 0x08;
+inline constexpr uint8_t INTERFACE_NVME = 0x02;
 
 inline constexpr uint8_t CLASS_SYSTEM_PERIPHERAL = 0x08;
 inline constexpr uint8_t SUBCLASS_SD_HOST = 0x05;
@@ -0,0 +1,84 @@
+#include "ramdisk.h"
+#include "lib/memory.h"
+#include "lib/stdio.h"
+#include "lib/string.h"
+#include "mm/pmm.h"
+#include <asm/mmu.h>
+#include <kernel/bootinfo.h>
+
+extern struct BootInfo __kernel_boot_info;
+
+namespace {
+
+RamDisk s_ram0{};
+bool s_registered{};
+
+}  // namespace
+
+Error RamDisk::init(uint8_t* base, uint32_t blocks, bool image) {
+    ENSURE(base && blocks > 0, Error::Invalid);
+
+    base_ = base;
+    image_ = image;
+    size = blocks;
+    type = blk::DeviceType::Disk;
+    strncpy(name, "ram0", sizeof(name) - 1);
+    return Error::None;
+}
+
+void RamDisk::print_info() {
+    cprintf("Device: %s (ramdisk, %s)\n", name, image_ ? "boot image" : "blank");
+    cprintf("  Size: %d sectors (%d MB) at [0x%p]\n", size, size / 2048, base_);
+    cprintf("\n");
+}
+
+void RamDisk::queue_rq(blk::Request* req) {
+    bool write = req->op == blk::Op::Write;
+    Error err = req->for_each_segment([&](uint32_t block, uint8_t* buf, size_t count) {
+        ENSURE(block <= size && count <= size - block, Error::IO);
+
+        uint8_t* disk = base_ + static_cast<size_t>(block) * SIZE;
+        memcpy(write ? disk : buf, write ? buf : disk, count * SIZE);
+        return Error::None;
+    });
+    req->end(err);
+}
+
+namespace ramdisk {
+
+int init() {
+    if (s_registered) {
+        return 0;
+    }
+
+    const BootInfo* bi = &::__kernel_boot_info;
+    uint32_t image_blocks = static_cast<uint32_t>(bi->ramdisk_size / BlockDevice::SIZE);
+
+    Error err{};
+    if (bi->ramdisk_addr != 0 && image_blocks > 0) {
+        err = s_ram0.init(phys_to_virt<uint8_t>(bi->ramdisk_addr), image_blocks, true);
+    } else {
+        auto* base = static_cast<uint8_t*>(kmalloc(DEFAULT_BLOCKS * BlockDevice::SIZE));
+        if (!base) {
+            cprintf("ramdisk: no memory for %d blocks\n", DEFAULT_BLOCKS);
+            return -1;
+        }
+        memset(base, 0, DEFAULT_BLOCKS * BlockDevice::SIZE);
+        err = s_ram0.init(base, DEFAULT_BLOCKS, false);
+    }
+    if (err != Error::None) {
+        return -1;
+    }
+
+    blk::register_device(&s_ram0);
+    s_registered = true;
+    cprintf("blk: registered ramdisk '%s' (%d sectors, %s)\n", s_ram0.name, s_ram0.size,
+            s_ram0.has_image() ? "boot image" : "blank");
+    return 0;
+}
+
+RamDisk* device() {
+    return s_registered ? &s_ram0 : nullptr;
+}
+
+}  // namespace ramdisk
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <base/types.h>
+#include "block/blk.h"
+#include "lib/result.h"
+
+namespace ramdisk {
+
+inline constexpr uint32_t DEFAULT_BLOCKS = 8192;  // 4 MB when the loader passed no image
+
+}  // namespace ramdisk
+
+// A block device in kernel memory; a transfer is a memcpy() in queue_rq().
+// It holds the image the loader placed in memory, or starts out zeroed.
+class RamDisk : public BlockDevice {
+public:
+    Error init(uint8_t* base, uint32_t blocks, bool image);
+    void print_info() override;
+
+    [[nodiscard]] bool has_image() const { return image_; }
+
+private:
+    void queue_rq(blk::Request* req) override;
+
+    uint8_t* base_{};
+    bool image_{};  // base_ is the loader's image, not kmalloc()
+};
+
+namespace ramdisk {
+
+// Create ram0 from BootInfo's image, or blank, and register it.
+int init();
+
+// ram0, or nullptr before init() or without memory for it.
+RamDisk* device();
+
+}  // namespace ramdisk
@@ -1,13 +1,21 @@
 #include "sdhci.h"
+#include "drivers/intr.h"
 #include "drivers/mmio.h"
 #include "drivers/pci.h"
+#include "lib/math.h"
+#include "lib/memory.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
+#include "mm/pmm.h"
 #include "mm/vmm.h"
+#include "time/clocksource.h"
+#include <asm/arch.h>
+#include <asm/mmu.h>
 #include <asm/page.h>
 
 namespace reg {
 
+constexpr uint32_t ARGUMENT2 = 0x00;   // Auto CMD23 block count
 constexpr uint32_t BLOCK_SIZE = 0x04;  // lower 16: block size; upper 16: block count
 constexpr uint32_t BLOCK_COUNT = 0x06;
 constexpr uint32_t ARGUMENT = 0x08;
@@ -16,6 +24,7 @@ constexpr uint32_t COMMAND = 0x0E;
 constexpr uint32_t RESPONSE0 = 0x10;
 constexpr uint32_t BUF_DATA = 0x20;
 constexpr uint32_t PRESENT_STATE = 0x24;
+constexpr uint32_t HOST_CTRL = 0x28;
 constexpr uint32_t POWER_CTRL = 0x29;
 constexpr uint32_t CLOCK_CTRL = 0x2C;
 constexpr uint32_t TIMEOUT_CTRL = 0x2E;
@@ -26,6 +35,10 @@ constexpr uint32_t INT_ENABLE = 0x34;
 constexpr uint32_t ERR_ENABLE = 0x36;
 constexpr uint32_t INT_SIGNAL = 0x38;
 constexpr uint32_t ERR_SIGNAL = 0x3A;
+constexpr uint32_t AUTO_CMD_ERR = 0x3C;
+constexpr uint32_t CAPABILITIES = 0x40;
+constexpr uint32_t ADMA_ERR = 0x54;
+constexpr uint32_t ADMA_ADDR = 0x58;
 constexpr uint32_t HOST_VERSION = 0xFE;
 
 }  // namespace reg
@@ -44,6 +57,17 @@ constexpr uint16_t CLK_INT_STABLE = (1U << 1);
 constexpr uint16_t CLK_SD_EN = (1U << 2);
 
 constexpr uint8_t RST_ALL = (1U << 0);
+constexpr uint8_t RST_CMD = (1U << 1);
+constexpr uint8_t RST_DAT = (1U << 2);
+
+constexpr uint8_t HOST_BUS_4BIT = (1U << 1);
+constexpr uint8_t HOST_DMA_ADMA2 = (2U << 3);  // 32-bit ADMA2
+constexpr uint8_t HOST_DMA_MASK = (3U << 3);
+
+constexpr uint32_t CAP_BASE_CLK_SHIFT = 8;  // MHz; 6 bits before 3.00, 8 after
+constexpr uint32_t CAP_ADMA2 = (1U << 19);
+
+constexpr uint8_t SPEC_300 = 2;  // HOST_VERSION[7:0]
 
 constexpr uint8_t PWR_ON = (1U << 0);
 constexpr uint8_t PWR_3V3 = (7U << 1);  // 3.3V
@@ -56,7 +80,18 @@ constexpr uint16_t CMD_CRC_EN = 0x08;
 constexpr uint16_t CMD_IDX_EN = 0x10;
 constexpr uint16_t CMD_DATA = 0x20;
 
+constexpr uint16_t XFER_DMA = (1U << 0);
+constexpr uint16_t XFER_BLK_CNT = (1U << 1);
+constexpr uint16_t XFER_AUTO_CMD12 = (1U << 2);
+constexpr uint16_t XFER_AUTO_CMD23 = (2U << 2);
 constexpr uint16_t XFER_READ = (1U << 4);
+constexpr uint16_t XFER_MULTI = (1U << 5);
+
+constexpr uint16_t ADMA_VALID = (1U << 0);
+constexpr uint16_t ADMA_END = (1U << 1);
+constexpr uint16_t ADMA_ACT_TRAN = (2U << 4);
+constexpr uint32_t ADMA_MAX_LEN = 0x10000;
+constexpr int ADMA_DESCRIPTORS = static_cast<int>(PG_SIZE / sizeof(AdmaDesc));
 
 constexpr uint8_t SD_CMD0_GO_IDLE = 0;
 constexpr uint8_t SD_CMD2_ALL_CID = 2;
@@ -66,9 +101,17 @@ constexpr uint8_t SD_CMD8_SEND_IF = 8;
 constexpr uint8_t SD_CMD9_SEND_CSD = 9;
 constexpr uint8_t SD_CMD16_SET_BLKLEN = 16;
 constexpr uint8_t SD_CMD17_READ = 17;
+constexpr uint8_t SD_CMD18_READ_MULTI = 18;
 constexpr uint8_t SD_CMD24_WRITE = 24;
+constexpr uint8_t SD_CMD25_WRITE_MULTI = 25;
 constexpr uint8_t SD_CMD55_APP = 55;
+constexpr uint8_t SD_ACMD6_BUS_WIDTH = 6;
 constexpr uint8_t SD_ACMD41_OP_COND = 41;
+constexpr uint8_t SD_ACMD51_SEND_SCR = 51;
+
+constexpr uint32_t ACMD6_BUS_4BIT = 2;
+constexpr uint8_t SCR_BUS_4BIT = (1U << 2);  // SCR byte 1: SD_BUS_WIDTHS
+constexpr uint8_t SCR_CMD23 = (1U << 1);     // SCR byte 3: CMD_SUPPORT
 
 constexpr uint32_t ACMD41_HCS = (1U << 30);      // Host Capacity Support (SDHC)
 constexpr uint32_t ACMD41_VOLTAGE = 0x00FF8000;  // 2.7-3.6V
@@ -78,6 +121,17 @@ constexpr uint32_t OCR_CCS = (1U << 30);   // Card Capacity Status (SDHC)
 
 constexpr int CMD_TIMEOUT_US = 1000000;  // 1 second in busy-loop iterations
 constexpr int ACMD41_RETRIES = 100;
+constexpr uint64_t XFER_TIMEOUT_US = 5000000;  // DMA transfer, polled
+constexpr uint32_t IDENT_CLOCK_KHZ = 400;
+constexpr uint32_t DEFAULT_SPEED_KHZ = 25000;
+
+namespace {
+
+void complete_work(Work* work) {
+    static_cast<SdDevice*>(work->data)->complete();
+}
+
+}  // namespace
 
 Error SdDevice::reset() {
     mmio::write8(base_, reg::SW_RESET, RST_ALL);
@@ -91,13 +145,47 @@ Error SdDevice::reset() {
     return Error::Timeout;
 }
 
-Error SdDevice::clock_setup() {
+// Clear the command and data state machines after a failed transfer.
+Error SdDevice::reset_lines() {
+    mmio::write8(base_, reg::SW_RESET, RST_CMD | RST_DAT);
+
+    for (int i = 0; i < CMD_TIMEOUT_US; i++) {
+        if ((mmio::read8(base_, reg::SW_RESET) & (RST_CMD | RST_DAT)) == 0)
+            return Error::None;
+    }
+
+    cprintf("sdhci: line reset timeout\n");
+    return Error::Timeout;
+}
+
+// SD clock = base / (2 * N), N = 0 passing the base clock through.  Before
+// 3.00 N is 8 bits and a power of two; from 3.00 it is any 10-bit value.
+Error SdDevice::clock_setup(uint32_t khz) {
+    uint32_t caps = mmio::read32(base_, reg::CAPABILITIES);
+    uint32_t base_khz = ((caps >> CAP_BASE_CLK_SHIFT) & (v3_ ? 0xFF : 0x3F)) * 1000;
+    if (base_khz == 0) {
+        base_khz = 50000;  // Unspecified: assume the common 50 MHz
+    }
+
+    uint32_t div = 0;
+    if (base_khz > khz) {
+        div = (base_khz + 2 * khz - 1) / (2 * khz);
+        if (v3_) {
+            div = min(div, 0x3FFU);
+        } else {
+            uint32_t pow2 = 1;
+            while (pow2 < div && pow2 < 0x80) {
+                pow2 <<= 1;
+            }
+            div = pow2;
+        }
+    }
+    clock_khz_ = div ? base_khz / (2 * div) : base_khz;
+
     // Disable clock first
     mmio::write16(base_, reg::CLOCK_CTRL, 0);
 
-    // Use divider 128 (0x40 in upper byte → actual divider = 2 * 0x40 = 128)
-    // This gives roughly 400 kHz from a typical 50 MHz base clock
-    uint16_t clk = (0x40 << 8) | CLK_INT_EN;
+    uint16_t clk = static_cast<uint16_t>((div & 0xFF) << 8 | ((div >> 8) & 0x3) << 6 | CLK_INT_EN);
     mmio::write16(base_, reg::CLOCK_CTRL, clk);
 
     // Wait for internal clock stable
@@ -122,14 +210,20 @@ Error SdDevice::power_on() {
     mmio::write16(base_, reg::INT_ENABLE, 0xFFFF);
     mmio::write16(base_, reg::ERR_ENABLE, 0xFFFF);
 
-    // Disable interrupt signals (we poll)
-    mmio::write16(base_, reg::INT_SIGNAL, 0);
-    mmio::write16(base_, reg::ERR_SIGNAL, 0);
+    // Commands are polled; signals are raised only for a DMA transfer
+    // that completes by interrupt.
+    set_signals(false);
 
     return Error::None;
 }
 
-Error SdDevice::send_cmd(uint8_t index, uint32_t arg, uint16_t flags) {
+void SdDevice::set_signals(bool on) {
+    mmio::write16(base_, reg::INT_SIGNAL, on ? INT_XFER_DONE : 0);
+    mmio::write16(base_, reg::ERR_SIGNAL, on ? 0xFFFF : 0);
+}
+
+// Start a command without waiting for its response.
+Error SdDevice::issue_cmd(uint8_t index, uint32_t arg, uint16_t flags) {
     int wait_time{};
 
     for (wait_time = 0; wait_time < CMD_TIMEOUT_US; wait_time++) {
@@ -160,9 +254,20 @@ Error SdDevice::send_cmd(uint8_t index, uint32_t arg, uint16_t flags) {
     uint16_t cmd_val = (static_cast<uint16_t>(index) << 8) | flags;
     mmio::write16(base_, reg::COMMAND, cmd_val);
 
+    return Error::None;
+}
+
+Error SdDevice::send_cmd(uint8_t index, uint32_t arg, uint16_t flags) {
+    TRY(issue_cmd(index, arg, flags));
     return wait_cmd_done();
 }
 
+Error SdDevice::send_app_cmd(uint8_t index, uint32_t arg, uint16_t flags) {
+    TRY_LOG(send_cmd(SD_CMD55_APP, static_cast<uint32_t>(rca_) << 16, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN),
+            "sdhci: CMD55 failed");
+    return send_cmd(index, arg, flags);
+}
+
 Error SdDevice::wait_cmd_done() {
     for (int i = 0; i < CMD_TIMEOUT_US; i++) {
         uint16_t status = mmio::read16(base_, reg::INT_STATUS);
@@ -301,115 +406,358 @@ Error SdDevice::card_identify() {
     return Error::None;
 }
 
-Error SdDevice::read_single(uint32_t lba, void* buf) {
-    uint32_t addr = sdhc_ ? lba : lba * 512;
+// SCR (ACMD51): the bus widths and optional commands the card supports.
+// Its 8 bytes arrive most significant first.
+Error SdDevice::read_scr() {
+    alignas(4) uint8_t scr[8]{};
 
-    mmio::write16(base_, reg::BLOCK_SIZE, 512);
+    mmio::write16(base_, reg::BLOCK_SIZE, sizeof(scr));
     mmio::write16(base_, reg::BLOCK_COUNT, 1);
-
     mmio::write16(base_, reg::XFER_MODE, XFER_READ);
 
-    TRY(send_cmd(SD_CMD17_READ, addr, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN | CMD_DATA));
+    TRY(send_app_cmd(SD_ACMD51_SEND_SCR, 0, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN | CMD_DATA));
+    TRY(pio_data(scr, sizeof(scr), 1, false));
+    TRY(wait_xfer_done());
 
-    for (int i = 0; i < CMD_TIMEOUT_US; i++) {
-        uint16_t status = mmio::read16(base_, reg::INT_STATUS);
-        if (status & INT_ERROR) {
-            cprintf("sdhci: read data error\n");
-            return Error::IO;
-        }
-        if (status & INT_BUF_RD_READY) {
-            mmio::write16(base_, reg::INT_STATUS, INT_BUF_RD_READY);
-            break;
-        }
-        if (i == CMD_TIMEOUT_US - 1) {
-            cprintf("sdhci: read buffer ready timeout\n");
-            return Error::Timeout;
-        }
-    }
-
-    auto* dst = static_cast<uint32_t*>(buf);
-    for (int i = 0; i < 128; i++) {
-        dst[i] = mmio::read32(base_, reg::BUF_DATA);
-    }
-
-    return wait_xfer_done();
+    bus4_ = (scr[1] & SCR_BUS_4BIT) != 0;
+    cmd23_ = v3_ && (scr[3] & SCR_CMD23) != 0;
+    return Error::None;
 }
 
-Error SdDevice::write_single(uint32_t lba, const void* buf) {
-    uint32_t addr = sdhc_ ? lba : lba * 512;
+// ADMA2 needs the capability and a descriptor table in 32-bit reach.
+void SdDevice::setup_dma() {
+    if (!(mmio::read32(base_, reg::CAPABILITIES) & CAP_ADMA2)) {
+        return;
+    }
 
-    mmio::write16(base_, reg::BLOCK_SIZE, 512);
-    mmio::write16(base_, reg::BLOCK_COUNT, 1);
+    auto* table = static_cast<AdmaDesc*>(kmalloc(PG_SIZE));
+    if (!table) {
+        return;
+    }
+    if (virt_to_phys(table) + PG_SIZE > 0x100000000ULL) {
+        kfree(table);
+        return;
+    }
 
-    mmio::write16(base_, reg::XFER_MODE, 0);
+    adma_ = table;
+    uint8_t host = mmio::read8(base_, reg::HOST_CTRL);
+    mmio::write8(base_, reg::HOST_CTRL, (host & ~HOST_DMA_MASK) | HOST_DMA_ADMA2);
 
-    TRY(send_cmd(SD_CMD24_WRITE, addr, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN | CMD_DATA));
+    work_.fn = complete_work;
+    work_.data = this;
+}
 
-    for (int i = 0; i < CMD_TIMEOUT_US; i++) {
-        uint16_t status = mmio::read16(base_, reg::INT_STATUS);
-        if (status & INT_ERROR) {
-            cprintf("sdhci: write data error\n");
-            return Error::IO;
-        }
-        if (status & INT_BUF_WR_READY) {
-            mmio::write16(base_, reg::INT_STATUS, INT_BUF_WR_READY);
-            break;
+// Move `blocks` blocks of `block_bytes` through the buffer data port.
+Error SdDevice::pio_data(void* buf, size_t block_bytes, size_t blocks, bool write) {
+    uint16_t ready = write ? INT_BUF_WR_READY : INT_BUF_RD_READY;
+    auto* words = static_cast<uint32_t*>(buf);
+
+    for (size_t b = 0; b < blocks; b++) {
+        for (int i = 0; i < CMD_TIMEOUT_US; i++) {
+            uint16_t status = mmio::read16(base_, reg::INT_STATUS);
+            if (status & INT_ERROR) {
+                cprintf("sdhci: %s data error\n", write ? "write" : "read");
+                return Error::IO;
+            }
+            if (status & ready) {
+                mmio::write16(base_, reg::INT_STATUS, ready);
+                break;
+            }
+            if (i == CMD_TIMEOUT_US - 1) {
+                cprintf("sdhci: %s buffer ready timeout\n", write ? "write" : "read");
+                return Error::Timeout;
+            }
         }
-        if (i == CMD_TIMEOUT_US - 1) {
-            cprintf("sdhci: write buffer ready timeout\n");
-            return Error::Timeout;
+
+        for (size_t i = 0; i < block_bytes / 4; i++) {
+            if (write) {
+                mmio::write32(base_, reg::BUF_DATA, *words++);
+            } else {
+                *words++ = mmio::read32(base_, reg::BUF_DATA);
+            }
         }
     }
+    return Error::None;
+}
 
-    auto const* src = static_cast<const uint32_t*>(buf);
-    for (int i = 0; i < 128; i++) {
-        mmio::write32(base_, reg::BUF_DATA, src[i]);
+// One CMD17/CMD24, or CMD18/CMD25 closed by auto CMD12, through the buffer
+// data port.
+Error SdDevice::pio_transfer(uint32_t lba, void* buf, size_t count, bool write) {
+    uint32_t addr = sdhc_ ? lba : lba * 512;
+    uint16_t mode = write ? 0 : XFER_READ;
+    uint8_t cmd = write ? SD_CMD24_WRITE : SD_CMD17_READ;
+    if (count > 1) {
+        mode |= XFER_BLK_CNT | XFER_MULTI | XFER_AUTO_CMD12;
+        cmd = write ? SD_CMD25_WRITE_MULTI : SD_CMD18_READ_MULTI;
     }
 
-    return wait_xfer_done();
+    mmio::write16(base_, reg::BLOCK_SIZE, 512);
+    mmio::write16(base_, reg::BLOCK_COUNT, static_cast<uint16_t>(count));
+    mmio::write16(base_, reg::XFER_MODE, mode);
+
+    Error err = send_cmd(cmd, addr, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN | CMD_DATA);
+    if (err == Error::None) {
+        err = pio_data(buf, 512, count, write);
+    }
+    if (err == Error::None) {
+        err = wait_xfer_done();
+    }
+    if (err != Error::None) {
+        static_cast<void>(reset_lines());
+    }
+    return err;
 }
 
-Error SdDevice::init(volatile uint8_t* base, int index) {
+Error SdDevice::init(volatile uint8_t* base, int index, int irq) {
     base_ = base;
 
     uint16_t ver = mmio::read16(base_, reg::HOST_VERSION);
     cprintf("sdhci: controller version %d.%02d\n", (ver >> 8) + 1, ver & 0xFF);
+    v3_ = (ver & 0xFF) >= SPEC_300;
 
     TRY(reset());
-    TRY(clock_setup());
+    TRY(clock_setup(IDENT_CLOCK_KHZ));
     TRY(power_on());
     TRY(card_identify());
 
+    if (read_scr() != Error::None) {
+        cprintf("sdhci: SCR unreadable, staying on a 1-bit bus\n");
+        static_cast<void>(reset_lines());
+    }
+    if (bus4_ &&
+        send_app_cmd(SD_ACMD6_BUS_WIDTH, ACMD6_BUS_4BIT, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN) == Error::None) {
+        mmio::write8(base_, reg::HOST_CTRL, mmio::read8(base_, reg::HOST_CTRL) | HOST_BUS_4BIT);
+    } else {
+        bus4_ = false;
+    }
+    TRY(clock_setup(DEFAULT_SPEED_KHZ));
+
+    setup_dma();
+    irq_ = adma_ ? irq : -1;
+
     type = blk::DeviceType::Disk;
     name[0] = 's';
     name[1] = 'd';
     name[2] = static_cast<char>('0' + index);
     name[3] = '\0';
 
-    cprintf("sdhci: SD card initialized as '%s'\n", name);
+    cprintf("sdhci: SD card initialized as '%s' (%u kHz, %d-bit, %s)\n", name, clock_khz_, bus4_ ? 4 : 1,
+            adma_ ? (cmd23_ ? "ADMA2, auto CMD23" : "ADMA2, auto CMD12") : "PIO");
     return Error::None;
 }
 
-Error SdDevice::read(uint32_t block_number, void* buf, size_t block_count) {
-    auto* p = static_cast<uint8_t*>(buf);
-    for (size_t i = 0; i < block_count; i++) {
-        if (read_single(block_number + i, p + i * 512) != Error::None)
-            return Error::IO;
+// A chain goes out as one DMA command when ADMA2 can describe it: 32-bit
+// dword-aligned segments that fit the descriptor table.  Otherwise each
+// segment is one polled PIO command.
+void SdDevice::queue_rq(blk::Request* req) {
+    bool write = req->op == blk::Op::Write;
+    uint32_t total = req->total_blocks();
+
+    if (req->block + total > size) {
+        cprintf("sdhci: %s out of range (block %d + %d > %d)\n", name, req->block, total, size);
+        req->end(Error::Invalid);
+        return;
     }
-    return Error::None;
+
+    if (dma_reachable(req)) {
+        start_dma(req);
+        if (polled()) {
+            poll();
+        }
+        return;
+    }
+
+    req->end(req->for_each_segment([&](uint32_t block, uint8_t* buf, size_t count) {
+        return pio_transfer(block, buf, count, write);
+    }));
 }
 
-Error SdDevice::write(uint32_t block_number, const void* buf, size_t block_count) {
-    auto const* p = static_cast<const uint8_t*>(buf);
-    for (size_t i = 0; i < block_count; i++) {
-        if (write_single(block_number + i, p + i * 512) != Error::None)
-            return Error::IO;
+bool SdDevice::polled() const {
+    // Early boot mounts the root filesystem before interrupts and the
+    // completion workqueue are running.
+    return irq_ < 0 || !arch_irq_is_enabled() || !workqueue::system().worker();
+}
+
+bool SdDevice::dma_reachable(const blk::Request* req) const {
+    if (!adma_ || req->total_blocks() > 0xFFFF) {
+        return false;
+    }
+
+    int descs = 0;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            uint64_t phys = r->segs[i].phys();
+            uint32_t len = r->segs[i].len;
+            if ((phys & 3) || (len & 3) || phys + len > 0x100000000ULL) {
+                return false;
+            }
+            descs += static_cast<int>((len + ADMA_MAX_LEN - 1) / ADMA_MAX_LEN);
+        }
+    }
+    return descs <= ADMA_DESCRIPTORS;
+}
+
+// Describe the chain in the ADMA2 table and issue CMD18/CMD25 (CMD17/CMD24
+// for a single block).  The transfer ends with INT_XFER_DONE once the auto
+// CMD12 has stopped the card, or straight after the last block with
+// auto CMD23.
+void SdDevice::start_dma(blk::Request* req) {
+    bool write = req->op == blk::Op::Write;
+    uint32_t count = req->total_blocks();
+
+    int n = 0;
+    for (const blk::Request* r = req; r; r = r->merge_next) {
+        for (int i = 0; i < r->nr_segs; i++) {
+            uint64_t phys = r->segs[i].phys();
+            uint32_t left = r->segs[i].len;
+            while (left) {
+                uint32_t len = min(left, ADMA_MAX_LEN);
+                adma_[n++] = {static_cast<uint16_t>(ADMA_VALID | ADMA_ACT_TRAN), static_cast<uint16_t>(len),
+                              static_cast<uint32_t>(phys)};
+                phys += len;
+                left -= len;
+            }
+        }
+    }
+    adma_[n - 1].attr |= ADMA_END;
+    arch_wmb();  // Descriptors before the controller fetches them
+
+    uint16_t mode = XFER_DMA | (write ? 0 : XFER_READ);
+    uint8_t cmd = write ? SD_CMD24_WRITE : SD_CMD17_READ;
+    if (count > 1) {
+        mode |= XFER_BLK_CNT | XFER_MULTI | (cmd23_ ? XFER_AUTO_CMD23 : XFER_AUTO_CMD12);
+        cmd = write ? SD_CMD25_WRITE_MULTI : SD_CMD18_READ_MULTI;
+        if (cmd23_) {
+            mmio::write32(base_, reg::ARGUMENT2, count);
+        }
+    }
+
+    uintptr_t table = virt_to_phys(adma_);
+    mmio::write32(base_, reg::ADMA_ADDR, static_cast<uint32_t>(table));
+    mmio::write32(base_, reg::ADMA_ADDR + 4, 0);
+    mmio::write16(base_, reg::BLOCK_SIZE, 512);
+    mmio::write16(base_, reg::BLOCK_COUNT, static_cast<uint16_t>(count));
+    mmio::write16(base_, reg::XFER_MODE, mode);
+
+    {
+        intr::Guard guard;
+        req_ = req;
+        irq_status_ = 0;
+        err_status_ = 0;
+        armed_ = !polled();
+    }
+
+    uint32_t addr = sdhc_ ? req->block : req->block * 512;
+    Error err = issue_cmd(cmd, addr, CMD_RESP_48 | CMD_CRC_EN | CMD_IDX_EN | CMD_DATA);
+    if (err != Error::None) {
+        finish(err);
+        return;
+    }
+    if (armed_) {
+        set_signals(true);
+    }
+}
+
+// Collect and acknowledge the status, including what interrupt() took.
+uint16_t SdDevice::take_status(uint16_t* err) {
+    intr::Guard guard;
+    uint16_t is = irq_status_ | mmio::read16(base_, reg::INT_STATUS);
+    uint16_t es = err_status_ | mmio::read16(base_, reg::ERR_STATUS);
+    mmio::write16(base_, reg::ERR_STATUS, es);
+    mmio::write16(base_, reg::INT_STATUS, is);
+    irq_status_ = 0;
+    err_status_ = 0;
+    *err = es;
+    return is;
+}
+
+// End the transfer in flight once the controller reports it done or
+// failed; false while it is still running.
+bool SdDevice::reap() {
+    uint16_t err{};
+    uint16_t is = take_status(&err);
+
+    if (is & INT_ERROR) {
+        cprintf("sdhci: %s DMA error, status=0x%x err=0x%x auto-cmd=0x%x adma=0x%x\n", name, is, err,
+                mmio::read16(base_, reg::AUTO_CMD_ERR), mmio::read8(base_, reg::ADMA_ERR));
+        finish(Error::IO);
+        return true;
+    }
+    if (is & INT_XFER_DONE) {
+        finish(Error::None);
+        return true;
+    }
+    return false;
+}
+
+void SdDevice::finish(Error err) {
+    blk::Request* req{};
+    {
+        intr::Guard guard;
+        req = req_;
+        req_ = nullptr;
+        armed_ = false;
+    }
+    if (!req) {
+        return;
+    }
+
+    set_signals(false);
+    if (err != Error::None) {
+        static_cast<void>(reset_lines());
+    }
+    req->end(err);
+}
+
+void SdDevice::poll() {
+    clocksource::Deadline deadline(XFER_TIMEOUT_US);
+
+    while (req_) {
+        if (reap()) {
+            break;
+        }
+        if (deadline.expired()) {
+            cprintf("sdhci: %s transfer timeout (block %d)\n", name, req_->block);
+            finish(Error::Timeout);
+            break;
+        }
+        arch_spin_hint();
+    }
+}
+
+// Only a transfer that armed the signals claims the (possibly shared) line;
+// the signals stay down until the next one so the level drops at once.
+void SdDevice::interrupt() {
+    if (!armed_) {
+        return;
+    }
+
+    uint16_t is = mmio::read16(base_, reg::INT_STATUS);
+    if (!(is & (INT_XFER_DONE | INT_ERROR))) {
+        return;
+    }
+
+    uint16_t es = mmio::read16(base_, reg::ERR_STATUS);
+    mmio::write16(base_, reg::ERR_STATUS, es);
+    mmio::write16(base_, reg::INT_STATUS, is);
+    set_signals(false);
+    armed_ = false;
+
+    irq_status_ |= is;
+    err_status_ |= es;
+    static_cast<void>(workqueue::queue_work(&work_));
+}
+
+void SdDevice::complete() {
+    if (req_) {
+        static_cast<void>(reap());
     }
-    return Error::None;
 }
 
 void SdDevice::print_info() {
     cprintf("SD Card '%s': %s, RCA=0x%x, %d sectors (%d MB)\n", name, sdhc_ ? "SDHC" : "SDSC", rca_, size, size / 2048);
+    cprintf("  Bus: %u kHz, %d-bit, %s, %s completion\n", clock_khz_, bus4_ ? 4 : 1,
+            adma_ ? (cmd23_ ? "ADMA2 + auto CMD23" : "ADMA2 + auto CMD12") : "PIO", irq_ >= 0 ? "IRQ" : "polled");
 }
 
 namespace sdhci {
@@ -427,6 +775,18 @@ static int probe_one_controller(SdDevice* dev, int device_index, int bus, int de
             static_cast<unsigned>(id & 0xFFFF), static_cast<unsigned>(id >> 16));
 
     pci::enable_bus_master(bus, dev_id, func);
+    uint32_t cmd = pci::config_read32(bus, dev_id, func, pci::COMMAND);
+    pci::config_write32(bus, dev_id, func, pci::COMMAND, cmd & ~static_cast<uint32_t>(pci::CMD_INTX_DISABLE));
+
+    // INTx: the platform routes the pin; x86 firmware leaves the line in
+    // config space instead.
+    uint32_t int_reg = pci::config_read32(bus, dev_id, func, pci::INTERRUPT);
+    uint8_t pin = (int_reg >> 8) & 0xFF;
+    uint8_t line = int_reg & 0xFF;
+    int irq = arch_pci_intx_to_irq(static_cast<uint8_t>(dev_id), pin ? pin : 1);
+    if (irq < 0 && line != 0 && line != 0xFF) {
+        irq = line;
+    }
 
     uint32_t bar0 = pci::read_bar(bus, dev_id, func, 0);
     if (bar0 == 0 || (bar0 & 1)) {
@@ -447,10 +807,14 @@ static int probe_one_controller(SdDevice* dev, int device_index, int bus, int de
     cprintf("sdhci: MMIO %d:%d.%d at PA 0x%lx -> VA 0x%lx\n", bus, dev_id, func, static_cast<unsigned long>(phys),
             static_cast<unsigned long>(va));
 
-    if (dev->init(reinterpret_cast<volatile uint8_t*>(va), device_index) != Error::None) {
+    new (dev) SdDevice();
+    if (dev->init(reinterpret_cast<volatile uint8_t*>(va), device_index, irq) != Error::None) {
         cprintf("sdhci: controller %d:%d.%d init failed\n", bus, dev_id, func);
         return -1;
     }
+    if (dev->irq() >= 0) {
+        arch_irq_enable_line(dev->irq());
+    }
 
     blk::register_device(dev);
     cprintf("blk: registered SD card '%s' (%d sectors)\n", dev->name, dev->size);
@@ -492,6 +856,14 @@ SdDevice* Manager::get_device(int index) {
     return &s_devices[index];
 }
 
+void Manager::interrupt_handler(int irq) {
+    for (size_t i = 0; i < s_devices.size(); i++) {
+        if (s_devices[i].irq() == irq) {
+            s_devices[i].interrupt();
+        }
+    }
+}
+
 Error Manager::probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*) {
     if (s_devices.full()) {
         cprintf("sdhci: too many controllers, max=%d\n", MAX_DEVICES);
@@ -524,4 +896,8 @@ SdDevice* get_device(int index) {
     return Manager::get_device(index);
 }
 
+void intr(int irq) {
+    Manager::interrupt_handler(irq);
+}
+
 }  // namespace sdhci
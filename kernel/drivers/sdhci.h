@@ -4,36 +4,74 @@
 #include "block/blk.h"
 #include "lib/array.h"
 #include "lib/result.h"
+#include "sched/workqueue.h"
 
 namespace pci {
 struct DeviceInfo;
 struct DriverId;
 }  // namespace pci
 
+// ADMA2 descriptor, 32-bit addressing (SD Host Controller 3.00 §1.13.4)
+struct AdmaDesc {
+    uint16_t attr;
+    uint16_t len;  // 0 means 65536
+    uint32_t addr;
+};
+
 class SdDevice : public BlockDevice {
 public:
-    Error init(volatile uint8_t* base, int index);
-    Error read(uint32_t block_number, void* buf, size_t block_count) override;
-    Error write(uint32_t block_number, const void* buf, size_t block_count) override;
+    Error init(volatile uint8_t* base, int index, int irq);
     void print_info() override;
 
+    [[nodiscard]] int irq() const { return irq_; }
+    void interrupt();  // Hard IRQ: take the status, mask the signals, defer
+    void complete();   // Completion work: end the transfer in flight
+
 private:
+    void queue_rq(blk::Request* req) override;
     volatile uint8_t* base_{};
     uint16_t rca_{};
     bool sdhc_{};
+    bool v3_{};         // Host controller spec 3.00 or later
+    bool bus4_{};       // 4-bit data bus
+    bool cmd23_{};      // Auto CMD23: host and card both support it
+    uint32_t clock_khz_{};
+
+    AdmaDesc* adma_{};  // Descriptor table, nullptr without ADMA2
+    blk::Request* req_{};  // DMA transfer in flight
+    bool armed_{};         // Interrupt signals raised for req_
+    uint16_t irq_status_{};
+    uint16_t err_status_{};
+    int irq_{-1};
+    Work work_{};  // Completion bottom half
 
     Error reset();
-    Error clock_setup();
+    Error reset_lines();
+    Error clock_setup(uint32_t khz);
     Error power_on();
+    Error issue_cmd(uint8_t index, uint32_t arg, uint16_t flags);
     Error send_cmd(uint8_t index, uint32_t arg, uint16_t flags);
+    Error send_app_cmd(uint8_t index, uint32_t arg, uint16_t flags);
     Error wait_cmd_done();
     Error wait_xfer_done();
     uint32_t read_response(int idx);
 
     Error card_identify();
     Error read_csd();
-    Error read_single(uint32_t lba, void* buf);
-    Error write_single(uint32_t lba, const void* buf);
+    Error read_scr();
+    void setup_dma();
+
+    Error pio_data(void* buf, size_t block_bytes, size_t blocks, bool write);
+    Error pio_transfer(uint32_t lba, void* buf, size_t count, bool write);
+
+    [[nodiscard]] bool dma_reachable(const blk::Request* req) const;
+    void start_dma(blk::Request* req);
+    uint16_t take_status(uint16_t* err);
+    bool reap();
+    void finish(Error err);
+    void poll();
+    [[nodiscard]] bool polled() const;
+    void set_signals(bool on);
 };
 
 namespace sdhci {
@@ -45,6 +83,7 @@ public:
     static int init();
     static int device_count();
     static SdDevice* get_device(int index);
+    static void interrupt_handler(int irq);
 
     static Error probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*);
 
@@ -57,5 +96,7 @@ int init();
 int device_count();
 SdDevice* get_device();
 SdDevice* get_device(int index);
+// Service every SD host controller on platform interrupt `irq`.
+void intr(int irq);
 
 }  // namespace sdhci
@@ -0,0 +1,525 @@
+#include "virtio.h"
+#include "drivers/mmio.h"
+#include "drivers/pci.h"
+#include "lib/math.h"
+#include "lib/memory.h"
+#include "lib/stdio.h"
+#include "mm/vmm.h"
+#include "time/clocksource.h"
+
+#include <asm/arch.h>
+#include <asm/mmu.h>
+#include <asm/page.h>
+
+namespace virtio {
+
+namespace {
+
+constexpr uint64_t RESET_TIMEOUT_US = 100000;
+
+// PCI vendor capability (§4.1.4)
+constexpr uint8_t PCI_CAP_VENDOR = 0x09;
+constexpr uint8_t PCI_CAP_COMMON_CFG = 1;
+constexpr uint8_t PCI_CAP_NOTIFY_CFG = 2;
+constexpr uint8_t PCI_CAP_ISR_CFG = 3;
+constexpr uint8_t PCI_CAP_DEVICE_CFG = 4;
+constexpr uint16_t PCI_STATUS_CAP_LIST = 1 << 4;
+
+// Common configuration structure (§4.1.4.3)
+namespace common {
+constexpr uintptr_t DEVICE_FEATURE_SELECT = 0x00;
+constexpr uintptr_t DEVICE_FEATURE = 0x04;
+constexpr uintptr_t DRIVER_FEATURE_SELECT = 0x08;
+constexpr uintptr_t DRIVER_FEATURE = 0x0C;
+constexpr uintptr_t NUM_QUEUES = 0x12;
+constexpr uintptr_t DEVICE_STATUS = 0x14;
+constexpr uintptr_t QUEUE_SELECT = 0x16;
+constexpr uintptr_t QUEUE_SIZE = 0x18;
+constexpr uintptr_t QUEUE_ENABLE = 0x1C;
+constexpr uintptr_t QUEUE_NOTIFY_OFF = 0x1E;
+constexpr uintptr_t QUEUE_DESC = 0x20;
+constexpr uintptr_t QUEUE_DRIVER = 0x28;
+constexpr uintptr_t QUEUE_DEVICE = 0x30;
+}  // namespace common
+
+// MMIO register layout (§4.2.2; legacy §4.2.4)
+namespace reg {
+constexpr uintptr_t MAGIC = 0x000;
+constexpr uintptr_t VERSION = 0x004;
+constexpr uintptr_t DEVICE_ID = 0x008;
+constexpr uintptr_t DEVICE_FEATURES = 0x010;
+constexpr uintptr_t DEVICE_FEATURES_SEL = 0x014;
+constexpr uintptr_t DRIVER_FEATURES = 0x020;
+constexpr uintptr_t DRIVER_FEATURES_SEL = 0x024;
+constexpr uintptr_t GUEST_PAGE_SIZE = 0x028;  // Legacy
+constexpr uintptr_t QUEUE_SEL = 0x030;
+constexpr uintptr_t QUEUE_NUM_MAX = 0x034;
+constexpr uintptr_t QUEUE_NUM = 0x038;
+constexpr uintptr_t QUEUE_ALIGN = 0x03C;  // Legacy
+constexpr uintptr_t QUEUE_PFN = 0x040;    // Legacy
+constexpr uintptr_t QUEUE_READY = 0x044;
+constexpr uintptr_t QUEUE_NOTIFY = 0x050;
+constexpr uintptr_t INTERRUPT_STATUS = 0x060;
+constexpr uintptr_t INTERRUPT_ACK = 0x064;
+constexpr uintptr_t STATUS = 0x070;
+constexpr uintptr_t QUEUE_DESC_LOW = 0x080;
+constexpr uintptr_t QUEUE_DRIVER_LOW = 0x090;
+constexpr uintptr_t QUEUE_DEVICE_LOW = 0x0A0;
+constexpr uintptr_t CONFIG = 0x100;
+
+constexpr uint32_t MAGIC_VALUE = 0x74726976;  // "virt"
+}  // namespace reg
+
+void write64(volatile uint8_t* base, uintptr_t offset, uint64_t value) {
+    mmio::write32(base, offset, static_cast<uint32_t>(value));
+    mmio::write32(base, offset + 4, static_cast<uint32_t>(value >> 32));
+}
+
+struct CapInfo {
+    uint8_t bar;
+    uint32_t offset;
+    uint32_t length;
+    uint8_t ptr;  // In config space
+};
+
+bool find_cap(const pci::DeviceInfo* d, uint8_t cfg_type, CapInfo* out) {
+    uint32_t reg = pci::config_read32(d->bus, d->dev, d->func, pci::COMMAND);
+    if (!((reg >> 16) & PCI_STATUS_CAP_LIST)) {
+        return false;
+    }
+
+    uint8_t ptr = pci::config_read32(d->bus, d->dev, d->func, pci::CAP_PTR) & 0xFF;
+    while (ptr != 0) {
+        uint32_t hdr = pci::config_read32(d->bus, d->dev, d->func, ptr);
+        if ((hdr & 0xFF) == PCI_CAP_VENDOR && static_cast<uint8_t>(hdr >> 24) == cfg_type) {
+            out->bar = pci::config_read32(d->bus, d->dev, d->func, ptr + 4) & 0xFF;
+            out->offset = pci::config_read32(d->bus, d->dev, d->func, ptr + 8);
+            out->length = pci::config_read32(d->bus, d->dev, d->func, ptr + 12);
+            out->ptr = ptr;
+            return true;
+        }
+        ptr = (hdr >> 8) & 0xFF;
+    }
+    return false;
+}
+
+volatile uint8_t* map_cap(const pci::DeviceInfo* d, const CapInfo& cap) {
+    uint32_t bar_lo = pci::read_bar(d->bus, d->dev, d->func, cap.bar);
+    uint64_t bar_phys = bar_lo & ~0xFULL;
+    if ((bar_lo & 0x6) == 0x4) {
+        bar_phys |= static_cast<uint64_t>(pci::read_bar(d->bus, d->dev, d->func, cap.bar + 1)) << 32;
+    }
+
+    uintptr_t phys = static_cast<uintptr_t>(bar_phys) + cap.offset;
+    uintptr_t page_off = phys & PG_MASK;
+    uintptr_t va = vmm::mmio_map(phys - page_off, page_off + max(cap.length, 1U), VM_WRITE | VM_NOCACHE);
+    return va ? reinterpret_cast<volatile uint8_t*>(va + page_off) : nullptr;
+}
+
+// Event-index test (§2.7.7.2): has the index moved from `old_idx` to
+// `new_idx` past `event`?
+bool need_event(uint16_t event, uint16_t new_idx, uint16_t old_idx) {
+    return static_cast<uint16_t>(new_idx - event - 1) < static_cast<uint16_t>(new_idx - old_idx);
+}
+
+}  // namespace
+
+// ============================================================================
+// Transport
+// ============================================================================
+
+void Transport::begin() {
+    set_status(0);
+    clocksource::Deadline deadline(RESET_TIMEOUT_US);
+    while (status() != 0 && !deadline.expired()) {
+        arch_spin_hint();
+    }
+    set_status(STATUS_ACK);
+    set_status(STATUS_ACK | STATUS_DRIVER);
+}
+
+Result<uint64_t> Transport::negotiate(uint64_t wanted) {
+    uint64_t offered = device_features();
+    uint64_t accepted = offered & wanted;
+
+    if (!legacy_) {
+        ENSURE(offered & F_VERSION_1, Error::NotSupported);
+        accepted |= F_VERSION_1;
+    }
+    set_driver_features(accepted);
+
+    if (!legacy_) {
+        set_status(status() | STATUS_FEATURES_OK);
+        ENSURE(status() & STATUS_FEATURES_OK, Error::NotSupported);
+    }
+
+    features_ = accepted;
+    return accepted;
+}
+
+void Transport::ready() {
+    set_status(status() | STATUS_DRIVER_OK);
+}
+
+void Transport::fail() {
+    set_status(status() | STATUS_FAILED);
+}
+
+uint64_t Transport::read_config64(uint32_t offset) {
+    uint64_t lo = read_config32(offset);
+    uint64_t hi = read_config32(offset + 4);
+    return lo | (hi << 32);
+}
+
+// ============================================================================
+// PCI transport
+// ============================================================================
+
+Error PciTransport::init(const pci::DeviceInfo* d) {
+    CapInfo common_cap{}, notify_cap{}, isr_cap{}, device_cap{};
+    ENSURE_LOG(find_cap(d, PCI_CAP_COMMON_CFG, &common_cap) && find_cap(d, PCI_CAP_NOTIFY_CFG, &notify_cap),
+               Error::NotSupported, "virtio: PCI %d:%d.%d has no modern capabilities", d->bus, d->dev, d->func);
+
+    pci::enable_bus_master(d->bus, d->dev, d->func);
+    uint32_t cmd = pci::config_read32(d->bus, d->dev, d->func, pci::COMMAND);
+    pci::config_write32(d->bus, d->dev, d->func, pci::COMMAND, cmd & ~static_cast<uint32_t>(pci::CMD_INTX_DISABLE));
+
+    notify_multiplier_ = pci::config_read32(d->bus, d->dev, d->func, notify_cap.ptr + 16);
+    common_ = map_cap(d, common_cap);
+    notify_base_ = map_cap(d, notify_cap);
+    if (find_cap(d, PCI_CAP_ISR_CFG, &isr_cap)) {
+        isr_ = map_cap(d, isr_cap);
+    }
+    if (find_cap(d, PCI_CAP_DEVICE_CFG, &device_cap)) {
+        device_ = map_cap(d, device_cap);
+    }
+    ENSURE_LOG(common_ && notify_base_, Error::NoMem, "virtio: failed to map BAR regions");
+
+    // INTx: the platform routes the pin; x86 firmware leaves the line in
+    // config space instead.
+    uint32_t int_reg = pci::config_read32(d->bus, d->dev, d->func, pci::INTERRUPT);
+    uint8_t pin = (int_reg >> 8) & 0xFF;
+    uint8_t line = int_reg & 0xFF;
+    irq_ = arch_pci_intx_to_irq(d->dev, pin ? pin : 1);
+    if (irq_ < 0 && line != 0 && line != 0xFF) {
+        irq_ = line;
+    }
+
+    legacy_ = false;
+    return Error::None;
+}
+
+uint8_t PciTransport::status() {
+    return mmio::read8(common_, common::DEVICE_STATUS);
+}
+
+void PciTransport::set_status(uint8_t status) {
+    mmio::write8(common_, common::DEVICE_STATUS, status);
+}
+
+uint64_t PciTransport::device_features() {
+    mmio::write32(common_, common::DEVICE_FEATURE_SELECT, 0);
+    uint64_t lo = mmio::read32(common_, common::DEVICE_FEATURE);
+    mmio::write32(common_, common::DEVICE_FEATURE_SELECT, 1);
+    uint64_t hi = mmio::read32(common_, common::DEVICE_FEATURE);
+    return lo | (hi << 32);
+}
+
+void PciTransport::set_driver_features(uint64_t features) {
+    mmio::write32(common_, common::DRIVER_FEATURE_SELECT, 0);
+    mmio::write32(common_, common::DRIVER_FEATURE, static_cast<uint32_t>(features));
+    mmio::write32(common_, common::DRIVER_FEATURE_SELECT, 1);
+    mmio::write32(common_, common::DRIVER_FEATURE, static_cast<uint32_t>(features >> 32));
+}
+
+uint16_t PciTransport::queue_max(uint16_t index) {
+    if (index >= MAX_QUEUES || index >= mmio::read16(common_, common::NUM_QUEUES)) {
+        return 0;
+    }
+    mmio::write16(common_, common::QUEUE_SELECT, index);
+    return mmio::read16(common_, common::QUEUE_SIZE);
+}
+
+Error PciTransport::enable_queue(uint16_t index, uint16_t size, uint64_t desc, uint64_t avail, uint64_t used) {
+    ENSURE(index < MAX_QUEUES, Error::Invalid);
+
+    mmio::write16(common_, common::QUEUE_SELECT, index);
+    mmio::write16(common_, common::QUEUE_SIZE, size);
+    write64(common_, common::QUEUE_DESC, desc);
+    write64(common_, common::QUEUE_DRIVER, avail);
+    write64(common_, common::QUEUE_DEVICE, used);
+
+    // Cached so notify() never touches the shared queue_select
+    size_t off = static_cast<size_t>(mmio::read16(common_, common::QUEUE_NOTIFY_OFF)) * notify_multiplier_;
+    notify_addr_[index] = reinterpret_cast<volatile uint16_t*>(notify_base_ + off);
+
+    mmio::write16(common_, common::QUEUE_ENABLE, 1);
+    return Error::None;
+}
+
+void PciTransport::notify(uint16_t index) {
+    *notify_addr_[index] = index;
+}
+
+uint8_t PciTransport::ack_interrupt() {
+    return isr_ ? mmio::read8(isr_, 0) : ISR_QUEUE;  // Reading clears it
+}
+
+uint32_t PciTransport::read_config32(uint32_t offset) {
+    return device_ ? mmio::read32(device_, offset) : 0;
+}
+
+// ============================================================================
+// MMIO transport
+// ============================================================================
+
+Error MmioTransport::init(volatile uint8_t* regs, int irq) {
+    ENSURE(mmio::read32(regs, reg::MAGIC) == reg::MAGIC_VALUE, Error::NotFound);
+    uint32_t version = mmio::read32(regs, reg::VERSION);
+    ENSURE(version == 1 || version == 2, Error::NotSupported);
+    device_id_ = mmio::read32(regs, reg::DEVICE_ID);
+    ENSURE(device_id_ != 0, Error::NotFound);  // Empty slot
+
+    regs_ = regs;
+    irq_ = irq;
+    legacy_ = version == 1;
+    if (legacy_) {
+        mmio::write32(regs_, reg::GUEST_PAGE_SIZE, PG_SIZE);
+    }
+    return Error::None;
+}
+
+uint8_t MmioTransport::status() {
+    return static_cast<uint8_t>(mmio::read32(regs_, reg::STATUS));
+}
+
+void MmioTransport::set_status(uint8_t status) {
+    mmio::write32(regs_, reg::STATUS, status);
+}
+
+uint64_t MmioTransport::device_features() {
+    mmio::write32(regs_, reg::DEVICE_FEATURES_SEL, 0);
+    uint64_t lo = mmio::read32(regs_, reg::DEVICE_FEATURES);
+    mmio::write32(regs_, reg::DEVICE_FEATURES_SEL, 1);
+    uint64_t hi = mmio::read32(regs_, reg::DEVICE_FEATURES);
+    return lo | (hi << 32);
+}
+
+void MmioTransport::set_driver_features(uint64_t features) {
+    mmio::write32(regs_, reg::DRIVER_FEATURES_SEL, 0);
+    mmio::write32(regs_, reg::DRIVER_FEATURES, static_cast<uint32_t>(features));
+    mmio::write32(regs_, reg::DRIVER_FEATURES_SEL, 1);
+    mmio::write32(regs_, reg::DRIVER_FEATURES, static_cast<uint32_t>(features >> 32));
+}
+
+uint16_t MmioTransport::queue_max(uint16_t index) {
+    mmio::write32(regs_, reg::QUEUE_SEL, index);
+    return static_cast<uint16_t>(min(mmio::read32(regs_, reg::QUEUE_NUM_MAX), 0x8000U));
+}
+
+Error MmioTransport::enable_queue(uint16_t index, uint16_t size, uint64_t desc, uint64_t avail, uint64_t used) {
+    mmio::write32(regs_, reg::QUEUE_SEL, index);
+    mmio::write32(regs_, reg::QUEUE_NUM, size);
+
+    if (legacy_) {
+        ENSURE((desc & PG_MASK) == 0, Error::Invalid);
+        mmio::write32(regs_, reg::QUEUE_ALIGN, PG_SIZE);
+        mmio::write32(regs_, reg::QUEUE_PFN, static_cast<uint32_t>(desc >> PG_SHIFT));
+        return Error::None;
+    }
+
+    write64(regs_, reg::QUEUE_DESC_LOW, desc);
+    write64(regs_, reg::QUEUE_DRIVER_LOW, avail);
+    write64(regs_, reg::QUEUE_DEVICE_LOW, used);
+    mmio::write32(regs_, reg::QUEUE_READY, 1);
+    return Error::None;
+}
+
+void MmioTransport::notify(uint16_t index) {
+    mmio::write32(regs_, reg::QUEUE_NOTIFY, index);
+}
+
+uint8_t MmioTransport::ack_interrupt() {
+    uint32_t isr = mmio::read32(regs_, reg::INTERRUPT_STATUS);
+    mmio::write32(regs_, reg::INTERRUPT_ACK, isr);
+    return static_cast<uint8_t>(isr);
+}
+
+uint32_t MmioTransport::read_config32(uint32_t offset) {
+    return mmio::read32(regs_, reg::CONFIG + offset);
+}
+
+// ============================================================================
+// Virtqueue
+// ============================================================================
+
+// The rings live in one allocation in the legacy layout (used ring on the
+// next page boundary) so the same queue works on every transport.
+Error Virtqueue::init(Transport* transport, uint16_t index, uint16_t max_size, int max_indirect) {
+    uint16_t limit = min(transport->queue_max(index), max_size);
+    ENSURE(limit > 0, Error::NotFound);
+
+    uint16_t size = 1;
+    while (size * 2 <= limit) {
+        size *= 2;
+    }
+
+    size_t avail_off = sizeof(VringDesc) * size;
+    size_t used_off = round_up(avail_off + sizeof(uint16_t) * (3 + size), PG_SIZE);
+    size_t ring_bytes = used_off + round_up(sizeof(uint16_t) * 3 + sizeof(VringUsedElem) * size, PG_SIZE);
+
+    auto* ring = static_cast<uint8_t*>(kmalloc(ring_bytes));
+    auto* meta = static_cast<uint8_t*>(kmalloc((sizeof(void*) + sizeof(uint16_t)) * size));
+    VringDesc* tables = nullptr;
+    if (transport->has(F_INDIRECT_DESC) && max_indirect > 1) {
+        tables = static_cast<VringDesc*>(kmalloc(sizeof(VringDesc) * max_indirect * size));
+    }
+    if (!ring || !meta || (transport->has(F_INDIRECT_DESC) && max_indirect > 1 && !tables)) {
+        kfree(ring);
+        kfree(meta);
+        kfree(tables);
+        return Error::NoMem;
+    }
+    memset(ring, 0, ring_bytes);
+
+    transport_ = transport;
+    index_ = index;
+    size_ = size;
+    desc_ = reinterpret_cast<VringDesc*>(ring);
+    avail_ = reinterpret_cast<VringAvail*>(ring + avail_off);
+    used_ = reinterpret_cast<VringUsed*>(ring + used_off);
+    tokens_ = reinterpret_cast<void**>(meta);
+    chain_len_ = reinterpret_cast<uint16_t*>(meta + sizeof(void*) * size);
+    indirect_ = tables;
+    max_indirect_ = tables ? max_indirect : 0;
+    event_idx_ = transport->has(F_EVENT_IDX);
+
+    for (uint16_t i = 0; i < size; i++) {
+        desc_[i].next = static_cast<uint16_t>(i + 1);
+        tokens_[i] = nullptr;
+    }
+    free_head_ = 0;
+    num_free_ = size;
+    avail_idx_ = 0;
+    added_ = 0;
+    last_used_ = 0;
+
+    uintptr_t phys = virt_to_phys(reinterpret_cast<uintptr_t>(ring));
+    return transport->enable_queue(index, size, phys, phys + avail_off, phys + used_off);
+}
+
+int Virtqueue::max_chain() const {
+    return indirect_ ? max_indirect_ : size_;
+}
+
+Error Virtqueue::add(const Buffer* bufs, int count, void* token) {
+    ENSURE(count > 0 && count <= max_chain());
+    bool use_indirect = indirect_ && count > 1;
+    uint16_t needed = use_indirect ? 1 : static_cast<uint16_t>(count);
+    ENSURE(num_free_ >= needed, Error::Full);
+
+    uint16_t head = free_head_;
+    if (use_indirect) {
+        VringDesc* table = indirect_ + static_cast<size_t>(head) * max_indirect_;
+        for (int i = 0; i < count; i++) {
+            table[i].addr = bufs[i].phys;
+            table[i].len = bufs[i].len;
+            table[i].flags = (bufs[i].device_writes ? VRING_DESC_F_WRITE : 0) | (i + 1 < count ? VRING_DESC_F_NEXT : 0);
+            table[i].next = static_cast<uint16_t>(i + 1);
+        }
+        desc_[head].addr = virt_to_phys(reinterpret_cast<uintptr_t>(table));
+        desc_[head].len = static_cast<uint32_t>(sizeof(VringDesc) * count);
+        desc_[head].flags = VRING_DESC_F_INDIRECT;
+        free_head_ = desc_[head].next;
+    } else {
+        uint16_t idx = head;
+        for (int i = 0; i < count; i++) {
+            desc_[idx].addr = bufs[i].phys;
+            desc_[idx].len = bufs[i].len;
+            desc_[idx].flags = (bufs[i].device_writes ? VRING_DESC_F_WRITE : 0) | (i + 1 < count ? VRING_DESC_F_NEXT : 0);
+            idx = desc_[idx].next;  // Free-list link doubles as the chain link
+        }
+        free_head_ = idx;
+    }
+
+    num_free_ = static_cast<uint16_t>(num_free_ - needed);
+    chain_len_[head] = needed;
+    tokens_[head] = token;
+
+    avail_->ring[avail_idx_ & (size_ - 1)] = head;
+    avail_idx_++;
+    added_++;
+    return Error::None;
+}
+
+void Virtqueue::kick() {
+    if (added_ == 0) {
+        return;
+    }
+
+    uint16_t old_idx = static_cast<uint16_t>(avail_idx_ - added_);
+    arch_wmb();  // Descriptors and ring entries before the index
+    avail_->idx = avail_idx_;
+    added_ = 0;
+    arch_mb();  // Index before reading the device's suppression state
+
+    bool notify = event_idx_ ? need_event(*avail_event(), avail_idx_, old_idx) :
+                               !(used_->flags & VRING_USED_F_NO_NOTIFY);
+    if (notify) {
+        transport_->notify(index_);
+        kicks_++;
+    } else {
+        suppressed_++;
+    }
+}
+
+void* Virtqueue::get_used(uint32_t* len) {
+    if (last_used_ == used_->idx) {
+        return nullptr;
+    }
+    arch_mb();  // Index before the entry it covers
+
+    uint16_t slot = last_used_ & (size_ - 1);
+    auto head = static_cast<uint16_t>(used_->ring[slot].id);
+    if (len) {
+        *len = used_->ring[slot].len;
+    }
+    last_used_++;
+
+    void* token = tokens_[head];
+    tokens_[head] = nullptr;
+
+    uint16_t tail = head;
+    for (uint16_t i = 1; i < chain_len_[head]; i++) {
+        tail = desc_[tail].next;
+    }
+    desc_[tail].next = free_head_;
+    free_head_ = head;
+    num_free_ = static_cast<uint16_t>(num_free_ + chain_len_[head]);
+
+    // Interrupt again at the next completion
+    if (event_idx_ && interrupts_) {
+        *used_event() = last_used_;
+    }
+    return token;
+}
+
+void Virtqueue::disable_interrupts() {
+    interrupts_ = false;
+    if (!event_idx_) {
+        avail_->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    }
+}
+
+bool Virtqueue::enable_interrupts() {
+    interrupts_ = true;
+    if (event_idx_) {
+        *used_event() = last_used_;
+    } else {
+        avail_->flags = 0;
+    }
+    arch_mb();
+    return last_used_ == used_->idx;
+}
+
+}  // namespace virtio
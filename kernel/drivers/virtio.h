@@ -0,0 +1,243 @@
+#pragma once
+
+#include <base/types.h>
+#include "lib/result.h"
+
+namespace pci {
+struct DeviceInfo;
+}  // namespace pci
+
+// VirtIO core shared by the virtio drivers: the PCI (1.x modern) and MMIO
+// (version 1 and 2) transports behind one Transport interface, and split
+// virtqueues with indirect descriptors and event-index notification
+// suppression.
+//
+// Bring-up (§3.1.1): Transport::begin(), negotiate(), Virtqueue::init() for
+// each queue, then Transport::ready().  Virtqueue calls are not locked;
+// each queue's owner serialises them.
+
+namespace virtio {
+
+inline constexpr uint16_t PCI_VENDOR = 0x1AF4;
+inline constexpr uint16_t PCI_DEVICE_MODERN = 0x1040;              // + device ID
+inline constexpr uint16_t PCI_DEVICE_BLOCK_TRANSITIONAL = 0x1001;  // Has the modern capabilities too
+
+inline constexpr uint32_t DEVICE_BLOCK = 2;
+inline constexpr uint32_t DEVICE_INPUT = 18;
+
+inline constexpr uint8_t STATUS_ACK = 1;
+inline constexpr uint8_t STATUS_DRIVER = 2;
+inline constexpr uint8_t STATUS_DRIVER_OK = 4;
+inline constexpr uint8_t STATUS_FEATURES_OK = 8;
+inline constexpr uint8_t STATUS_FAILED = 128;
+
+inline constexpr uint64_t F_INDIRECT_DESC = 1ULL << 28;
+inline constexpr uint64_t F_EVENT_IDX = 1ULL << 29;
+inline constexpr uint64_t F_VERSION_1 = 1ULL << 32;
+
+inline constexpr uint8_t ISR_QUEUE = 1;   // A used ring advanced
+inline constexpr uint8_t ISR_CONFIG = 2;  // Device configuration changed
+
+inline constexpr int MAX_QUEUES = 8;  // Per device
+
+// ============================================================================
+// Split virtqueue layout (§2.7)
+// ============================================================================
+
+inline constexpr uint16_t VRING_DESC_F_NEXT = 1;
+inline constexpr uint16_t VRING_DESC_F_WRITE = 2;
+inline constexpr uint16_t VRING_DESC_F_INDIRECT = 4;
+
+inline constexpr uint16_t VRING_AVAIL_F_NO_INTERRUPT = 1;
+inline constexpr uint16_t VRING_USED_F_NO_NOTIFY = 1;
+
+struct VringDesc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct VringAvail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];  // Followed by used_event with F_EVENT_IDX
+};
+
+struct VringUsedElem {
+    uint32_t id;
+    uint32_t len;
+};
+
+struct VringUsed {
+    uint16_t flags;
+    uint16_t idx;
+    VringUsedElem ring[];  // Followed by avail_event with F_EVENT_IDX
+};
+
+// ============================================================================
+// Transports
+// ============================================================================
+
+class Transport {
+public:
+    // Reset the device and announce a driver (ACKNOWLEDGE | DRIVER).
+    void begin();
+    // Accept the `wanted` features the device offers, plus VERSION_1 on
+    // modern devices; the accepted set, or NotSupported when the device
+    // refuses it.
+    Result<uint64_t> negotiate(uint64_t wanted);
+    void ready();  // DRIVER_OK: queues are live
+    void fail();
+
+    [[nodiscard]] uint64_t features() const { return features_; }
+    [[nodiscard]] bool has(uint64_t feature) const { return (features_ & feature) != 0; }
+    [[nodiscard]] bool legacy() const { return legacy_; }
+    [[nodiscard]] int irq() const { return irq_; }
+
+    virtual uint8_t status() = 0;
+    virtual void set_status(uint8_t status) = 0;
+    virtual uint64_t device_features() = 0;
+    virtual void set_driver_features(uint64_t features) = 0;
+
+    // Largest size queue `index` takes; 0 when there is no such queue.
+    virtual uint16_t queue_max(uint16_t index) = 0;
+    // Hand the rings of queue `index` to the device.  Legacy transports
+    // take only `desc`: the rings must follow the legacy layout.
+    virtual Error enable_queue(uint16_t index, uint16_t size, uint64_t desc, uint64_t avail, uint64_t used) = 0;
+    virtual void notify(uint16_t index) = 0;
+    // Read and acknowledge the interrupt status (ISR_* bits).
+    virtual uint8_t ack_interrupt() = 0;
+
+    // Device-specific configuration space.
+    virtual uint32_t read_config32(uint32_t offset) = 0;
+    uint64_t read_config64(uint32_t offset);
+
+protected:
+    uint64_t features_{};
+    int irq_{-1};
+    bool legacy_{};
+};
+
+// Modern PCI transport: register regions located through the vendor
+// capabilities, interrupt on the function's INTx line.
+class PciTransport final : public Transport {
+public:
+    Error init(const pci::DeviceInfo* dev);
+
+    uint8_t status() override;
+    void set_status(uint8_t status) override;
+    uint64_t device_features() override;
+    void set_driver_features(uint64_t features) override;
+    uint16_t queue_max(uint16_t index) override;
+    Error enable_queue(uint16_t index, uint16_t size, uint64_t desc, uint64_t avail, uint64_t used) override;
+    void notify(uint16_t index) override;
+    uint8_t ack_interrupt() override;
+    uint32_t read_config32(uint32_t offset) override;
+
+private:
+    volatile uint8_t* common_{};
+    volatile uint8_t* notify_base_{};
+    volatile uint8_t* isr_{};
+    volatile uint8_t* device_{};
+    uint32_t notify_multiplier_{};
+    volatile uint16_t* notify_addr_[MAX_QUEUES]{};  // Cached by enable_queue()
+};
+
+// Memory-mapped transport for the fixed virtio-mmio slots of a board.
+class MmioTransport final : public Transport {
+public:
+    // NotFound when the slot at `regs` is empty or not virtio.
+    Error init(volatile uint8_t* regs, int irq);
+    [[nodiscard]] uint32_t device_id() const { return device_id_; }
+
+    uint8_t status() override;
+    void set_status(uint8_t status) override;
+    uint64_t device_features() override;
+    void set_driver_features(uint64_t features) override;
+    uint16_t queue_max(uint16_t index) override;
+    Error enable_queue(uint16_t index, uint16_t size, uint64_t desc, uint64_t avail, uint64_t used) override;
+    void notify(uint16_t index) override;
+    uint8_t ack_interrupt() override;
+    uint32_t read_config32(uint32_t offset) override;
+
+private:
+    volatile uint8_t* regs_{};
+    uint32_t device_id_{};
+};
+
+// Board-wired virtio-mmio slots: `count` register windows `stride` bytes
+// apart from `phys`, slot i interrupting on `irq_base + i`.
+struct MmioWindow {
+    uintptr_t phys;
+    size_t stride;
+    int count;
+    int irq_base;
+};
+
+// ============================================================================
+// Virtqueue
+// ============================================================================
+
+// A buffer in a descriptor chain, by physical address.
+struct Buffer {
+    uint64_t phys;
+    uint32_t len;
+    bool device_writes;
+};
+
+class Virtqueue {
+public:
+    // Allocate and enable queue `index` with up to `max_size` entries.  With
+    // F_INDIRECT_DESC negotiated, every entry also gets a table of
+    // `max_indirect` descriptors so a chain takes one ring slot.
+    Error init(Transport* transport, uint16_t index, uint16_t max_size, int max_indirect = 0);
+
+    // Queue the chain `bufs[0..count)`, device-readable buffers first, with
+    // `token` to hand back from get_used().  Full when there is no room.
+    Error add(const Buffer* bufs, int count, void* token);
+    // Publish added chains and notify the device unless it asked not to be.
+    void kick();
+
+    // The token of the next chain the device has finished, or nullptr.
+    void* get_used(uint32_t* len = nullptr);
+
+    // Interrupt suppression.  enable_interrupts() returns false when used
+    // entries arrived meanwhile, so the caller drains again.
+    void disable_interrupts();
+    [[nodiscard]] bool enable_interrupts();
+
+    [[nodiscard]] uint16_t size() const { return size_; }
+    [[nodiscard]] uint16_t index() const { return index_; }
+    [[nodiscard]] bool indirect() const { return indirect_ != nullptr; }
+    [[nodiscard]] int max_chain() const;  // Longest chain add() accepts
+    [[nodiscard]] uint64_t kicks() const { return kicks_; }
+    [[nodiscard]] uint64_t suppressed() const { return suppressed_; }
+
+private:
+    volatile uint16_t* used_event() { return &avail_->ring[size_]; }
+    volatile uint16_t* avail_event() { return reinterpret_cast<volatile uint16_t*>(&used_->ring[size_]); }
+
+    Transport* transport_{};
+    uint16_t index_{};
+    uint16_t size_{};
+    VringDesc* desc_{};
+    volatile VringAvail* avail_{};
+    volatile VringUsed* used_{};
+    void** tokens_{};        // Per head descriptor
+    uint16_t* chain_len_{};  // Descriptors per head, for freeing
+    VringDesc* indirect_{};  // size_ tables of max_indirect_ entries
+    int max_indirect_{};
+    bool event_idx_{};
+
+    uint16_t free_head_{};
+    uint16_t num_free_{};
+    uint16_t avail_idx_{};  // Shadow of avail_->idx
+    uint16_t added_{};      // Since the last kick()
+    uint16_t last_used_{};
+    bool interrupts_{true};
+    uint64_t kicks_{};
+    uint64_t suppressed_{};
+};
+
+}  // namespace virtio
@@ -0,0 +1,416 @@
+/**
+ * @file virtio_blk.cpp
+ * @brief Virtio block driver (PCI and MMIO transports).
+ *
+ * Each request is one descriptor chain: the header (type, sector), the
+ * request's segments by physical address, and the status byte.  With
+ * indirect descriptors a chain takes a single ring entry, so the queue
+ * depth is the ring size.
+ *
+ * With VIRTIO_BLK_F_MQ the device offers several request queues; the
+ * driver takes one per CPU.  Completion runs from the system workqueue
+ * after the interrupt, or by polling the used ring while polled().
+ */
+
+#include "virtio_blk.h"
+#include "drivers/mmio.h"
+#include "drivers/pci.h"
+#include "lib/math.h"
+#include "lib/memory.h"
+#include "lib/stdio.h"
+#include "mm/vmm.h"
+#include "time/clocksource.h"
+
+#include <asm/arch.h>
+#include <asm/mmu.h>
+#include <asm/page.h>
+
+namespace {
+
+// Feature bits (§5.2.3)
+constexpr uint64_t F_SEG_MAX = 1ULL << 2;
+constexpr uint64_t F_RO = 1ULL << 5;
+constexpr uint64_t F_MQ = 1ULL << 12;
+
+// Configuration layout (§5.2.4)
+constexpr uint32_t CFG_CAPACITY = 0x00;
+constexpr uint32_t CFG_SEG_MAX = 0x0C;
+constexpr uint32_t CFG_NUM_QUEUES = 0x20;  // le16 at 0x22
+
+constexpr uint32_t T_IN = 0;
+constexpr uint32_t T_OUT = 1;
+
+constexpr uint8_t S_OK = 0;
+constexpr uint8_t S_UNSUPP = 2;
+
+constexpr int NR_CPUS = 1;                        // The kernel runs on the boot CPU only
+constexpr uint64_t REQUEST_TIMEOUT_US = 1000000;  // Polled completion, per request
+
+int this_cpu() {
+    return 0;
+}
+
+void complete_work(Work* work) {
+    static_cast<VirtioBlkDevice*>(work->data)->complete();
+}
+
+Error slot_status(const VirtioBlkSlot* slot) {
+    switch (slot->status) {
+        case S_OK: return Error::None;
+        case S_UNSUPP: return Error::NotSupported;
+        default: return Error::IO;
+    }
+}
+
+}  // namespace
+
+// ============================================================================
+// VirtioBlkDevice
+// ============================================================================
+
+Error VirtioBlkDevice::init_pci(const pci::DeviceInfo* pdev, int index) {
+    TRY(pci_.init(pdev));
+    transport_ = &pci_;
+    return setup(index);
+}
+
+Error VirtioBlkDevice::init_mmio(volatile uint8_t* regs, int irq, int index) {
+    TRY(mmio_.init(regs, irq));
+    ENSURE(mmio_.device_id() == virtio::DEVICE_BLOCK, Error::NotFound);
+    transport_ = &mmio_;
+    return setup(index);
+}
+
+Error VirtioBlkDevice::setup(int index) {
+    virtio::Transport& t = *transport_;
+    t.begin();
+
+    auto negotiated = t.negotiate(F_SEG_MAX | F_RO | F_MQ | virtio::F_INDIRECT_DESC | virtio::F_EVENT_IDX);
+    if (!negotiated.ok()) {
+        t.fail();
+        cprintf("virtio_blk: feature negotiation failed\n");
+        return negotiated.error();
+    }
+
+    // Header and status take two entries of every chain.
+    int seg_max = t.has(F_SEG_MAX) ? static_cast<int>(t.read_config32(CFG_SEG_MAX)) : 1;
+    max_segments_ = max(1, min(seg_max, blk::Queue::DEFAULT_MAX_SEGMENTS));
+
+    int offered = t.has(F_MQ) ? static_cast<int>(t.read_config32(CFG_NUM_QUEUES) >> 16) : 1;
+    nr_queues_ = max(1, min(min(offered, NR_CPUS), virtio::MAX_QUEUES));
+
+    for (int i = 0; i < nr_queues_; i++) {
+        Error err = setup_queue(queues_[i], static_cast<uint16_t>(i));
+        if (err != Error::None) {
+            t.fail();
+            cprintf("virtio_blk: queue %d setup failed: %s\n", i, error_str(err));
+            return err;
+        }
+    }
+
+    uint64_t capacity = t.read_config64(CFG_CAPACITY);
+    size = static_cast<uint32_t>(min(capacity, static_cast<uint64_t>(__UINT32_MAX__)));
+    read_only_ = t.has(F_RO);
+    type = blk::DeviceType::Disk;
+    name[0] = 'v';
+    name[1] = 'd';
+    name[2] = static_cast<char>('0' + index);
+    name[3] = '\0';
+
+    work_.fn = complete_work;
+    work_.data = this;
+    irq_ = t.irq() >= 0;
+    if (irq_) {
+        arch_irq_enable_line(t.irq());
+    }
+
+    // Without indirect descriptors a full chain takes max_segments_ + 2
+    // ring entries.
+    const virtio::Virtqueue& vq = queues_[0].vq;
+    int depth = vq.indirect() ? vq.size() : max(1, vq.size() / (max_segments_ + 2));
+    queue.set_depth(depth * nr_queues_);
+    queue.set_limits(blk::Queue::DEFAULT_MAX_BLOCKS, max_segments_);
+
+    t.ready();
+    return Error::None;
+}
+
+Error VirtioBlkDevice::setup_queue(VirtioBlkQueue& q, uint16_t index) {
+    TRY(q.vq.init(transport_, index, MAX_QUEUE_SIZE, max_segments_ + 2));
+
+    uint16_t n = q.vq.size();
+    q.slots = static_cast<VirtioBlkSlot*>(kmalloc(sizeof(VirtioBlkSlot) * n));
+    q.chain = static_cast<virtio::Buffer*>(kmalloc(sizeof(virtio::Buffer) * (max_segments_ + 2)));
+    ENSURE(q.slots && q.chain, Error::NoMem);
+
+    q.free = nullptr;
+    for (int i = n - 1; i >= 0; i--) {
+        q.slots[i] = {};
+        q.slots[i].next = q.free;
+        q.free = &q.slots[i];
+    }
+    return Error::None;
+}
+
+void VirtioBlkDevice::print_info() {
+    const virtio::Virtqueue& vq = queues_[0].vq;
+    cprintf("Device: %s (virtio-blk, %s%s)\n", name, transport_ == &pci_ ? "PCI" : "MMIO",
+            transport_->legacy() ? " legacy" : "");
+    cprintf("  Size: %d sectors (%d MB)%s\n", size, size / 2048, read_only_ ? ", read-only" : "");
+    cprintf("  Queues: %d x %d entries, %d segments, %s%s, %s completion\n", nr_queues_, vq.size(), max_segments_,
+            vq.indirect() ? "indirect" : "direct", transport_->has(virtio::F_EVENT_IDX) ? ", event index" : "",
+            irq_ ? "IRQ" : "polled");
+    for (int i = 0; i < nr_queues_; i++) {
+        cprintf("  vq%d: %lu kicks, %lu suppressed\n", i, queues_[i].vq.kicks(), queues_[i].vq.suppressed());
+    }
+    cprintf("\n");
+}
+
+// The chain goes on this CPU's queue.  The request completes from
+// complete() after the interrupt, or before queue_rq() returns when
+// polled().
+void VirtioBlkDevice::queue_rq(blk::Request* req) {
+    bool write = req->op == blk::Op::Write;
+    uint32_t total = req->total_blocks();
+
+    if (req->block + total > size) {
+        cprintf("virtio_blk: %s out of range (block %d + %d > %d)\n", name, req->block, total, size);
+        req->end(Error::Invalid);
+        return;
+    }
+    if (write && read_only_) {
+        req->end(Error::NotSupported);
+        return;
+    }
+
+    VirtioBlkQueue& q = queues_[this_cpu() % nr_queues_];
+    VirtioBlkSlot* slot{};
+    uint32_t seq{};  // The slot's seq before the device can complete it
+    Error err{};
+    {
+        LockGuard<Spinlock> guard(q.lock);
+        slot = q.free;
+        if (!slot) {  // The queue depth keeps this from happening
+            err = Error::Busy;
+        } else {
+            q.free = slot->next;
+            slot->type = write ? T_OUT : T_IN;
+            slot->reserved = 0;
+            slot->sector = req->block;
+            slot->status = 0xFF;
+            slot->req = req;
+            seq = slot->seq;
+
+            int n = 0;
+            q.chain[n++] = {virt_to_phys(reinterpret_cast<uintptr_t>(slot)), 16, false};
+            for (const blk::Request* r = req; r; r = r->merge_next) {
+                for (int i = 0; i < r->nr_segs; i++) {
+                    q.chain[n++] = {r->segs[i].phys(), r->segs[i].len, !write};
+                }
+            }
+            q.chain[n++] = {virt_to_phys(reinterpret_cast<uintptr_t>(&slot->status)), 1, true};
+
+            err = q.vq.add(q.chain, n, slot);
+            if (err == Error::None) {
+                q.vq.kick();
+            } else {
+                slot->req = nullptr;
+                slot->next = q.free;
+                q.free = slot;
+            }
+        }
+    }
+
+    if (err != Error::None) {
+        req->end(err);
+        return;
+    }
+
+    if (polled()) {
+        poll(q, slot, seq);
+    }
+}
+
+bool VirtioBlkDevice::polled() const {
+    // Early boot mounts the root filesystem before interrupts and the
+    // completion workqueue are running.
+    return !irq_ || !arch_irq_is_enabled() || !workqueue::system().worker();
+}
+
+// Retire finished chains one at a time, outside the lock: end() may
+// submit the next request straight back into queue_rq().
+void VirtioBlkDevice::reap(VirtioBlkQueue& q) {
+    {
+        LockGuard<Spinlock> guard(q.lock);
+        q.vq.disable_interrupts();
+    }
+
+    while (true) {
+        blk::Request* req{};
+        Error err{};
+        {
+            LockGuard<Spinlock> guard(q.lock);
+            auto* slot = static_cast<VirtioBlkSlot*>(q.vq.get_used());
+            if (!slot) {
+                if (q.vq.enable_interrupts()) {
+                    break;
+                }
+                continue;  // More arrived while re-enabling
+            }
+
+            req = slot->req;
+            err = slot_status(slot);
+            slot->req = nullptr;
+            slot->seq++;
+            slot->next = q.free;
+            q.free = slot;
+        }
+        req->end(err);
+    }
+}
+
+// `seq` was read before the kick: another poller may reap the slot, and
+// bump it, before we get here.
+void VirtioBlkDevice::poll(VirtioBlkQueue& q, const VirtioBlkSlot* slot, uint32_t seq) {
+    clocksource::Deadline deadline(REQUEST_TIMEOUT_US);
+    bool warned = false;
+
+    // A virtio device cannot abort a request, so a slow one is waited out.
+    while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == seq) {
+        reap(q);
+        if (!warned && deadline.expired()) {
+            cprintf("virtio_blk: %s slow to complete (sector %lu)\n", name, slot->sector);
+            warned = true;
+        }
+        arch_spin_hint();
+    }
+}
+
+void VirtioBlkDevice::interrupt() {
+    if (transport_->ack_interrupt() & virtio::ISR_QUEUE) {
+        static_cast<void>(workqueue::queue_work(&work_));
+    }
+}
+
+void VirtioBlkDevice::complete() {
+    for (int i = 0; i < nr_queues_; i++) {
+        reap(queues_[i]);
+    }
+}
+
+// ============================================================================
+// Manager
+// ============================================================================
+
+namespace virtio_blk {
+
+namespace {
+
+const pci::DriverId VIRTIO_BLK_IDS[] = {
+    {virtio::PCI_VENDOR, virtio::PCI_DEVICE_MODERN + virtio::DEVICE_BLOCK, pci::ANY_CLASS, pci::ANY_CLASS,
+     pci::ANY_CLASS},
+    {virtio::PCI_VENDOR, virtio::PCI_DEVICE_BLOCK_TRANSITIONAL, pci::ANY_CLASS, pci::ANY_CLASS, pci::ANY_CLASS},
+};
+
+const pci::Driver VIRTIO_BLK_DRIVER = {
+    "virtio_blk",
+    VIRTIO_BLK_IDS,
+    static_cast<int>(array_size(VIRTIO_BLK_IDS)),
+    Manager::probe_callback,
+};
+
+void announce(VirtioBlkDevice* dev) {
+    blk::register_device(dev);
+    cprintf("blk: registered virtio disk '%s' (%d sectors)\n", dev->name, dev->size);
+}
+
+}  // namespace
+
+int Manager::init() {
+    if (s_initialized) {
+        return 0;
+    }
+
+    if (pci::register_driver(&VIRTIO_BLK_DRIVER) != Error::None) {
+        cprintf("virtio_blk: failed to register PCI driver\n");
+        return -1;
+    }
+
+    s_initialized = true;
+    return 0;
+}
+
+Error Manager::probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*) {
+    if (s_devices.full()) {
+        cprintf("virtio_blk: too many devices, max=%d\n", MAX_DEVICES);
+        return Error::Full;
+    }
+
+    cprintf("virtio_blk: found at PCI %d:%d.%d\n", pdev->bus, pdev->dev, pdev->func);
+    int index = static_cast<int>(s_devices.size());
+    VirtioBlkDevice* dev = &s_devices[index];
+    new (dev) VirtioBlkDevice();
+    TRY(dev->init_pci(pdev, index));
+
+    s_devices.commit_back();
+    announce(dev);
+    return Error::None;
+}
+
+Error Manager::probe_mmio(const virtio::MmioWindow& window) {
+    if (window.count <= 0) {
+        return Error::None;
+    }
+
+    uintptr_t va = vmm::mmio_map(window.phys, window.stride * window.count, VM_WRITE | VM_NOCACHE);
+    ENSURE_LOG(va != 0, Error::NoMem, "virtio_blk: failed to map virtio-mmio window");
+
+    for (int i = 0; i < window.count && !s_devices.full(); i++) {
+        auto* regs = reinterpret_cast<volatile uint8_t*>(va + window.stride * i);
+        int index = static_cast<int>(s_devices.size());
+        VirtioBlkDevice* dev = &s_devices[index];
+        new (dev) VirtioBlkDevice();
+        if (dev->init_mmio(regs, window.irq_base + i, index) != Error::None) {
+            continue;  // Empty slot or another device type
+        }
+
+        cprintf("virtio_blk: found at MMIO 0x%lx, IRQ %d\n", static_cast<unsigned long>(window.phys + window.stride * i),
+                window.irq_base + i);
+        s_devices.commit_back();
+        announce(dev);
+    }
+    return Error::None;
+}
+
+void Manager::interrupt_handler(int irq) {
+    for (size_t i = 0; i < s_devices.size(); i++) {
+        if (s_devices[i].irq() == irq) {
+            s_devices[i].interrupt();
+        }
+    }
+}
+
+int Manager::device_count() {
+    return static_cast<int>(s_devices.size());
+}
+
+VirtioBlkDevice* Manager::get_device(int index) {
+    if (index < 0 || static_cast<size_t>(index) >= s_devices.size()) {
+        return nullptr;
+    }
+    return &s_devices[index];
+}
+
+int init() {
+    return Manager::init();
+}
+
+Error probe_mmio(const virtio::MmioWindow& window) {
+    return Manager::probe_mmio(window);
+}
+
+void intr(int irq) {
+    Manager::interrupt_handler(irq);
+}
+
+}  // namespace virtio_blk
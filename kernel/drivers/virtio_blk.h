@@ -0,0 +1,95 @@
+#pragma once
+
+#include <base/types.h>
+#include "block/blk.h"
+#include "drivers/virtio.h"
+#include "lib/array.h"
+#include "lib/result.h"
+#include "lib/spinlock.h"
+#include "sched/workqueue.h"
+
+namespace pci {
+struct DeviceInfo;
+struct DriverId;
+}  // namespace pci
+
+// Request header and status byte the device reads and writes (§5.2.6).
+struct VirtioBlkSlot {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+    uint8_t status;
+    uint32_t seq;  // Bumped when the slot's request completes
+    blk::Request* req;
+    VirtioBlkSlot* next;  // Free list
+};
+
+// A virtqueue and the slots of the requests in flight on it.
+struct VirtioBlkQueue {
+    virtio::Virtqueue vq{};
+    VirtioBlkSlot* slots{};
+    VirtioBlkSlot* free{};
+    virtio::Buffer* chain{};  // Scratch for queue_rq(), under lock
+    Spinlock lock{};
+};
+
+class VirtioBlkDevice : public BlockDevice {
+public:
+    static constexpr uint16_t MAX_QUEUE_SIZE = 128;
+
+    Error init_pci(const pci::DeviceInfo* pdev, int index);
+    Error init_mmio(volatile uint8_t* regs, int irq, int index);
+    void print_info() override;
+
+    [[nodiscard]] int irq() const { return transport_ ? transport_->irq() : -1; }
+    void interrupt();  // Hard IRQ: acknowledge and defer to complete()
+    void complete();   // Completion work: retire every finished request
+
+private:
+    void queue_rq(blk::Request* req) override;
+
+    Error setup(int index);
+    Error setup_queue(VirtioBlkQueue& q, uint16_t index);
+    void reap(VirtioBlkQueue& q);
+    void poll(VirtioBlkQueue& q, const VirtioBlkSlot* slot, uint32_t seq);
+    [[nodiscard]] bool polled() const;
+
+    virtio::PciTransport pci_{};
+    virtio::MmioTransport mmio_{};
+    virtio::Transport* transport_{};
+    VirtioBlkQueue queues_[virtio::MAX_QUEUES]{};
+    int nr_queues_{};
+    int max_segments_{};
+    bool read_only_{};
+    bool irq_{};
+    Work work_{};  // Completion bottom half
+};
+
+namespace virtio_blk {
+
+class Manager {
+public:
+    static constexpr int MAX_DEVICES = 4;
+
+    static int init();
+    static Error probe_mmio(const virtio::MmioWindow& window);
+    static void interrupt_handler(int irq);
+
+    static int device_count();
+    static VirtioBlkDevice* get_device(int index);
+
+    static Error probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*);
+
+private:
+    inline static bool s_initialized{};
+    inline static Array<VirtioBlkDevice, MAX_DEVICES> s_devices{};
+};
+
+// Register the PCI driver; devices bind in pci::probe_drivers().
+int init();
+// Probe a board's virtio-mmio slots for block devices.
+Error probe_mmio(const virtio::MmioWindow& window);
+// Service every virtio-blk device on platform interrupt `irq`.
+void intr(int irq);
+
+}  // namespace virtio_blk
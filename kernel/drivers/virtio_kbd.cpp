@@ -3,8 +3,7 @@
  * @brief Virtio-input keyboard driver (modern PCI transport).
  *
  * Provides GUI keyboard input via virtio-keyboard-pci on QEMU virt.
- * Uses VirtIO 1.x modern PCI transport with capability-based BAR regions,
- * the same approach as virtio_gpu.cpp.
+ * The transport and the event queue come from the virtio core.
  *
  * virtio-keyboard-pci (device ID 0x1052 = 0x1040+18) is a modern-only
  * device — it does NOT support the legacy BAR0 register layout.
@@ -15,225 +14,48 @@
  *
  * Each event is: { le16 type, le16 code, le32 value } = 8 bytes.
  * We only care about EV_KEY (type=1) with value=1 (key press).
+ *
+ * The hard-IRQ handler only acknowledges the ISR; the used ring is drained
+ * from the INPUT softirq.
  */
 
 #include "virtio_kbd.h"
-#include "drivers/mmio.h"
 #include "drivers/pci.h"
+#include "drivers/virtio.h"
 #include "cons/cons.h"
 #include "lib/result.h"
 #include "lib/stdio.h"
-#include "lib/memory.h"
-#include "mm/vmm.h"
+#include "sched/softirq.h"
 #include <asm/arch.h>
-#include <asm/page.h>
 #include <asm/mmu.h>
 
 namespace {
 
-// ============================================================================
-// VirtIO constants
-// ============================================================================
-
-constexpr uint16_t VIRTIO_VENDOR = 0x1AF4;
-constexpr uint16_t VIRTIO_INPUT_DEV = 0x1052;  // 0x1040 + 18
-
-constexpr uint8_t VIRTIO_STATUS_ACK = 1;
-constexpr uint8_t VIRTIO_STATUS_DRIVER = 2;
-constexpr uint8_t VIRTIO_STATUS_DRIVER_OK = 4;
-constexpr uint8_t VIRTIO_STATUS_FEATURES_OK = 8;
-
-constexpr uint8_t VIRTIO_PCI_CAP_COMMON_CFG = 1;
-constexpr uint8_t VIRTIO_PCI_CAP_NOTIFY_CFG = 2;
-constexpr uint8_t VIRTIO_PCI_CAP_ISR_CFG = 3;
-
-constexpr uint16_t VRING_DESC_F_WRITE = 2;
-
 // Linux input event types
 constexpr uint16_t EV_KEY = 1;
 
-// ============================================================================
-// VirtIO structures
-// ============================================================================
-
 struct VirtioInputEvent {
     uint16_t type;
     uint16_t code;
     uint32_t value;
 };
 
-struct VringDesc {
-    uint64_t addr;
-    uint32_t len;
-    uint16_t flags;
-    uint16_t next;
-};
-
-struct VringAvail {
-    uint16_t flags;
-    uint16_t idx;
-    uint16_t ring[];
-};
-
-struct VringUsedElem {
-    uint32_t id;
-    uint32_t len;
-};
-
-struct VringUsed {
-    uint16_t flags;
-    uint16_t idx;
-    VringUsedElem ring[];
-};
-
 // ============================================================================
 // Driver state
 // ============================================================================
 
 constexpr uint16_t MAX_QUEUE_SIZE = 64;
 
-// Mapped register regions (from PCI capabilities)
-volatile uint8_t* common_cfg = nullptr;
-volatile uint8_t* notify_base = nullptr;
-volatile uint8_t* isr_cfg = nullptr;
-uint32_t notify_off_multiplier = 0;
-
-// Eventq (VQ 0)
-uint16_t vq_size = 0;
-VringDesc* vq_desc = nullptr;
-VringAvail* vq_avail = nullptr;
-VringUsed* vq_used = nullptr;
-uint16_t last_used_idx = 0;
+virtio::PciTransport s_transport;
+virtio::Virtqueue s_eventq;  // VQ 0
 
 // Event buffers — one per descriptor
 VirtioInputEvent event_bufs[MAX_QUEUE_SIZE];
 
-// Cached notify address (avoid reading common_cfg in interrupt context)
-volatile uint16_t* vq_notify_addr = nullptr;
-
 int s_irq = -1;
 bool s_initialized = false;
 bool s_registered = false;
 
-// ============================================================================
-// Common config register accessors (VirtIO 1.x §4.1.4.3)
-// ============================================================================
-
-uint8_t read_status() {
-    return mmio::read8(common_cfg, 0x14);
-}
-void write_status(uint8_t v) {
-    mmio::write8(common_cfg, 0x14, v);
-}
-void select_queue(uint16_t q) {
-    mmio::write16(common_cfg, 0x16, q);
-}
-uint16_t read_queue_size() {
-    return mmio::read16(common_cfg, 0x18);
-}
-void write_queue_size(uint16_t v) {
-    mmio::write16(common_cfg, 0x18, v);
-}
-void write_queue_enable(uint16_t v) {
-    mmio::write16(common_cfg, 0x1C, v);
-}
-uint16_t read_queue_notify_off() {
-    return mmio::read16(common_cfg, 0x1E);
-}
-
-void write_queue_desc(uint64_t v) {
-    mmio::write32(common_cfg, 0x20, static_cast<uint32_t>(v));
-    mmio::write32(common_cfg, 0x24, static_cast<uint32_t>(v >> 32));
-}
-void write_queue_avail(uint64_t v) {
-    mmio::write32(common_cfg, 0x28, static_cast<uint32_t>(v));
-    mmio::write32(common_cfg, 0x2C, static_cast<uint32_t>(v >> 32));
-}
-void write_queue_used(uint64_t v) {
-    mmio::write32(common_cfg, 0x30, static_cast<uint32_t>(v));
-    mmio::write32(common_cfg, 0x34, static_cast<uint32_t>(v >> 32));
-}
-
-void write_driver_features(uint64_t v) {
-    mmio::write32(common_cfg, 0x08, 0);
-    mmio::write32(common_cfg, 0x0C, static_cast<uint32_t>(v));
-    mmio::write32(common_cfg, 0x08, 1);
-    mmio::write32(common_cfg, 0x0C, static_cast<uint32_t>(v >> 32));
-}
-
-// ============================================================================
-// PCI capability helpers (same pattern as virtio_gpu)
-// ============================================================================
-
-struct CapInfo {
-    uint8_t bar;
-    uint32_t offset;
-    uint32_t length;
-};
-
-bool find_cap(int bus, int dev, int func, uint8_t cap_type, CapInfo* out) {
-    uint32_t reg = pci::config_read32(bus, dev, func, 0x04);
-    if (!((reg >> 16) & (1 << 4)))
-        return false;
-
-    uint8_t ptr = pci::config_read32(bus, dev, func, pci::CAP_PTR) & 0xFF;
-    while (ptr != 0) {
-        uint32_t cap_hdr = pci::config_read32(bus, dev, func, ptr);
-        uint8_t cap_id = cap_hdr & 0xFF;
-        uint8_t cap_next = (cap_hdr >> 8) & 0xFF;
-
-        if (cap_id == 0x09) {  // Vendor-specific (VirtIO)
-            uint8_t cfg_type = static_cast<uint8_t>(cap_hdr >> 24);
-            uint32_t w1 = pci::config_read32(bus, dev, func, ptr + 4);
-            uint8_t bar = w1 & 0xFF;
-            uint32_t bar_offset = pci::config_read32(bus, dev, func, ptr + 8);
-            uint32_t bar_length = pci::config_read32(bus, dev, func, ptr + 12);
-
-            if (cfg_type == cap_type) {
-                out->bar = bar;
-                out->offset = bar_offset;
-                out->length = bar_length;
-                return true;
-            }
-        }
-        ptr = cap_next;
-    }
-    return false;
-}
-
-uint32_t read_notify_multiplier(int bus, int dev, int func) {
-    uint8_t ptr = pci::config_read32(bus, dev, func, pci::CAP_PTR) & 0xFF;
-    while (ptr != 0) {
-        uint32_t cap_hdr = pci::config_read32(bus, dev, func, ptr);
-        uint8_t cap_id = cap_hdr & 0xFF;
-        uint8_t cap_next = (cap_hdr >> 8) & 0xFF;
-        uint8_t cfg_type = static_cast<uint8_t>(cap_hdr >> 24);
-
-        if (cap_id == 0x09 && cfg_type == VIRTIO_PCI_CAP_NOTIFY_CFG) {
-            return pci::config_read32(bus, dev, func, ptr + 16);
-        }
-        ptr = cap_next;
-    }
-    return 0;
-}
-
-uintptr_t map_bar_region(int bus, int dev, int func, const CapInfo* ci) {
-    uint32_t bar_lo = pci::read_bar(bus, dev, func, ci->bar);
-    uint64_t bar_phys = bar_lo & ~0xFULL;
-
-    if ((bar_lo & 0x6) == 0x4) {
-        uint32_t bar_hi = pci::read_bar(bus, dev, func, ci->bar + 1);
-        bar_phys |= static_cast<uint64_t>(bar_hi) << 32;
-    }
-
-    uintptr_t phys = static_cast<uintptr_t>(bar_phys) + ci->offset;
-    size_t map_size = ci->length;
-    if (map_size < PG_SIZE)
-        map_size = PG_SIZE;
-
-    return vmm::mmio_map(phys, map_size, VM_WRITE | VM_NOCACHE);
-}
-
 // ============================================================================
 // Linux keycode → ASCII translation (subset)
 // ============================================================================
@@ -258,144 +80,69 @@ static const char keymap_normal[128] = {
 };
 
 // ============================================================================
-// Virtqueue helpers
+// Event queue
 // ============================================================================
 
-void fill_eventq() {
-    for (uint16_t i = 0; i < vq_size; i++) {
-        vq_desc[i].addr = virt_to_phys(&event_bufs[i]);
-        vq_desc[i].len = sizeof(VirtioInputEvent);
-        vq_desc[i].flags = VRING_DESC_F_WRITE;
-        vq_desc[i].next = 0;
-
-        vq_avail->ring[i] = i;
-    }
-    arch_wmb();
-    vq_avail->idx = vq_size;
-    arch_wmb();
+Error post_event(VirtioInputEvent* ev) {
+    virtio::Buffer buf{virt_to_phys(reinterpret_cast<uintptr_t>(ev)), sizeof(VirtioInputEvent), true};
+    return s_eventq.add(&buf, 1, ev);
 }
 
-int init_from_pci_device(int bus, int dev, int func) {
-    cprintf("virtio_kbd: found at PCI %d:%d.%d\n", bus, dev, func);
-    pci::enable_bus_master(bus, dev, func);
-
-    // Ensure PCI INTx is not disabled (bit 10 of Command register)
-    uint32_t cmd = pci::config_read32(bus, dev, func, pci::COMMAND);
-    cmd &= ~(1U << 10);  // clear Interrupt Disable
-    pci::config_write32(bus, dev, func, pci::COMMAND, cmd);
+// INPUT softirq: turn completed key events into console input and
+// hand the buffers back to the device.
+void drain_events() {
+    do {
+        while (auto* ev = static_cast<VirtioInputEvent*>(s_eventq.get_used())) {
+            if (ev->type == EV_KEY && ev->value == 1) {
+                uint16_t code = ev->code;
+                if (code < 128) {
+                    char c = keymap_normal[code];
+                    if (c != 0) {
+                        cons::push_input(c);
+                    }
+                }
+            }
+            static_cast<void>(post_event(ev));  // Recycle the buffer
+        }
+    } while (!s_eventq.enable_interrupts());
 
-    // Walk PCI capabilities to find modern config regions
-    CapInfo common_ci{}, notify_ci{}, isr_ci{};
-    if (!find_cap(bus, dev, func, VIRTIO_PCI_CAP_COMMON_CFG, &common_ci)) {
-        cprintf("virtio_kbd: common_cfg cap not found\n");
-        return -1;
-    }
-    if (!find_cap(bus, dev, func, VIRTIO_PCI_CAP_NOTIFY_CFG, &notify_ci)) {
-        cprintf("virtio_kbd: notify cap not found\n");
-        return -1;
-    }
-    find_cap(bus, dev, func, VIRTIO_PCI_CAP_ISR_CFG, &isr_ci);
+    s_eventq.kick();
+}
 
-    notify_off_multiplier = read_notify_multiplier(bus, dev, func);
+int init_from_pci_device(const pci::DeviceInfo* pdev) {
+    cprintf("virtio_kbd: found at PCI %d:%d.%d\n", pdev->bus, pdev->dev, pdev->func);
 
-    // Map BAR regions
-    uintptr_t common_va = map_bar_region(bus, dev, func, &common_ci);
-    uintptr_t notify_va = map_bar_region(bus, dev, func, &notify_ci);
-    if (common_va == 0 || notify_va == 0) {
-        cprintf("virtio_kbd: failed to map BAR regions\n");
+    if (s_transport.init(pdev) != Error::None) {
         return -1;
     }
-    common_cfg = reinterpret_cast<volatile uint8_t*>(common_va);
-    notify_base = reinterpret_cast<volatile uint8_t*>(notify_va);
-
-    if (isr_ci.length > 0) {
-        uintptr_t isr_va = map_bar_region(bus, dev, func, &isr_ci);
-        isr_cfg = reinterpret_cast<volatile uint8_t*>(isr_va);
-    }
-
-    // Device init sequence (VirtIO 1.x §3.1.1)
-    write_status(0);  // reset
-    write_status(read_status() | VIRTIO_STATUS_ACK);
-    write_status(read_status() | VIRTIO_STATUS_DRIVER);
 
-    // Accept VIRTIO_F_VERSION_1 (bit 32) — required for modern devices
-    write_driver_features(1ULL << 32);
-    write_status(read_status() | VIRTIO_STATUS_FEATURES_OK);
-
-    if (!(read_status() & VIRTIO_STATUS_FEATURES_OK)) {
+    s_transport.begin();
+    if (!s_transport.negotiate(virtio::F_EVENT_IDX).ok()) {
+        s_transport.fail();
         cprintf("virtio_kbd: features negotiation failed\n");
         return -1;
     }
 
-    // Set up eventq (VQ 0)
-    select_queue(0);
-    uint16_t qsz = read_queue_size();
-    if (qsz == 0) {
-        cprintf("virtio_kbd: eventq size is 0\n");
-        return -1;
-    }
-    if (qsz > MAX_QUEUE_SIZE)
-        qsz = MAX_QUEUE_SIZE;
-    vq_size = qsz;
-    write_queue_size(qsz);
-
-    // Allocate separate contiguous regions for desc, avail, used
-    size_t desc_sz = sizeof(VringDesc) * qsz;
-    size_t avail_sz = sizeof(uint16_t) * (3 + qsz);
-    size_t used_sz = sizeof(uint16_t) * 3 + sizeof(VringUsedElem) * qsz;
-
-    size_t desc_pages = (desc_sz + PG_SIZE - 1) / PG_SIZE;
-    size_t avail_pages = (avail_sz + PG_SIZE - 1) / PG_SIZE;
-    size_t used_pages = (used_sz + PG_SIZE - 1) / PG_SIZE;
-
-    vq_desc = static_cast<VringDesc*>(kmalloc(desc_pages * PG_SIZE));
-    vq_avail = static_cast<VringAvail*>(kmalloc(avail_pages * PG_SIZE));
-    vq_used = static_cast<VringUsed*>(kmalloc(used_pages * PG_SIZE));
-    if (!vq_desc || !vq_avail || !vq_used) {
-        kfree(vq_desc);
-        kfree(vq_avail);
-        kfree(vq_used);
-        vq_desc = nullptr;
-        vq_avail = nullptr;
-        vq_used = nullptr;
-        cprintf("virtio_kbd: VQ alloc failed\n");
+    if (s_eventq.init(&s_transport, 0, MAX_QUEUE_SIZE) != Error::None) {
+        s_transport.fail();
+        cprintf("virtio_kbd: eventq setup failed\n");
         return -1;
     }
 
-    memset(vq_desc, 0, desc_pages * PG_SIZE);
-    memset(vq_avail, 0, avail_pages * PG_SIZE);
-    memset(vq_used, 0, used_pages * PG_SIZE);
+    // Fill eventq with writable buffers
+    for (uint16_t i = 0; i < s_eventq.size(); i++) {
+        static_cast<void>(post_event(&event_bufs[i]));
+    }
 
-    // Tell device the physical addresses
-    write_queue_desc(virt_to_phys(reinterpret_cast<uintptr_t>(vq_desc)));
-    write_queue_avail(virt_to_phys(reinterpret_cast<uintptr_t>(vq_avail)));
-    write_queue_used(virt_to_phys(reinterpret_cast<uintptr_t>(vq_used)));
+    // Mark device ready, then hand it the buffers
+    s_transport.ready();
+    s_eventq.kick();
 
-    // Fill eventq with writable buffers
-    fill_eventq();
-
-    // Enable queue
-    write_queue_enable(1);
-
-    // Mark device ready
-    write_status(read_status() | VIRTIO_STATUS_DRIVER_OK);
-
-    // Cache notify address and kick the device
-    select_queue(0);
-    uint16_t q_notify_off = read_queue_notify_off();
-    size_t notify_off = static_cast<size_t>(q_notify_off) * static_cast<size_t>(notify_off_multiplier);
-    vq_notify_addr = reinterpret_cast<volatile uint16_t*>(notify_base + notify_off);
-    *vq_notify_addr = 0;
-
-    // Resolve platform IRQ from PCI INTx and enable it in the interrupt controller
-    uint32_t int_reg = pci::config_read32(bus, dev, func, 0x3C);
-    uint8_t int_pin = (int_reg >> 8) & 0xFF;  // interrupt pin (1-based)
-    if (int_pin == 0)
-        int_pin = 1;  // default to INTA
-    s_irq = arch_pci_intx_to_irq(static_cast<uint8_t>(dev), int_pin);
+    s_irq = s_transport.irq();
+    softirq::open(softirq::INPUT, drain_events);
     arch_irq_enable_line(s_irq);
 
-    cprintf("virtio_kbd: ready, eventq=%d, IRQ=%d\n", qsz, s_irq);
+    cprintf("virtio_kbd: ready, eventq=%d, IRQ=%d\n", s_eventq.size(), s_irq);
     return 0;
 }
 
@@ -404,7 +151,7 @@ Error probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*) {
         return Error::Busy;
     }
 
-    int rc = init_from_pci_device(pdev->bus, pdev->dev, pdev->func);
+    int rc = init_from_pci_device(pdev);
     if (rc == 0) {
         s_initialized = true;
         return Error::None;
@@ -413,7 +160,8 @@ Error probe_callback(const pci::DeviceInfo* pdev, const pci::DriverId*) {
 }
 
 const pci::DriverId VIRTIO_KBD_IDS[] = {
-    {VIRTIO_VENDOR, VIRTIO_INPUT_DEV, pci::ANY_CLASS, pci::ANY_CLASS, pci::ANY_CLASS},
+    {virtio::PCI_VENDOR, virtio::PCI_DEVICE_MODERN + virtio::DEVICE_INPUT, pci::ANY_CLASS, pci::ANY_CLASS,
+     pci::ANY_CLASS},
 };
 
 const pci::Driver VIRTIO_KBD_DRIVER = {
@@ -446,42 +194,12 @@ int init() {
 }
 
 void intr() {
-    // Read ISR to acknowledge interrupt (modern: via ISR cap region)
-    if (isr_cfg) {
-        static_cast<void>(mmio::read8(isr_cfg, 0));
-    }
-
-    // Process used ring entries
-    arch_mb();
-    while (last_used_idx != vq_used->idx) {
-        uint16_t idx = last_used_idx % vq_size;
-        uint32_t desc_id = vq_used->ring[idx].id;
-
-        VirtioInputEvent* ev = &event_bufs[desc_id];
-
-        if (ev->type == EV_KEY && ev->value == 1) {
-            uint16_t code = ev->code;
-            if (code < 128) {
-                char c = keymap_normal[code];
-                if (c != 0) {
-                    cons::push_input(c);
-                }
-            }
-        }
-
-        // Recycle descriptor
-        uint16_t avail_idx = vq_avail->idx % vq_size;
-        vq_avail->ring[avail_idx] = static_cast<uint16_t>(desc_id);
-        arch_wmb();
-        vq_avail->idx++;
-        arch_wmb();
-
-        last_used_idx++;
+    // Read ISR to acknowledge interrupt
+    if (s_initialized) {
+        static_cast<void>(s_transport.ack_interrupt());
     }
 
-    // Notify device we recycled buffers (use cached address)
-    if (vq_notify_addr)
-        *vq_notify_addr = 0;
+    softirq::raise(softirq::INPUT);
 }
 
 int irq() {
@@ -9,6 +9,7 @@
 #include "mm/pmm.h"
 #include "mm/vmm.h"
 #include "sched/sched.h"
+#include "time/vdso.h"
 #include "drivers/intr.h"
 #include "debug/assert.h"
 
@@ -63,10 +64,77 @@ pde_t* create_user_pgdir() {
     memcpy(&pgdir[USER_TOP_ENTRIES], &boot_pgdir[USER_TOP_ENTRIES],
            (PAGE_TABLE_ENTRIES - USER_TOP_ENTRIES) * sizeof(pde_t));
 
+    if (vdso::map(pgdir) != Error::None) {
+        cprintf("exec: failed to map the vDSO\n");
+        pmm::free_user_pgdir(pgdir);
+        return nullptr;
+    }
+
     return pgdir;
 }
 
-uintptr_t setup_user_stack(pde_t* pgdir) {
+static int count_args(const char* const* args) {
+    int n = 0;
+    while (args && args[n]) {
+        n++;
+    }
+    return n;
+}
+
+static size_t args_bytes(const char* const* args, int n) {
+    size_t bytes = 0;
+    for (int i = 0; i < n; i++) {
+        bytes += strlen(args[i]) + 1;
+    }
+    return bytes;
+}
+
+// `pgdir` is the new program's, not the current address space, so go
+// through the kernel mapping of each page.
+static void copy_to_pgdir(pde_t* pgdir, uintptr_t va, const void* src, size_t size) {
+    const auto* from = static_cast<const uint8_t*>(src);
+
+    iterate_pages(va, size, [&](uintptr_t cur, size_t chunk) {
+        pte_t* ptep = pmm::get_pte(pgdir, cur, false);
+        assert(ptep && (*ptep & VM_PRESENT));
+
+        uint8_t* kva = phys_to_virt<uint8_t>(pte_addr(*ptep));
+        memcpy(kva + (cur & PG_MASK), from, chunk);
+
+        from += chunk;
+    });
+}
+
+// Copy each string up to `*str` and store its user address at `*slot`,
+// then the NULL terminator.
+static void push_args(pde_t* pgdir, const char* const* args, int n, uintptr_t* slot, uintptr_t* str) {
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(args[i]) + 1;
+        copy_to_pgdir(pgdir, *str, args[i], len);
+        copy_to_pgdir(pgdir, *slot, str, sizeof(*str));
+        *str += len;
+        *slot += sizeof(uintptr_t);
+    }
+
+    uintptr_t null = 0;
+    copy_to_pgdir(pgdir, *slot, &null, sizeof(null));
+    *slot += sizeof(uintptr_t);
+}
+
+uintptr_t setup_user_stack(pde_t* pgdir, const char* const* argv, const char* const* envp) {
+    int argc = count_args(argv);
+    int envc = count_args(envp);
+    if (argc > MAX_ARGS || envc > MAX_ARGS) {
+        cprintf("exec: too many arguments (%d argv, %d envp, max %d)\n", argc, envc, MAX_ARGS);
+        return 0;
+    }
+
+    size_t str_bytes = args_bytes(argv, argc) + args_bytes(envp, envc);
+    if (str_bytes > MAX_ARG_BYTES) {
+        cprintf("exec: arguments too long (%lu bytes, max %lu)\n", str_bytes, MAX_ARG_BYTES);
+        return 0;
+    }
+
     uintptr_t stack_bottom = USER_STACK_TOP - USER_STACK_SIZE;
 
     for (uintptr_t va = stack_bottom; va < USER_STACK_TOP; va += PG_SIZE) {
@@ -79,7 +147,32 @@ uintptr_t setup_user_stack(pde_t* pgdir) {
         memset(phys_to_virt(pmm::page_to_phys(page)), 0, PG_SIZE);
     }
 
-    return USER_STACK_TOP;
+    // Strings at the top; below them argc, argv[], envp[] and the
+    // auxiliary vector, with the stack pointer 16-byte aligned on argc.
+    uintptr_t auxv[6]{};
+    size_t auxv_words = 0;
+    auxv[auxv_words++] = AT_PAGESZ;
+    auxv[auxv_words++] = PG_SIZE;
+    if (vdso::available()) {
+        auxv[auxv_words++] = AT_ZONIX_VDSO;
+        auxv[auxv_words++] = vdso::TEXT_ADDR;
+    }
+    auxv[auxv_words++] = AT_NULL;
+    auxv[auxv_words++] = 0;
+
+    uintptr_t str = USER_STACK_TOP - str_bytes;
+    size_t nr_words = 1 + (argc + 1) + (envc + 1) + auxv_words;
+    uintptr_t sp = round_down(str - nr_words * sizeof(uintptr_t), 16);
+
+    uintptr_t slot = sp;
+    uintptr_t argc_word = argc;
+    copy_to_pgdir(pgdir, slot, &argc_word, sizeof(argc_word));
+    slot += sizeof(uintptr_t);
+    push_args(pgdir, argv, argc, &slot, &str);
+    push_args(pgdir, envp, envc, &slot, &str);
+    copy_to_pgdir(pgdir, slot, auxv, auxv_words * sizeof(uintptr_t));
+
+    return sp;
 }
 
 static uintptr_t load_binary(const uint8_t* data, size_t size, pde_t* pgdir) {
@@ -92,7 +185,7 @@ static uintptr_t load_binary(const uint8_t* data, size_t size, pde_t* pgdir) {
     return 0;
 }
 
-Result<int> exec(const char* path) {
+Result<int> spawn(const char* path, const char* const* argv, const char* const* envp) {
     ENSURE(path);
 
     OpenFile file;
@@ -133,7 +226,7 @@ Result<int> exec(const char* path) {
         return Error::Fail;
     }
 
-    uintptr_t user_rsp = setup_user_stack(user_pgdir);
+    uintptr_t user_rsp = setup_user_stack(user_pgdir, argv, envp);
     if (user_rsp == 0) {
         cprintf("exec: failed to set up user stack\n");
         pmm::free_user_pgdir(user_pgdir);
@@ -147,10 +240,11 @@ Result<int> exec(const char* path) {
     mm->pgdir = user_pgdir;
     mm->map_count = 0;
 
+    // The child starts in `mm` directly rather than sharing ours first.
     int pid{};
     {
         intr::Guard guard;
-        auto pid_r = sched::fork(0, user_rsp, &tf);
+        auto pid_r = sched::fork(0, user_rsp, &tf, mm);
         if (!pid_r.ok()) {
             cprintf("exec: fork failed\n");
             delete mm;
@@ -160,13 +254,21 @@ Result<int> exec(const char* path) {
 
         TaskStruct* proc = sched::find_proc(pid);
         if (proc) {
-            proc->memory = mm;
             proc->set_name(path);
         }
     }
 
-    cprintf("exec: started user process '%s' (PID %d) entry=0x%lx rsp=0x%lx\n", path, pid, entry, user_rsp);
     return pid;
 }
 
+Result<int> exec(const char* path) {
+    const char* argv[] = {path, nullptr};
+
+    auto pid_r = spawn(path, argv, nullptr);
+    if (pid_r.ok()) {
+        cprintf("exec: started user process '%s' (PID %d)\n", path, pid_r.value());
+    }
+    return pid_r;
+}
+
 }  // namespace exec
@@ -8,10 +8,24 @@
 namespace exec {
 
 inline constexpr size_t MAX_BINARY_SIZE = 1024ULL * 1024ULL;  // 1 MB
+inline constexpr int MAX_ARGS = 32;                            // Entries in argv, and in envp
+inline constexpr size_t MAX_ARG_BYTES = PG_SIZE;               // argv + envp strings, NULs included
 
+// Kernel half plus the vDSO pages (time/vdso.h).
 pde_t* create_user_pgdir();
-uintptr_t setup_user_stack(pde_t* pgdir);
 
+// Map the user stack and lay out the arguments System V style: argc at the
+// returned stack pointer, then the NULL-terminated argv[] and envp[] pointer
+// arrays and the auxiliary vector (abi/vdso.h), with the strings above them.  `argv`/`envp` are NULL-terminated
+// kernel arrays and may be null.  Returns 0 on failure.
+uintptr_t setup_user_stack(pde_t* pgdir, const char* const* argv = nullptr, const char* const* envp = nullptr);
+
+// Load the program at `path` into a fresh address space and start it as a
+// child of the caller; returns its PID.  Nothing of the caller's address
+// space is copied.
+Result<int> spawn(const char* path, const char* const* argv, const char* const* envp);
+
+// spawn() with argv = { path }, logged to the console.
 Result<int> exec(const char* path);
 
 }  // namespace exec
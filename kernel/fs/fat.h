@@ -30,6 +30,8 @@ public:
 
     Error mount(BlockDevice* dev);
     void unmount();
+    // Write back the metadata the buffer cache holds dirty.
+    Error sync();
 
     void print() const;
 
@@ -53,6 +55,7 @@ private:
 
     uint32_t alloc_cluster();
     Error free_chain(uint32_t start_cluster);
+    Error zero_sectors(uint32_t abs_sector, uint32_t count);
 
     Error find_entry(uint32_t start_cluster, const char* name, FatDirEntry* out);
     Error resolve_parent(const char* relpath, uint32_t* parent_cluster, char* child_name, size_t name_size);
@@ -83,8 +86,4 @@ private:
     uint32_t data_start_{};           // Data area start sector
     uint32_t cluster_count_{};        // Total clusters
     uint32_t total_sectors_{};        // Total sectors
-
-    uint8_t buffer_[512]{};     // Sector buffer
-    uint32_t buffer_sector_{};  // Buffered sector number
-    bool buffer_dirty_{};       // Buffer modified flag
 };
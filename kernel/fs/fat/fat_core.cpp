@@ -1,7 +1,10 @@
 #include "fs/fat.h"
 
+#include "block/bcache.h"
+#include "lib/lock_guard.h"
 #include "lib/memory.h"
 #include "lib/stdio.h"
+#include "sched/sched.h"
 
 #include <base/bpb.h>
 #include <base/gpt.h>
@@ -9,8 +12,6 @@
 
 namespace {
 
-constexpr uint32_t FAT_INVALID_SECTOR = static_cast<uint32_t>(-1);
-
 Result<uint32_t> find_partition_start(BlockDevice* dev) {
     MbrHeader mbr{};
     TRY_LOG(dev->read(0, &mbr, 1), "fat_mount: failed to read sector 0");
@@ -63,8 +64,6 @@ void FatInfo::do_init_state(BlockDevice* dev, uint32_t partition_start, const Fa
     uint32_t data_sectors = total_sectors_ - data_start_;
     cluster_count_ = data_sectors / sectors_per_cluster_;
     fat_type_ = fat::TYPE_FAT32;
-
-    buffer_sector_ = FAT_INVALID_SECTOR;
 }
 
 Error FatInfo::mount(BlockDevice* dev) {
@@ -93,19 +92,19 @@ Error FatInfo::mount(BlockDevice* dev) {
 }
 
 void FatInfo::unmount() {
-    if (buffer_dirty_ && buffer_sector_ != FAT_INVALID_SECTOR) {
-        for (uint32_t i = 0; i < num_fats_; i++) {
-            uint32_t fat_sector = fat_start_ + (i * fat_size_) + (buffer_sector_ - fat_start_);
-            if (dev_->write(partition_start_ + fat_sector, buffer_, 1) != Error::None) {
-                cprintf("fat_unmount: failed to write FAT sector %d\n", fat_sector);
-            }
+    if (dev_) {
+        if (sync() != Error::None) {
+            cprintf("fat_unmount: failed to write back metadata\n");
         }
-        buffer_dirty_ = false;
+        bcache::invalidate(dev_);
     }
 
     dev_ = nullptr;
-    buffer_sector_ = FAT_INVALID_SECTOR;
-    buffer_dirty_ = false;
+}
+
+Error FatInfo::sync() {
+    ENSURE(dev_);
+    return bcache::flush(dev_);
 }
 
 void FatInfo::print() const {
@@ -132,14 +131,13 @@ uint32_t FatInfo::read_entry(uint32_t cluster) {
     uint32_t fat_sector = fat_start_ + (fat_offset / bytes_per_sector_);
     uint32_t ent_offset = fat_offset % bytes_per_sector_;
 
-    if (fat_sector != buffer_sector_) {
-        if (dev_->read(partition_start_ + fat_sector, buffer_, 1) != Error::None) {
-            return 0;
-        }
-        buffer_sector_ = fat_sector;
+    bcache::BufferRef buf(bcache::read(dev_, partition_start_ + fat_sector).value_or(nullptr));
+    if (!buf) {
+        return 0;
     }
 
-    uint32_t value = *reinterpret_cast<uint32_t*>(&buffer_[ent_offset]);
+    LockGuard<Mutex> guard(buf->lock);
+    uint32_t value = *reinterpret_cast<const uint32_t*>(&buf->data[ent_offset]);
     return value & fat::FAT32_CLUSTER_MASK;
 }
 
@@ -150,46 +148,45 @@ Error FatInfo::write_entry(uint32_t cluster, uint32_t value) {
     uint32_t fat_sector = fat_start_ + (fat_offset / bytes_per_sector_);
     uint32_t ent_offset = fat_offset % bytes_per_sector_;
 
-    if (fat_sector != buffer_sector_) {
-        if (buffer_dirty_ && buffer_sector_ != FAT_INVALID_SECTOR) {
-            for (uint32_t i = 0; i < num_fats_; i++) {
-                uint32_t abs_sector = partition_start_ + buffer_sector_ + (i * fat_size_);
-                TRY(dev_->write(abs_sector, buffer_, 1));
-            }
-            buffer_dirty_ = false;
-        }
+    // Update every FAT copy in the cache; sync() writes them back.
+    for (uint32_t i = 0; i < num_fats_; i++) {
+        bcache::BufferRef buf(TRY(bcache::read(dev_, partition_start_ + fat_sector + (i * fat_size_))));
+        LockGuard<Mutex> guard(buf->lock);
 
-        TRY(dev_->read(partition_start_ + fat_sector, buffer_, 1));
-        buffer_sector_ = fat_sector;
+        // Preserve top 4 reserved bits.
+        auto* entry = reinterpret_cast<uint32_t*>(&buf->data[ent_offset]);
+        *entry = (*entry & 0xF0000000) | (value & fat::FAT32_CLUSTER_MASK);
+        bcache::mark_dirty(buf.get());
     }
 
-    // Preserve top 4 reserved bits.
-    uint32_t old = *reinterpret_cast<uint32_t*>(&buffer_[ent_offset]);
-    *reinterpret_cast<uint32_t*>(&buffer_[ent_offset]) = (old & 0xF0000000) | (value & fat::FAT32_CLUSTER_MASK);
-    buffer_dirty_ = true;
+    return Error::None;
+}
+
+// Submitted as one batch so the request queue merges the run of single
+// sectors into one transfer.  Cached copies, such as a freed directory's,
+// are dropped first so they cannot be written back over the zeroes.
+Error FatInfo::zero_sectors(uint32_t abs_sector, uint32_t count) {
+    static const uint8_t ZERO[BlockDevice::SIZE]{};
 
-    // Write through to all FAT copies immediately.
-    for (uint32_t i = 0; i < num_fats_; i++) {
-        uint32_t abs_sector = partition_start_ + fat_sector + (i * fat_size_);
-        TRY(dev_->write(abs_sector, buffer_, 1));
-    }
-    buffer_dirty_ = false;
+    bcache::discard(dev_, abs_sector, count);
 
-    return Error::None;
+    blk::Batch batch(dev_);
+    for (uint32_t s = 0; s < count; s++) {
+        TRY(batch.add(blk::Op::Write, abs_sector + s, ZERO, 1));
+    }
+    return batch.finish();
 }
 
 uint32_t FatInfo::alloc_cluster() {
     for (uint32_t c = 2; c < cluster_count_ + 2; c++) {
+        sched::cond_resched();
+
         if (read_entry(c) == fat::FAT32_FREE) {
             if (write_entry(c, fat::FAT32_EOC_MAX) != Error::None)
                 return 0;
 
-            uint8_t zero[512]{};
-            uint32_t sector = cluster_to_sector(c);
-            for (uint32_t s = 0; s < sectors_per_cluster_; s++) {
-                if (dev_->write(partition_start_ + sector + s, zero, 1) != Error::None)
-                    return 0;
-            }
+            if (zero_sectors(partition_start_ + cluster_to_sector(c), sectors_per_cluster_) != Error::None)
+                return 0;
             return c;
         }
     }
@@ -199,6 +196,8 @@ uint32_t FatInfo::alloc_cluster() {
 Error FatInfo::free_chain(uint32_t start_cluster) {
     uint32_t cluster = start_cluster;
     while (cluster >= 2 && cluster < fat::FAT32_EOC_MIN) {
+        sched::cond_resched();
+
         uint32_t next = read_entry(cluster);
         TRY(write_entry(cluster, fat::FAT32_FREE));
         cluster = next;
@@ -1,10 +1,13 @@
 #include "fs/fat.h"
 
+#include "block/bcache.h"
 #include "lib/array.h"
+#include "lib/lock_guard.h"
 #include "lib/math.h"
 #include "lib/memory.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
+#include "sched/sched.h"
 #include <base/bpb.h>
 
 namespace {
@@ -13,6 +16,8 @@ constexpr int MAX_PART_LEN = 13;
 constexpr int MAX_DEPTH = 16;
 constexpr uint32_t FAT_IO_MAX_CLUSTER_BUF = 4096;
 
+using DirSector = SectorArray<FatDirEntry>;
+
 static char to_upper(char ch) {
     return (ch >= 'a' && ch <= 'z') ? static_cast<char>(ch - 32) : ch;
 }
@@ -33,6 +38,10 @@ static bool next_part(const char*& path, char (&buf)[N]) {
     return true;
 }
 
+static DirSector& dir_sector(const bcache::BufferRef& buf) {
+    return *reinterpret_cast<DirSector*>(buf->data);
+}
+
 }  // namespace
 
 Result<int> FatInfo::do_file_io(FatDirEntry* entry, uint8_t* io_buf, uint32_t offset, uint32_t size, const char* op,
@@ -53,6 +62,8 @@ Result<int> FatInfo::do_file_io(FatDirEntry* entry, uint8_t* io_buf, uint32_t of
     uint32_t solve_bytes{};
 
     for (; cluster >= 2 && cluster < fat::FAT32_EOC_MIN && solve_bytes < size; cluster = read_entry(cluster)) {
+        sched::cond_resched();
+
         uint32_t sector = cluster_to_sector(cluster);
         TRY_LOG(dev_->read(partition_start_ + sector, cluster_buf, sectors_per_cluster_),
                 "fat_%s_file: failed to read cluster %d", op, cluster);
@@ -83,7 +94,6 @@ Result<int> FatInfo::do_file_io(FatDirEntry* entry, uint8_t* io_buf, uint32_t of
 
 Result<int> FatInfo::read_dir(uint32_t start_cluster, DirVisitor& visitor, bool verbose_read_error) {
     int count{};
-    SectorArray<FatDirEntry> sector_buf{};
 
     for (uint32_t cluster = start_cluster; cluster >= 2 && cluster < fat::FAT32_EOC_MIN;
          cluster = read_entry(cluster)) {
@@ -91,14 +101,22 @@ Result<int> FatInfo::read_dir(uint32_t start_cluster, DirVisitor& visitor, bool
 
         for (uint32_t i = 0; i < sectors_per_cluster_; i++) {
             uint32_t sector = base_sector + i;
-            if (dev_->read(partition_start_ + sector, &sector_buf, 1) != Error::None) {
+            bcache::BufferRef buf(bcache::read(dev_, partition_start_ + sector).value_or(nullptr));
+            if (!buf) {
                 if (verbose_read_error) {
                     cprintf("fat_read_dir: failed to read sector %d\n", sector);
                 }
                 return Error::IO;
             }
 
-            for (auto& entry : sector_buf.entries) {
+            // The visitor runs with no buffer locked: it sees a copy of
+            // each entry, taken under buf->lock.
+            for (const auto& slot : dir_sector(buf).entries) {
+                FatDirEntry entry{};
+                {
+                    LockGuard<Mutex> guard(buf->lock);
+                    entry = slot;
+                }
                 if (entry.is_end()) {
                     return count;
                 }
@@ -135,15 +153,14 @@ Result<int> FatInfo::read_dir(const char* relpath, DirVisitor& visitor) {
 }
 
 Error FatInfo::find_entry(uint32_t start_cluster, const char* name, FatDirEntry* out) {
-    SectorArray<FatDirEntry> sector_buf{};
-
     for (uint32_t cluster = start_cluster; cluster >= 2 && cluster < fat::FAT32_EOC_MIN;
          cluster = read_entry(cluster)) {
         uint32_t base_sector = cluster_to_sector(cluster);
         for (uint32_t i = 0; i < sectors_per_cluster_; i++) {
-            TRY(dev_->read(partition_start_ + base_sector + i, &sector_buf, 1));
+            bcache::BufferRef buf(TRY(bcache::read(dev_, partition_start_ + base_sector + i)));
+            LockGuard<Mutex> guard(buf->lock);
 
-            for (auto& entry : sector_buf.entries) {
+            for (auto& entry : dir_sector(buf).entries) {
                 if (entry.is_end())
                     return Error::NotFound;
 
@@ -265,23 +282,21 @@ Error FatInfo::resolve_parent(const char* relpath, uint32_t* parent_cluster, cha
 }
 
 Error FatInfo::add_dir_entry(uint32_t dir_cluster, const FatDirEntry* new_entry) {
-    using Sector = SectorArray<FatDirEntry>;
-    Sector sector_buf{};
-
     for (uint32_t cluster = dir_cluster; cluster >= 2 && cluster < fat::FAT32_EOC_MIN; cluster = read_entry(cluster)) {
         uint32_t base_sector = cluster_to_sector(cluster);
         for (uint32_t i = 0; i < sectors_per_cluster_; i++) {
-            uint32_t abs_sector = partition_start_ + base_sector + i;
-            TRY(dev_->read(abs_sector, &sector_buf, 1));
-
-            for (int j = 0; j < Sector::COUNT; j++) {
-                if (sector_buf.entries[j].is_end() || sector_buf.entries[j].is_deleted()) {
-                    bool was_end = sector_buf.entries[j].is_end();
-                    sector_buf.entries[j] = *new_entry;
-                    if (was_end && j + 1 < Sector::COUNT) {
-                        sector_buf.entries[j + 1] = {};
+            bcache::BufferRef buf(TRY(bcache::read(dev_, partition_start_ + base_sector + i)));
+            LockGuard<Mutex> guard(buf->lock);
+
+            auto& entries = dir_sector(buf).entries;
+            for (size_t j = 0; j < DirSector::COUNT; j++) {
+                if (entries[j].is_end() || entries[j].is_deleted()) {
+                    bool was_end = entries[j].is_end();
+                    entries[j] = *new_entry;
+                    if (was_end && j + 1 < DirSector::COUNT) {
+                        entries[j + 1] = {};
                     }
-                    TRY(dev_->write(abs_sector, &sector_buf, 1));
+                    bcache::mark_dirty(buf.get());
                     return Error::None;
                 }
             }
@@ -298,19 +313,18 @@ Error FatInfo::add_dir_entry(uint32_t dir_cluster, const FatDirEntry* new_entry)
                 return Error::IO;
             }
 
+            // alloc_cluster() zeroed the cluster; only the first sector changes.
             uint32_t new_base_sector = partition_start_ + cluster_to_sector(new_cluster);
-            memset(&sector_buf, 0, sizeof(sector_buf));
-            sector_buf.entries[0] = *new_entry;
-
-            for (uint32_t s = 0; s < sectors_per_cluster_; s++) {
-                if (dev_->write(new_base_sector + s, &sector_buf, 1) != Error::None) {
-                    free_chain(new_cluster);
-                    return Error::IO;
-                }
-                if (s == 0) {
-                    memset(&sector_buf, 0, sizeof(sector_buf));
-                }
+            bcache::BufferRef buf(bcache::get(dev_, new_base_sector).value_or(nullptr));
+            if (!buf) {
+                free_chain(new_cluster);
+                return Error::IO;
             }
+
+            LockGuard<Mutex> guard(buf->lock);
+            memset(buf->data, 0, BlockDevice::SIZE);
+            dir_sector(buf).entries[0] = *new_entry;
+            bcache::mark_dirty(buf.get());
             return Error::None;
         }
     }
@@ -319,17 +333,14 @@ Error FatInfo::add_dir_entry(uint32_t dir_cluster, const FatDirEntry* new_entry)
 }
 
 Error FatInfo::remove_dir_entry(uint32_t dir_cluster, const char* name) {
-    using Sector = SectorArray<FatDirEntry>;
-    Sector sector_buf{};
-
     for (uint32_t cluster = dir_cluster; cluster >= 2 && cluster < fat::FAT32_EOC_MIN; cluster = read_entry(cluster)) {
         uint32_t base_sector = cluster_to_sector(cluster);
         for (uint32_t i = 0; i < sectors_per_cluster_; i++) {
-            uint32_t abs_sector = partition_start_ + base_sector + i;
-            TRY(dev_->read(abs_sector, &sector_buf, 1));
+            bcache::BufferRef buf(TRY(bcache::read(dev_, partition_start_ + base_sector + i)));
+            LockGuard<Mutex> guard(buf->lock);
 
-            auto& entries = sector_buf.entries;
-            for (uint32_t j = 0; j < Sector::COUNT; j++) {
+            auto& entries = dir_sector(buf).entries;
+            for (size_t j = 0; j < DirSector::COUNT; j++) {
                 if (entries[j].is_end()) {
                     return Error::NotFound;
                 }
@@ -346,7 +357,7 @@ Error FatInfo::remove_dir_entry(uint32_t dir_cluster, const char* name) {
 
                 if (strcmp(entry_name, name) == 0) {
                     entries[j].name[0] = static_cast<char>(0xE5);  // Mark deleted.
-                    TRY(dev_->write(abs_sector, &sector_buf, 1));
+                    bcache::mark_dirty(buf.get());
                     return Error::None;
                 }
             }
@@ -386,36 +397,39 @@ Error FatInfo::mkdir(const char* relpath) {
     dir_entry.file_size = 0;
 
     // Write the "." and ".." entries into the new directory cluster.
-    uint8_t sector_buf[512]{};
-    memset(sector_buf, 0, sizeof(sector_buf));
-    auto* entries = reinterpret_cast<FatDirEntry*>(sector_buf);
-
-    // "." entry
-    memset(&entries[0], 0, sizeof(FatDirEntry));
-    memset(entries[0].name, ' ', 8);
-    memset(entries[0].ext, ' ', 3);
-    entries[0].name[0] = '.';
-    entries[0].attr = FAT_ATTR_DIRECTORY;
-    entries[0].first_cluster_high = static_cast<uint16_t>(new_cluster >> 16);
-    entries[0].first_cluster_low = static_cast<uint16_t>(new_cluster & 0xFFFF);
-
-    // ".." entry
-    memset(&entries[1], 0, sizeof(FatDirEntry));
-    memset(entries[1].name, ' ', 8);
-    memset(entries[1].ext, ' ', 3);
-    entries[1].name[0] = '.';
-    entries[1].name[1] = '.';
-    entries[1].attr = FAT_ATTR_DIRECTORY;
-    uint32_t parent_val = (parent_cluster == root_cluster_) ? 0 : parent_cluster;
-    entries[1].first_cluster_high = static_cast<uint16_t>(parent_val >> 16);
-    entries[1].first_cluster_low = static_cast<uint16_t>(parent_val & 0xFFFF);
-
-    uint32_t sector = partition_start_ + cluster_to_sector(new_cluster);
-    if (dev_->write(sector, sector_buf, 1) != Error::None) {
+    bcache::BufferRef buf(bcache::get(dev_, partition_start_ + cluster_to_sector(new_cluster)).value_or(nullptr));
+    if (!buf) {
         free_chain(new_cluster);
         return Error::IO;
     }
 
+    {
+        LockGuard<Mutex> guard(buf->lock);
+        memset(buf->data, 0, BlockDevice::SIZE);
+        auto* entries = reinterpret_cast<FatDirEntry*>(buf->data);
+
+        // "." entry
+        memset(&entries[0], 0, sizeof(FatDirEntry));
+        memset(entries[0].name, ' ', 8);
+        memset(entries[0].ext, ' ', 3);
+        entries[0].name[0] = '.';
+        entries[0].attr = FAT_ATTR_DIRECTORY;
+        entries[0].first_cluster_high = static_cast<uint16_t>(new_cluster >> 16);
+        entries[0].first_cluster_low = static_cast<uint16_t>(new_cluster & 0xFFFF);
+
+        // ".." entry
+        memset(&entries[1], 0, sizeof(FatDirEntry));
+        memset(entries[1].name, ' ', 8);
+        memset(entries[1].ext, ' ', 3);
+        entries[1].name[0] = '.';
+        entries[1].name[1] = '.';
+        entries[1].attr = FAT_ATTR_DIRECTORY;
+        uint32_t parent_val = (parent_cluster == root_cluster_) ? 0 : parent_cluster;
+        entries[1].first_cluster_high = static_cast<uint16_t>(parent_val >> 16);
+        entries[1].first_cluster_low = static_cast<uint16_t>(parent_val & 0xFFFF);
+        bcache::mark_dirty(buf.get());
+    }
+
     // Add the entry to the parent directory.
     if (add_dir_entry(parent_cluster, &dir_entry) != Error::None) {
         free_chain(new_cluster);
@@ -489,15 +503,15 @@ Error FatInfo::rmdir(const char* relpath) {
 
     // Check that directory is empty (only . and .. allowed).
     uint32_t dir_cluster = entry.get_cluster();
-    uint8_t sector_buf[512]{};
     bool empty = true;
 
     for (uint32_t cluster = dir_cluster; cluster >= 2 && cluster < fat::FAT32_EOC_MIN && empty;
          cluster = read_entry(cluster)) {
         uint32_t base_sector = cluster_to_sector(cluster);
         for (uint32_t i = 0; i < sectors_per_cluster_ && empty; i++) {
-            TRY(dev_->read(partition_start_ + base_sector + i, sector_buf, 1));
-            auto* dir_entries = reinterpret_cast<FatDirEntry*>(sector_buf);
+            bcache::BufferRef buf(TRY(bcache::read(dev_, partition_start_ + base_sector + i)));
+            LockGuard<Mutex> guard(buf->lock);
+            auto* dir_entries = dir_sector(buf).entries;
             for (uint32_t j = 0; j < bytes_per_sector_ / 32; j++) {
                 if (dir_entries[j].is_end()) {
                     break;
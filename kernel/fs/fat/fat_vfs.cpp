@@ -108,27 +108,34 @@ public:
 
     Error mkdir(const char* relpath) override {
         ENSURE(relpath && relpath[0] != '\0');
-        return fat_.mkdir(relpath);
+        return synced(fat_.mkdir(relpath));
     }
 
     Error create(const char* relpath) override {
         ENSURE(relpath && relpath[0] != '\0');
-        return fat_.create_file(relpath);
+        return synced(fat_.create_file(relpath));
     }
 
     Error unlink(const char* relpath) override {
         ENSURE(relpath && relpath[0] != '\0');
-        return fat_.unlink(relpath);
+        return synced(fat_.unlink(relpath));
     }
 
     Error rmdir(const char* relpath) override {
         ENSURE(relpath && relpath[0] != '\0');
-        return fat_.rmdir(relpath);
+        return synced(fat_.rmdir(relpath));
     }
 
     void print() override { fat_.print(); }
 
 private:
+    // Metadata an operation dirtied reaches the disk before it returns, in
+    // one merged write-back instead of a write per entry.
+    Error synced(Error err) {
+        Error flushed = fat_.sync();
+        return err != Error::None ? err : flushed;
+    }
+
     FatInfo fat_{};
 };
 
@@ -1,5 +1,6 @@
 #include "fd.h"
 #include "fs/vfs.h"
+#include "lib/lock_guard.h"
 
 namespace fd {
 
@@ -12,6 +13,7 @@ void Table::init() {
 Result<int> Table::alloc(vfs::File* file) {
     ENSURE(file, Error::Invalid);
 
+    LockGuard<Spinlock> guard(lock_);
     for (auto& entry : entries_) {
         if (!entry.used) {
             entry.set(file, 0, true);
@@ -34,18 +36,45 @@ Entry* Table::get(int fd) {
     return &entries_[fd];
 }
 
-Error Table::close(int fd) {
+// The reference keeps the file alive across a blocking read or write while
+// a sibling thread closes `fd`.
+vfs::File* Table::get_file(int fd, size_t* offset) {
+    LockGuard<Spinlock> guard(lock_);
     Entry* entry = get(fd);
     if (!entry) {
-        return Error::Invalid;
+        return nullptr;
     }
 
-    vfs::close(entry->file);
-    entry->reset();
+    *offset = entry->offset;
+    return entry->file->get();
+}
+
+void Table::advance(int fd, const vfs::File* file, size_t bytes) {
+    LockGuard<Spinlock> guard(lock_);
+    Entry* entry = get(fd);
+    if (entry && entry->file == file) {
+        entry->offset += bytes;
+    }
+}
+
+Error Table::close(int fd) {
+    vfs::File* file = nullptr;
+    {
+        LockGuard<Spinlock> guard(lock_);
+        Entry* entry = get(fd);
+        if (!entry) {
+            return Error::Invalid;
+        }
+        file = entry->file;
+        entry->reset();
+    }
 
+    // The file system may block; close outside the table lock.
+    vfs::close(file);
     return Error::None;
 }
 
+// Only the last user of a table calls this, so nothing races with it.
 void Table::close_all() {
     for (auto& entry : entries_) {
         if (entry.used && entry.file) {
@@ -2,6 +2,7 @@
 
 #include <base/types.h>
 #include "lib/result.h"
+#include "lib/spinlock.h"
 
 namespace vfs {
 class File;
@@ -29,17 +30,31 @@ struct Entry {
     inline void reset() { set(nullptr, 0, false); }
 };
 
+// Tasks created with CLONE_FILES share one Table; `users_` counts them and
+// the last put() leaves the caller to close and free it.
 class Table {
 public:
     void init();
     Result<int> alloc(vfs::File* file);
+    // Unlocked: the entry can be closed under a caller that shares the table.
     Entry* get(int fd);
+    // The file open at `fd`, referenced, and the slot's offset; nullptr when
+    // `fd` is not open.  The caller vfs::close()s the file when done.
+    vfs::File* get_file(int fd, size_t* offset);
+    // Moves `fd`'s offset on by `bytes`, unless the slot no longer holds
+    // `file`.
+    void advance(int fd, const vfs::File* file, size_t bytes);
     Error close(int fd);
     void close_all();
     Error fork_from(const Table& parent, ForkPolicy policy);
 
+    void get() { __atomic_add_fetch(&users_, 1, __ATOMIC_RELAXED); }
+    [[nodiscard]] bool put() { return __atomic_sub_fetch(&users_, 1, __ATOMIC_ACQ_REL) == 0; }
+
 private:
     Entry entries_[MAX_FD]{};
+    int users_{1};
+    Spinlock lock_{};  // Slot allocation and release among sharing threads
 };
 
 }  // namespace fd
\ No newline at end of file
@@ -2,21 +2,40 @@
 
 #include "fs/vfs.h"
 #include "block/blk.h"
+#include "drivers/ramdisk.h"
 #include "lib/stdio.h"
 
 namespace rootfs {
 
+namespace {
+
+bool try_mount(BlockDevice* dev) {
+    if (vfs::mount("/", dev, "fat") != Error::None) {
+        return false;
+    }
+    cprintf("rootfs: mounted %s at /\n", dev->name);
+    return true;
+}
+
+}  // namespace
+
 int init() {
+    // A boot image the loader handed over wins over the disks; a blank
+    // ramdisk holds no filesystem yet.
+    RamDisk* ram = ramdisk::device();
+    if (ram && ram->has_image() && try_mount(ram)) {
+        return 0;
+    }
+
     int count = BlockManager::get_device_count();
 
     for (int i = 0; i < count; i++) {
         BlockDevice* dev = BlockManager::get_device(i);
-        if (!dev || dev->type != blk::DeviceType::Disk) {
+        if (!dev || dev->type != blk::DeviceType::Disk || dev == ram) {
             continue;
         }
 
-        if (vfs::mount("/", dev, "fat") == Error::None) {
-            cprintf("rootfs: mounted %s at /\n", dev->name);
+        if (try_mount(dev)) {
             return 0;
         }
     }
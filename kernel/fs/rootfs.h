@@ -2,9 +2,10 @@
 
 namespace rootfs {
 
-// Scan all registered disk block devices and mount the first one that
-// contains a recognised filesystem to "/". Called once during kernel init,
-// after block devices and PCI drivers have been probed.
+// Mount the ramdisk's boot image to "/" if the loader passed one, else scan
+// the other registered disk block devices and mount the first one that
+// contains a recognised filesystem. Called once during kernel init, after
+// block devices, PCI drivers and the ramdisk have been probed.
 int init();
 
 }  // namespace rootfs
@@ -3,6 +3,7 @@
 
 #include "lib/array.h"
 #include "lib/memory.h"
+#include "lib/rwlock.h"
 #include "lib/stdio.h"
 #include "lib/string.h"
 
@@ -24,17 +25,35 @@ struct MountSlot {
     const char* device_name{};
     FileSystem* fs{};
     const char* fs_type{};
+    int users{};  // Path calls running in fs, atomic
 };
 
 MountSlot s_mounts[] = {
-    {"/dev", nullptr, nullptr, nullptr, nullptr},
-    {"/mnt", nullptr, nullptr, nullptr, nullptr},
-    {"/", nullptr, nullptr, nullptr, nullptr},
+    {"/dev", nullptr, nullptr, nullptr, nullptr, 0},
+    {"/mnt", nullptr, nullptr, nullptr, nullptr, 0},
+    {"/", nullptr, nullptr, nullptr, nullptr, 0},
 };
 
+// Every path lookup reads the mount table; only mount/umount write it.
+// Filesystem calls run after the lock is dropped, since they may sleep, so
+// resolve_path() pins the slot's fs for the call and umount() refuses a
+// pinned one with Busy.
+RwLock s_mounts_lock{};
+
 struct ResolveResult {
-    MountSlot* slot{};
+    FileSystem* fs{};
     const char* relpath{};
+    MountSlot* slot{};  // Pinned until the result goes out of scope
+
+    ResolveResult() = default;
+    ResolveResult(const ResolveResult&) = delete;
+    ResolveResult& operator=(const ResolveResult&) = delete;
+
+    ~ResolveResult() {
+        if (slot) {
+            __atomic_sub_fetch(&slot->users, 1, __ATOMIC_RELEASE);
+        }
+    }
 };
 
 MountSlot* find_slot(const char* mount_point) {
@@ -56,31 +75,36 @@ int resolve_path(const char* path, ResolveResult* out) {
         return -1;
     }
 
+    const char* mount_point = "/";
     if (strcmp(path, "/dev") == 0) {
-        out->slot = find_slot("/dev");
+        mount_point = "/dev";
         out->relpath = "";
     } else if (str_starts_with(path, "/dev/")) {
-        out->slot = find_slot("/dev");
+        mount_point = "/dev";
         out->relpath = str_skip_char(path + 5, '/');
     } else if (strcmp(path, "/mnt") == 0) {
-        out->slot = find_slot("/mnt");
+        mount_point = "/mnt";
         out->relpath = "";
     } else if (str_starts_with(path, "/mnt/")) {
-        out->slot = find_slot("/mnt");
+        mount_point = "/mnt";
         out->relpath = str_skip_char(path + 5, '/');
     } else if (path[0] == '/') {
-        out->slot = find_slot("/");
         out->relpath = str_skip_char(path + 1, '/');
     } else {
-        out->slot = find_slot("/");
         out->relpath = str_skip_char(path, '/');
     }
 
-    if (!out->slot || !out->slot->fs) {
-        return -1;
+    {
+        ReadLockGuard guard(s_mounts_lock);
+        MountSlot* slot = find_slot(mount_point);
+        if (slot && slot->fs) {
+            __atomic_add_fetch(&slot->users, 1, __ATOMIC_RELAXED);
+            out->fs = slot->fs;
+            out->slot = slot;
+        }
     }
 
-    if (!out->relpath) {
+    if (!out->fs || !out->relpath) {
         return -1;
     }
 
@@ -105,9 +129,12 @@ int init() {
 Error mount(const char* mount_point, BlockDevice* dev, const char* fs_type) {
     ENSURE(mount_point && fs_type, Error::Invalid);
 
-    MountSlot* slot = find_slot(mount_point);
-    if (!slot || slot->fs != nullptr) {
-        return Error::NotFound;
+    {
+        ReadLockGuard guard(s_mounts_lock);
+        MountSlot* slot = find_slot(mount_point);
+        if (!slot || slot->fs != nullptr) {
+            return Error::NotFound;
+        }
     }
 
     FileSystem* fs = nullptr;
@@ -128,27 +155,52 @@ Error mount(const char* mount_point, BlockDevice* dev, const char* fs_type) {
         return rc;
     }
 
-    slot->fs = fs;
-    slot->fs_type = fs_type;
-    slot->device = dev;
-    slot->device_name = dev ? dev->name : nullptr;
+    // Publish, unless a concurrent mount got there while we were reading
+    // the superblock.
+    bool published = false;
+    {
+        WriteLockGuard guard(s_mounts_lock);
+        MountSlot* slot = find_slot(mount_point);
+        if (slot->fs == nullptr) {
+            slot->fs = fs;
+            slot->fs_type = fs_type;
+            slot->device = dev;
+            slot->device_name = dev ? dev->name : nullptr;
+            published = true;
+        }
+    }
+
+    if (!published) {
+        fs->unmount();
+        delete fs;
+        return Error::Busy;
+    }
 
     return Error::None;
 }
 
 Error umount(const char* mount_point) {
-    MountSlot* slot = find_slot(mount_point);
-    if (!slot || !slot->fs) {
-        return Error::NotFound;
-    }
+    FileSystem* fs = nullptr;
+    {
+        WriteLockGuard guard(s_mounts_lock);
+        MountSlot* slot = find_slot(mount_point);
+        if (!slot || !slot->fs) {
+            return Error::NotFound;
+        }
+        // Pins are only taken under the read lock, so none can appear now.
+        if (__atomic_load_n(&slot->users, __ATOMIC_ACQUIRE) > 0) {
+            return Error::Busy;
+        }
 
-    slot->fs->unmount();
-    delete slot->fs;
+        fs = slot->fs;
+        slot->fs = nullptr;
+        slot->fs_type = nullptr;
+        slot->device = nullptr;
+        slot->device_name = nullptr;
+    }
 
-    slot->fs = nullptr;
-    slot->fs_type = nullptr;
-    slot->device = nullptr;
-    slot->device_name = nullptr;
+    fs->unmount();
+    delete fs;
 
     return Error::None;
 }
@@ -159,7 +211,7 @@ Error open(const char* path, File** out_file) {
     *out_file = nullptr;
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
@@ -167,7 +219,7 @@ Error open(const char* path, File** out_file) {
         return Error::Invalid;
     }
 
-    return rr.slot->fs->open(rr.relpath, out_file);
+    return rr.fs->open(rr.relpath, out_file);
 }
 
 Result<int> read(File* file, void* buf, size_t size, size_t offset) {
@@ -183,81 +235,85 @@ Result<int> write(File* file, const void* buf, size_t size, size_t offset) {
 }
 
 void close(File* file) {
-    delete file;
+    if (file && file->put()) {
+        delete file;
+    }
 }
 
 Error stat(const char* path, Stat* st) {
     ENSURE(path && st, Error::Invalid);
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
-    return rr.slot->fs->stat(rr.relpath, st);
+    return rr.fs->stat(rr.relpath, st);
 }
 
 Result<int> readdir(const char* path, DirVisitor& visitor) {
     ENSURE(path, Error::Invalid);
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
-    return rr.slot->fs->readdir(rr.relpath, visitor);
+    return rr.fs->readdir(rr.relpath, visitor);
 }
 
 Error mkdir(const char* path) {
     ENSURE(path, Error::Invalid);
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
-    return rr.slot->fs->mkdir(rr.relpath);
+    return rr.fs->mkdir(rr.relpath);
 }
 
 Error create(const char* path) {
     ENSURE(path, Error::Invalid);
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
-    return rr.slot->fs->create(rr.relpath);
+    return rr.fs->create(rr.relpath);
 }
 
 Error unlink(const char* path) {
     ENSURE(path, Error::Invalid);
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
-    return rr.slot->fs->unlink(rr.relpath);
+    return rr.fs->unlink(rr.relpath);
 }
 
 Error rmdir(const char* path) {
     ENSURE(path, Error::Invalid);
 
     ResolveResult rr{};
-    if (resolve_path(path, &rr) != 0 || !rr.slot || !rr.slot->fs) {
+    if (resolve_path(path, &rr) != 0) {
         return Error::NotFound;
     }
 
-    return rr.slot->fs->rmdir(rr.relpath);
+    return rr.fs->rmdir(rr.relpath);
 }
 
 bool is_mounted(const char* mount_point) {
+    ReadLockGuard guard(s_mounts_lock);
     MountSlot* slot = find_slot(mount_point);
     return slot != nullptr && slot->fs != nullptr;
 }
 
 const char* mounted_device(const char* mount_point) {
+    ReadLockGuard guard(s_mounts_lock);
     MountSlot* slot = find_slot(mount_point);
     if (!slot || !slot->fs) {
         return nullptr;
@@ -266,18 +322,26 @@ const char* mounted_device(const char* mount_point) {
 }
 
 void print_mount_info(const char* mount_point) {
-    MountSlot* slot = find_slot(mount_point);
-    if (!slot || !slot->fs) {
+    MountSlot snap{};
+    {
+        ReadLockGuard guard(s_mounts_lock);
+        MountSlot* slot = find_slot(mount_point);
+        if (slot) {
+            snap = *slot;
+        }
+    }
+
+    if (!snap.fs) {
         cprintf("vfs: %s is not mounted\n", mount_point ? mount_point : "(null)");
         return;
     }
 
-    cprintf("  FS: %s\n", slot->fs_type ? slot->fs_type : "unknown");
-    if (slot->device_name) {
-        cprintf("  Device: %s\n", slot->device_name);
+    cprintf("  FS: %s\n", snap.fs_type ? snap.fs_type : "unknown");
+    if (snap.device_name) {
+        cprintf("  Device: %s\n", snap.device_name);
     }
 
-    slot->fs->print();
+    snap.fs->print();
 }
 
 Error register_fs(const char* name, FsFactory factory) {
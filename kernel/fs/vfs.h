@@ -39,6 +39,8 @@ struct DirEntry {
     void set(const char* n, NodeType t, uint32_t s, uint32_t a);
 };
 
+// An open file.  Descriptors that share one (stdio on the console) each
+// hold a reference; close() drops it and frees the file with the last one.
 class File {
 public:
     virtual ~File() = default;
@@ -46,6 +48,16 @@ public:
     virtual Result<int> read(void* buf, size_t size, size_t offset) = 0;
     virtual Result<int> write(const void* buf, size_t size, size_t offset) = 0;
     virtual Error stat(Stat* st) = 0;
+
+    File* get() {
+        __atomic_add_fetch(&refs_, 1, __ATOMIC_RELAXED);
+        return this;
+    }
+
+    [[nodiscard]] bool put() { return __atomic_sub_fetch(&refs_, 1, __ATOMIC_ACQ_REL) == 0; }
+
+private:
+    int refs_{1};
 };
 
 class DirVisitor {
@@ -1,7 +1,9 @@
 #include "block/blk.h"
 #include "drivers/intr.h"
 #include "drivers/pci.h"
+#include "drivers/ramdisk.h"
 #include "drivers/sdhci.h"
+#include "drivers/virtio_blk.h"
 #include "cons/cons.h"
 #include "fs/vfs.h"
 #include "fs/rootfs.h"
@@ -9,6 +11,11 @@
 #include "mm/vmm.h"
 #include "mm/swap.h"
 #include "sched/sched.h"
+#include "sched/workqueue.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
+#include "time/vdso.h"
+#include "lib/rcu.h"
 #include "lib/stdio.h"
 #include "lib/unistd.h"
 #include <kernel/bootinfo.h>
@@ -63,18 +70,25 @@ static int pci_registers() {
 
 static const InitStep KERN_STEPS[] = {
     {"early_init", early_init, true},
+    {"clock", clocksource::init, false},
+    {"timers", ktimer::init, true},
+    {"rcu", rcu::init, true},
     {"pmm", pmm::init, true},
     {"vmm", vmm::init, true},
+    {"vdso", vdso::init, false},
     {"vfs", vfs::init, true},
     {"cons_late", cons::late_init, false},
     {"pci_init", pci::init, false},
     {"blk", blk::init, true},
     {"sdhci", sdhci::init, false},
+    {"virtio_blk", virtio_blk::init, false},
     {"pci_reg", pci_registers, false},
     {"pci_probe", pci::probe_drivers, false},
+    {"ramdisk", ramdisk::init, false},
     {"rootfs", rootfs::init, false},
     {"swap", swap::init, false},
     {"sched", sched::init, true},
+    {"workqueue", workqueue::init, false},
 };
 
 // ============================================================================
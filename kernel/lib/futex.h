@@ -0,0 +1,29 @@
+#pragma once
+
+#include <base/types.h>
+#include "lib/result.h"
+
+struct MemoryDesc;
+
+// Fast user-space locking.  A futex is a 32-bit word in some address space:
+// user code changes it with atomics and only enters the kernel to sleep
+// while the word holds a given value, or to wake such sleepers.
+//
+// Sleepers hang off a small hash table keyed by (address space, address), so
+// threads sharing a MemoryDesc meet on the same word while equal addresses
+// in other processes stay apart.
+
+namespace futex {
+
+inline constexpr int HASH_BITS = 6;
+
+// Sleep until wake() if *addr still equals `expected` (Busy if not; Fault if
+// a user address cannot be read).  The check and the enqueue are atomic
+// against wake(), so a wakeup between the caller's last look at the word and
+// the sleep is never lost.
+Error wait(const MemoryDesc* mm, const uint32_t* addr, uint32_t expected);
+
+// Wake up to `nr` tasks sleeping on `addr`; returns how many were woken.
+int wake(const MemoryDesc* mm, const uint32_t* addr, int nr);
+
+}  // namespace futex
@@ -86,6 +86,30 @@ struct CircularView {
     [[nodiscard]] Iter end() const { return Iter{head, start, nullptr}; }
 };
 
+// Forward traversal that may run concurrently with the *_rcu() updates.
+template<typename NodePtr>
+struct RcuIterator {
+    NodePtr cur{};
+
+    NodePtr operator*() const { return cur; }
+
+    RcuIterator& operator++() {
+        cur = __atomic_load_n(&cur->next, __ATOMIC_ACQUIRE);
+        return *this;
+    }
+
+    bool operator==(const RcuIterator& other) const { return cur == other.cur; }
+    bool operator!=(const RcuIterator& other) const { return cur != other.cur; }
+};
+
+template<typename NodePtr, typename Iter>
+struct RcuView {
+    NodePtr head{};
+
+    [[nodiscard]] Iter begin() const { return Iter{__atomic_load_n(&head->next, __ATOMIC_ACQUIRE)}; }
+    [[nodiscard]] Iter end() const { return Iter{head}; }
+};
+
 }  // namespace list_detail
 
 struct ListNode {
@@ -95,6 +119,8 @@ struct ListNode {
 
     using reverse_view = list_detail::ReverseView<ListNode*, reverse_iterator>;
     using circular_view = list_detail::CircularView<ListNode*, circular_iterator>;
+    using rcu_iterator = list_detail::RcuIterator<ListNode*>;
+    using rcu_view = list_detail::RcuView<ListNode*, rcu_iterator>;
 
     ListNode* prev{};
     ListNode* next{};
@@ -107,6 +133,9 @@ struct ListNode {
     [[nodiscard]] reverse_view reversed() { return reverse_view{this}; }
     [[nodiscard]] circular_view circular_from(ListNode* start) { return circular_view{this, start}; }
 
+    // Lock-free traversal for readers inside rcu::read_lock().
+    [[nodiscard]] rcu_view rcu() { return rcu_view{this}; }
+
     [[nodiscard]] inline ListNode* get_next() const { return next; }
     [[nodiscard]] inline ListNode* get_prev() const { return prev; }
 
@@ -131,6 +160,32 @@ struct ListNode {
         next->prev = prev;
     }
 
+    // RCU variants.  Writers still serialize among themselves; readers may
+    // walk the list with rcu() meanwhile.  The new node is fully linked
+    // before the store that publishes it.
+    inline void add_rcu(ListNode& elm) {
+        ListNode* old_next = next;
+        elm.next = old_next;
+        elm.prev = this;
+        __atomic_store_n(&next, &elm, __ATOMIC_RELEASE);
+        old_next->prev = &elm;
+    }
+
+    inline void add_before_rcu(ListNode& elm) {
+        ListNode* old_prev = prev;
+        elm.next = this;
+        elm.prev = old_prev;
+        __atomic_store_n(&old_prev->next, &elm, __ATOMIC_RELEASE);
+        prev = &elm;
+    }
+
+    // A reader already on this node keeps following its next pointer, so
+    // the node must not be reused or freed until a grace period has passed.
+    inline void unlink_rcu() const {
+        next->prev = prev;
+        __atomic_store_n(&prev->next, next, __ATOMIC_RELEASE);
+    }
+
     [[nodiscard]] inline bool empty() const { return next == this; }
 
     template<typename T>
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <base/types.h>
+#include <kernel/config.h>
+
+// Lock contention statistics, built in with CONFIG_LOCKSTAT.
+//
+// Locks are grouped into named classes: every lock constructed with the same
+// LockClass adds to one set of counters, and locks constructed without one
+// fall into a per-type default ("spinlock", "mutex", ...).  A class joins the
+// global list the first time one of its locks is taken.
+//
+// Times are in cycle-counter ticks.  Wait time runs from the first failed
+// attempt to the acquisition; hold time from the acquisition to the release
+// and is only kept for exclusive owners (Spinlock and Mutex).  A WaitQueue
+// counts each sleep as a contended acquisition.
+//
+// With CONFIG_LOCKSTAT off, LockClass keeps only its name and every hook is
+// an empty inline function.
+
+struct LockClass {
+    const char* name;
+#ifdef CONFIG_LOCKSTAT
+    uint64_t acquisitions{};
+    uint64_t contentions{};
+    uint64_t wait_total{};
+    uint64_t wait_max{};
+    uint64_t hold_total{};
+    uint64_t hold_max{};
+    LockClass* next{};  // Link in the registered list
+    bool registered{};
+#endif
+};
+
+namespace lockstat {
+
+inline constexpr int DEFAULT_TOP = 10;
+
+// Defaults for locks built without a class
+extern LockClass spinlock_class;
+extern LockClass mutex_class;
+extern LockClass semaphore_class;
+extern LockClass waitqueue_class;
+
+[[nodiscard]] bool enabled();
+
+void reset();
+void print(int top_n = DEFAULT_TOP);  // Classes with the most contentions first
+
+#ifdef CONFIG_LOCKSTAT
+
+[[nodiscard]] uint64_t cycles();
+void record_acquire(LockClass* cls, uint64_t wait, bool contended);
+void record_hold(LockClass* cls, uint64_t hold);
+
+// Per-lock hook.  Stamps the acquisition of an exclusive lock so that the
+// holder's release can account the hold time.
+class Tracker {
+public:
+    constexpr explicit Tracker(LockClass* cls) : class_(cls) {}
+
+    [[nodiscard]] uint64_t start() const { return cycles(); }
+
+    // Exclusive acquisition; `start` is only read when contended.
+    void acquired(uint64_t start, bool contended) {
+        held_since_ = cycles();
+        record_acquire(class_, contended ? held_since_ - start : 0, contended);
+    }
+
+    void released() { record_hold(class_, cycles() - held_since_); }
+
+    // Shared or counting acquisition: no hold time.
+    void waited(uint64_t start, bool contended) {
+        record_acquire(class_, contended ? cycles() - start : 0, contended);
+    }
+
+private:
+    LockClass* class_;
+    uint64_t held_since_{};
+};
+
+#else
+
+class Tracker {
+public:
+    constexpr explicit Tracker(LockClass*) {}
+
+    [[nodiscard]] uint64_t start() const { return 0; }
+    void acquired(uint64_t, bool) {}
+    void released() {}
+    void waited(uint64_t, bool) {}
+};
+
+#endif
+
+}  // namespace lockstat
@@ -1,8 +1,9 @@
 #pragma once
 
+#include "lib/list.h"
 #include "lib/lock_guard.h"
+#include "lib/lockstat.h"
 #include "lib/spinlock.h"
-#include "lib/waitqueue.h"
 
 // Forward declaration
 struct TaskStruct;
@@ -10,22 +11,70 @@ struct TaskStruct;
 // Mutex — mutual exclusion lock with ownership tracking.
 // Unlike Spinlock, a Mutex blocks (sleeps) when contended.
 // Only the holder may unlock it.
+//
+// The owner word is the fast path: an uncontended lock() or unlock() is a
+// single compare-and-swap.  A contended lock() first spins while the owner
+// is running on a CPU, then queues and sleeps; queueing sets HAS_WAITERS in
+// the owner word so the owner's unlock() takes the slow path.
+//
+// Priority inheritance: while a task sleeps in lock(), the owner (and,
+// transitively, whatever the owner is blocked on) runs at no worse than the
+// waiter's effective priority.  unlock() hands the mutex directly to the
+// highest-priority waiter.
+//
+// lockstat counts spinning on the owner as contention, like sleeping.
+//
+// Before sched::init() there is no current task; the boot path's locks
+// record BOOT_OWNER instead and must be released before the scheduler runs.
 
 class Mutex {
 public:
+    Mutex() : stat_(&lockstat::mutex_class) {}
+    explicit Mutex(LockClass& cls) : stat_(&cls) {}
+
     void lock();
     void unlock();
     bool try_lock();
 
-    [[nodiscard]] bool is_locked() const { return held_; }
+    [[nodiscard]] bool is_locked() const { return __atomic_load_n(&owner_, __ATOMIC_RELAXED) != 0; }
+    [[nodiscard]] TaskStruct* owner() const { return owner_task(__atomic_load_n(&owner_, __ATOMIC_RELAXED)); }
 
     // LockGuard<T> expects acquire()/release()
     void acquire() { lock(); }
     void release() { unlock(); }
 
+    // Re-sort `task` in the mutex it is blocked on and re-propagate its
+    // priority after a set_scheduler() change.
+    static void prio_changed(TaskStruct* task);
+
 private:
-    bool held_{false};
-    TaskStruct* owner_{};
-    Spinlock spin_{};
-    WaitQueue waitq_{};
+    static constexpr uintptr_t HAS_WAITERS = 1;  // Low bit of owner_
+    static constexpr uintptr_t BOOT_OWNER = 2;   // Owner word with no current task
+    static constexpr int MAX_SPIN = 1000;        // Spin iterations before sleeping
+    static constexpr int MAX_PI_DEPTH = 8;       // Longest owner chain boosted
+
+    static uintptr_t owner_word(TaskStruct* cur) { return cur ? reinterpret_cast<uintptr_t>(cur) : BOOT_OWNER; }
+    static TaskStruct* owner_task(uintptr_t word) {
+        word &= ~HAS_WAITERS;
+        return word == BOOT_OWNER ? nullptr : reinterpret_cast<TaskStruct*>(word);
+    }
+
+    bool try_acquire(TaskStruct* cur);
+    bool spin_on_owner(TaskStruct* cur);
+    void lock_slow(TaskStruct* cur);
+    void unlock_slow(TaskStruct* cur);
+    void enqueue_waiter(TaskStruct* task);
+    [[nodiscard]] int top_waiter_prio() const;
+
+    static void update_pi(TaskStruct* task);
+    static void boost_chain(TaskStruct* owner);
+
+    static Mutex* from_held_link(ListNode* node) {
+        return reinterpret_cast<Mutex*>(reinterpret_cast<char*>(node) - offset_of(&Mutex::held_node_));
+    }
+
+    uintptr_t owner_{};     // TaskStruct* | HAS_WAITERS, 0 when free
+    ListNode waiters_{};    // Blocked tasks by effective priority, FIFO among equals
+    ListNode held_node_{};  // Link in the owner's pi_held while HAS_WAITERS is set
+    lockstat::Tracker stat_;
 };
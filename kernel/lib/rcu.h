@@ -0,0 +1,75 @@
+#pragma once
+
+#include <base/types.h>
+
+#include "sched/preempt.h"
+
+// Quiescent-state-based RCU.
+//
+// Readers bracket lookups with rcu::read_lock()/read_unlock() (or
+// rcu::ReadGuard), which only disables preemption, and must not sleep
+// inside.  A pass through the scheduler -- a context switch or the idle
+// loop -- is therefore a quiescent state: the CPU holds no references from
+// an earlier read-side section.  A grace period ends once every CPU has
+// passed one; on this single-CPU kernel that is the next quiescent state.
+//
+// Writers unpublish an object (e.g. ListNode::unlink_rcu()) and then either
+// wait with synchronize() or defer the free with call().
+
+struct RcuHead {
+    using Func = void (*)(RcuHead* head);
+
+    RcuHead* next{};
+    Func fn{};
+    uint64_t gp{};  // Grace period that must complete before fn runs
+};
+
+namespace rcu {
+
+int init();
+
+inline void read_lock() {
+    preempt::disable();
+}
+
+inline void read_unlock() {
+    preempt::enable();
+}
+
+class ReadGuard {
+public:
+    ReadGuard() { read_lock(); }
+    ~ReadGuard() { read_unlock(); }
+
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+};
+
+// This CPU is outside any read-side section.  Called by the scheduler.
+void note_qs();
+
+// Wait for a grace period.  Must not be called inside a read-side section.
+void synchronize();
+
+// Run fn(head) from softirq context after a grace period.  Safe from any
+// context.  fn must not sleep.
+void call(RcuHead* head, RcuHead::Func fn);
+
+// Wait until every callback queued before the call has run.
+void barrier();
+
+[[nodiscard]] uint64_t completed();  // Grace periods completed
+[[nodiscard]] uint64_t invoked();    // Callbacks run
+
+// Publish / read a pointer that readers follow without a lock.
+template<typename T>
+inline void assign_pointer(T*& slot, T* value) {
+    __atomic_store_n(&slot, value, __ATOMIC_RELEASE);
+}
+
+template<typename T>
+[[nodiscard]] inline T* dereference(T* const& slot) {
+    return __atomic_load_n(&slot, __ATOMIC_ACQUIRE);
+}
+
+}  // namespace rcu
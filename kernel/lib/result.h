@@ -15,6 +15,7 @@ enum class Error : int {
     NotSupported = -11,
     Full = -12,
     Fail = -13,
+    Fault = -14,
 };
 
 inline const char* error_str(Error e) {
@@ -33,6 +34,7 @@ inline const char* error_str(Error e) {
         case Error::NotSupported: return "not supported";
         case Error::Full: return "full";
         case Error::Fail: return "failed";
+        case Error::Fault: return "bad address";
         default: return "unknown error";
     }
 }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <base/types.h>
+
+#include "lib/spinlock.h"
+
+// Reader-writer spinlock for read-mostly tables.  Any number of readers may
+// hold it together; a writer excludes everyone.  A waiting writer stops new
+// readers from entering, so a steady stream of lookups cannot starve it.
+// Writers queue among themselves on a ticket lock.
+
+class RwLock {
+public:
+    void read_lock();
+    void read_unlock();
+    void write_lock();
+    void write_unlock();
+
+    [[nodiscard]] uint64_t read_lock_irqsave();
+    void read_unlock_irqrestore(uint64_t flags);
+    [[nodiscard]] uint64_t write_lock_irqsave();
+    void write_unlock_irqrestore(uint64_t flags);
+
+    [[nodiscard]] uint32_t readers() const;
+    [[nodiscard]] bool write_locked() const;
+
+private:
+    static constexpr uint32_t WRITER = 1U << 31;
+    static constexpr uint32_t WRITER_WAITING = 1U << 30;
+    static constexpr uint32_t READER_MASK = WRITER_WAITING - 1;
+
+    uint32_t state_{};  // WRITER | WRITER_WAITING | reader count
+    Spinlock writers_{};
+};
+
+class ReadLockGuard {
+public:
+    explicit ReadLockGuard(RwLock& lock) : ref_(lock), flags_(lock.read_lock_irqsave()) {}
+    ~ReadLockGuard() { ref_.read_unlock_irqrestore(flags_); }
+
+    ReadLockGuard(const ReadLockGuard&) = delete;
+    ReadLockGuard& operator=(const ReadLockGuard&) = delete;
+
+private:
+    RwLock& ref_;
+    uint64_t flags_;
+};
+
+class WriteLockGuard {
+public:
+    explicit WriteLockGuard(RwLock& lock) : ref_(lock), flags_(lock.write_lock_irqsave()) {}
+    ~WriteLockGuard() { ref_.write_unlock_irqrestore(flags_); }
+
+    WriteLockGuard(const WriteLockGuard&) = delete;
+    WriteLockGuard& operator=(const WriteLockGuard&) = delete;
+
+private:
+    RwLock& ref_;
+    uint64_t flags_;
+};
@@ -1,24 +1,50 @@
 #pragma once
 
+#include "lib/list.h"
 #include "lib/lock_guard.h"
+#include "lib/lockstat.h"
 #include "lib/spinlock.h"
-#include "lib/waitqueue.h"
+
+// Forward declaration
+struct TaskStruct;
 
 // Counting semaphore — blocks when count reaches zero.
-// Based on spinlock + WaitQueue.
+//
+// down() and up() are a single atomic on count_ while nobody waits.  A
+// sleeper registers in nr_waiters_ before its final check of count_, and
+// up() checks nr_waiters_ after publishing its increment, so one of the
+// two always sees the other and no wakeup is lost.  up() then hands the
+// unit straight to the first sleeper.
 
 class Semaphore {
 public:
-    explicit Semaphore(int initial_count = 0) : count_(initial_count) {}
+    explicit Semaphore(int initial_count = 0) : count_(initial_count), stat_(&lockstat::semaphore_class) {}
+    Semaphore(int initial_count, LockClass& cls) : count_(initial_count), stat_(&cls) {}
 
     void down();
     bool try_down();
     void up();
 
-    [[nodiscard]] int count() const { return count_; }
+    [[nodiscard]] int count() const { return __atomic_load_n(&count_, __ATOMIC_RELAXED); }
 
 private:
+    struct Waiter {
+        TaskStruct* task{};
+        ListNode node{};
+        bool granted{};
+
+        static Waiter* from_node(ListNode* n) {
+            return reinterpret_cast<Waiter*>(reinterpret_cast<char*>(n) - offset_of(&Waiter::node));
+        }
+    };
+
+    bool take();
+    void down_slow();
+    void up_slow();
+
     int count_;
+    int nr_waiters_{};   // Sleepers registered or queued, under lock_ for writes
     Spinlock lock_{};
-    WaitQueue waitq_{};
+    ListNode waiters_{};  // FIFO of Waiter
+    lockstat::Tracker stat_;
 };
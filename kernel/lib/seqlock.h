@@ -0,0 +1,70 @@
+#pragma once
+
+#include <base/types.h>
+
+#include "lib/spinlock.h"
+
+// Sequence lock for small, frequently read data such as timekeeping.
+// Readers never block the writer: they snapshot the data and retry if the
+// sequence moved meanwhile.  The sequence is odd while a write is open.
+//
+//   uint32_t seq;
+//   do {
+//       seq = lock.read_begin();
+//       copy = data;
+//   } while (lock.read_retry(seq));
+//
+// A reader must not interrupt a writer on the same CPU, so writers keep
+// interrupts disabled (write_lock_irqsave(), or the timer ISR itself).
+
+class SeqLock {
+public:
+    [[nodiscard]] uint32_t read_begin() const {
+        uint32_t seq;
+        while ((seq = __atomic_load_n(&seq_, __ATOMIC_ACQUIRE)) & 1) {
+            arch_spin_hint();
+        }
+        return seq;
+    }
+
+    [[nodiscard]] bool read_retry(uint32_t start) const {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&seq_, __ATOMIC_RELAXED) != start;
+    }
+
+    void write_lock() {
+        lock_.lock();
+        write_begin();
+    }
+
+    void write_unlock() {
+        write_end();
+        lock_.unlock();
+    }
+
+    [[nodiscard]] uint64_t write_lock_irqsave() {
+        uint64_t flags = lock_.lock_irqsave();
+        write_begin();
+        return flags;
+    }
+
+    void write_unlock_irqrestore(uint64_t flags) {
+        write_end();
+        lock_.unlock_irqrestore(flags);
+    }
+
+    [[nodiscard]] uint32_t sequence() const { return __atomic_load_n(&seq_, __ATOMIC_RELAXED); }
+
+private:
+    void write_begin() {
+        __atomic_store_n(&seq_, seq_ + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void write_end() {
+        __atomic_store_n(&seq_, seq_ + 1, __ATOMIC_RELEASE);
+    }
+
+    uint32_t seq_{};
+    Spinlock lock_{};
+};
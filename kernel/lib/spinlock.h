@@ -3,17 +3,48 @@
 #include <asm/arch.h>
 #include "drivers/intr.h"
 #include "lib/lock_guard.h"
+#include "lib/lockstat.h"
 
-// Simple spinlock for uniprocessor systems.
+// Ticket spinlock.  Acquirers take a ticket and spin until it is served, so
+// the lock is granted in FIFO order and waiters only read the shared word.
+//
+// The saved interrupt state belongs to the acquirer, not the lock:
+// lock_irqsave() returns it and the caller hands it back to
+// unlock_irqrestore().  LockGuard<Spinlock> keeps it in the guard.
+//
+// Pass a LockClass to have lockstat account the lock under its own name.
 
 class Spinlock {
 public:
-    void acquire();
-    void release();
+    constexpr Spinlock() : stat_(&lockstat::spinlock_class) {}
+    constexpr explicit Spinlock(LockClass& cls) : stat_(&cls) {}
 
-    [[nodiscard]] bool is_locked() const { return __atomic_load_n(&locked_, __ATOMIC_RELAXED); }
+    void lock();  // Caller manages the interrupt state
+    void unlock();
+    [[nodiscard]] bool try_lock();
+
+    [[nodiscard]] uint64_t lock_irqsave();
+    void unlock_irqrestore(uint64_t flags);
+
+    [[nodiscard]] bool is_locked() const;
+    [[nodiscard]] bool is_contended() const;  // Someone is queued behind the owner
+
+private:
+    uint32_t next_{};   // Next ticket to hand out
+    uint32_t owner_{};  // Ticket being served
+    lockstat::Tracker stat_;
+};
+
+template<>
+class LockGuard<Spinlock> {
+public:
+    explicit LockGuard(Spinlock& lock) : ref_(lock), flags_(lock.lock_irqsave()) {}
+    ~LockGuard() { ref_.unlock_irqrestore(flags_); }
+
+    LockGuard(const LockGuard&) = delete;
+    LockGuard& operator=(const LockGuard&) = delete;
 
 private:
-    volatile bool locked_{false};
-    uint64_t saved_flags_{};
+    Spinlock& ref_;
+    uint64_t flags_;
 };
@@ -1,20 +1,35 @@
 #pragma once
 
 #include "lib/list.h"
+#include "lib/lockstat.h"
 #include "lib/spinlock.h"
 
 struct TaskStruct;
 enum class ProcessState : uint8_t;
 
+// lockstat counts each sleep() as a contended acquisition and the time until
+// the wakeup as its wait.
+
 class WaitQueue {
 public:
+    WaitQueue() : stat_(&lockstat::waitqueue_class) {}
+    explicit WaitQueue(LockClass& cls) : stat_(&cls) {}
+
     void sleep();
     void wakeup_one();
     void wakeup_all();
 
+    // Sleep until `flag` is set by complete_all(); returns at once if it
+    // already is.  The two are atomic against each other, so the waker
+    // never touches the queue after the waiter has seen the flag and
+    // returned: a queue and flag on the waiter's stack are safe.
+    void wait_for(const volatile bool& flag);
+    void complete_all(volatile bool& flag);
+
     [[nodiscard]] bool empty() const { return head_.empty(); }
 
 private:
     ListNode head_{};
     Spinlock lock_{};
+    lockstat::Tracker stat_;
 };
@@ -0,0 +1,89 @@
+#include "objcache.h"
+#include "lib/lock_guard.h"
+#include "lib/memory.h"
+#include "lib/stdio.h"
+
+void* ObjCache::alloc() {
+    {
+        LockGuard<Spinlock> guard(lock_);
+        if (FreeObj* obj = free_) {
+            free_ = obj->next;
+            nr_free_--;
+            hits_++;
+            return obj;
+        }
+        misses_++;
+    }
+    return kmalloc(size_);
+}
+
+void ObjCache::free(void* obj) {
+    if (!obj) {
+        return;
+    }
+
+    {
+        LockGuard<Spinlock> guard(lock_);
+        if (nr_free_ < limit_) {
+            auto* node = static_cast<FreeObj*>(obj);
+            node->next = free_;
+            free_ = node;
+            nr_free_++;
+            return;
+        }
+    }
+    kfree(obj);
+}
+
+ObjCache::FreeObj* ObjCache::pop_excess(size_t keep) {
+    FreeObj* excess = nullptr;
+    while (nr_free_ > keep) {
+        FreeObj* obj = free_;
+        free_ = obj->next;
+        nr_free_--;
+        obj->next = excess;
+        excess = obj;
+    }
+    return excess;
+}
+
+// Runs outside lock_; the page allocator guards itself.
+void ObjCache::release(FreeObj* list) {
+    while (list) {
+        FreeObj* next = list->next;
+        kfree(list);
+        list = next;
+    }
+}
+
+void ObjCache::set_limit(size_t limit) {
+    FreeObj* excess = nullptr;
+    {
+        LockGuard<Spinlock> guard(lock_);
+        limit_ = limit;
+        excess = pop_excess(limit);
+    }
+
+    release(excess);
+}
+
+void ObjCache::shrink() {
+    FreeObj* excess = nullptr;
+    {
+        LockGuard<Spinlock> guard(lock_);
+        excess = pop_excess(0);
+    }
+
+    release(excess);
+}
+
+void ObjCache::reset_stats() {
+    LockGuard<Spinlock> guard(lock_);
+    hits_ = 0;
+    misses_ = 0;
+}
+
+void ObjCache::print() const {
+    cprintf("%-12s size %5lu  cached %3lu/%-3lu  hits %8lu  misses %8lu\n", name_, size_, nr_free_, limit_, hits_,
+            misses_);
+}
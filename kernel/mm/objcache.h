@@ -0,0 +1,55 @@
+#pragma once
+
+#include <base/types.h>
+#include "lib/spinlock.h"
+
+// Recycling cache for one kind of fixed-size kernel object.
+//
+// free() keeps up to `limit` objects on a LIFO free list, linked through
+// their first word, and alloc() hands the most recently freed (cache-warm)
+// one back, so a hot alloc/free cycle costs a couple of pointer updates
+// instead of a trip to the page allocator.  Misses and overflow go to
+// kmalloc/kfree, so an object from alloc() may also be released with kfree()
+// directly; it just bypasses the cache.
+//
+// Contents are not preserved or cleared: callers construct over the block.
+
+class ObjCache {
+public:
+    constexpr ObjCache(const char* name, size_t size, size_t limit)
+        : name_(name), size_(size < sizeof(void*) ? sizeof(void*) : size), limit_(limit) {}
+
+    [[nodiscard]] void* alloc();
+    void free(void* obj);
+
+    void set_limit(size_t limit);  // 0 disables caching; frees the excess
+    void shrink();                 // Return every cached object to kfree()
+
+    [[nodiscard]] const char* name() const { return name_; }
+    [[nodiscard]] size_t size() const { return size_; }
+    [[nodiscard]] size_t limit() const { return limit_; }
+    [[nodiscard]] size_t cached() const { return nr_free_; }
+    [[nodiscard]] uint64_t hits() const { return hits_; }
+    [[nodiscard]] uint64_t misses() const { return misses_; }
+    void reset_stats();
+
+    void print() const;
+
+private:
+    struct FreeObj {
+        FreeObj* next;
+    };
+
+    FreeObj* pop_excess(size_t keep);  // Detach objects beyond `keep`; caller holds lock_
+    static void release(FreeObj* list);
+
+    const char* name_;
+    size_t size_;
+    size_t limit_;
+
+    FreeObj* free_{};
+    size_t nr_free_{};
+    uint64_t hits_{};
+    uint64_t misses_{};
+    Spinlock lock_{};
+};
@@ -5,6 +5,7 @@
 #include "lib/memory.h"
 #include "lib/stdio.h"
 #include "lib/math.h"
+#include "sched/sched.h"
 
 #include <asm/arch.h>
 #include <asm/page.h>
@@ -154,9 +155,7 @@ static void free_user_pt_subtree(pde_t* table, int depth) {
         if (depth == 0) {
             /* Leaf PTE — free the mapped physical page */
             Page* page = pmm::phys_to_page(pte_addr(entry));
-            if (page->ref > 0)
-                page->ref--;
-            if (page->ref == 0)
+            if (page->put_ref())
                 pmm::free_pages(page);
             continue;
         }
@@ -264,8 +263,12 @@ static int page_init() {
     cprintf("pmm: %d pages, page array at [0x%p], max_pa=0x%lx\n", Factory::s_page_count, Factory::s_page_desc,
             static_cast<uint64_t>(max_pa));
 
+    constexpr uint32_t RESCHED_BATCH = 4096;
     for (uint32_t i = 0; i < Factory::s_page_count; i++) {
         Factory::s_page_desc[i].set_reserved();
+        if ((i % RESCHED_BATCH) == RESCHED_BATCH - 1) {
+            sched::cond_resched();
+        }
     }
 
     uintptr_t valid_mem = virt_to_phys(reinterpret_cast<uintptr_t>(Factory::s_page_desc + Factory::s_page_count));
@@ -291,7 +294,7 @@ void pmm::tlb_invl(pde_t* pgdir, uintptr_t la) {
     }
 }
 
-Page* pmm::pgdir_alloc_page(pde_t* pgdir, uintptr_t la, uint32_t perm) {
+Page* pmm::pgdir_alloc_page(pde_t* pgdir, uintptr_t la, uintptr_t perm) {
     Page* page = pmm::alloc_pages(1);
     if (page) {
         pmm::page_insert(pgdir, page, la, perm);
@@ -300,12 +303,12 @@ Page* pmm::pgdir_alloc_page(pde_t* pgdir, uintptr_t la, uint32_t perm) {
     return page;
 }
 
-Error pmm::page_insert(pde_t* pgdir, Page* page, uintptr_t la, uint32_t perm) {
+Error pmm::page_insert(pde_t* pgdir, Page* page, uintptr_t la, uintptr_t perm) {
     pte_t* ptep = pmm::get_pte(pgdir, la, true);
     if (!ptep) {
         return Error::NoMem;
     }
-    page->ref++;
+    page->get_ref();
     *ptep = make_pte_page(pmm::page_to_phys(page), perm);
 
     pmm::tlb_invl(pgdir, la);
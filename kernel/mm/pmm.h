@@ -29,6 +29,17 @@ struct Page {
 
     [[nodiscard]] ListNode& node() { return list_node; }
 
+    // Mappings of one page (the vDSO's) are added and dropped by every
+    // exec and exit, so the count is updated atomically.
+    void get_ref() { __atomic_add_fetch(&ref, 1, __ATOMIC_RELAXED); }
+    // Drop a mapping's reference; true once none is left.
+    [[nodiscard]] bool put_ref() {
+        int old = __atomic_load_n(&ref, __ATOMIC_RELAXED);
+        while (old > 0 && !__atomic_compare_exchange_n(&ref, &old, old - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        }
+        return old <= 1;
+    }
+
     static constexpr size_t node_offset() { return offset_of(&Page::list_node); }
 };
 
@@ -58,9 +69,9 @@ int init();
 // TLB and page table operations
 void tlb_invl(pde_t* pgdir, uintptr_t la);
 
-Page* pgdir_alloc_page(pde_t* pgdir, uintptr_t la, uint32_t perm);
+Page* pgdir_alloc_page(pde_t* pgdir, uintptr_t la, uintptr_t perm);
 pte_t* get_pte(pde_t* pml4, uintptr_t la, bool create);
-Error page_insert(pde_t* pgdir, Page* page, uintptr_t la, uint32_t perm);
+Error page_insert(pde_t* pgdir, Page* page, uintptr_t la, uintptr_t perm);
 
 Page* alloc_pages(size_t n = 1);
 void free_pages(Page* base, size_t n = 1);
@@ -0,0 +1,95 @@
+#include "uaccess.h"
+
+// arch/<arch>/kernel/uaccess.S.  The copies return the number of bytes NOT
+// copied (0 on success); the string copy returns the length, n if there was
+// no NUL in the first n bytes, or -1 on a fault.
+extern "C" size_t arch_copy_from_user(void* dst, const void* user_src, size_t n);
+extern "C" size_t arch_copy_to_user(void* user_dst, const void* src, size_t n);
+extern "C" long arch_strncpy_from_user(char* dst, const char* user_src, size_t n);
+
+namespace {
+
+// One per faulting instruction, emitted by the EX_TABLE macro in uaccess.S.
+struct ExtableEntry {
+    uintptr_t insn;
+    uintptr_t fixup;
+};
+
+// Nesting depth of NofaultScopes.  Their holders do not sleep, so the
+// running task cannot change underneath; one counter serves the one CPU.
+volatile int s_nofault{};
+
+}  // namespace
+
+extern "C" const ExtableEntry __ex_table_start[];
+extern "C" const ExtableEntry __ex_table_end[];
+
+namespace uaccess {
+
+Error copy_from_user(void* dst, const void* user_src, size_t n) {
+    ENSURE(range_ok(reinterpret_cast<uintptr_t>(user_src), n), Error::Fault);
+    return arch_copy_from_user(dst, user_src, n) == 0 ? Error::None : Error::Fault;
+}
+
+Error copy_to_user(void* user_dst, const void* src, size_t n) {
+    ENSURE(range_ok(reinterpret_cast<uintptr_t>(user_dst), n), Error::Fault);
+    return arch_copy_to_user(user_dst, src, n) == 0 ? Error::None : Error::Fault;
+}
+
+NofaultScope::NofaultScope() {
+    s_nofault = s_nofault + 1;
+    __asm__ volatile("" ::: "memory");
+}
+
+NofaultScope::~NofaultScope() {
+    __asm__ volatile("" ::: "memory");
+    s_nofault = s_nofault - 1;
+}
+
+Error copy_from_user_nofault(void* dst, const void* user_src, size_t n) {
+    NofaultScope nofault;
+    return copy_from_user(dst, user_src, n);
+}
+
+bool faults_disabled() {
+    return s_nofault != 0;
+}
+
+Result<size_t> strncpy_from_user(char* dst, const char* user_src, size_t size) {
+    ENSURE(dst && size > 0, Error::Invalid);
+
+    // Clamp to user space: a string running into the kernel half is as bad
+    // as one that faults.
+    uintptr_t base = reinterpret_cast<uintptr_t>(user_src);
+    ENSURE(base < USER_SPACE_TOP, Error::Fault);
+    size_t n = size - 1;
+    bool clamped = n > USER_SPACE_TOP - base;
+    if (clamped) {
+        n = USER_SPACE_TOP - base;
+    }
+
+    long len = arch_strncpy_from_user(dst, user_src, n);
+    if (len < 0) {
+        dst[0] = '\0';
+        return Error::Fault;
+    }
+
+    dst[len] = '\0';
+    if (static_cast<size_t>(len) == n) {
+        return clamped ? Error::Fault : Error::Invalid;
+    }
+    return static_cast<size_t>(len);
+}
+
+// The table is small (a few entries per architecture), so a linear scan is
+// cheaper than keeping it sorted.
+uintptr_t search_extable(uintptr_t pc) {
+    for (const ExtableEntry* e = __ex_table_start; e < __ex_table_end; e++) {
+        if (e->insn == pc) {
+            return e->fixup;
+        }
+    }
+    return 0;
+}
+
+}  // namespace uaccess
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <base/types.h>
+#include <asm/page.h>
+
+#include "lib/result.h"
+
+// Kernel access to user memory.
+//
+// Syscalls never dereference a user pointer themselves: they check the range
+// with range_ok() and move the bytes with these routines, whose loads and
+// stores (arch/<arch>/kernel/uaccess.S) each have an entry in the exception
+// table.  A fault on one of them that the page-fault handler cannot resolve
+// resumes at the entry's fixup, which reports how far the copy got, so a bad
+// pointer becomes Error::Fault instead of a kernel panic.
+//
+// The copies move whole words (x86_64: rep movsb) and open the user window
+// once per call: STAC/CLAC under SMAP, SUM on riscv64, and unprivileged
+// LDTR/STTR on aarch64 so EL0 permissions apply.
+
+namespace uaccess {
+
+// [addr, addr + size) lies entirely below USER_SPACE_TOP.
+[[nodiscard]] inline bool range_ok(uintptr_t addr, size_t size) {
+    return addr < USER_SPACE_TOP && size <= USER_SPACE_TOP - addr;
+}
+
+[[nodiscard]] Error copy_from_user(void* dst, const void* user_src, size_t n);
+[[nodiscard]] Error copy_to_user(void* user_dst, const void* src, size_t n);
+
+// Copy a NUL-terminated string of at most size - 1 bytes; returns its length.
+// Invalid if it does not fit (dst is still terminated), Fault on a bad address.
+[[nodiscard]] Result<size_t> strncpy_from_user(char* dst, const char* user_src, size_t size);
+
+template<typename T>
+[[nodiscard]] Error get_user(T& val, const T* user_ptr) {
+    return copy_from_user(&val, user_ptr, sizeof(T));
+}
+
+template<typename T>
+[[nodiscard]] Error put_user(const T& val, T* user_ptr) {
+    return copy_to_user(user_ptr, &val, sizeof(T));
+}
+
+// For callers that must not sleep, e.g. under a Spinlock: a page that is
+// not present fails with Fault instead of being faulted in, and the caller
+// drops its lock, touches the page with get_user() and retries.
+[[nodiscard]] Error copy_from_user_nofault(void* dst, const void* user_src, size_t n);
+
+template<typename T>
+[[nodiscard]] Error get_user_nofault(T& val, const T* user_ptr) {
+    return copy_from_user_nofault(&val, user_ptr, sizeof(T));
+}
+
+// True inside a _nofault copy; the page-fault handler then leaves the
+// fault to the copy's fixup.
+[[nodiscard]] bool faults_disabled();
+
+// Every user access in its scope behaves as a _nofault one.
+class NofaultScope {
+public:
+    NofaultScope();
+    ~NofaultScope();
+
+    NofaultScope(const NofaultScope&) = delete;
+    NofaultScope& operator=(const NofaultScope&) = delete;
+};
+
+// Fixup address for a fault at `pc`, or 0 if `pc` is not a user access.
+[[nodiscard]] uintptr_t search_extable(uintptr_t pc);
+
+}  // namespace uaccess
@@ -48,20 +48,32 @@ void print_pgdir() {
     cprintf("--------------------- END ---------------------\n");
 }
 
+// Demand-allocates or swaps in the page at `addr`.  Returns -1 for what no
+// mapping can fix: a kernel address, a protection fault (error_code bit 0),
+// or no memory; the trap path then applies an exception fixup or kills the
+// task.
 int pg_fault(MemoryDesc* mm, uint32_t error_code, uintptr_t addr) {
-    uint32_t perm = VM_USER;
+    uint32_t perm = VM_USER_RW;
     Page* page = nullptr;
 
+    if (addr >= USER_SPACE_TOP || (error_code & 1)) {
+        return -1;
+    }
     addr = round_down(addr, PG_SIZE);
 
     pte_t* ptep = pmm::get_pte(mm->pgdir, addr, 1);
+    if (!ptep) {
+        return -1;
+    }
+    if (*ptep & VM_PRESENT) {
+        return 0;  // Another thread of this mm mapped it first
+    }
+
     if (*ptep == 0) {
         page = pmm::pgdir_alloc_page(mm->pgdir, addr, perm);
-    } else {
-        swap::in(mm, addr, &page);
+        return page ? 0 : -1;
     }
-
-    return 0;
+    return swap::in(mm, addr, &page) == Error::None ? 0 : -1;
 }
 
 // Map virtual pages to physical pages in 4-level page table
@@ -10,6 +10,10 @@ struct MemoryDesc {
     pde_t* pgdir{};        // the PDT of these vma
     int map_count{};       // the count of these vma
     ListNode swap_list{};  // active swap queue for page replacement
+    int users{1};          // Tasks sharing this address space (CLONE_VM)
+
+    void get() { __atomic_add_fetch(&users, 1, __ATOMIC_RELAXED); }
+    [[nodiscard]] bool put() { return __atomic_sub_fetch(&users, 1, __ATOMIC_ACQ_REL) == 0; }  // True for the last user
 
     ~MemoryDesc() {
         if (pgdir) {
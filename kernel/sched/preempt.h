@@ -0,0 +1,80 @@
+#pragma once
+
+#include <base/types.h>
+
+// Preemption counter.  While it is non-zero the running task must not be
+// switched out at the interrupt-return preemption point; a pending
+// need_resched is honoured once the count drops back to zero.
+//
+// Spinlocks and intr::Guard hold one count each.  Softirq handlers add
+// SOFTIRQ_OFFSET and hard-IRQ handlers HARDIRQ_OFFSET, so that neither an
+// interrupt nested inside a handler nor the softirq stage reschedules
+// underneath it.
+//
+// Conceptually per CPU; the kernel runs on a single CPU, so it is one counter.
+
+namespace preempt {
+
+inline constexpr int SOFTIRQ_OFFSET = 1 << 8;
+inline constexpr int HARDIRQ_OFFSET = 1 << 16;
+inline constexpr int PREEMPT_MASK = SOFTIRQ_OFFSET - 1;
+inline constexpr int SOFTIRQ_MASK = HARDIRQ_OFFSET - SOFTIRQ_OFFSET;
+inline constexpr int HARDIRQ_MASK = ~(HARDIRQ_OFFSET - 1);
+
+extern volatile int s_count;  // Defined in sched/sched.cpp
+
+inline void barrier() {
+    __asm__ volatile("" ::: "memory");
+}
+
+inline void disable() {
+    s_count = s_count + 1;
+    barrier();
+}
+
+inline void enable() {
+    barrier();
+    s_count = s_count - 1;
+}
+
+inline void irq_enter() {
+    s_count = s_count + HARDIRQ_OFFSET;
+    barrier();
+}
+
+inline void irq_exit() {
+    barrier();
+    s_count = s_count - HARDIRQ_OFFSET;
+}
+
+inline void softirq_enter() {
+    s_count = s_count + SOFTIRQ_OFFSET;
+    barrier();
+}
+
+inline void softirq_exit() {
+    barrier();
+    s_count = s_count - SOFTIRQ_OFFSET;
+}
+
+[[nodiscard]] inline int count() {
+    return s_count;
+}
+
+[[nodiscard]] inline bool preemptible() {
+    return s_count == 0;
+}
+
+[[nodiscard]] inline bool in_irq() {
+    return (s_count & HARDIRQ_MASK) != 0;
+}
+
+[[nodiscard]] inline bool in_softirq() {
+    return (s_count & SOFTIRQ_MASK) != 0;
+}
+
+[[nodiscard]] inline bool in_interrupt() {
+    return (s_count & (HARDIRQ_MASK | SOFTIRQ_MASK)) != 0;
+}
+
+}  // namespace preempt
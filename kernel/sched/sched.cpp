@@ -1,13 +1,19 @@
 #include "sched.h"
+#include "preempt.h"
+#include "sched_trace.h"
 #include "mm/vmm.h"
 #include "lib/stdio.h"
 #include "lib/memory.h"
 #include "lib/string.h"
+#include "lib/mutex.h"
 #include "drivers/intr.h"
 #include "debug/assert.h"
 #include <asm/arch.h>
 #include <asm/mmu.h>
 #include "fs/vfs.h"
+#include "time/clocksource.h"
+
+#include <abi/syscall.h>
 
 extern long user_stack[];
 extern pde_t* boot_pgdir;
@@ -17,17 +23,52 @@ using fnThread = int (*)(void*);
 
 #include "cons/shell.h"
 
+namespace preempt {
+
+volatile int s_count = 0;
+
+}  // namespace preempt
+
+// First code a new task runs (from forkret, before trapret).  The task that
+// switched to us held the scheduler's preempt count; the new task holds nothing.
+extern "C" void schedule_tail() {
+    preempt::s_count = 0;
+}
+
 namespace {
 
+// One open /dev/console shared by every task's stdin/stdout/stderr.  It is
+// opened on first use and keeps a reference of its own, so each fd only
+// bumps the count and closing stdio never frees it.
+vfs::File* s_console{};
+
+vfs::File* console_file() {
+    vfs::File* file = __atomic_load_n(&s_console, __ATOMIC_ACQUIRE);
+    if (file) {
+        return file;
+    }
+
+    if (vfs::open("/dev/console", &file) != Error::None || !file) {
+        return nullptr;
+    }
+
+    // open() may sleep; whoever publishes first wins.
+    vfs::File* expected = nullptr;
+    if (!__atomic_compare_exchange_n(&s_console, &expected, file, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        vfs::close(file);
+        return expected;
+    }
+    return file;
+}
+
 int setup_stdio(fd::Table& files) {
-    const char* console_path = "/dev/console";
+    vfs::File* console = console_file();
+    if (!console) {
+        return -1;
+    }
 
     for (int expected_fd = 0; expected_fd < 3; expected_fd++) {
-        vfs::File* file = nullptr;
-        if (vfs::open(console_path, &file) != Error::None || !file) {
-            files.close_all();
-            return -1;
-        }
+        vfs::File* file = console->get();
 
         auto fd_r = files.alloc(file);
         if (!fd_r.ok()) {
@@ -50,6 +91,33 @@ SchedulerPolicy& scheduler() {
     return policy;
 }
 
+// Close prev's run interval and next's wait interval.  Called with
+// interrupts disabled, before either task changes state.
+void account_switch(uint64_t now, TaskStruct* prev, TaskStruct* next) {
+    SchedStats& ps = prev->stats;
+    SchedStats& ns = next->stats;
+
+    ps.runtime_ns += now - ps.last_ns;
+    ps.last_ns = now;
+
+    ProcessState prev_state = prev->get_state();
+    if (prev_state == ProcessState::Sleeping || prev_state == ProcessState::Zombie) {
+        ps.nr_voluntary++;
+    } else {
+        ps.nr_involuntary++;
+    }
+
+    uint64_t waited = now - ns.last_ns;
+    ns.wait_ns += waited;
+    if (ns.woken) {
+        if (waited > ns.max_latency_ns) {
+            ns.max_latency_ns = waited;
+        }
+        ns.woken = false;
+    }
+    ns.last_ns = now;
+}
+
 }  // namespace
 
 static const char* state_str(ProcessState state) {
@@ -63,6 +131,15 @@ static const char* state_str(ProcessState state) {
     }
 }
 
+static const char* policy_str(SchedPolicy policy) {
+    switch (policy) {
+        case SchedPolicy::Normal: return "TS";      // Time-shared
+        case SchedPolicy::Fifo: return "FF";        // Real-time FIFO
+        case SchedPolicy::RoundRobin: return "RR";  // Real-time round robin
+        default: return "?";
+    }
+}
+
 static int get_pid() {
     static int next_pid = 1;
 
@@ -125,9 +202,26 @@ void TaskStruct::run() {
 
 void TaskStruct::wakeup() {
     assert(state_ != ProcessState::Zombie);
+    TaskStruct* current = TaskManager::get_current();
+
     if (state_ != ProcessState::Runnable) {
+        // Leaving sleep starts the wait that wakeup latency is measured over.
+        // The current task is still on the CPU, and a preempted task's wait
+        // is started by schedule().
+        if (state_ != ProcessState::Running && this != current) {
+            uint64_t now = clocksource::now_ns();
+            stats.last_ns = now;
+            stats.woken = true;
+            sched_trace::wakeup(now, current, this);
+        }
         state_ = ProcessState::Runnable;
     }
+
+    // Wakeup preemption: a higher-priority task should not wait for the
+    // current task's slice to run out.
+    if (current && current != this && effective_prio() < current->effective_prio()) {
+        current->need_resched = 1;
+    }
 }
 
 void TaskStruct::mark_running() {
@@ -164,8 +258,41 @@ uintptr_t TaskStruct::get_cr3() const {
 }
 
 void TaskStruct::copy_mm(uint32_t clone_flags) {
-    // TODO Full copy implementation
+    // TODO Full copy implementation; until then every child shares the
+    // address space as if CLONE_VM were set.
+    static_cast<void>(clone_flags);
     memory = TaskManager::get_current()->memory;
+    if (memory && memory != &init_mm) {
+        memory->get();
+    }
+}
+
+// CLONE_FILES shares the caller's table; otherwise the child starts with a
+// fresh one holding only stdin/stdout/stderr.
+Error TaskStruct::copy_files(uint32_t clone_flags) {
+    TaskStruct* cur = TaskManager::get_current();
+    if ((clone_flags & CLONE_FILES) && cur && cur->files_) {
+        files_ = cur->files_;
+        files_->get();
+        return Error::None;
+    }
+
+    files_ = new fd::Table();
+    ENSURE(files_, Error::NoMem);
+    files_->init();
+    if (cur && cur->files_) {
+        TRY(files_->fork_from(cur->files(), fd::ForkPolicy::Reset));
+    }
+    ENSURE(setup_stdio(*files_) == 0, Error::Fail);
+    return Error::None;
+}
+
+void TaskStruct::exit_files() {
+    if (files_ && files_->put()) {
+        files_->close_all();
+        delete files_;
+    }
+    files_ = nullptr;
 }
 
 void TaskStruct::copy_thread(uintptr_t esp, TrapFrame* src_tf) {
@@ -179,7 +306,7 @@ void TaskStruct::copy_thread(uintptr_t esp, TrapFrame* src_tf) {
 }
 
 int TaskStruct::setup_kernel_stack() {
-    void* stack = kmalloc(KSTACK_SIZE);
+    void* stack = TaskManager::s_kstack_cache.alloc();
     if (!stack) {
         return -1;
     }
@@ -201,16 +328,28 @@ void TaskStruct::remove_links() {
 }
 
 void TaskStruct::destroy() {
-    files().close_all();
+    exit_files();
 
+    // The parent reaps us from its own stack, so ours can be reused at once.
     if (kernel_stack_ != reinterpret_cast<uintptr_t>(user_stack)) {
-        kfree(reinterpret_cast<void*>(kernel_stack_));
+        TaskManager::s_kstack_cache.free(reinterpret_cast<void*>(kernel_stack_));
     }
 
-    if (memory && memory != &init_mm) {
+    if (memory && memory != &init_mm && memory->put()) {
         delete memory;
     }
-    delete this;
+
+    // find_proc() may still be walking through hash_node.
+    rcu::call(&rcu, [](RcuHead* head) { delete TaskStruct::from_rcu(head); });
+}
+
+void* TaskStruct::operator new(size_t size) noexcept {
+    static_cast<void>(size);
+    return TaskManager::s_task_cache.alloc();
+}
+
+void TaskStruct::operator delete(void* ptr) noexcept {
+    TaskManager::s_task_cache.free(ptr);
 }
 
 int TaskManager::init() {
@@ -230,13 +369,19 @@ int TaskManager::init() {
 }
 
 void TaskManager::add_process(TaskStruct* proc) {
-    get_hash_node(proc->pid).add(proc->hash_node);
+    {
+        LockGuard<Spinlock> guard(s_hash_lock);
+        get_hash_node(proc->pid).add_rcu(proc->hash_node);
+    }
     s_proc_list.add(proc->list_node);
     s_process_count++;
 }
 
 void TaskManager::remove_process(TaskStruct* proc) {
-    proc->hash_node.unlink();
+    {
+        LockGuard<Spinlock> guard(s_hash_lock);
+        proc->hash_node.unlink_rcu();
+    }
     proc->list_node.unlink();
     s_process_count--;
 }
@@ -245,8 +390,10 @@ TaskStruct* TaskManager::find_proc(int pid) {
     if (pid <= 0) {
         return nullptr;
     }
+
+    rcu::ReadGuard guard;
     ListNode& head = get_hash_node(pid);
-    for (auto* node : head) {
+    for (auto* node : head.rcu()) {
         TaskStruct* proc = TaskStruct::from_hash_link(node);
         if (proc->pid == pid) {
             return proc;
@@ -257,14 +404,15 @@ TaskStruct* TaskManager::find_proc(int pid) {
 
 void TaskManager::print() {
     // Print header (similar to ps aux format)
-    cprintf("PID  STAT  PPID  PRIO  SLICE  KSTACK            MM                NAME\n");
-    cprintf("---  ----  ----  ----  -----  ----------------  ----------------  ----------------\n");
+    cprintf("PID  STAT  PPID  CLS  PRIO  SLICE  KSTACK            MM                NAME\n");
+    cprintf("---  ----  ----  ---  ----  -----  ----------------  ----------------  ----------------\n");
 
     for (auto* node : s_proc_list.reversed()) {
         TaskStruct* proc = TaskStruct::from_list_link(node);
-        cprintf("%c%-3d %-4s  %-4d  %-4d  %-5d  %016lx  %016lx  %s\n", (proc == s_current) ? '*' : ' ', proc->pid,
-                state_str(proc->state_), (proc->parent ? proc->parent->pid : -1), proc->priority, proc->time_slice,
-                proc->kernel_stack_, reinterpret_cast<uintptr_t>(proc->memory), proc->name_);
+        cprintf("%c%-3d %-4s  %-4d  %-3s  %-4d  %-5d  %016lx  %016lx  %s\n", (proc == s_current) ? '*' : ' ', proc->pid,
+                state_str(proc->state_), (proc->parent ? proc->parent->pid : -1), policy_str(proc->policy),
+                proc->effective_prio(), proc->time_slice, proc->kernel_stack_,
+                reinterpret_cast<uintptr_t>(proc->memory), proc->name_);
     }
 
     cprintf("\nTotal processes: %d\n", s_process_count);
@@ -278,6 +426,34 @@ void TaskManager::print_stats() {
             s_need_resched_events);
     cprintf("sched stats: ctx_switches=%lu same_task=%lu pick_idle=%lu pick_non_idle=%lu\n", s_context_switches,
             s_same_task_runs, s_pick_idle, s_pick_non_idle);
+    s_task_cache.print();
+    s_kstack_cache.print();
+}
+
+void TaskManager::print_acct() {
+    cprintf("PID   RUNTIME(ms)  WAIT(ms)  VCSW      ICSW      MAXLAT(us)  NAME\n");
+    cprintf("----  -----------  --------  --------  --------  ----------  ----------------\n");
+
+    intr::Guard guard;
+    uint64_t now = clocksource::now_ns();
+
+    for (auto* node : s_proc_list.reversed()) {
+        TaskStruct* proc = TaskStruct::from_list_link(node);
+        const SchedStats& st = proc->stats;
+
+        // Include the interval the task is in right now.
+        uint64_t runtime = st.runtime_ns;
+        uint64_t wait = st.wait_ns;
+        if (proc == s_current) {
+            runtime += now - st.last_ns;
+        } else if (proc->state_ == ProcessState::Runnable) {
+            wait += now - st.last_ns;
+        }
+
+        cprintf("%-4d  %-11lu  %-8lu  %-8lu  %-8lu  %-10lu  %s\n", proc->pid, runtime / clocksource::NSEC_PER_MSEC,
+                wait / clocksource::NSEC_PER_MSEC, st.nr_voluntary, st.nr_involuntary,
+                st.max_latency_ns / clocksource::NSEC_PER_USEC, proc->name_);
+    }
 }
 
 uint32_t TaskManager::pid_hash(int x) {
@@ -300,7 +476,11 @@ void TaskManager::schedule() {
     intr::Guard guard;
     s_schedule_calls++;
 
-    TaskStruct* next = scheduler().pick_next(s_proc_list, s_idle_proc);
+    // Every pass through here, the idle loop's included, is outside any
+    // RCU read-side section.
+    rcu::note_qs();
+
+    TaskStruct* next = scheduler().pick_next(s_proc_list, s_current, s_idle_proc);
     if (next == s_idle_proc) {
         s_pick_idle++;
     } else {
@@ -308,11 +488,16 @@ void TaskManager::schedule() {
     }
 
     if (next->time_slice <= 0) {
-        next->time_slice = scheduler().calc_time_slice(next->priority);
+        next->time_slice = scheduler().calc_time_slice(next);
     }
 
     if (next != s_current) {
         s_context_switches++;
+
+        uint64_t now = clocksource::now_ns();
+        sched_trace::switch_to(now, s_current, next);
+        account_switch(now, s_current, next);
+
         if (s_current->get_state() == ProcessState::Running) {
             s_current->wakeup();
         }
@@ -325,41 +510,38 @@ void TaskManager::schedule() {
     }
 }
 
-Result<int> TaskManager::fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* trap_frame) {
+Result<int> TaskManager::fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* trap_frame, MemoryDesc* mm) {
     TaskStruct* proc = new TaskStruct();
     if (!proc) {
         cprintf("sched: fork: failed to allocate TaskStruct\n");
         return Error::NoMem;
     }
     proc->parent = get_current();
-    if (proc->parent) {
-        if (proc->files().fork_from(proc->parent->files(), fd::ForkPolicy::Reset) != Error::None) {
-            cprintf("sched: fork: failed to clone file table\n");
-            delete proc;
-            return Error::Fail;
-        }
-    } else {
-        proc->files().init();
-    }
-
-    if (setup_stdio(proc->files()) != 0) {
-        cprintf("sched: fork: failed to set up stdio\n");
+    if (proc->copy_files(clone_flags) != Error::None) {
+        cprintf("sched: fork: failed to set up file table\n");
+        proc->exit_files();
         delete proc;
         return Error::Fail;
     }
 
     if (proc->setup_kernel_stack() != 0) {
         cprintf("sched: fork: failed to allocate kernel stack\n");
-        proc->files().close_all();
+        proc->exit_files();
         delete proc;
         return Error::NoMem;
     }
-    proc->copy_mm(clone_flags);
+    if (mm) {
+        proc->memory = mm;
+    } else {
+        proc->copy_mm(clone_flags);
+    }
     proc->copy_thread(stack, trap_frame);
 
     // Inherit parent's priority and compute timeslice
     proc->priority = get_current()->priority;
-    proc->time_slice = scheduler().calc_time_slice(proc->priority);
+    proc->policy = get_current()->policy;
+    proc->rt_priority = get_current()->rt_priority;
+    proc->time_slice = scheduler().calc_time_slice(proc);
 
     {
         intr::Guard guard;
@@ -371,13 +553,13 @@ Result<int> TaskManager::fork(uint32_t clone_flags, uintptr_t stack, TrapFrame*
     return proc->pid;
 }
 
-Result<int> TaskManager::kernel_thread(fnThread fn, void* arg) {
+Result<int> TaskManager::kernel_thread(fnThread fn, void* arg, uint32_t clone_flags) {
     TrapFrame tf{};
 
     arch_setup_kthread_tf(&tf, reinterpret_cast<uintptr_t>(kernel_thread_entry), reinterpret_cast<uintptr_t>(fn),
                           reinterpret_cast<uintptr_t>(arg));
 
-    return fork(0, 0, &tf);
+    return fork(clone_flags, 0, &tf);
 }
 
 int TaskManager::exit(int error_code) {
@@ -465,6 +647,36 @@ Result<int> TaskManager::wait(int pid, int* code_store) {
     }
 }
 
+Error TaskManager::set_scheduler(TaskStruct* task, SchedPolicy policy, int prio) {
+    ENSURE(task != nullptr && task != s_idle_proc, Error::Invalid);
+    if (policy == SchedPolicy::Normal) {
+        ENSURE(prio >= sched_prio::MAX_PRIO && prio <= sched_prio::MIN_PRIO, Error::Invalid);
+    } else {
+        ENSURE(prio >= sched_prio::RT_PRIO_MIN && prio <= sched_prio::RT_PRIO_MAX, Error::Invalid);
+    }
+
+    intr::Guard guard;
+    task->policy = policy;
+    if (policy == SchedPolicy::Normal) {
+        task->priority = prio;
+        task->rt_priority = 0;
+    } else {
+        task->rt_priority = prio;
+    }
+    task->time_slice = scheduler().calc_time_slice(task);
+
+    // A waiter's new priority re-sorts it and re-propagates to the owner.
+    Mutex::prio_changed(task);
+
+    // Lowering the current task or raising a runnable one above it takes
+    // effect at the next preemption point.
+    if (task == s_current ||
+        (task->state_ == ProcessState::Runnable && task->effective_prio() < s_current->effective_prio())) {
+        s_current->need_resched = 1;
+    }
+    return Error::None;
+}
+
 // PID 0
 int TaskManager::init_idle() {
     TaskStruct* idle_proc = new TaskStruct();
@@ -474,7 +686,13 @@ int TaskManager::init_idle() {
     }
     idle_proc->wakeup();
     idle_proc->kernel_stack_ = reinterpret_cast<uintptr_t>(user_stack);  // Use boot stack
-    idle_proc->files().init();
+    idle_proc->files_ = new fd::Table();
+    if (!idle_proc->files_) {
+        cprintf("sched: init_idle: failed to allocate fd table\n");
+        delete idle_proc;
+        return -1;
+    }
+    idle_proc->files_->init();
     idle_proc->priority = sched_prio::IDLE_PRIO;
     idle_proc->time_slice = 0;
 
@@ -527,12 +745,12 @@ void tick() {
     TaskManager::tick();
 }
 
-Result<int> fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* tf) {
-    return TaskManager::fork(clone_flags, stack, tf);
+Result<int> fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* tf, MemoryDesc* mm) {
+    return TaskManager::fork(clone_flags, stack, tf, mm);
 }
 
-Result<int> kernel_thread(fnThread fn, void* arg) {
-    return TaskManager::kernel_thread(fn, arg);
+Result<int> kernel_thread(fnThread fn, void* arg, uint32_t clone_flags) {
+    return TaskManager::kernel_thread(fn, arg, clone_flags);
 }
 
 int exit(int error_code) {
@@ -543,6 +761,17 @@ Result<int> wait(int pid, int* code_store) {
     return TaskManager::wait(pid, code_store);
 }
 
+Error set_scheduler(TaskStruct* task, SchedPolicy policy, int prio) {
+    return TaskManager::set_scheduler(task, policy, prio);
+}
+
+void cond_resched() {
+    TaskStruct* cur = TaskManager::get_current();
+    if (cur && cur->need_resched && preempt::preemptible()) {
+        TaskManager::schedule();
+    }
+}
+
 TaskStruct* current() {
     return TaskManager::get_current();
 }
@@ -559,4 +788,8 @@ void print_stats() {
     TaskManager::print_stats();
 }
 
+void print_acct() {
+    TaskManager::print_acct();
+}
+
 }  // namespace sched
@@ -5,14 +5,23 @@
 
 #include "lib/list.h"
 #include "lib/result.h"
+#include "lib/rcu.h"
+#include "lib/spinlock.h"
 #include "fs/fd.h"
+#include "mm/objcache.h"
 #include "mm/vmm.h"
 #include "trap/trap.h"
 
+namespace blk {
+class Plug;
+}
+
 namespace vfs {
 class File;
 }
 
+class Mutex;
+
 enum class ProcessState : uint8_t {
     Uninit = 0,    // uninitialized
     Sleeping = 1,  // sleeping (blocked, waiting for event)
@@ -21,23 +30,50 @@ enum class ProcessState : uint8_t {
     Zombie = 4,    // almost dead (waiting to be cleaned up)
 };
 
+enum class SchedPolicy : uint8_t {
+    Normal = 0,      // Time-shared, `priority` 0..20
+    Fifo = 1,        // Real-time, runs until it blocks or a higher task wakes
+    RoundRobin = 2,  // Real-time, FIFO with a time slice among equals
+};
+
 namespace sched_prio {
 inline constexpr int MAX_PRIO = 0;    // Highest priority
 inline constexpr int DEFAULT = 10;    // Normal processes
 inline constexpr int MIN_PRIO = 20;   // Lowest priority
 inline constexpr int IDLE_PRIO = 31;  // Idle process only
 
+// Real-time priorities follow POSIX: 1..99, higher runs first.  They map
+// below MAX_PRIO on the effective scale, so any real-time task beats any
+// normal one.
+inline constexpr int RT_PRIO_MIN = 1;
+inline constexpr int RT_PRIO_MAX = 99;
+
+inline constexpr int NO_BOOST = IDLE_PRIO + 1;  // pi_prio when nothing is inherited
+
 inline constexpr int BASE_TIMESLICE = 10;  // 100ms default
 }  // namespace sched_prio
 
 struct TaskStruct;
 
+// Per-task CPU accounting, in clocksource nanoseconds.  `last_ns` marks the
+// start of the interval the task is currently in: running if it is current,
+// waiting if it is runnable.
+struct SchedStats {
+    uint64_t runtime_ns{};      // Time spent running
+    uint64_t wait_ns{};         // Time spent runnable but not running
+    uint64_t max_latency_ns{};  // Longest wakeup-to-run delay
+    uint64_t nr_voluntary{};    // Switched out while blocking or exiting
+    uint64_t nr_involuntary{};  // Switched out while still runnable
+    uint64_t last_ns{};
+    bool woken{};  // The current wait started with a wakeup from sleep
+};
+
 class SchedulerPolicy {
 public:
     [[nodiscard]] const char* get_name() const;
-    [[nodiscard]] int calc_time_slice(int priority) const;
+    [[nodiscard]] int calc_time_slice(const TaskStruct* task) const;
     void tick(TaskStruct* current, TaskStruct* idle) const;
-    [[nodiscard]] TaskStruct* pick_next(ListNode& proc_list, TaskStruct* idle);
+    [[nodiscard]] TaskStruct* pick_next(ListNode& proc_list, TaskStruct* current, TaskStruct* idle);
 };
 
 // Process control block - modeling Linux's task_struct
@@ -51,7 +87,7 @@ private:
     Context context_{};              // Process context for switching
     uintptr_t kernel_stack_{};       // Kernel stack bottom
     volatile ProcessState state_{};  // Process state
-    fd::Table files_{};
+    fd::Table* files_{};             // Shared with CLONE_FILES threads
     friend struct TaskStructAccess;
 
 public:
@@ -60,8 +96,9 @@ public:
     uint32_t flags{};         // Process flags
 
     ListNode list_node{};   // Link in process list
-    ListNode hash_node{};   // Link in hash list
+    ListNode hash_node{};   // Link in hash list (RCU)
     ListNode child_node{};  // Link in parent's child list
+    RcuHead rcu{};          // Deferred free once PID-hash readers are gone
     int exit_code{};        // Exit code (for zombie processes)
     uint32_t wait_state{};  // Waiting state
 
@@ -72,6 +109,24 @@ public:
     int priority{sched_prio::DEFAULT};  // Static priority (lower = higher)
     int time_slice{};                   // Remaining ticks in current quantum
     volatile int need_resched{};        // Set by timer ISR to request reschedule
+    SchedStats stats{};
+
+    SchedPolicy policy{SchedPolicy::Normal};
+    int rt_priority{};  // RT_PRIO_MIN..RT_PRIO_MAX under Fifo/RoundRobin
+
+    // Priority inheritance (sync/mutex.cpp)
+    int pi_prio{sched_prio::NO_BOOST};  // Best effective priority lent by waiters
+    Mutex* pi_blocked_on{};             // Mutex this task is sleeping on
+    ListNode pi_node{};                 // Link in pi_blocked_on's waiter list
+    ListNode pi_held{};                 // Mutexes this task owns
+
+    blk::Plug* blk_plug{};  // Holds block requests back (block/queue.cpp)
+
+    [[nodiscard]] bool is_rt() const { return policy != SchedPolicy::Normal; }
+
+    // Lower runs first.  Real-time tasks map to MAX_PRIO - rt_priority.
+    [[nodiscard]] int base_prio() const { return is_rt() ? sched_prio::MAX_PRIO - rt_priority : priority; }
+    [[nodiscard]] int effective_prio() const { return pi_prio < base_prio() ? pi_prio : base_prio(); }
 
     void run();
     void sleep();
@@ -83,10 +138,12 @@ public:
     [[nodiscard]] uintptr_t get_cr3() const;
 
     void copy_mm(uint32_t clone_flags);
+    Error copy_files(uint32_t clone_flags);
+    void exit_files();  // Drop this task's reference to its file table
     void copy_thread(uintptr_t esp, TrapFrame* src_tf);
     int setup_kernel_stack();
-    [[nodiscard]] fd::Table& files() { return files_; }
-    [[nodiscard]] const fd::Table& files() const { return files_; }
+    [[nodiscard]] fd::Table& files() { return *files_; }
+    [[nodiscard]] const fd::Table& files() const { return *files_; }
 
     ListNode* node() { return &list_node; }
 
@@ -102,10 +159,23 @@ public:
         return reinterpret_cast<TaskStruct*>(reinterpret_cast<char*>(node) - offset_of(&TaskStruct::child_node));
     }
 
+    static TaskStruct* from_rcu(RcuHead* head) {
+        return reinterpret_cast<TaskStruct*>(reinterpret_cast<char*>(head) - offset_of(&TaskStruct::rcu));
+    }
+
+    static TaskStruct* from_pi_link(ListNode* node) {
+        return reinterpret_cast<TaskStruct*>(reinterpret_cast<char*>(node) - offset_of(&TaskStruct::pi_node));
+    }
+
     void set_links();
     void remove_links();
     void destroy();
 
+    // Backed by TaskManager::s_task_cache, so the RCU free of an exited
+    // task feeds the next fork.
+    static void* operator new(size_t size) noexcept;
+    static void operator delete(void* ptr) noexcept;
+
     friend class TaskManager;
 };
 
@@ -116,6 +186,14 @@ public:
 
     inline static ListNode s_proc_list{};
     inline static ListNode s_hash_list[HASH_LIST_SIZE]{};
+    inline static LockClass s_hash_class{"pid_hash"};
+    inline static Spinlock s_hash_lock{s_hash_class};  // Serializes s_hash_list writers; find_proc() reads under RCU
+
+    // Recycled TaskStructs and kernel stacks: fork/exit cycles reuse them
+    // instead of going back to the page allocator.
+    static constexpr size_t TASK_CACHE_LIMIT = 32;
+    inline static ObjCache s_task_cache{"task_struct", sizeof(TaskStruct), TASK_CACHE_LIMIT};
+    inline static ObjCache s_kstack_cache{"kstack", TaskStruct::KSTACK_SIZE, TASK_CACHE_LIMIT};
 
     inline static TaskStruct* s_idle_proc{};  // Idle process (PID 0)
     inline static TaskStruct* s_init_proc{};  // Init process (PID 1)
@@ -135,14 +213,16 @@ public:
 
     static void print();
     static void print_stats();
+    static void print_acct();
 
     // Scheduling and process lifecycle
     static void schedule();
     static void tick();  // Called from timer ISR each tick
-    static Result<int> fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* trap_frame);
-    static Result<int> kernel_thread(int (*fn)(void*), void* arg);
+    static Result<int> fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* trap_frame, MemoryDesc* mm = nullptr);
+    static Result<int> kernel_thread(int (*fn)(void*), void* arg, uint32_t clone_flags = 0);
     static int exit(int error_code);
     static Result<int> wait(int pid, int* code_store);
+    static Error set_scheduler(TaskStruct* task, SchedPolicy policy, int prio);
 
 private:
     inline static TaskStruct* s_current{};
@@ -169,14 +249,23 @@ int init();
 
 void schedule();
 void tick();  // Called from timer ISR each tick
-Result<int> fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* tf);
-Result<int> kernel_thread(int (*fn)(void*), void* arg);
+// With `mm`, the child runs in that fresh address space and takes over the
+// caller's reference to it instead of sharing the parent's.
+Result<int> fork(uint32_t clone_flags, uintptr_t stack, TrapFrame* tf, MemoryDesc* mm = nullptr);
+Result<int> kernel_thread(int (*fn)(void*), void* arg, uint32_t clone_flags = 0);
 int exit(int error_code);
 Result<int> wait(int pid, int* code_store);
 
+// Change a task's class.  `prio` is rt_priority for Fifo/RoundRobin and the
+// normal priority (MAX_PRIO..MIN_PRIO) for Normal.
+Error set_scheduler(TaskStruct* task, SchedPolicy policy, int prio);
+
+void cond_resched();  // Explicit preemption point for long-running kernel loops
+
 TaskStruct* current();
 TaskStruct* find_proc(int pid);
 void print();
 void print_stats();
+void print_acct();  // Per-task runtime, wait time and switch counts
 
 }  // namespace sched
@@ -6,9 +6,13 @@ const char* SchedulerPolicy::get_name() const {
     return "Priority Round Robin";
 }
 
-int SchedulerPolicy::calc_time_slice(int priority) const {
+int SchedulerPolicy::calc_time_slice(const TaskStruct* task) const {
+    if (task->is_rt()) {
+        return sched_prio::BASE_TIMESLICE;  // Only RoundRobin consumes it
+    }
+
     // Priority 0 (highest) -> 2x base, priority 20 (lowest) -> 0.5x base
-    int slice = sched_prio::BASE_TIMESLICE * (sched_prio::MIN_PRIO + 1 - priority) / (sched_prio::DEFAULT + 1);
+    int slice = sched_prio::BASE_TIMESLICE * (sched_prio::MIN_PRIO + 1 - task->priority) / (sched_prio::DEFAULT + 1);
     if (slice < 1)
         slice = 1;
     return slice;
@@ -17,6 +21,8 @@ int SchedulerPolicy::calc_time_slice(int priority) const {
 void SchedulerPolicy::tick(TaskStruct* current, TaskStruct* idle) const {
     if (!current || current == idle)
         return;  // idle doesn't consume timeslice
+    if (current->policy == SchedPolicy::Fifo)
+        return;  // FIFO runs until it blocks or is preempted
 
     if (current->time_slice > 0) {
         current->time_slice--;
@@ -26,9 +32,12 @@ void SchedulerPolicy::tick(TaskStruct* current, TaskStruct* idle) const {
     }
 }
 
-TaskStruct* SchedulerPolicy::pick_next(ListNode& proc_list, TaskStruct* idle) {
+// Highest effective priority wins.  Ties rotate from the cursor, which sits
+// just past the last pick, so the task being switched out comes last --
+// except a FIFO task, which keeps the CPU against its equals.
+TaskStruct* SchedulerPolicy::pick_next(ListNode& proc_list, TaskStruct* current, TaskStruct* idle) {
     TaskStruct* next = idle;
-    int best_prio = sched_prio::IDLE_PRIO + 1;  // Worse than idle
+    int best_prio = sched_prio::NO_BOOST;  // Worse than idle
     ListNode* head = &proc_list;
 
     if (!sched_cursor || sched_cursor == head) {
@@ -37,11 +46,16 @@ TaskStruct* SchedulerPolicy::pick_next(ListNode& proc_list, TaskStruct* idle) {
 
     for (auto* node : proc_list.circular_from(sched_cursor)) {
         TaskStruct* proc = TaskStruct::from_list_link(node);
-        if (proc->get_state() == ProcessState::Runnable && proc != idle) {
-            if (proc->priority < best_prio) {
-                next = proc;
-                best_prio = proc->priority;
-            }
+        ProcessState state = proc->get_state();
+        bool runnable = state == ProcessState::Runnable || (proc == current && state == ProcessState::Running);
+        if (!runnable || proc == idle) {
+            continue;
+        }
+
+        int prio = proc->effective_prio();
+        if (prio < best_prio || (prio == best_prio && proc == current && proc->policy == SchedPolicy::Fifo)) {
+            next = proc;
+            best_prio = prio;
         }
     }
 
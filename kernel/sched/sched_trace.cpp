@@ -0,0 +1,147 @@
+#include "sched_trace.h"
+
+#include "sched.h"
+#include "lib/memory.h"
+#include "lib/stdio.h"
+#include "time/clocksource.h"
+
+namespace {
+
+static_assert((sched_trace::CAPACITY & (sched_trace::CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+constexpr uint64_t MASK = sched_trace::CAPACITY - 1;
+
+struct Slot {
+    uint64_t seq{};  // Index + 1 of the event last published here; 0 = empty
+    sched_trace::Record rec{};
+};
+
+Slot s_ring[sched_trace::CAPACITY]{};
+uint64_t s_head{};  // Next event index
+uint64_t s_base{};  // First index still reported after reset()
+
+void record(const sched_trace::Record& rec) {
+    uint64_t idx = __atomic_fetch_add(&s_head, 1, __ATOMIC_RELAXED);
+    Slot& slot = s_ring[idx & MASK];
+
+    __atomic_store_n(&slot.seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot.rec = rec;
+    __atomic_store_n(&slot.seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+int16_t prio_of(const TaskStruct* task) {
+    return static_cast<int16_t>(task ? task->effective_prio() : -1);
+}
+
+int pid_of(const TaskStruct* task) {
+    return task ? task->pid : -1;
+}
+
+const char* state_name(uint8_t state) {
+    switch (static_cast<ProcessState>(state)) {
+        case ProcessState::Uninit: return "U";
+        case ProcessState::Sleeping: return "S";
+        case ProcessState::Runnable: return "R";
+        case ProcessState::Running: return "R+";
+        case ProcessState::Zombie: return "Z";
+        default: return "?";
+    }
+}
+
+}  // namespace
+
+namespace sched_trace {
+
+void switch_to(uint64_t ts_ns, const TaskStruct* prev, const TaskStruct* next) {
+    Record rec{};
+    rec.ts_ns = ts_ns;
+    rec.event = Event::Switch;
+    rec.prev_state = static_cast<uint8_t>(prev ? prev->get_state() : ProcessState::Uninit);
+    rec.prev_prio = prio_of(prev);
+    rec.next_prio = prio_of(next);
+    rec.prev_pid = pid_of(prev);
+    rec.next_pid = pid_of(next);
+    record(rec);
+}
+
+void wakeup(uint64_t ts_ns, const TaskStruct* waker, const TaskStruct* woken) {
+    Record rec{};
+    rec.ts_ns = ts_ns;
+    rec.event = Event::Wakeup;
+    rec.prev_prio = prio_of(waker);
+    rec.next_prio = prio_of(woken);
+    rec.prev_pid = pid_of(waker);
+    rec.next_pid = pid_of(woken);
+    record(rec);
+}
+
+uint64_t total() {
+    return __atomic_load_n(&s_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&s_base, __ATOMIC_RELAXED);
+}
+
+size_t snapshot(Record* out, size_t max) {
+    uint64_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    uint64_t first = __atomic_load_n(&s_base, __ATOMIC_RELAXED);
+
+    if (head - first > CAPACITY) {
+        first = head - CAPACITY;
+    }
+    if (head - first > max) {
+        first = head - max;
+    }
+
+    size_t n = 0;
+    for (uint64_t idx = first; idx < head; idx++) {
+        const Slot& slot = s_ring[idx & MASK];
+
+        if (__atomic_load_n(&slot.seq, __ATOMIC_ACQUIRE) != idx + 1) {
+            continue;  // Not yet published, or already overwritten
+        }
+        Record rec = slot.rec;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot.seq, __ATOMIC_RELAXED) != idx + 1) {
+            continue;  // Rewritten while we copied it
+        }
+        out[n++] = rec;
+    }
+
+    return n;
+}
+
+void reset() {
+    __atomic_store_n(&s_base, __atomic_load_n(&s_head, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+}
+
+void dump() {
+    auto* recs = static_cast<Record*>(kmalloc(sizeof(Record) * CAPACITY));
+    if (!recs) {
+        cprintf("schedtrace: out of memory\n");
+        return;
+    }
+
+    uint64_t events = total();
+    size_t n = snapshot(recs, CAPACITY);
+
+    cprintf("# schedtrace: %lu events, %lu shown, clock=%s\n", events, static_cast<uint64_t>(n),
+            clocksource::available() ? "counter" : "tick");
+    cprintf("#      timestamp  event\n");
+
+    for (size_t i = 0; i < n; i++) {
+        const Record& r = recs[i];
+        uint64_t us = r.ts_ns / clocksource::NSEC_PER_USEC;
+
+        if (r.event == Event::Switch) {
+            cprintf("%10lu.%06lu  sched_switch: prev_pid=%d prev_prio=%d prev_state=%s ==> next_pid=%d next_prio=%d\n",
+                    us / 1000000, us % 1000000, r.prev_pid, r.prev_prio, state_name(r.prev_state), r.next_pid,
+                    r.next_prio);
+        } else {
+            cprintf("%10lu.%06lu  sched_wakeup: pid=%d prio=%d waker=%d\n", us / 1000000, us % 1000000, r.next_pid,
+                    r.next_prio, r.prev_pid);
+        }
+    }
+
+    kfree(recs);
+}
+
+}  // namespace sched_trace
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <base/types.h>
+
+struct TaskStruct;
+
+// Lock-free ring of sched_switch / sched_wakeup events.
+//
+// Writers claim a slot with an atomic increment of the head and publish it
+// through a per-slot sequence number, so recording never blocks and is safe
+// from IRQ context.  The oldest events are overwritten once the ring wraps;
+// readers skip any slot that is rewritten while they copy it.
+
+namespace sched_trace {
+
+inline constexpr size_t CAPACITY = 512;  // Must be a power of two
+
+enum class Event : uint8_t {
+    Switch = 0,
+    Wakeup = 1,
+};
+
+struct Record {
+    uint64_t ts_ns{};
+    Event event{};
+    uint8_t prev_state{};  // ProcessState of prev when switched out
+    int16_t prev_prio{};
+    int16_t next_prio{};
+    int prev_pid{};  // Switch: outgoing task; Wakeup: the waker
+    int next_pid{};  // Switch: incoming task; Wakeup: the woken task
+};
+
+void switch_to(uint64_t ts_ns, const TaskStruct* prev, const TaskStruct* next);
+void wakeup(uint64_t ts_ns, const TaskStruct* waker, const TaskStruct* woken);
+
+[[nodiscard]] uint64_t total();  // Events recorded since the last reset
+
+// Copy up to `max` of the most recent events, oldest first.
+size_t snapshot(Record* out, size_t max);
+
+void reset();
+void dump();
+
+}  // namespace sched_trace
@@ -0,0 +1,87 @@
+#include "softirq.h"
+
+#include "preempt.h"
+#include "workqueue.h"
+#include "drivers/intr.h"
+#include "lib/stdio.h"
+
+#include <asm/arch.h>
+
+namespace {
+
+softirq::Handler s_handlers[softirq::NR_VECS]{};
+uint64_t s_runs[softirq::NR_VECS]{};
+uint32_t s_pending{};
+
+// Overflow from a softirq storm: finish in thread context.
+Work s_overflow_work{};
+
+void run_overflow(Work* work) {
+    static_cast<void>(work);
+    softirq::run();
+}
+
+}  // namespace
+
+namespace softirq {
+
+void open(int nr, Handler handler) {
+    if (nr < 0 || nr >= NR_VECS) {
+        return;
+    }
+    s_handlers[nr] = handler;
+}
+
+void raise(int nr) {
+    if (nr < 0 || nr >= NR_VECS) {
+        return;
+    }
+    __atomic_fetch_or(&s_pending, 1U << nr, __ATOMIC_RELEASE);
+}
+
+bool pending() {
+    return __atomic_load_n(&s_pending, __ATOMIC_ACQUIRE) != 0;
+}
+
+uint64_t runs(int nr) {
+    if (nr < 0 || nr >= NR_VECS) {
+        return 0;
+    }
+    return s_runs[nr];
+}
+
+void run() {
+    if (preempt::in_interrupt() || !pending()) {
+        return;
+    }
+
+    bool irq_was_on = arch_irq_is_enabled();
+    preempt::softirq_enter();
+    intr::enable();
+
+    for (int pass = 0; pass < MAX_RESTART; pass++) {
+        uint32_t mask = __atomic_exchange_n(&s_pending, 0, __ATOMIC_ACQUIRE);
+        if (mask == 0) {
+            break;
+        }
+
+        for (int nr = 0; nr < NR_VECS; nr++) {
+            if ((mask & (1U << nr)) && s_handlers[nr]) {
+                s_runs[nr]++;
+                s_handlers[nr]();
+            }
+        }
+    }
+
+    if (!irq_was_on) {
+        intr::disable();
+    }
+    preempt::softirq_exit();
+
+    if (pending()) {
+        s_overflow_work.fn = run_overflow;
+        static_cast<void>(workqueue::queue_work(&s_overflow_work));
+    }
+}
+
+}  // namespace softirq
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <base/types.h>
+
+// Bottom halves.  A hard-IRQ handler acknowledges its device, raises a
+// softirq vector and returns; the vector's handler runs on the way out of
+// the outermost interrupt, after EOI and with interrupts enabled, so the
+// next interrupt is not held off by the deferred work.
+//
+// Handlers must not sleep.  A vector raised while it runs is run again;
+// after MAX_RESTART passes any remainder is handed to the system workqueue.
+
+namespace softirq {
+
+enum Vec : int {
+    TIMER = 0,  // Timer wheel expiry
+    INPUT = 1,  // Keyboard / console input
+    RCU = 2,    // RCU callbacks past their grace period
+    NR_VECS,
+};
+
+inline constexpr int MAX_RESTART = 10;
+
+using Handler = void (*)();
+
+void open(int nr, Handler handler);
+void raise(int nr);  // Safe from any context
+
+[[nodiscard]] bool pending();
+[[nodiscard]] uint64_t runs(int nr);  // Times the vector's handler has run
+
+// Run pending vectors unless already inside a hard IRQ or softirq.
+// Called from trap_dispatch after the outermost interrupt is acknowledged.
+void run();
+
+}  // namespace softirq
@@ -0,0 +1,206 @@
+#include "workqueue.h"
+
+#include "sched.h"
+#include "drivers/intr.h"
+#include "lib/stdio.h"
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+namespace {
+
+WorkQueue s_system_wq{};
+
+struct Barrier {
+    Work work{};
+    TaskStruct* task{};
+    volatile bool done{};
+};
+
+void barrier_fn(Work* work) {
+    auto* barrier = static_cast<Barrier*>(work->data);
+    barrier->done = true;
+    barrier->task->wakeup();
+}
+
+void delayed_work_timer(KernelTimer* timer) {
+    auto* dwork = static_cast<DelayedWork*>(timer->data);
+    static_cast<void>(dwork->wq->queue(&dwork->work));
+}
+
+}  // namespace
+
+int WorkQueue::start(const char* name) {
+    if (worker_) {
+        return 0;
+    }
+
+    auto pid_r = sched::kernel_thread(worker_main, this);
+    if (!pid_r.ok()) {
+        cprintf("workqueue: failed to start %s\n", name);
+        return -1;
+    }
+
+    TaskStruct* worker = sched::find_proc(pid_r.value());
+    if (worker) {
+        worker->set_name(name);
+        worker->priority = sched_prio::DEFAULT;
+    }
+
+    intr::Guard guard;
+    worker_ = worker;
+    if (!list_.empty()) {
+        wake_worker();
+    }
+    return 0;
+}
+
+void WorkQueue::wake_worker() {
+    if (worker_ && worker_->get_state() == ProcessState::Sleeping) {
+        worker_->wakeup();
+    }
+}
+
+bool WorkQueue::queue(Work* work) {
+    if (!work || !work->fn) {
+        return false;
+    }
+
+    intr::Guard guard;
+    if (work->pending()) {
+        return false;
+    }
+
+    list_.add_before(work->node);
+    wake_worker();
+    return true;
+}
+
+bool WorkQueue::queue_delayed(DelayedWork* dwork, int64_t delay_ticks) {
+    if (!dwork || !dwork->work.fn) {
+        return false;
+    }
+    if (delay_ticks <= 0) {
+        return queue(&dwork->work);
+    }
+
+    intr::Guard guard;
+    if (dwork->work.pending() || dwork->timer.pending()) {
+        return false;
+    }
+
+    dwork->wq = this;
+    dwork->timer.fn = delayed_work_timer;
+    dwork->timer.data = dwork;
+    ktimer::add(&dwork->timer, timer::ticks + delay_ticks);
+    return true;
+}
+
+bool WorkQueue::cancel(Work* work) {
+    if (!work) {
+        return false;
+    }
+
+    intr::Guard guard;
+    if (!work->pending()) {
+        return false;
+    }
+    work->detach();
+    return true;
+}
+
+bool WorkQueue::cancel_delayed(DelayedWork* dwork) {
+    if (!dwork) {
+        return false;
+    }
+
+    intr::Guard guard;
+    bool timer_cancelled = ktimer::cancel(&dwork->timer);
+    return cancel(&dwork->work) || timer_cancelled;
+}
+
+void WorkQueue::flush() {
+    TaskStruct* cur = sched::current();
+    if (!worker_ || cur == worker_) {
+        return;
+    }
+
+    Barrier barrier{};
+    barrier.work.fn = barrier_fn;
+    barrier.work.data = &barrier;
+    barrier.task = cur;
+    static_cast<void>(queue(&barrier.work));
+
+    while (true) {
+        {
+            intr::Guard guard;
+            if (barrier.done) {
+                break;
+            }
+            cur->sleep();
+        }
+        sched::schedule();
+    }
+}
+
+int WorkQueue::worker_main(void* arg) {
+    auto* wq = static_cast<WorkQueue*>(arg);
+    TaskStruct* self = sched::current();
+
+    while (true) {
+        Work* work = nullptr;
+        {
+            intr::Guard guard;
+            if (wq->list_.empty()) {
+                self->sleep();
+            } else {
+                work = Work::from_node(wq->list_.get_next());
+                work->detach();
+            }
+        }
+
+        if (!work) {
+            sched::schedule();
+            continue;
+        }
+
+        work->fn(work);
+        wq->executed_++;
+        sched::cond_resched();
+    }
+
+    return 0;
+}
+
+namespace workqueue {
+
+int init() {
+    return s_system_wq.start("kworker/0");
+}
+
+WorkQueue& system() {
+    return s_system_wq;
+}
+
+bool queue_work(Work* work) {
+    return s_system_wq.queue(work);
+}
+
+bool queue_delayed_work(DelayedWork* dwork, int64_t delay_ticks) {
+    return s_system_wq.queue_delayed(dwork, delay_ticks);
+}
+
+bool cancel_work(Work* work) {
+    return s_system_wq.cancel(work);
+}
+
+bool cancel_delayed_work(DelayedWork* dwork) {
+    return s_system_wq.cancel_delayed(dwork);
+}
+
+void flush() {
+    s_system_wq.flush();
+}
+
+}  // namespace workqueue
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <base/types.h>
+
+#include "lib/list.h"
+#include "time/timer_wheel.h"
+
+struct TaskStruct;
+
+// Deferred work executed in thread context by a workqueue's worker.
+// A work item is pending from queue() until its worker dequeues it, so the
+// function may requeue its own item.
+struct Work {
+    using Func = void (*)(Work* work);
+
+    ListNode node{};
+    Func fn{};
+    void* data{};
+
+    [[nodiscard]] bool pending() const { return !node.empty(); }
+
+    void detach() {
+        node.unlink();
+        node.prev = node.next = &node;
+    }
+
+    static Work* from_node(ListNode* n) {
+        return reinterpret_cast<Work*>(reinterpret_cast<char*>(n) - offset_of(&Work::node));
+    }
+};
+
+class WorkQueue;
+
+// Work queued once a timer expires.
+struct DelayedWork {
+    Work work{};
+    KernelTimer timer{};
+    WorkQueue* wq{};
+};
+
+// FIFO of work items drained by a dedicated kernel thread.  queue() is
+// safe from hard-IRQ and softirq context.
+class WorkQueue {
+public:
+    int start(const char* name);
+
+    bool queue(Work* work);  // false if already pending
+    bool queue_delayed(DelayedWork* dwork, int64_t delay_ticks);
+    bool cancel(Work* work);  // true if it was pending and will not run
+    bool cancel_delayed(DelayedWork* dwork);
+
+    // Wait until every item queued before the call has run.  Must not be
+    // called from one of this queue's work functions.
+    void flush();
+
+    [[nodiscard]] TaskStruct* worker() const { return worker_; }
+    [[nodiscard]] uint64_t executed() const { return executed_; }
+
+private:
+    static int worker_main(void* arg);
+    void wake_worker();
+
+    ListNode list_{};
+    TaskStruct* worker_{};
+    uint64_t executed_{};
+};
+
+// The system workqueue: one worker thread per CPU (one on this kernel).
+namespace workqueue {
+
+int init();
+
+WorkQueue& system();
+
+bool queue_work(Work* work);
+bool queue_delayed_work(DelayedWork* dwork, int64_t delay_ticks);
+bool cancel_work(Work* work);
+bool cancel_delayed_work(DelayedWork* dwork);
+void flush();
+
+}  // namespace workqueue
@@ -0,0 +1,115 @@
+#include "lib/futex.h"
+#include "lib/list.h"
+#include "lib/lock_guard.h"
+#include "lib/spinlock.h"
+#include "mm/uaccess.h"
+#include "sched/sched.h"
+
+namespace futex {
+
+namespace {
+
+constexpr size_t HASH_SIZE = 1 << HASH_BITS;
+
+struct Waiter {
+    TaskStruct* task{};
+    const MemoryDesc* mm{};
+    const uint32_t* addr{};
+    ListNode node{};
+    bool woken{};
+
+    static Waiter* from_node(ListNode* n) {
+        return reinterpret_cast<Waiter*>(reinterpret_cast<char*>(n) - offset_of(&Waiter::node));
+    }
+};
+
+LockClass s_bucket_class{"futex"};
+
+// A bucket is shared by every key that hashes to it, so wake() matches the
+// key of each waiter rather than waking the whole queue.
+struct Bucket {
+    Spinlock lock{s_bucket_class};
+    ListNode waiters{};
+};
+
+Bucket s_buckets[HASH_SIZE];
+
+Bucket& bucket_of(const MemoryDesc* mm, const uint32_t* addr) {
+    uint64_t key = reinterpret_cast<uintptr_t>(mm) ^ (reinterpret_cast<uintptr_t>(addr) >> 2);
+    return s_buckets[(key * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS)];
+}
+
+// User words are read through uaccess, so a bad address fails the wait
+// instead of faulting in the kernel; kernel threads wait on kernel words.
+// Under the bucket lock `nofault` is set: the page may have been swapped
+// out again, and paging it in would sleep.
+Error load_word(const uint32_t* addr, uint32_t& val, bool nofault) {
+    if (reinterpret_cast<uintptr_t>(addr) < USER_SPACE_TOP) {
+        return nofault ? uaccess::get_user_nofault(val, addr) : uaccess::get_user(val, addr);
+    }
+    val = __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+    return Error::None;
+}
+
+}  // namespace
+
+Error wait(const MemoryDesc* mm, const uint32_t* addr, uint32_t expected) {
+    ENSURE(addr, Error::Invalid);
+
+    Bucket& bucket = bucket_of(mm, addr);
+    Waiter waiter{};
+    waiter.task = sched::current();
+    waiter.mm = mm;
+    waiter.addr = addr;
+
+    // Check the word and queue under the bucket lock.  If its page is not
+    // present, fault it in with the lock dropped and look again.
+    uint32_t val = 0;
+    while (true) {
+        {
+            LockGuard<Spinlock> guard(bucket.lock);
+            if (load_word(addr, val, true) == Error::None) {
+                if (val != expected) {
+                    return Error::Busy;
+                }
+                bucket.waiters.add_before(waiter.node);
+                waiter.task->sleep();
+                break;
+            }
+        }
+        TRY(load_word(addr, val, false));
+    }
+
+    // wake() dequeues us before the wakeup; anything else is spurious.
+    while (true) {
+        sched::schedule();
+
+        LockGuard<Spinlock> guard(bucket.lock);
+        if (waiter.woken) {
+            return Error::None;
+        }
+        waiter.task->sleep();
+    }
+}
+
+int wake(const MemoryDesc* mm, const uint32_t* addr, int nr) {
+    Bucket& bucket = bucket_of(mm, addr);
+    int woken = 0;
+
+    LockGuard<Spinlock> guard(bucket.lock);
+    ListNode* node = bucket.waiters.get_next();
+    while (node != &bucket.waiters && woken < nr) {
+        ListNode* next = node->get_next();
+        Waiter* waiter = Waiter::from_node(node);
+        if (waiter->mm == mm && waiter->addr == addr) {
+            node->unlink();
+            waiter->woken = true;
+            waiter->task->wakeup();
+            woken++;
+        }
+        node = next;
+    }
+    return woken;
+}
+
+}  // namespace futex
@@ -0,0 +1,128 @@
+#include "lib/lockstat.h"
+#include "lib/stdio.h"
+#include "time/clocksource.h"
+
+namespace lockstat {
+
+LockClass spinlock_class{"spinlock"};
+LockClass mutex_class{"mutex"};
+LockClass semaphore_class{"semaphore"};
+LockClass waitqueue_class{"waitqueue"};
+
+#ifdef CONFIG_LOCKSTAT
+
+namespace {
+
+constexpr int MAX_PRINT = 64;  // Classes considered by print()
+
+// Singly linked, push-only.  Hooks run under spinlocks and in interrupt
+// context, so neither registration nor the counters may take a lock.
+LockClass* s_classes{};
+
+void register_class(LockClass* cls) {
+    if (__atomic_exchange_n(&cls->registered, true, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    LockClass* head = __atomic_load_n(&s_classes, __ATOMIC_RELAXED);
+    do {
+        cls->next = head;
+    } while (!__atomic_compare_exchange_n(&s_classes, &head, cls, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void update_max(uint64_t* max, uint64_t val) {
+    uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (val > cur && !__atomic_compare_exchange_n(max, &cur, val, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+uint64_t load(const uint64_t& val) {
+    return __atomic_load_n(&val, __ATOMIC_RELAXED);
+}
+
+}  // namespace
+
+bool enabled() {
+    return true;
+}
+
+uint64_t cycles() {
+    return clocksource::read_cycles();
+}
+
+void record_acquire(LockClass* cls, uint64_t wait, bool contended) {
+    register_class(cls);
+
+    __atomic_fetch_add(&cls->acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        __atomic_fetch_add(&cls->contentions, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cls->wait_total, wait, __ATOMIC_RELAXED);
+        update_max(&cls->wait_max, wait);
+    }
+}
+
+void record_hold(LockClass* cls, uint64_t hold) {
+    __atomic_fetch_add(&cls->hold_total, hold, __ATOMIC_RELAXED);
+    update_max(&cls->hold_max, hold);
+}
+
+void reset() {
+    for (LockClass* cls = __atomic_load_n(&s_classes, __ATOMIC_ACQUIRE); cls; cls = cls->next) {
+        __atomic_store_n(&cls->acquisitions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cls->contentions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cls->wait_total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cls->wait_max, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cls->hold_total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cls->hold_max, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void print(int top_n) {
+    LockClass* sorted[MAX_PRINT]{};
+    int n = 0;
+
+    // Insertion sort by contentions, then by total wait.
+    for (LockClass* cls = __atomic_load_n(&s_classes, __ATOMIC_ACQUIRE); cls; cls = cls->next) {
+        if (load(cls->acquisitions) == 0) {
+            continue;
+        }
+        int i = n < MAX_PRINT ? n++ : MAX_PRINT;
+        while (i > 0 && (load(sorted[i - 1]->contentions) < load(cls->contentions) ||
+                         (load(sorted[i - 1]->contentions) == load(cls->contentions) &&
+                          load(sorted[i - 1]->wait_total) < load(cls->wait_total)))) {
+            if (i < MAX_PRINT) {
+                sorted[i] = sorted[i - 1];
+            }
+            i--;
+        }
+        if (i < MAX_PRINT) {
+            sorted[i] = cls;
+        }
+    }
+
+    cprintf("%-12s %10s %10s %12s %12s %12s %12s\n", "class", "acq", "contend", "wait-total", "wait-max",
+            "hold-total", "hold-max");
+    for (int i = 0; i < n && i < top_n; i++) {
+        LockClass* cls = sorted[i];
+        cprintf("%-12s %10lu %10lu %12lu %12lu %12lu %12lu\n", cls->name, load(cls->acquisitions),
+                load(cls->contentions), load(cls->wait_total), load(cls->wait_max), load(cls->hold_total),
+                load(cls->hold_max));
+    }
+    cprintf("(times in cycles, %lu Hz)\n", clocksource::freq_hz());
+}
+
+#else
+
+bool enabled() {
+    return false;
+}
+
+void reset() {}
+
+void print(int top_n) {
+    static_cast<void>(top_n);
+    cprintf("lockstat: not built in (build with make LOCKSTAT=1)\n");
+}
+
+#endif
+
+}  // namespace lockstat
@@ -1,38 +1,230 @@
 #include "lib/mutex.h"
 #include "lib/lock_guard.h"
+#include "lib/rcu.h"
 #include "debug/assert.h"
 #include "sched/sched.h"
 
+#include <asm/arch.h>
+
+namespace {
+
+// Protects every contended mutex's wait queue together with the pi_* fields
+// of all tasks, so a boost can walk an owner chain without lock ordering.
+// The uncontended fast paths never take it.
+LockClass s_pi_class{"pi_lock"};
+Spinlock s_pi_lock{s_pi_class};
+
+void reset_link(ListNode& node) {
+    node.unlink();
+    node.prev = node.next = &node;
+}
+
+}  // namespace
+
 void Mutex::lock() {
-    while (true) {
-        {
-            LockGuard<Spinlock> guard(spin_);
-            if (!held_) {
-                held_ = true;
-                owner_ = sched::current();
-                return;
-            }
-        }
-        waitq_.sleep();
+    TaskStruct* cur = sched::current();
+
+    if (try_acquire(cur)) {
+        stat_.acquired(0, false);
+        return;
     }
+
+    // Before sched::init() nothing else runs to release it.
+    assert(cur);
+
+    uint64_t start = stat_.start();
+    if (!spin_on_owner(cur)) {
+        lock_slow(cur);
+    }
+    stat_.acquired(start, true);
 }
 
 void Mutex::unlock() {
-    {
-        LockGuard<Spinlock> guard(spin_);
-        assert(held_ && owner_ == sched::current());
-        held_ = false;
-        owner_ = nullptr;
+    TaskStruct* cur = sched::current();
+    stat_.released();
+
+    uintptr_t expected = owner_word(cur);
+    if (__atomic_compare_exchange_n(&owner_, &expected, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return;
     }
-    waitq_.wakeup_one();
+    unlock_slow(cur);
 }
 
 bool Mutex::try_lock() {
-    LockGuard<Spinlock> guard(spin_);
-    if (!held_) {
-        held_ = true;
-        owner_ = sched::current();
-        return true;
+    if (!try_acquire(sched::current())) {
+        return false;
+    }
+    stat_.acquired(0, false);
+    return true;
+}
+
+bool Mutex::try_acquire(TaskStruct* cur) {
+    uintptr_t expected = 0;
+    return __atomic_compare_exchange_n(&owner_, &expected, owner_word(cur), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// An owner that is running on a CPU is likely to unlock soon, and spinning
+// for it is cheaper than a sleep/wakeup round trip.  Stop as soon as the
+// owner blocks or is preempted, once others are queued (the lock will be
+// handed to them), or when we are asked to reschedule.  The read-side
+// section keeps the owner's TaskStruct alive while we look at it.
+bool Mutex::spin_on_owner(TaskStruct* cur) {
+    rcu::ReadGuard guard;
+
+    for (int i = 0; i < MAX_SPIN; i++) {
+        uintptr_t word = __atomic_load_n(&owner_, __ATOMIC_RELAXED);
+        if (word == 0) {
+            if (try_acquire(cur)) {
+                return true;
+            }
+            continue;
+        }
+        if (word & HAS_WAITERS) {
+            return false;
+        }
+
+        TaskStruct* owner = owner_task(word);
+        assert(owner && owner != cur);
+        if (owner->get_state() != ProcessState::Running || cur->need_resched) {
+            return false;
+        }
+        arch_spin_hint();
     }
     return false;
 }
+
+void Mutex::lock_slow(TaskStruct* cur) {
+    {
+        LockGuard<Spinlock> guard(s_pi_lock);
+
+        // Take the mutex if it came free, otherwise mark it contended so the
+        // owner's unlock() comes here for the hand-off.
+        uintptr_t word = __atomic_load_n(&owner_, __ATOMIC_RELAXED);
+        while (!(word & HAS_WAITERS)) {
+            assert(word != BOOT_OWNER);
+            if (word == 0) {
+                if (__atomic_compare_exchange_n(&owner_, &word, reinterpret_cast<uintptr_t>(cur), false,
+                                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                    return;
+                }
+                continue;
+            }
+            if (__atomic_compare_exchange_n(&owner_, &word, word | HAS_WAITERS, false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                owner_task(word)->pi_held.add_before(held_node_);
+                break;
+            }
+        }
+
+        TaskStruct* owner = owner_task(word);
+        assert(owner != cur);
+        enqueue_waiter(cur);
+        cur->pi_blocked_on = this;
+        boost_chain(owner);
+        cur->sleep();
+    }
+
+    // unlock() hands the mutex over before waking us, so there is no retry.
+    while (true) {
+        sched::schedule();
+
+        LockGuard<Spinlock> guard(s_pi_lock);
+        if (owner() == cur) {
+            return;
+        }
+        cur->sleep();
+    }
+}
+
+void Mutex::unlock_slow(TaskStruct* cur) {
+    LockGuard<Spinlock> guard(s_pi_lock);
+
+    uintptr_t word = __atomic_load_n(&owner_, __ATOMIC_RELAXED);
+    assert(owner_task(word) == cur && (word & HAS_WAITERS) && !waiters_.empty());
+
+    reset_link(held_node_);
+
+    TaskStruct* next = TaskStruct::from_pi_link(waiters_.get_next());
+    reset_link(next->pi_node);
+    next->pi_blocked_on = nullptr;
+
+    word = reinterpret_cast<uintptr_t>(next);
+    if (!waiters_.empty()) {
+        word |= HAS_WAITERS;
+        next->pi_held.add_before(held_node_);
+    }
+    __atomic_store_n(&owner_, word, __ATOMIC_RELEASE);
+    update_pi(next);  // Inherit from waiters still queued behind it
+
+    // Drop whatever this mutex lent us; let the scheduler re-evaluate if
+    // that leaves us behind someone.
+    int before = cur->effective_prio();
+    update_pi(cur);
+    if (cur->effective_prio() > before) {
+        cur->need_resched = 1;
+    }
+
+    next->wakeup();
+}
+
+void Mutex::prio_changed(TaskStruct* task) {
+    LockGuard<Spinlock> guard(s_pi_lock);
+
+    Mutex* blocked = task->pi_blocked_on;
+    if (!blocked) {
+        return;
+    }
+
+    reset_link(task->pi_node);
+    blocked->enqueue_waiter(task);
+    boost_chain(blocked->owner());
+}
+
+void Mutex::enqueue_waiter(TaskStruct* task) {
+    int prio = task->effective_prio();
+    for (auto* node : waiters_) {
+        if (TaskStruct::from_pi_link(node)->effective_prio() > prio) {
+            node->add_before(task->pi_node);
+            return;
+        }
+    }
+    waiters_.add_before(task->pi_node);
+}
+
+int Mutex::top_waiter_prio() const {
+    if (waiters_.empty()) {
+        return sched_prio::NO_BOOST;
+    }
+    return TaskStruct::from_pi_link(waiters_.get_next())->effective_prio();
+}
+
+void Mutex::update_pi(TaskStruct* task) {
+    int best = sched_prio::NO_BOOST;
+    for (auto* node : task->pi_held) {
+        int prio = from_held_link(node)->top_waiter_prio();
+        if (prio < best) {
+            best = prio;
+        }
+    }
+    task->pi_prio = best;
+}
+
+// Recompute `owner`'s boost and, while that changes its priority and it is
+// itself blocked, re-sort it in that mutex and continue with the next owner.
+void Mutex::boost_chain(TaskStruct* owner) {
+    for (int depth = 0; owner && depth < MAX_PI_DEPTH; depth++) {
+        int before = owner->effective_prio();
+        update_pi(owner);
+        if (owner->effective_prio() == before) {
+            return;
+        }
+
+        Mutex* blocked = owner->pi_blocked_on;
+        if (!blocked) {
+            return;
+        }
+        reset_link(owner->pi_node);
+        blocked->enqueue_waiter(owner);
+        owner = blocked->owner();
+    }
+}
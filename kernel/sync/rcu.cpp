@@ -0,0 +1,100 @@
+#include "lib/rcu.h"
+
+#include "drivers/intr.h"
+#include "sched/softirq.h"
+
+namespace {
+
+// Callbacks in call() order, hence in grace-period order.  Touched with
+// interrupts off, since call() may come from an IRQ handler.
+RcuHead* s_cb_head{};
+RcuHead** s_cb_tail{&s_cb_head};
+
+uint64_t s_gp_seq{};   // Grace periods completed
+uint64_t s_invoked{};  // Callbacks run
+
+bool ready(const RcuHead* head) {
+    return head && head->gp <= s_gp_seq;
+}
+
+// Detach the callbacks whose grace period has ended and run them.
+void invoke_ready() {
+    RcuHead* list = nullptr;
+    {
+        intr::Guard guard;
+        RcuHead** link = &s_cb_head;
+        while (ready(*link)) {
+            link = &(*link)->next;
+        }
+        if (link == &s_cb_head) {
+            return;
+        }
+
+        list = s_cb_head;
+        s_cb_head = *link;
+        *link = nullptr;
+        if (!s_cb_head) {
+            s_cb_tail = &s_cb_head;
+        }
+    }
+
+    while (list) {
+        RcuHead* next = list->next;
+        list->fn(list);
+        s_invoked++;
+        list = next;
+    }
+}
+
+}  // namespace
+
+namespace rcu {
+
+int init() {
+    softirq::open(softirq::RCU, invoke_ready);
+    return 0;
+}
+
+void note_qs() {
+    intr::Guard guard;
+
+    // One CPU: its quiescent state ends the current grace period.
+    s_gp_seq++;
+    if (ready(s_cb_head)) {
+        softirq::raise(softirq::RCU);
+    }
+}
+
+void synchronize() {
+    // A caller that may sleep is not inside a read-side section, so this
+    // CPU is quiescent right now, and there is no other CPU to wait for.
+    note_qs();
+}
+
+void call(RcuHead* head, RcuHead::Func fn) {
+    if (!head || !fn) {
+        return;
+    }
+
+    intr::Guard guard;
+    head->fn = fn;
+    head->next = nullptr;
+    head->gp = s_gp_seq + 1;
+    *s_cb_tail = head;
+    s_cb_tail = &head->next;
+}
+
+void barrier() {
+    synchronize();
+    invoke_ready();
+}
+
+uint64_t completed() {
+    return s_gp_seq;
+}
+
+uint64_t invoked() {
+    return s_invoked;
+}
+
+}  // namespace rcu
@@ -0,0 +1,72 @@
+#include "lib/rwlock.h"
+#include "sched/preempt.h"
+
+#include <asm/arch.h>
+
+void RwLock::read_lock() {
+    preempt::disable();
+
+    uint32_t cur = __atomic_load_n(&state_, __ATOMIC_RELAXED);
+    while (true) {
+        if (cur & (WRITER | WRITER_WAITING)) {
+            arch_spin_hint();
+            cur = __atomic_load_n(&state_, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&state_, &cur, cur + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+}
+
+void RwLock::read_unlock() {
+    __atomic_fetch_sub(&state_, 1, __ATOMIC_RELEASE);
+    preempt::enable();
+}
+
+void RwLock::write_lock() {
+    writers_.lock();  // Holds the preempt count for the write section
+
+    __atomic_fetch_or(&state_, WRITER_WAITING, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&state_, __ATOMIC_ACQUIRE) & READER_MASK) {
+        arch_spin_hint();
+    }
+    __atomic_store_n(&state_, WRITER, __ATOMIC_RELAXED);
+}
+
+void RwLock::write_unlock() {
+    __atomic_store_n(&state_, 0, __ATOMIC_RELEASE);
+    writers_.unlock();
+}
+
+uint64_t RwLock::read_lock_irqsave() {
+    uint64_t flags = arch_irq_save();
+    arch_irq_disable();
+    read_lock();
+    return flags;
+}
+
+void RwLock::read_unlock_irqrestore(uint64_t flags) {
+    read_unlock();
+    arch_irq_restore(flags);
+}
+
+uint64_t RwLock::write_lock_irqsave() {
+    uint64_t flags = arch_irq_save();
+    arch_irq_disable();
+    write_lock();
+    return flags;
+}
+
+void RwLock::write_unlock_irqrestore(uint64_t flags) {
+    write_unlock();
+    arch_irq_restore(flags);
+}
+
+uint32_t RwLock::readers() const {
+    return __atomic_load_n(&state_, __ATOMIC_RELAXED) & READER_MASK;
+}
+
+bool RwLock::write_locked() const {
+    return (__atomic_load_n(&state_, __ATOMIC_RELAXED) & WRITER) != 0;
+}
@@ -1,32 +1,78 @@
 #include "lib/semaphore.h"
 #include "lib/lock_guard.h"
+#include "sched/sched.h"
 
 void Semaphore::down() {
-    while (true) {
-        {
-            LockGuard<Spinlock> guard(lock_);
-            if (count_ > 0) {
-                count_--;
-                return;
-            }
-        }
-        waitq_.sleep();
+    if (take()) {
+        stat_.waited(0, false);
+        return;
     }
+
+    uint64_t start = stat_.start();
+    down_slow();
+    stat_.waited(start, true);
 }
 
 bool Semaphore::try_down() {
-    LockGuard<Spinlock> guard(lock_);
-    if (count_ > 0) {
-        count_--;
-        return true;
+    if (!take()) {
+        return false;
+    }
+    stat_.waited(0, false);
+    return true;
+}
+
+bool Semaphore::take() {
+    int cur = __atomic_load_n(&count_, __ATOMIC_RELAXED);
+    while (cur > 0) {
+        if (__atomic_compare_exchange_n(&count_, &cur, cur - 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
     }
     return false;
 }
 
 void Semaphore::up() {
+    __atomic_fetch_add(&count_, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&nr_waiters_, __ATOMIC_SEQ_CST) > 0) {
+        up_slow();
+    }
+}
+
+void Semaphore::down_slow() {
+    Waiter waiter{};
+    waiter.task = sched::current();
+
     {
         LockGuard<Spinlock> guard(lock_);
-        count_++;
+        __atomic_fetch_add(&nr_waiters_, 1, __ATOMIC_SEQ_CST);
+        if (take()) {
+            __atomic_fetch_sub(&nr_waiters_, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        waiters_.add_before(waiter.node);
+        waiter.task->sleep();
+    }
+
+    // up_slow() takes the unit for us and dequeues us before the wakeup.
+    while (true) {
+        sched::schedule();
+
+        LockGuard<Spinlock> guard(lock_);
+        if (waiter.granted) {
+            return;
+        }
+        waiter.task->sleep();
+    }
+}
+
+void Semaphore::up_slow() {
+    LockGuard<Spinlock> guard(lock_);
+
+    while (!waiters_.empty() && take()) {
+        Waiter* waiter = Waiter::from_node(waiters_.get_next());
+        waiter->node.unlink();
+        waiter->granted = true;
+        __atomic_fetch_sub(&nr_waiters_, 1, __ATOMIC_RELAXED);
+        waiter->task->wakeup();
     }
-    waitq_.wakeup_one();
 }
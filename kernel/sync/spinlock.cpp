@@ -1,19 +1,64 @@
 #include "lib/spinlock.h"
+#include "sched/preempt.h"
 
 #include <asm/arch.h>
 
-void Spinlock::acquire() {
-    uint64_t flags = arch_irq_save();
-    arch_irq_disable();
+void Spinlock::lock() {
+    preempt::disable();
 
-    while (__atomic_test_and_set(&locked_, __ATOMIC_ACQUIRE)) {
+    uint32_t ticket = __atomic_fetch_add(&next_, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&owner_, __ATOMIC_ACQUIRE) == ticket) {
+        stat_.acquired(0, false);
+        return;
+    }
+
+    uint64_t start = stat_.start();
+    while (__atomic_load_n(&owner_, __ATOMIC_ACQUIRE) != ticket) {
         arch_spin_hint();
     }
+    stat_.acquired(start, true);
+}
+
+void Spinlock::unlock() {
+    stat_.released();
+
+    // Only the holder writes owner_, so a plain increment is enough.
+    __atomic_store_n(&owner_, static_cast<uint32_t>(owner_ + 1), __ATOMIC_RELEASE);
+    preempt::enable();
+}
+
+bool Spinlock::try_lock() {
+    preempt::disable();
+
+    uint32_t owner = __atomic_load_n(&owner_, __ATOMIC_RELAXED);
+    uint32_t expected = owner;
+    if (__atomic_compare_exchange_n(&next_, &expected, static_cast<uint32_t>(owner + 1), false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED)) {
+        stat_.acquired(0, false);
+        return true;
+    }
+
+    preempt::enable();
+    return false;
+}
+
+uint64_t Spinlock::lock_irqsave() {
+    uint64_t flags = arch_irq_save();
+    arch_irq_disable();
+    lock();
+    return flags;
+}
+
+void Spinlock::unlock_irqrestore(uint64_t flags) {
+    unlock();
+    arch_irq_restore(flags);
+}
 
-    saved_flags_ = flags;
+bool Spinlock::is_locked() const {
+    return __atomic_load_n(&next_, __ATOMIC_RELAXED) != __atomic_load_n(&owner_, __ATOMIC_RELAXED);
 }
 
-void Spinlock::release() {
-    __atomic_clear(&locked_, __ATOMIC_RELEASE);
-    arch_irq_restore(saved_flags_);
+bool Spinlock::is_contended() const {
+    return static_cast<uint32_t>(__atomic_load_n(&next_, __ATOMIC_RELAXED) -
+                                 __atomic_load_n(&owner_, __ATOMIC_RELAXED)) > 1;
 }
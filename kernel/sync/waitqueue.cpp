@@ -14,6 +14,7 @@ struct Entry {
 void WaitQueue::sleep() {
     Entry entry;
     entry.task = sched::current();
+    uint64_t start = stat_.start();
 
     {
         LockGuard<Spinlock> guard(lock_);
@@ -27,6 +28,43 @@ void WaitQueue::sleep() {
         LockGuard<Spinlock> guard(lock_);
         entry.node.unlink();
     }
+    stat_.waited(start, true);
+}
+
+void WaitQueue::wait_for(const volatile bool& flag) {
+    Entry entry;
+    entry.task = sched::current();
+    uint64_t start = stat_.start();
+    bool slept = false;
+
+    while (true) {
+        {
+            LockGuard<Spinlock> guard(lock_);
+            if (flag) {
+                break;
+            }
+            head_.add_before(entry.node);
+            entry.task->sleep();
+        }
+
+        sched::schedule();
+        slept = true;
+
+        LockGuard<Spinlock> guard(lock_);
+        entry.node.unlink();
+    }
+
+    stat_.waited(start, slept);
+}
+
+void WaitQueue::complete_all(volatile bool& flag) {
+    LockGuard<Spinlock> guard(lock_);
+    flag = true;
+    while (!head_.empty()) {
+        ListNode* node = head_.get_next();
+        node->unlink();
+        Entry::from_node(node)->task->wakeup();
+    }
 }
 
 void WaitQueue::wakeup_one() {
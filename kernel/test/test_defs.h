@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lib/stdio.h"
+#include "sched/sched.h"
 
 // Shared test macros for all unit tests.
 // Each test file should declare:
@@ -41,3 +42,17 @@
         cprintf("\n  [FAILURE] %d %s test(s) failed!\n", tests_failed, suite_name); \
     }                                                                               \
     cprintf("========================================\n");
+
+// Kernel threads for suites that need more than one task.
+
+// Starts fn(arg) in a kernel thread; its pid, or -1.
+inline int spawn(int (*fn)(void*), void* arg = nullptr, uint32_t clone_flags = 0) {
+    auto pid_r = sched::kernel_thread(fn, arg, clone_flags);
+    return pid_r.ok() ? pid_r.value() : -1;
+}
+
+// Waits for `pid`; true if it was spawned and exited with 0.
+inline bool reap(int pid) {
+    int exit_code = -1;
+    return pid > 0 && sched::wait(pid, &exit_code).ok() && exit_code == 0;
+}
@@ -17,6 +17,30 @@ namespace list_test {
 void test();
 }
 
+namespace sync_test {
+void test();
+}
+
+namespace rcu_test {
+void test();
+}
+
+namespace sync_bench_test {
+void test();
+}
+
+namespace lockstat_test {
+void test();
+}
+
+namespace thread_test {
+void test();
+}
+
+namespace fork_bench_test {
+void test();
+}
+
 namespace pmm_test {
 void test();
 }
@@ -41,6 +65,27 @@ namespace exec_test {
 void test();
 }
 
+namespace time_test {
+void test();
+}
+
+namespace latency_test {
+void test();
+}
+
+namespace workqueue_test {
+void test();
+}
+namespace rt_test {
+void test();
+}
+namespace uaccess_test {
+void test();
+}
+namespace blk_bench_test {
+void test();
+}
+
 // QEMU ISA debug exit port (configured via -device isa-debug-exit,iobase=0xf4,iosize=0x04)
 static constexpr uint16_t QEMU_EXIT_PORT = 0xf4;
 
@@ -59,6 +104,17 @@ static const TestSuite SUITES[] = {
     {"Swap (FIFO)", run_swap_suite},       {"Block Manager", blk_test::test},
     {"ELF Loader", elf_test::test},        {"File System", fs_test::test},
     {"Shell", shell_test::test},           {"Exec (E2E)", exec_test::test},
+    {"Time", time_test::test},             {"Latency", latency_test::test},
+    {"Workqueue", workqueue_test::test},
+    {"Real-time", rt_test::test},
+    {"Sync", sync_test::test},
+    {"RCU", rcu_test::test},
+    {"Sync bench", sync_bench_test::test},
+    {"Lockstat", lockstat_test::test},
+    {"Threads", thread_test::test},
+    {"Fork bench", fork_bench_test::test},
+    {"User access", uaccess_test::test},
+    {"Block bench", blk_bench_test::test},
 };
 
 int test_run_all(void*) {
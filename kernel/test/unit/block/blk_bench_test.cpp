@@ -0,0 +1,158 @@
+#include "test/test_defs.h"
+#include "block/blk.h"
+#include "lib/memory.h"
+#include "lib/math.h"
+#include "lib/stdio.h"
+#include "lib/waitqueue.h"
+#include "mm/pmm.h"
+#include "time/clocksource.h"
+
+#include <asm/page.h>
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int MAX_DEPTH = 32;
+constexpr int IOS_PER_DEPTH = 256;
+constexpr uint32_t IO_BLOCKS = PG_SIZE / BlockDevice::SIZE;  // 4 KB reads
+constexpr uint32_t SPAN_BLOCKS = 64 * 1024 * 2;              // First 64 MB of the disk
+
+// Random reads kept `depth` deep: each completion submits the next read
+// from its end_io until `target` have been issued.
+struct ReadLoad {
+    BlockDevice* dev{};
+    blk::Request* reqs{};
+    uint8_t* bufs[MAX_DEPTH]{};
+    uint32_t span{};  // In IO_BLOCKS units
+    uint32_t seed{1};
+    int target{};
+    int issued{};
+    int completed{};
+    Error status{};
+    volatile bool done{};
+    WaitQueue waitq{};
+};
+
+ReadLoad s_load;
+
+void submit_next(ReadLoad* load, blk::Request* req);
+
+void read_done(blk::Request* req) {
+    auto* load = static_cast<ReadLoad*>(req->private_data);
+    if (req->status != Error::None && load->status == Error::None) {
+        load->status = req->status;
+    }
+    if (__atomic_add_fetch(&load->completed, 1, __ATOMIC_ACQ_REL) == load->target) {
+        load->waitq.complete_all(load->done);
+        return;
+    }
+    submit_next(load, req);
+}
+
+void submit_next(ReadLoad* load, blk::Request* req) {
+    if (__atomic_fetch_add(&load->issued, 1, __ATOMIC_ACQ_REL) >= load->target) {
+        return;
+    }
+
+    uint8_t* buf = load->bufs[req - load->reqs];
+    load->seed = load->seed * 1103515245 + 12345;
+    uint32_t block = (load->seed >> 8) % load->span * IO_BLOCKS;
+
+    new (req) blk::Request(blk::Op::Read, block);
+    static_cast<void>(req->add_buffer(buf, PG_SIZE));
+    req->end_io = read_done;
+    req->private_data = load;
+    load->dev->submit(req);
+}
+
+// Reads per second at `depth` outstanding; 0 on error.
+uint64_t read_iops(ReadLoad* load, int depth) {
+    load->target = IOS_PER_DEPTH;
+    load->issued = 0;
+    load->completed = 0;
+    load->status = Error::None;
+    load->done = false;
+
+    uint64_t start = clocksource::read_cycles();
+    for (int i = 0; i < depth; i++) {
+        submit_next(load, &load->reqs[i]);
+    }
+    load->waitq.wait_for(load->done);
+    uint64_t ns = clocksource::cycles_to_ns(clocksource::read_cycles() - start);
+
+    if (load->status != Error::None) {
+        return 0;
+    }
+    return ns ? static_cast<uint64_t>(IOS_PER_DEPTH) * clocksource::NSEC_PER_SEC / ns : 0;
+}
+
+}  // namespace
+
+// ============================================================================
+// Queue depth sweep
+// ============================================================================
+
+static void test_queue_depth_sweep() {
+    TEST_START("Random 4K reads at queue depth 1..32");
+
+    BlockDevice* dev = BlockManager::get_device(blk::DeviceType::Disk);
+    if (!dev || dev->size < IO_BLOCKS || !clocksource::available()) {
+        cprintf("  (no disk or no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    ReadLoad& load = s_load;
+    load.dev = dev;
+    load.span = min(dev->size, SPAN_BLOCKS) / IO_BLOCKS;
+    load.reqs = static_cast<blk::Request*>(kmalloc(sizeof(blk::Request) * MAX_DEPTH));
+
+    bool alloc_ok = load.reqs != nullptr;
+    for (auto& buf : load.bufs) {
+        buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+        alloc_ok = alloc_ok && buf;
+    }
+    TEST_ASSERT(alloc_ok, "Requests and buffers allocated");
+
+    if (alloc_ok) {
+        dev->queue.reset_stats();
+        bool all_ok = true;
+        for (int depth = 1; depth <= MAX_DEPTH; depth *= 2) {
+            uint64_t iops = read_iops(&load, depth);
+            cprintf("  %s QD %2d: %lu IOPS\n", dev->name, depth, iops);
+            all_ok = all_ok && iops > 0;
+        }
+        dev->queue.print();
+
+        TEST_ASSERT(all_ok, "Every read at every depth succeeded");
+        TEST_ASSERT(dev->queue.stats().errors == 0, "Queue saw no errors");
+    }
+
+    for (auto& buf : load.bufs) {
+        kfree(buf);
+        buf = nullptr;
+    }
+    kfree(load.reqs);
+    load.reqs = nullptr;
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace blk_bench_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_queue_depth_sweep();
+
+    TEST_SUMMARY("Block bench");
+}
+
+}  // namespace blk_bench_test
@@ -1,8 +1,14 @@
 #include "test/test_defs.h"
+#include "block/bcache.h"
 #include "block/blk.h"
+#include "drivers/ramdisk.h"
+#include "lib/lock_guard.h"
 #include "lib/result.h"
 #include "lib/string.h"
 #include "lib/memory.h"
+#include "mm/pmm.h"
+
+#include <asm/page.h>
 
 static int tests_passed = 0;
 static int tests_failed = 0;
@@ -13,29 +19,68 @@ static int tests_failed = 0;
 
 class MockBlockDevice : public BlockDevice {
 public:
-    uint8_t backing[512]{};
+    static constexpr uint32_t BLOCKS = PG_SIZE / BlockDevice::SIZE;
+
+    uint8_t* backing{};
     int read_count{};
     int write_count{};
+    bool defer{};  // Hold requests until complete_pending()
+    blk::Request* pending{};
+    uint32_t dispatched[8]{};  // First block of each request, in dispatch order
+    int nr_dispatched{};
 
-    MockBlockDevice(const char* dev_name, blk::DeviceType dev_type, uint32_t dev_size) {
+    MockBlockDevice(const char* dev_name, blk::DeviceType dev_type, uint32_t dev_size)
+        : backing(static_cast<uint8_t*>(kmalloc(PG_SIZE))) {
         strncpy(name, dev_name, sizeof(name) - 1);
         type = dev_type;
         size = dev_size;
+        if (backing) {
+            memset(backing, 0, PG_SIZE);
+        }
     }
 
-    Error read(uint32_t, void* buf, size_t) override {
-        read_count++;
-        memcpy(buf, backing, 512);
-        return Error::None;
+    ~MockBlockDevice() { kfree(backing); }
+
+    MockBlockDevice(const MockBlockDevice&) = delete;
+    MockBlockDevice& operator=(const MockBlockDevice&) = delete;
+
+    void queue_rq(blk::Request* req) override {
+        if (nr_dispatched < 8) {
+            dispatched[nr_dispatched] = req->block;
+        }
+        nr_dispatched++;
+        if (defer) {
+            pending = req;
+            return;
+        }
+        req->end(execute(req));
     }
 
-    Error write(uint32_t, const void* buf, size_t) override {
-        write_count++;
-        memcpy(backing, buf, 512);
-        return Error::None;
+    void complete_pending() {
+        blk::Request* req = pending;
+        pending = nullptr;
+        if (req) {
+            req->end(execute(req));
+        }
+    }
+
+private:
+    Error execute(const blk::Request* req) {
+        bool write = req->op == blk::Op::Write;
+        (write ? write_count : read_count)++;
+        return req->for_each_segment([&](uint32_t block, uint8_t* buf, size_t count) {
+            ENSURE(backing && block + count <= BLOCKS, Error::IO);
+            uint8_t* disk = backing + block * BlockDevice::SIZE;
+            memcpy(write ? disk : buf, write ? buf : disk, count * BlockDevice::SIZE);
+            return Error::None;
+        });
     }
 };
 
+static void count_end_io(blk::Request* req) {
+    (*static_cast<int*>(req->private_data))++;
+}
+
 // ============================================================================
 // Device count (observe-only, do not register real devices)
 // ============================================================================
@@ -75,6 +120,345 @@ static void test_mock_readwrite() {
     TEST_END();
 }
 
+// ============================================================================
+// Asynchronous requests
+// ============================================================================
+
+static void test_request_async() {
+    TEST_START("Request submit and completion callback");
+
+    MockBlockDevice mock("test1", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    auto* buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    TEST_ASSERT(mock.backing && buf, "Buffers allocated");
+    if (!mock.backing || !buf) {
+        kfree(buf);
+        TEST_END();
+        return;
+    }
+    memset(buf, 0xA5, PG_SIZE);
+
+    int completions = 0;
+    blk::Request req(blk::Op::Write, 2);
+    req.end_io = count_end_io;
+    req.private_data = &completions;
+    TEST_ASSERT(req.add_buffer(buf, 2 * BlockDevice::SIZE) == Error::None && req.count == 2, "Buffer added");
+
+    mock.defer = true;
+    mock.submit(&req);
+    TEST_ASSERT(completions == 0 && mock.pending == &req, "submit() returns before completion");
+    mock.complete_pending();
+    TEST_ASSERT(completions == 1 && req.status == Error::None, "end_io ran once with success");
+    TEST_ASSERT(mock.backing[2 * BlockDevice::SIZE] == 0xA5 && mock.backing[4 * BlockDevice::SIZE - 1] == 0xA5 &&
+                    mock.backing[4 * BlockDevice::SIZE] == 0,
+                "Only the requested blocks written");
+
+    blk::Request bad(blk::Op::Read, MockBlockDevice::BLOCKS - 1);
+    bad.end_io = count_end_io;
+    bad.private_data = &completions;
+    static_cast<void>(bad.add_buffer(buf, 2 * BlockDevice::SIZE));
+    mock.defer = false;
+    mock.submit(&bad);
+    TEST_ASSERT(completions == 2 && bad.status == Error::IO, "Failure reported through end_io");
+
+    kfree(buf);
+    TEST_END();
+}
+
+static void test_request_segments() {
+    TEST_START("Request scatter-gather segments");
+
+    MockBlockDevice mock("test2", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    Page* pages = pmm::alloc_pages(2);
+    TEST_ASSERT(mock.backing && pages, "Buffers allocated");
+    if (!mock.backing || !pages) {
+        if (pages) {
+            pmm::free_pages(pages, 2);
+        }
+        TEST_END();
+        return;
+    }
+
+    auto* lo = static_cast<uint8_t*>(pmm::page_to_kva(pages));
+    auto* hi = static_cast<uint8_t*>(pmm::page_to_kva(pages + 1));
+    memset(lo, 0x11, PG_SIZE);
+    memset(hi, 0x22, PG_SIZE);
+
+    // Out of order: the second page first, so the segments cannot merge.
+    blk::Request req(blk::Op::Write, 0);
+    TEST_ASSERT(req.add_page(pages + 1, 0, BlockDevice::SIZE) == Error::None &&
+                    req.add_page(pages, BlockDevice::SIZE, BlockDevice::SIZE) == Error::None,
+                "Two segments added");
+    TEST_ASSERT(req.nr_segs == 2 && req.count == 2, "Discontiguous segments kept apart");
+    TEST_ASSERT(blk::submit_wait(&mock, &req) == Error::None, "submit_wait succeeds");
+    TEST_ASSERT(mock.backing[0] == 0x22 && mock.backing[BlockDevice::SIZE] == 0x11, "Segments land in order");
+
+    // The end of the first page runs on into the second: one segment.
+    blk::Request merged(blk::Op::Read, 0);
+    TEST_ASSERT(merged.add_page(pages, PG_SIZE - BlockDevice::SIZE, BlockDevice::SIZE) == Error::None &&
+                    merged.add_page(pages + 1, 0, BlockDevice::SIZE) == Error::None,
+                "Contiguous segments added");
+    TEST_ASSERT(merged.nr_segs == 1 && merged.count == 2, "Contiguous segments merged");
+    TEST_ASSERT(merged.segs[0].phys() == pmm::page_to_phys(pages) + PG_SIZE - BlockDevice::SIZE,
+                "Segment physical address for DMA");
+    TEST_ASSERT(req.add_page(pages, 0, 100) == Error::Invalid, "Partial block rejected");
+
+    pmm::free_pages(pages, 2);
+    TEST_END();
+}
+
+static void test_sync_wrappers() {
+    TEST_START("Synchronous read/write over submit()");
+
+    MockBlockDevice mock("test3", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    TEST_ASSERT(mock.backing != nullptr, "Backing store allocated");
+
+    uint8_t wbuf[BlockDevice::SIZE], rbuf[BlockDevice::SIZE]{};
+    memset(wbuf, 0x3C, sizeof(wbuf));
+    TEST_ASSERT(mock.write(5, wbuf, 1) == Error::None && mock.read(5, rbuf, 1) == Error::None,
+                "Stack buffers round-trip");
+    TEST_ASSERT(memcmp(wbuf, rbuf, sizeof(wbuf)) == 0, "Data matches");
+    TEST_ASSERT(mock.read(MockBlockDevice::BLOCKS, rbuf, 1) == Error::IO, "Device error propagated");
+    TEST_ASSERT(mock.read(0, rbuf, 0) == Error::Invalid, "Empty transfer rejected");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Request queue
+// ============================================================================
+
+static void test_queue_merge() {
+    TEST_START("Request queue merging under a plug");
+
+    MockBlockDevice mock("test4", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    auto* reqs = static_cast<blk::Request*>(kmalloc(PG_SIZE));
+    auto* buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    TEST_ASSERT(mock.backing && reqs && buf, "Buffers allocated");
+    if (!mock.backing || !reqs || !buf) {
+        kfree(reqs);
+        kfree(buf);
+        TEST_END();
+        return;
+    }
+    for (uint32_t i = 0; i < MockBlockDevice::BLOCKS; i++) {
+        memset(buf + i * BlockDevice::SIZE, static_cast<int>(0x40 + i), BlockDevice::SIZE);
+    }
+
+    // 2 and 3 join behind, 1 in front; 6 stays on its own.
+    static const uint32_t BLOCKS[] = {2, 3, 1, 6};
+    int completions = 0;
+    {
+        blk::Plug plug;
+        for (int i = 0; i < 4; i++) {
+            auto* req = new (&reqs[i]) blk::Request(blk::Op::Write, BLOCKS[i]);
+            static_cast<void>(req->add_buffer(buf + BLOCKS[i] * BlockDevice::SIZE, BlockDevice::SIZE));
+            req->end_io = count_end_io;
+            req->private_data = &completions;
+            mock.submit(req);
+        }
+        TEST_ASSERT(mock.nr_dispatched == 0, "Plugged requests held back");
+    }
+
+    blk::QueueStats stats = mock.queue.stats();
+    TEST_ASSERT(completions == 4, "Every request completed");
+    TEST_ASSERT(mock.nr_dispatched == 2 && mock.dispatched[0] == 1 && mock.dispatched[1] == 6,
+                "Two requests reach the driver, in block order");
+    TEST_ASSERT(stats.submitted == 4 && stats.back_merges == 1 && stats.front_merges == 1, "Merges counted");
+    TEST_ASSERT(stats.avg_blocks_x10() == 20, "Average request size is two blocks");
+    TEST_ASSERT(memcmp(mock.backing + BlockDevice::SIZE, buf + BlockDevice::SIZE, 3 * BlockDevice::SIZE) == 0 &&
+                    memcmp(mock.backing + 6 * BlockDevice::SIZE, buf + 6 * BlockDevice::SIZE, BlockDevice::SIZE) == 0,
+                "Merged data lands in place");
+
+    kfree(reqs);
+    kfree(buf);
+    TEST_END();
+}
+
+static void test_queue_deadline() {
+    TEST_START("Deadline scheduler dispatch order");
+
+    MockBlockDevice mock("test5", blk::DeviceType::Disk, 1024);
+    auto* reqs = static_cast<blk::Request*>(kmalloc(PG_SIZE));
+    auto* buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    TEST_ASSERT(reqs && buf, "Buffers allocated");
+    if (!reqs || !buf) {
+        kfree(reqs);
+        kfree(buf);
+        TEST_END();
+        return;
+    }
+
+    // The first write goes straight to the (busy) driver; the rest queue
+    // behind it.  Reads go first, the oldest, then on up in block order.
+    static const uint32_t BLOCKS[] = {100, 30, 10, 20, 0};
+    static const blk::Op OPS[] = {blk::Op::Write, blk::Op::Read, blk::Op::Read, blk::Op::Read, blk::Op::Write};
+    static const uint32_t EXPECTED[] = {100, 30, 10, 20, 0};
+    mock.defer = true;
+    for (int i = 0; i < 5; i++) {
+        auto* req = new (&reqs[i]) blk::Request(OPS[i], BLOCKS[i]);
+        static_cast<void>(req->add_buffer(buf, BlockDevice::SIZE));
+        mock.submit(req);
+    }
+    TEST_ASSERT(mock.nr_dispatched == 1, "Depth 1: one request in flight");
+
+    while (mock.pending) {
+        mock.complete_pending();  // Completion dispatches the next one
+    }
+
+    bool in_order = mock.nr_dispatched == 5;
+    for (int i = 0; in_order && i < 5; i++) {
+        in_order = mock.dispatched[i] == EXPECTED[i];
+    }
+    TEST_ASSERT(in_order, "Reads before writes, swept in block order");
+    TEST_ASSERT(mock.queue.stats().dispatched == 5, "Dispatch count matches");
+
+    kfree(reqs);
+    kfree(buf);
+    TEST_END();
+}
+
+static void test_batch() {
+    TEST_START("Batch of adjacent transfers");
+
+    MockBlockDevice mock("test6", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    auto* buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    TEST_ASSERT(mock.backing && buf, "Buffers allocated");
+    if (!mock.backing || !buf) {
+        kfree(buf);
+        TEST_END();
+        return;
+    }
+    memset(buf, 0x5E, BlockDevice::SIZE);
+
+    {
+        blk::Batch batch(&mock);
+        for (uint32_t b = 0; b < 4; b++) {
+            static_cast<void>(batch.add(blk::Op::Write, b, buf, 1));
+        }
+        TEST_ASSERT(batch.finish() == Error::None, "Batch completes");
+    }
+
+    blk::QueueStats stats = mock.queue.stats();
+    TEST_ASSERT(stats.dispatched == 1 && stats.back_merges == 3, "Four single-block writes merged into one");
+    TEST_ASSERT(mock.backing[0] == 0x5E && mock.backing[4 * BlockDevice::SIZE - 1] == 0x5E, "All four written");
+
+    {
+        blk::Batch batch(&mock);
+        static_cast<void>(batch.add(blk::Op::Read, MockBlockDevice::BLOCKS, buf, 1));
+        TEST_ASSERT(batch.finish() == Error::IO, "Batch reports a failed request");
+    }
+
+    kfree(buf);
+    TEST_END();
+}
+
+// ============================================================================
+// Ramdisk
+// ============================================================================
+
+static void test_ramdisk() {
+    TEST_START("RamDisk read/write");
+
+    auto* base = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    auto* buf = static_cast<uint8_t*>(kmalloc(PG_SIZE));
+    TEST_ASSERT(base && buf, "Buffers allocated");
+    if (!base || !buf) {
+        kfree(base);
+        kfree(buf);
+        TEST_END();
+        return;
+    }
+    memset(base, 0, PG_SIZE);
+
+    RamDisk ram;
+    TEST_ASSERT(ram.init(base, PG_SIZE / BlockDevice::SIZE, false) == Error::None, "RamDisk init");
+
+    memset(buf, 0x6B, 2 * BlockDevice::SIZE);
+    TEST_ASSERT(ram.write(3, buf, 2) == Error::None, "Write two blocks");
+    TEST_ASSERT(base[3 * BlockDevice::SIZE] == 0x6B && base[5 * BlockDevice::SIZE - 1] == 0x6B,
+                "Write landed in memory");
+
+    memset(buf, 0, PG_SIZE);
+    TEST_ASSERT(ram.read(3, buf, 2) == Error::None && buf[BlockDevice::SIZE] == 0x6B, "Read back");
+    TEST_ASSERT(ram.read(7, buf, 2) == Error::IO, "Read past the end fails");
+
+    kfree(buf);
+    kfree(base);
+    TEST_END();
+}
+
+// ============================================================================
+// Buffer cache
+// ============================================================================
+
+static void test_bcache_hit_miss() {
+    TEST_START("Buffer cache hits, write-back and discard");
+
+    MockBlockDevice mock("test7", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    TEST_ASSERT(mock.backing != nullptr, "Backing allocated");
+    if (!mock.backing) {
+        TEST_END();
+        return;
+    }
+    memset(mock.backing + BlockDevice::SIZE, 0x3C, BlockDevice::SIZE);
+
+    bcache::CacheStats before = bcache::stats();
+    {
+        bcache::BufferRef buf(bcache::read(&mock, 1).value_or(nullptr));
+        TEST_ASSERT(buf && buf->data[0] == 0x3C, "First read fills from the device");
+    }
+    {
+        bcache::BufferRef buf(bcache::read(&mock, 1).value_or(nullptr));
+        TEST_ASSERT(buf && mock.read_count == 1, "Second read is served from the cache");
+        if (buf) {
+            LockGuard<Mutex> guard(buf->lock);
+            buf->data[0] = 0x7D;
+            bcache::mark_dirty(buf.get());
+        }
+    }
+    bcache::CacheStats after = bcache::stats();
+    TEST_ASSERT(after.misses - before.misses == 1 && after.hits - before.hits == 1, "One miss, one hit");
+    TEST_ASSERT(mock.write_count == 0, "Dirty buffer not written yet");
+
+    TEST_ASSERT(bcache::flush(&mock) == Error::None, "Flush succeeds");
+    TEST_ASSERT(mock.write_count == 1 && mock.backing[BlockDevice::SIZE] == 0x7D, "Flush wrote the block back");
+    TEST_ASSERT(bcache::stats().writebacks - before.writebacks == 1, "Write-back counted");
+
+    mock.backing[BlockDevice::SIZE] = 0x11;  // Changed around the cache
+    bcache::discard(&mock, 1, 1);
+    {
+        bcache::BufferRef buf(bcache::read(&mock, 1).value_or(nullptr));
+        TEST_ASSERT(buf && buf->data[0] == 0x11 && mock.read_count == 2, "Discarded block is read again");
+    }
+
+    bcache::invalidate(&mock);
+    TEST_END();
+}
+
+static void test_bcache_eviction() {
+    TEST_START("Buffer cache LRU eviction");
+
+    MockBlockDevice mock("test8", blk::DeviceType::Disk, MockBlockDevice::BLOCKS);
+    bcache::CacheStats before = bcache::stats();
+
+    // More distinct blocks than the pool holds; get() does no I/O.
+    bool ok = true;
+    for (uint32_t b = 0; b <= static_cast<uint32_t>(bcache::NR_BUFFERS) && ok; b++) {
+        bcache::BufferRef buf(bcache::get(&mock, b).value_or(nullptr));
+        ok = static_cast<bool>(buf);
+    }
+    TEST_ASSERT(ok, "Every get() found a buffer");
+    TEST_ASSERT(bcache::stats().evictions > before.evictions, "Oldest buffers evicted");
+
+    {
+        bcache::BufferRef last(bcache::get(&mock, bcache::NR_BUFFERS).value_or(nullptr));
+        TEST_ASSERT(last && bcache::stats().hits > before.hits, "Most recent block still cached");
+    }
+
+    bcache::invalidate(&mock);
+    TEST_END();
+}
+
 // ============================================================================
 // Get device by index (existing devices)
 // ============================================================================
@@ -165,6 +549,15 @@ void test() {
 
     test_device_count();
     test_mock_readwrite();
+    test_request_async();
+    test_request_segments();
+    test_sync_wrappers();
+    test_queue_merge();
+    test_queue_deadline();
+    test_batch();
+    test_ramdisk();
+    test_bcache_hit_miss();
+    test_bcache_eviction();
     test_get_device_by_index();
     test_get_device_by_name();
     test_get_device_by_type();
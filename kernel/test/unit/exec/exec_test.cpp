@@ -4,6 +4,11 @@
 #include "fs/vfs.h"
 #include "lib/string.h"
 #include "sched/sched.h"
+#include "time/vdso.h"
+#include "trap/trap.h"
+
+#include <abi/syscall.h>
+#include <asm/mmu.h>
 
 static int tests_passed = 0;
 static int tests_failed = 0;
@@ -79,6 +84,210 @@ static void test_exec_zcc_hello() {
     TEST_END();
 }
 
+// ============================================================================
+// Test: argv/envp layout on a fresh user stack
+// ============================================================================
+
+// Read through the kernel mapping: `pgdir` is not the current address space.
+template<typename T>
+static T peek_user(pde_t* pgdir, uintptr_t va) {
+    pte_t* ptep = pmm::get_pte(pgdir, va, false);
+    if (!ptep || !(*ptep & VM_PRESENT)) {
+        return T{};
+    }
+    return *reinterpret_cast<T*>(phys_to_virt<uint8_t>(pte_addr(*ptep)) + (va & PG_MASK));
+}
+
+static bool user_str_eq(pde_t* pgdir, uintptr_t va, const char* expected) {
+    for (size_t i = 0;; i++) {
+        char ch = peek_user<char>(pgdir, va + i);
+        if (ch != expected[i]) {
+            return false;
+        }
+        if (ch == '\0') {
+            return true;
+        }
+    }
+}
+
+static void test_user_stack_args() {
+    TEST_START("setup_user_stack — argc/argv/envp layout");
+
+    pde_t* pgdir = exec::create_user_pgdir();
+    TEST_ASSERT(pgdir != nullptr, "User page directory created");
+    if (!pgdir) {
+        TEST_END();
+        return;
+    }
+
+    const char* argv[] = {"/mnt/PROG.ELF", "-v", "arg two", nullptr};
+    const char* envp[] = {"HOME=/", nullptr};
+    uintptr_t sp = exec::setup_user_stack(pgdir, argv, envp);
+
+    TEST_ASSERT(sp != 0 && sp < USER_STACK_TOP && sp >= USER_STACK_TOP - USER_STACK_SIZE, "Stack pointer in the stack");
+    TEST_ASSERT((sp & 15) == 0, "Stack pointer 16-byte aligned");
+    TEST_ASSERT(peek_user<uintptr_t>(pgdir, sp) == 3, "argc = 3");
+
+    uintptr_t slot = sp + sizeof(uintptr_t);
+    bool argv_ok = true;
+    for (int i = 0; i < 3; i++, slot += sizeof(uintptr_t)) {
+        argv_ok = user_str_eq(pgdir, peek_user<uintptr_t>(pgdir, slot), argv[i]) && argv_ok;
+    }
+    TEST_ASSERT(argv_ok, "argv[] strings");
+    TEST_ASSERT(peek_user<uintptr_t>(pgdir, slot) == 0, "argv[] NULL-terminated");
+    slot += sizeof(uintptr_t);
+    TEST_ASSERT(user_str_eq(pgdir, peek_user<uintptr_t>(pgdir, slot), envp[0]), "envp[0] string");
+    TEST_ASSERT(peek_user<uintptr_t>(pgdir, slot + sizeof(uintptr_t)) == 0, "envp[] NULL-terminated");
+    slot += 2 * sizeof(uintptr_t);
+
+    bool pagesz = false;
+    uintptr_t vdso_text = 0;
+    for (int i = 0; i < 8; i++, slot += 2 * sizeof(uintptr_t)) {
+        uintptr_t type = peek_user<uintptr_t>(pgdir, slot);
+        uintptr_t val = peek_user<uintptr_t>(pgdir, slot + sizeof(uintptr_t));
+        if (type == AT_NULL) {
+            break;
+        }
+        pagesz = pagesz || (type == AT_PAGESZ && val == PG_SIZE);
+        vdso_text = type == AT_ZONIX_VDSO ? val : vdso_text;
+    }
+    TEST_ASSERT(pagesz, "auxv carries AT_PAGESZ");
+    TEST_ASSERT(!vdso::available() || vdso_text == vdso::TEXT_ADDR, "auxv points AT_ZONIX_VDSO at the vDSO");
+
+    const char* too_many[exec::MAX_ARGS + 2]{};
+    for (int i = 0; i <= exec::MAX_ARGS; i++) {
+        too_many[i] = "x";
+    }
+    pde_t* pgdir2 = exec::create_user_pgdir();
+    TEST_ASSERT(pgdir2 && exec::setup_user_stack(pgdir2, too_many, nullptr) == 0, "More than MAX_ARGS rejected");
+
+    pmm::free_user_pgdir(pgdir);
+    if (pgdir2) {
+        pmm::free_user_pgdir(pgdir2);
+    }
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test: spawn+waitpid benchmark (SPAWNLAT.ELF spawns itself from user mode)
+// ============================================================================
+
+static void test_spawn_latency() {
+    TEST_START("spawn — run SPAWNLAT.ELF from userdata disk");
+
+    vfs::File* probe = nullptr;
+    if (!ensure_mnt_mounted() || vfs::open("/mnt/SPAWNLAT.ELF", &probe) != Error::None || !probe) {
+        cprintf("  (SPAWNLAT.ELF not on the userdata disk, skipped)\n");
+        TEST_END();
+        return;
+    }
+    vfs::close(probe);
+
+    const char* argv[] = {"/mnt/SPAWNLAT.ELF", nullptr};
+    auto pid_r = exec::spawn(argv[0], argv, nullptr);
+    TEST_ASSERT(pid_r.ok(), "spawn() returned valid PID");
+    if (!pid_r.ok()) {
+        TEST_END();
+        return;
+    }
+
+    int exit_code = -1;
+    auto wait_r = sched::wait(pid_r.value(), &exit_code);
+    TEST_ASSERT(wait_r.ok(), "sched::wait() succeeded");
+    TEST_ASSERT(exit_code == 0, "Every spawn and waitpid from user mode succeeded");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test: syscall table dispatch
+// ============================================================================
+
+static void test_syscall_table() {
+    TEST_START("syscall table dispatch");
+
+    TrapFrame tf{};
+    tf.set_syscall_nr(NR_GETPID);
+    bool handled = trap::handle_syscall(&tf);
+    TEST_ASSERT(handled, "getpid is in the table");
+    TEST_ASSERT(handled && static_cast<int>(tf.return_value()) == sched::current()->pid,
+                "getpid returned the caller's pid");
+
+    TrapFrame unused{};
+    unused.set_syscall_nr(NR_PAUSE);
+    TEST_ASSERT(!trap::handle_syscall(&unused), "Empty slot is rejected");
+
+    TrapFrame past_end{};
+    past_end.set_syscall_nr(1000);
+    TEST_ASSERT(!trap::handle_syscall(&past_end), "Number past the table is rejected");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test: null-syscall benchmark (NULLSYS.ELF times both entry paths)
+// ============================================================================
+
+static void test_null_syscall_latency() {
+    TEST_START("syscall — run NULLSYS.ELF from userdata disk");
+
+    vfs::File* probe = nullptr;
+    if (!ensure_mnt_mounted() || vfs::open("/mnt/NULLSYS.ELF", &probe) != Error::None || !probe) {
+        cprintf("  (NULLSYS.ELF not on the userdata disk, skipped)\n");
+        TEST_END();
+        return;
+    }
+    vfs::close(probe);
+
+    const char* argv[] = {"/mnt/NULLSYS.ELF", nullptr};
+    auto pid_r = exec::spawn(argv[0], argv, nullptr);
+    TEST_ASSERT(pid_r.ok(), "spawn() returned valid PID");
+    if (!pid_r.ok()) {
+        TEST_END();
+        return;
+    }
+
+    int exit_code = -1;
+    auto wait_r = sched::wait(pid_r.value(), &exit_code);
+    TEST_ASSERT(wait_r.ok(), "sched::wait() succeeded");
+    TEST_ASSERT(exit_code == 0, "getpid returned a valid pid on every entry path");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test: vDSO clock benchmark (VDSOCLK.ELF reads the clock without a syscall)
+// ============================================================================
+
+static void test_vdso_clock_latency() {
+    TEST_START("vDSO — run VDSOCLK.ELF from userdata disk");
+
+    vfs::File* probe = nullptr;
+    if (!vdso::available() || !ensure_mnt_mounted() || vfs::open("/mnt/VDSOCLK.ELF", &probe) != Error::None ||
+        !probe) {
+        cprintf("  (no vDSO or VDSOCLK.ELF not on the userdata disk, skipped)\n");
+        TEST_END();
+        return;
+    }
+    vfs::close(probe);
+
+    const char* argv[] = {"/mnt/VDSOCLK.ELF", nullptr};
+    auto pid_r = exec::spawn(argv[0], argv, nullptr);
+    TEST_ASSERT(pid_r.ok(), "spawn() returned valid PID");
+    if (!pid_r.ok()) {
+        TEST_END();
+        return;
+    }
+
+    int exit_code = -1;
+    auto wait_r = sched::wait(pid_r.value(), &exit_code);
+    TEST_ASSERT(wait_r.ok(), "sched::wait() succeeded");
+    TEST_ASSERT(exit_code == 0, "Found the vDSO and its clock never went backwards");
+
+    TEST_END();
+}
+
 // ============================================================================
 
 namespace exec_test {
@@ -88,6 +297,11 @@ void test() {
     tests_failed = 0;
 
     test_exec_zcc_hello();
+    test_user_stack_args();
+    test_spawn_latency();
+    test_syscall_table();
+    test_null_syscall_latency();
+    test_vdso_clock_latency();
 
     TEST_SUMMARY("Exec (E2E)");
 }
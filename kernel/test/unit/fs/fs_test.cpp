@@ -91,6 +91,24 @@ public:
     }
 };
 
+// Tries to unmount the filesystem it is visiting.
+class UmountVisitor : public vfs::DirVisitor {
+public:
+    const char* mount_point{};
+    Error rc{Error::None};
+    bool tried{};
+
+    explicit UmountVisitor(const char* mp) : mount_point(mp) {}
+
+    int visit(const vfs::DirEntry&) override {
+        if (!tried) {
+            rc = vfs::umount(mount_point);
+            tried = true;
+        }
+        return 0;
+    }
+};
+
 // ============================================================
 // Test 1: overwrite write/read roundtrip (existing test)
 // ============================================================
@@ -461,6 +479,23 @@ void test_fat_readdir_subdir() {
     TEST_END();
 }
 
+// ============================================================
+// Test 10: umount of a filesystem in use
+// ============================================================
+
+void test_umount_busy() {
+    TEST_START("VFS umount refuses a filesystem in use");
+
+    UmountVisitor visitor("/");
+    auto rc = vfs::readdir("/", visitor);
+    TEST_ASSERT(rc.ok(), "readdir(\"/\") succeeds");
+    TEST_ASSERT(visitor.tried, "Visitor ran inside the filesystem");
+    TEST_ASSERT(visitor.rc == Error::Busy, "umount(\"/\") from inside readdir returns Busy");
+    TEST_ASSERT(vfs::is_mounted("/"), "Root stays mounted");
+
+    TEST_END();
+}
+
 }  // namespace
 
 namespace fs_test {
@@ -478,6 +513,7 @@ void test() {
     test_fat_nonexistent_paths();
     test_fat_unlink_dir_fails();
     test_fat_readdir_subdir();
+    test_umount_busy();
 
     TEST_SUMMARY("File System");
 }
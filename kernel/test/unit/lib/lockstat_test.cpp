@@ -0,0 +1,157 @@
+#include "test/test_defs.h"
+#include "lib/lockstat.h"
+#include "lib/mutex.h"
+#include "lib/semaphore.h"
+#include "lib/spinlock.h"
+#include "lib/waitqueue.h"
+#include "sched/sched.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
+#include "lib/stdio.h"
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+#ifdef CONFIG_LOCKSTAT
+
+namespace {
+
+constexpr int SPIN_ITERS = 1000;
+
+LockClass s_spin_class{"test_spin"};
+LockClass s_mutex_class{"test_mutex"};
+LockClass s_sem_class{"test_sem"};
+LockClass s_wq_class{"test_wq"};
+
+Mutex s_mutex{s_mutex_class};
+Semaphore s_sem{0, s_sem_class};
+WaitQueue s_wq{s_wq_class};
+volatile bool s_woken{};
+
+int mutex_waiter(void*) {
+    s_mutex.lock();
+    s_mutex.unlock();
+    return 0;
+}
+
+int sem_waiter(void*) {
+    s_sem.down();
+    return 0;
+}
+
+int wq_sleeper(void*) {
+    while (!s_woken) {
+        s_wq.sleep();
+    }
+    return 0;
+}
+
+}  // namespace
+
+// ============================================================================
+// Uncontended accounting
+// ============================================================================
+
+static void test_uncontended() {
+    TEST_START("Uncontended acquisitions");
+
+    lockstat::reset();
+
+    Spinlock lock{s_spin_class};
+    for (int i = 0; i < SPIN_ITERS; i++) {
+        LockGuard<Spinlock> guard(lock);
+    }
+    {
+        LockGuard<Spinlock> guard(lock);
+        TEST_ASSERT(!lock.try_lock(), "try_lock() fails while held");
+    }
+    TEST_ASSERT(lock.try_lock(), "try_lock() on a free lock");
+    lock.unlock();
+
+    TEST_ASSERT(s_spin_class.acquisitions == SPIN_ITERS + 2, "Each lock() and successful try_lock() counted");
+    TEST_ASSERT(s_spin_class.contentions == 0, "No contention on one CPU without preemption");
+    TEST_ASSERT(s_spin_class.wait_total == 0, "No wait time without contention");
+    if (clocksource::available()) {
+        TEST_ASSERT(s_spin_class.hold_total > 0 && s_spin_class.hold_max <= s_spin_class.hold_total,
+                    "Hold time accumulated");
+    }
+
+    TEST_END();
+}
+
+// ============================================================================
+// Contention
+// ============================================================================
+
+static void test_contended() {
+    TEST_START("Sleeping locks record contention");
+
+    lockstat::reset();
+
+    // The waiter runs while we sleep, finds the mutex held and blocks.
+    s_mutex.lock();
+    int pid = spawn(mutex_waiter);
+    ktimer::sleep_ticks(2);
+    s_mutex.unlock();
+    bool reaped = reap(pid);
+
+    pid = spawn(sem_waiter);
+    ktimer::sleep_ticks(2);
+    s_sem.up();
+    reaped = reap(pid) && reaped;
+
+    s_woken = false;
+    pid = spawn(wq_sleeper);
+    ktimer::sleep_ticks(2);
+    s_woken = true;
+    s_wq.wakeup_all();
+    reaped = reap(pid) && reaped;
+
+    TEST_ASSERT(reaped, "Waiters reaped");
+    TEST_ASSERT(s_mutex_class.acquisitions == 2 && s_mutex_class.contentions == 1, "Mutex: one of two contended");
+    TEST_ASSERT(s_sem_class.acquisitions == 1 && s_sem_class.contentions == 1, "Semaphore: down() slept");
+    TEST_ASSERT(s_wq_class.contentions >= 1, "WaitQueue: sleep counted");
+    TEST_ASSERT(s_mutex_class.hold_total >= s_mutex_class.hold_max, "Mutex hold totals consistent");
+    TEST_ASSERT(s_mutex_class.wait_total >= s_mutex_class.wait_max && s_sem_class.wait_total >= s_sem_class.wait_max,
+                "Wait totals consistent");
+    if (clocksource::available()) {
+        TEST_ASSERT(s_mutex_class.wait_max > 0 && s_sem_class.wait_max > 0, "Wait time measured");
+        TEST_ASSERT(s_mutex_class.hold_max > s_mutex_class.wait_max / 2, "Holder's sleep shows up in hold time");
+    }
+
+    lockstat::print(4);
+
+    lockstat::reset();
+    TEST_ASSERT(s_mutex_class.acquisitions == 0 && s_mutex_class.wait_max == 0 && s_sem_class.contentions == 0,
+                "reset() clears the counters");
+    TEST_ASSERT(s_mutex_class.registered, "reset() keeps classes registered");
+
+    TEST_END();
+}
+
+#endif  // CONFIG_LOCKSTAT
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace lockstat_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+#ifdef CONFIG_LOCKSTAT
+    test_uncontended();
+    test_contended();
+#else
+    TEST_START("Lockstat");
+    TEST_ASSERT(!lockstat::enabled(), "Built without CONFIG_LOCKSTAT");
+    cprintf("  (CONFIG_LOCKSTAT off, skipped; build with LOCKSTAT=1)\n");
+    TEST_END();
+#endif
+
+    TEST_SUMMARY("Lockstat");
+}
+
+}  // namespace lockstat_test
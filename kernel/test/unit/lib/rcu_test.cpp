@@ -0,0 +1,231 @@
+#include "test/test_defs.h"
+#include "lib/list.h"
+#include "lib/rcu.h"
+#include "sched/preempt.h"
+#include "sched/sched.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
+#include "lib/stdio.h"
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int BENCH_TICKS = 20;  // Measurement window per phase
+constexpr int LOOKUP_BATCH = 256;
+
+struct Item {
+    int value{};
+    ListNode node{};
+    RcuHead rcu{};
+
+    static Item* from_node(ListNode* n) {
+        return reinterpret_cast<Item*>(reinterpret_cast<char*>(n) - offset_of(&Item::node));
+    }
+};
+
+volatile int s_freed{};
+
+void count_free(RcuHead* head) {
+    static_cast<void>(head);
+    s_freed++;
+}
+
+volatile bool s_stop{};
+volatile int s_churned{};
+volatile int s_last_child{};
+
+int exit_at_once(void*) {
+    return 0;
+}
+
+// Fork/exit load: each child is inserted into and removed from the PID hash.
+int churn(void*) {
+    while (!s_stop) {
+        auto pid_r = sched::kernel_thread(exit_at_once, nullptr);
+        if (!pid_r.ok()) {
+            break;
+        }
+        s_last_child = pid_r.value();
+        int exit_code = -1;
+        static_cast<void>(sched::wait(pid_r.value(), &exit_code));
+        s_churned++;
+    }
+    return 0;
+}
+
+struct LookupStats {
+    uint64_t lookups{};
+    uint64_t ns{};
+    bool self_always_found{true};
+    bool no_wrong_pid{true};
+};
+
+// Look up our own PID and the churn thread's latest child for BENCH_TICKS.
+LookupStats run_lookups() {
+    LookupStats st{};
+    TaskStruct* self = sched::current();
+    int64_t end = timer::ticks + BENCH_TICKS;
+
+    while (timer::ticks < end) {
+        uint64_t start = clocksource::read_cycles();
+        for (int i = 0; i < LOOKUP_BATCH; i++) {
+            if (sched::find_proc(self->pid) != self) {
+                st.self_always_found = false;
+            }
+            int child = s_last_child;
+            rcu::ReadGuard guard;
+            TaskStruct* t = sched::find_proc(child);
+            if (t && t->pid != child) {
+                st.no_wrong_pid = false;
+            }
+        }
+        st.ns += clocksource::cycles_to_ns(clocksource::read_cycles() - start);
+        st.lookups += 2 * LOOKUP_BATCH;
+    }
+    return st;
+}
+
+}  // namespace
+
+// ============================================================================
+// RCU list operations
+// ============================================================================
+
+static void test_rcu_list() {
+    TEST_START("RCU list add / unlink");
+
+    ListNode head{};
+    Item a{1};
+    Item b{2};
+    Item c{3};
+
+    head.add_before_rcu(a.node);
+    head.add_before_rcu(c.node);
+    a.node.add_rcu(b.node);
+
+    int expect = 1;
+    bool ordered = true;
+    int count = 0;
+    {
+        rcu::ReadGuard guard;
+        for (auto* node : head.rcu()) {
+            ordered = ordered && Item::from_node(node)->value == expect++;
+            count++;
+        }
+    }
+    TEST_ASSERT(count == 3 && ordered, "rcu() walks 1, 2, 3");
+
+    b.node.unlink_rcu();
+    TEST_ASSERT(a.node.get_next() == &c.node && c.node.get_prev() == &a.node, "Neighbours skip the removed node");
+    TEST_ASSERT(b.node.get_next() == &c.node, "Removed node still leads a late reader onward");
+
+    count = 0;
+    for (auto* node : head.rcu()) {
+        static_cast<void>(node);
+        count++;
+    }
+    TEST_ASSERT(count == 2, "New readers no longer see it");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Grace periods
+// ============================================================================
+
+static void test_grace_period() {
+    TEST_START("call / synchronize / barrier");
+
+    s_freed = 0;
+    Item item{};
+    uint64_t gp = rcu::completed();
+
+    {
+        rcu::ReadGuard guard;
+        TEST_ASSERT(!preempt::preemptible(), "Read-side section disables preemption");
+        rcu::call(&item.rcu, count_free);
+        TEST_ASSERT(s_freed == 0, "Callback deferred while a reader is active");
+    }
+    TEST_ASSERT(s_freed == 0, "Callback still waits for a quiescent state");
+
+    rcu::barrier();
+    TEST_ASSERT(s_freed == 1, "barrier() ran the callback");
+    TEST_ASSERT(rcu::completed() > gp, "A grace period completed");
+
+    gp = rcu::completed();
+    rcu::synchronize();
+    TEST_ASSERT(rcu::completed() > gp, "synchronize() ends a grace period");
+
+    // Callbacks also run on their own once the scheduler passes a
+    // quiescent state and the softirq fires.
+    s_freed = 0;
+    rcu::call(&item.rcu, count_free);
+    uint64_t before = rcu::invoked();
+    for (int i = 0; i < 50 && s_freed == 0; i++) {
+        ktimer::sleep_ticks(1);
+    }
+    TEST_ASSERT(s_freed == 1 && rcu::invoked() > before, "Callback ran from the RCU softirq");
+
+    TEST_END();
+}
+
+// ============================================================================
+// PID hash lookups under fork/exit
+// ============================================================================
+
+static void test_lookup_bench() {
+    TEST_START("find_proc() under concurrent fork/exit");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    s_last_child = -1;
+    LookupStats idle = run_lookups();
+
+    s_stop = false;
+    s_churned = 0;
+    int pid = spawn(churn);
+    TEST_ASSERT(pid > 0, "Churn thread created");
+    LookupStats busy = run_lookups();
+    s_stop = true;
+
+    bool reaped = reap(pid);
+    rcu::barrier();
+
+    cprintf("  (quiet: %lu ns/lookup, churn: %lu ns/lookup, %d fork/exit)\n", idle.ns / idle.lookups,
+            busy.ns / busy.lookups, s_churned);
+    TEST_ASSERT(reaped, "Churn thread reaped");
+    TEST_ASSERT(s_churned > 0, "Children forked and reaped meanwhile");
+    TEST_ASSERT(idle.self_always_found && busy.self_always_found, "Own PID always found");
+    TEST_ASSERT(busy.no_wrong_pid, "Lookups never returned another PID's task");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace rcu_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_rcu_list();
+    test_grace_period();
+    test_lookup_bench();
+
+    TEST_SUMMARY("RCU");
+}
+
+}  // namespace rcu_test
@@ -0,0 +1,273 @@
+#include "test/test_defs.h"
+#include "lib/mutex.h"
+#include "lib/semaphore.h"
+#include "sched/preempt.h"
+#include "sched/sched.h"
+#include "drivers/intr.h"
+#include "time/clocksource.h"
+#include "lib/stdio.h"
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int FAST_ITERS = 100000;
+constexpr int HANDOFF_ROUNDS = 50;
+constexpr int TPUT_THREADS = 4;
+constexpr int TPUT_ITERS = 2000;
+constexpr int TPUT_HOLD_SPINS = 2000;  // Long enough for ticks to land inside
+
+constexpr int RUNNER_PRIO = 50;
+constexpr int WAITER_PRIO = 60;
+
+Mutex s_mutex{};
+Semaphore s_go{0};
+Semaphore s_done{0};
+Semaphore s_slots{2};
+
+volatile uint64_t s_unlock_ns{};
+volatile uint64_t s_post_ns{};
+uint64_t s_handoff_ns[HANDOFF_ROUNDS]{};
+uint64_t s_wake_ns[HANDOFF_ROUNDS]{};
+
+volatile uint64_t s_counter{};
+volatile int s_in_slots{};
+volatile int s_max_in_slots{};
+
+uint64_t elapsed_ns(uint64_t start_cycles) {
+    return clocksource::cycles_to_ns(clocksource::read_cycles() - start_cycles);
+}
+
+void hold_for(int spins) {
+    for (int i = 0; i < spins; i++) {
+        preempt::barrier();
+    }
+}
+
+// Higher-priority partner: each round it sleeps on s_go, then blocks on the
+// mutex the runner holds until the runner unlocks it.
+int handoff_partner(void*) {
+    for (int round = 0; round < HANDOFF_ROUNDS; round++) {
+        s_go.down();
+        s_wake_ns[round] = clocksource::now_ns() - s_post_ns;
+
+        s_mutex.lock();
+        s_handoff_ns[round] = clocksource::now_ns() - s_unlock_ns;
+        s_mutex.unlock();
+        s_done.up();
+    }
+    return 0;
+}
+
+int mutex_worker(void*) {
+    for (int i = 0; i < TPUT_ITERS; i++) {
+        s_mutex.lock();
+        s_counter = s_counter + 1;
+        hold_for(TPUT_HOLD_SPINS);
+        s_mutex.unlock();
+    }
+    return 0;
+}
+
+int sem_worker(void*) {
+    for (int i = 0; i < TPUT_ITERS; i++) {
+        s_slots.down();
+        int in = __atomic_add_fetch(&s_in_slots, 1, __ATOMIC_RELAXED);
+        if (in > s_max_in_slots) {
+            s_max_in_slots = in;
+        }
+        hold_for(TPUT_HOLD_SPINS);
+        __atomic_sub_fetch(&s_in_slots, 1, __ATOMIC_RELAXED);
+        s_slots.up();
+    }
+    return 0;
+}
+
+bool run_workers(int (*fn)(void*), uint64_t* ns) {
+    int pids[TPUT_THREADS]{};
+    bool ok = true;
+
+    uint64_t start = clocksource::read_cycles();
+    for (int& pid : pids) {
+        pid = spawn(fn);
+    }
+    for (int pid : pids) {
+        ok = reap(pid) && ok;
+    }
+    *ns = elapsed_ns(start);
+    return ok;
+}
+
+void summarize(const uint64_t* samples, int n, uint64_t* max_out, uint64_t* avg_out) {
+    uint64_t max = 0;
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += samples[i];
+        max = samples[i] > max ? samples[i] : max;
+    }
+    *max_out = max;
+    *avg_out = total / n;
+}
+
+}  // namespace
+
+// ============================================================================
+// Uncontended fast paths
+// ============================================================================
+
+static void test_fast_path() {
+    TEST_START("Uncontended lock / down cost");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    Mutex mutex{};
+    uint64_t start = clocksource::read_cycles();
+    for (int i = 0; i < FAST_ITERS; i++) {
+        mutex.lock();
+        mutex.unlock();
+    }
+    uint64_t mutex_ns = elapsed_ns(start);
+
+    Semaphore sem{1};
+    start = clocksource::read_cycles();
+    for (int i = 0; i < FAST_ITERS; i++) {
+        sem.down();
+        sem.up();
+    }
+    uint64_t sem_ns = elapsed_ns(start);
+
+    cprintf("  (mutex lock+unlock %lu ns, sem down+up %lu ns)\n", mutex_ns / FAST_ITERS, sem_ns / FAST_ITERS);
+    TEST_ASSERT(!mutex.is_locked() && mutex.owner() == nullptr, "Mutex free afterwards");
+    TEST_ASSERT(sem.count() == 1, "Semaphore count restored");
+
+    mutex.lock();
+    TEST_ASSERT(mutex.owner() == sched::current(), "Fast path records the owner");
+    TEST_ASSERT(!mutex.try_lock(), "try_lock() fails while held");
+    mutex.unlock();
+
+    TEST_ASSERT(sem.try_down() && !sem.try_down(), "try_down() takes the only unit");
+    sem.up();
+
+    TEST_END();
+}
+
+// ============================================================================
+// Hand-off latency
+// ============================================================================
+
+static void test_handoff_latency() {
+    TEST_START("Mutex / semaphore hand-off latency");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    TaskStruct* cur = sched::current();
+    SchedPolicy saved_policy = cur->policy;
+    int saved_prio = cur->priority;
+    static_cast<void>(sched::set_scheduler(cur, SchedPolicy::Fifo, RUNNER_PRIO));
+
+    auto pid_r = sched::kernel_thread(handoff_partner, nullptr);
+    TaskStruct* partner = pid_r.ok() ? sched::find_proc(pid_r.value()) : nullptr;
+    bool ok = partner && sched::set_scheduler(partner, SchedPolicy::Fifo, WAITER_PRIO) == Error::None;
+
+    for (int round = 0; ok && round < HANDOFF_ROUNDS; round++) {
+        s_mutex.lock();
+
+        // Wakeup preemption lets the partner in at the next preemption
+        // point; it blocks on the mutex and we resume.
+        s_post_ns = clocksource::now_ns();
+        s_go.up();
+        sched::cond_resched();
+
+        s_unlock_ns = clocksource::now_ns();
+        s_mutex.unlock();  // Hands over and lets the partner preempt us
+        s_done.down();
+    }
+
+    int exit_code = -1;
+    ok = ok && sched::wait(pid_r.value(), &exit_code).ok() && exit_code == 0;
+
+    {
+        intr::Guard guard;
+        cur->policy = saved_policy;
+        cur->rt_priority = 0;
+        cur->priority = saved_prio;
+    }
+
+    uint64_t mutex_max = 0;
+    uint64_t mutex_avg = 0;
+    uint64_t sem_max = 0;
+    uint64_t sem_avg = 0;
+    summarize(s_handoff_ns, HANDOFF_ROUNDS, &mutex_max, &mutex_avg);
+    summarize(s_wake_ns, HANDOFF_ROUNDS, &sem_max, &sem_avg);
+
+    cprintf("  (mutex hand-off max %lu ns avg %lu ns; sem wake max %lu ns avg %lu ns)\n", mutex_max, mutex_avg,
+            sem_max, sem_avg);
+    TEST_ASSERT(ok, "Partner ran every round and was reaped");
+    TEST_ASSERT(!s_mutex.is_locked(), "Mutex free afterwards");
+    TEST_ASSERT(mutex_max < clocksource::NSEC_PER_TICK, "Hand-off completes within a tick");
+    TEST_ASSERT(sem_max < clocksource::NSEC_PER_TICK, "Semaphore wakeup completes within a tick");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Contended throughput
+// ============================================================================
+
+static void test_throughput() {
+    TEST_START("Contended throughput");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    s_counter = 0;
+    uint64_t mutex_ns = 0;
+    bool mutex_ok = run_workers(mutex_worker, &mutex_ns);
+
+    s_in_slots = 0;
+    s_max_in_slots = 0;
+    uint64_t sem_ns = 0;
+    bool sem_ok = run_workers(sem_worker, &sem_ns);
+
+    uint64_t ops = static_cast<uint64_t>(TPUT_THREADS) * TPUT_ITERS;
+    cprintf("  (mutex %lu ops/s, sem %lu ops/s, %d threads)\n", mutex_ns ? ops * clocksource::NSEC_PER_SEC / mutex_ns : 0,
+            sem_ns ? ops * clocksource::NSEC_PER_SEC / sem_ns : 0, TPUT_THREADS);
+    TEST_ASSERT(mutex_ok && sem_ok, "Workers finished and were reaped");
+    TEST_ASSERT(s_counter == ops, "No lost updates under the mutex");
+    TEST_ASSERT(!s_mutex.is_locked(), "Mutex free afterwards");
+    TEST_ASSERT(s_max_in_slots <= 2, "Semaphore admits at most its count");
+    TEST_ASSERT(s_slots.count() == 2, "Semaphore count restored");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace sync_bench_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_fast_path();
+    test_handoff_latency();
+    test_throughput();
+
+    TEST_SUMMARY("Sync bench");
+}
+
+}  // namespace sync_bench_test
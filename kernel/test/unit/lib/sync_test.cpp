@@ -0,0 +1,267 @@
+#include "test/test_defs.h"
+#include "lib/rwlock.h"
+#include "lib/seqlock.h"
+#include "lib/spinlock.h"
+#include "sched/preempt.h"
+#include "sched/sched.h"
+#include "drivers/intr.h"
+#include "time/clocksource.h"
+#include "lib/stdio.h"
+
+#include <asm/arch.h>
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int BENCH_THREADS = 4;
+constexpr int BENCH_ITERS = 20000;
+
+enum class BenchKind : uint8_t { Spin, ReadLock, WriteLock, SeqRead, IrqGuard };
+
+struct BenchArg {
+    BenchKind kind{};
+    uint64_t ops{};
+};
+
+Spinlock s_bench_spin{};
+RwLock s_bench_rw{};
+SeqLock s_bench_seq{};
+volatile uint64_t s_bench_counter{};
+
+// Each thread hammers the primitive, yielding every so often so the others
+// interleave with it.
+int bench_worker(void* arg) {
+    auto* ba = static_cast<BenchArg*>(arg);
+
+    for (int i = 0; i < BENCH_ITERS; i++) {
+        switch (ba->kind) {
+            case BenchKind::Spin: {
+                LockGuard<Spinlock> guard(s_bench_spin);
+                s_bench_counter = s_bench_counter + 1;
+                break;
+            }
+            case BenchKind::ReadLock: {
+                ReadLockGuard guard(s_bench_rw);
+                static_cast<void>(s_bench_counter);
+                break;
+            }
+            case BenchKind::WriteLock: {
+                WriteLockGuard guard(s_bench_rw);
+                s_bench_counter = s_bench_counter + 1;
+                break;
+            }
+            case BenchKind::SeqRead: {
+                uint32_t seq;
+                uint64_t val;
+                do {
+                    seq = s_bench_seq.read_begin();
+                    val = s_bench_counter;
+                } while (s_bench_seq.read_retry(seq));
+                static_cast<void>(val);
+                break;
+            }
+            case BenchKind::IrqGuard: {
+                intr::Guard guard;
+                s_bench_counter = s_bench_counter + 1;
+                break;
+            }
+        }
+        ba->ops++;
+
+        if ((i & 1023) == 0) {
+            sched::cond_resched();
+        }
+    }
+    return 0;
+}
+
+// Run BENCH_THREADS workers on `kind` and report ns per operation.  Returns
+// false if a thread could not be created or reaped.
+bool run_bench(const char* name, BenchKind kind, uint64_t* ns_per_op) {
+    BenchArg args[BENCH_THREADS]{};
+    int pids[BENCH_THREADS]{};
+    bool ok = true;
+
+    s_bench_counter = 0;
+    uint64_t start = clocksource::read_cycles();
+
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        args[i].kind = kind;
+        pids[i] = spawn(bench_worker, &args[i]);
+        ok = ok && pids[i] > 0;
+    }
+    for (int pid : pids) {
+        ok = reap(pid) && ok;
+    }
+
+    uint64_t elapsed = clocksource::cycles_to_ns(clocksource::read_cycles() - start);
+    uint64_t total = 0;
+    uint64_t min_ops = ~0ULL;
+    uint64_t max_ops = 0;
+    for (auto& a : args) {
+        total += a.ops;
+        min_ops = a.ops < min_ops ? a.ops : min_ops;
+        max_ops = a.ops > max_ops ? a.ops : max_ops;
+    }
+
+    *ns_per_op = total ? elapsed / total : 0;
+    cprintf("  %-10s %d threads x %d: %lu ns/op (ops/thread %lu..%lu)\n", name, BENCH_THREADS, BENCH_ITERS,
+            *ns_per_op, min_ops, max_ops);
+    return ok && total == static_cast<uint64_t>(BENCH_THREADS) * BENCH_ITERS;
+}
+
+}  // namespace
+
+// ============================================================================
+// Ticket spinlock
+// ============================================================================
+
+static void test_spinlock() {
+    TEST_START("Ticket spinlock");
+
+    Spinlock lock{};
+    int base = preempt::count();
+
+    TEST_ASSERT(!lock.is_locked(), "New lock is free");
+
+    bool irq_on = arch_irq_is_enabled();
+    uint64_t flags = lock.lock_irqsave();
+    TEST_ASSERT(lock.is_locked(), "lock_irqsave() takes the lock");
+    TEST_ASSERT(!arch_irq_is_enabled(), "Interrupts off while held");
+    TEST_ASSERT(preempt::count() == base + 1, "Holder has one preempt count");
+    TEST_ASSERT(!lock.is_contended(), "No one queued behind the owner");
+    TEST_ASSERT(!lock.try_lock(), "try_lock() fails while held");
+    TEST_ASSERT(preempt::count() == base + 1, "Failed try_lock() drops its count");
+    lock.unlock_irqrestore(flags);
+
+    TEST_ASSERT(!lock.is_locked(), "unlock releases");
+    TEST_ASSERT(arch_irq_is_enabled() == irq_on, "Interrupt state restored from the caller's flags");
+    TEST_ASSERT(preempt::count() == base, "Preempt count restored");
+
+    // Tickets stay in step over many acquisitions.
+    for (int i = 0; i < 70000; i++) {
+        LockGuard<Spinlock> guard(lock);
+    }
+    TEST_ASSERT(!lock.is_locked(), "Free after repeated acquisition");
+
+    {
+        intr::Guard guard;
+        TEST_ASSERT(lock.try_lock(), "try_lock() on a free lock");
+        lock.unlock();
+    }
+
+    TEST_END();
+}
+
+// ============================================================================
+// Reader-writer lock
+// ============================================================================
+
+static void test_rwlock() {
+    TEST_START("Reader-writer lock");
+
+    RwLock lock{};
+    {
+        ReadLockGuard r1(lock);
+        ReadLockGuard r2(lock);
+        TEST_ASSERT(lock.readers() == 2, "Readers share the lock");
+        TEST_ASSERT(!lock.write_locked(), "No writer while read-held");
+    }
+    TEST_ASSERT(lock.readers() == 0, "Readers released");
+
+    {
+        WriteLockGuard w(lock);
+        TEST_ASSERT(lock.write_locked(), "Writer holds the lock");
+        TEST_ASSERT(lock.readers() == 0, "Writer excludes readers");
+    }
+    TEST_ASSERT(!lock.write_locked(), "Writer released");
+
+    TEST_ASSERT(sched::find_proc(sched::current()->pid) == sched::current(), "PID hash lookup under read lock");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Seqlock
+// ============================================================================
+
+static void test_seqlock() {
+    TEST_START("Seqlock");
+
+    SeqLock lock{};
+    uint32_t seq = lock.read_begin();
+    TEST_ASSERT(!lock.read_retry(seq), "Quiet read does not retry");
+
+    seq = lock.read_begin();
+    uint64_t flags = lock.write_lock_irqsave();
+    TEST_ASSERT(lock.sequence() & 1, "Sequence odd during a write");
+    lock.write_unlock_irqrestore(flags);
+    TEST_ASSERT(lock.read_retry(seq), "Read overlapping a write retries");
+    TEST_ASSERT((lock.sequence() & 1) == 0, "Sequence even after the write");
+
+    // now_ns() reads the clock under its seqlock while the tick folds it.
+    uint64_t prev = clocksource::now_ns();
+    bool monotonic = true;
+    for (int i = 0; i < 200000; i++) {
+        uint64_t now = clocksource::now_ns();
+        if (now < prev) {
+            monotonic = false;
+        }
+        prev = now;
+    }
+    TEST_ASSERT(monotonic, "now_ns() stays monotonic across ticks");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Contention microbenchmarks
+// ============================================================================
+
+static void test_sync_bench() {
+    TEST_START("Lock microbenchmarks");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    uint64_t guard_ns = 0;
+    uint64_t spin_ns = 0;
+    uint64_t read_ns = 0;
+    uint64_t write_ns = 0;
+    uint64_t seq_ns = 0;
+
+    TEST_ASSERT(run_bench("intr-guard", BenchKind::IrqGuard, &guard_ns), "intr::Guard baseline ran");
+    TEST_ASSERT(run_bench("spinlock", BenchKind::Spin, &spin_ns), "Spinlock workers finished");
+    TEST_ASSERT(s_bench_counter == static_cast<uint64_t>(BENCH_THREADS) * BENCH_ITERS, "No lost updates under spinlock");
+    TEST_ASSERT(run_bench("rw-read", BenchKind::ReadLock, &read_ns), "Read-lock workers finished");
+    TEST_ASSERT(run_bench("rw-write", BenchKind::WriteLock, &write_ns), "Write-lock workers finished");
+    TEST_ASSERT(s_bench_counter == static_cast<uint64_t>(BENCH_THREADS) * BENCH_ITERS, "No lost updates under rwlock");
+    TEST_ASSERT(run_bench("seq-read", BenchKind::SeqRead, &seq_ns), "Seqlock readers finished");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace sync_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_spinlock();
+    test_rwlock();
+    test_seqlock();
+    test_sync_bench();
+
+    TEST_SUMMARY("Sync");
+}
+
+}  // namespace sync_test
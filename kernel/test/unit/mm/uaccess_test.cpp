@@ -0,0 +1,316 @@
+#include "test/test_defs.h"
+#include "exec/exec.h"
+#include "fs/vfs.h"
+#include "lib/memory.h"
+#include "mm/uaccess.h"
+#include "mm/vmm.h"
+#include "sched/sched.h"
+#include "time/clocksource.h"
+#include "time/vdso.h"
+#include "trap/trap.h"
+
+#include <abi/syscall.h>
+#include <asm/arch.h>
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+// Demand-faulted on first touch; clear of the stack and the vDSO.
+constexpr uintptr_t TEST_VA = 0x40000000;
+
+constexpr size_t BENCH_BYTES = 16 * PG_SIZE;
+constexpr int BENCH_ITERS = 64;
+
+// Runs the calling kernel thread in a fresh user address space until
+// destroyed, so the tests can hand uaccess real user pointers.
+class UserSpace {
+public:
+    UserSpace() : task_(sched::current()), saved_(task_ ? task_->memory : nullptr) {
+        pde_t* pgdir = task_ ? exec::create_user_pgdir() : nullptr;
+        if (!pgdir) {
+            return;
+        }
+        mm_ = new MemoryDesc();
+        mm_->pgdir = pgdir;
+        task_->memory = mm_;
+        arch_load_cr3(task_->get_cr3());
+    }
+
+    ~UserSpace() {
+        if (!mm_) {
+            return;
+        }
+        task_->memory = saved_;
+        arch_load_cr3(task_->get_cr3());
+        delete mm_;
+    }
+
+    UserSpace(const UserSpace&) = delete;
+    UserSpace& operator=(const UserSpace&) = delete;
+
+    [[nodiscard]] bool ok() const { return mm_ != nullptr; }
+
+private:
+    TaskStruct* task_;
+    MemoryDesc* saved_;
+    MemoryDesc* mm_{};
+};
+
+template<typename T>
+T* user_ptr(uintptr_t offset = 0) {
+    return reinterpret_cast<T*>(TEST_VA + offset);
+}
+
+// Bytes per second for `iters` runs of `copy`; 0 if any run failed.
+template<typename Fn>
+uint64_t copy_rate(int iters, size_t bytes, Fn copy) {
+    uint64_t start = clocksource::read_cycles();
+    for (int i = 0; i < iters; i++) {
+        if (!copy()) {
+            return 0;
+        }
+    }
+    uint64_t ns = clocksource::cycles_to_ns(clocksource::read_cycles() - start);
+    return ns ? static_cast<uint64_t>(iters) * bytes * clocksource::NSEC_PER_SEC / ns : 0;
+}
+
+// Accepts and counts whatever is written to it.
+class SinkFile : public vfs::File {
+public:
+    Result<int> read(void*, size_t, size_t) override { return 0; }
+    Result<int> write(const void*, size_t size, size_t) override {
+        written += size;
+        return static_cast<int>(size);
+    }
+    Error stat(vfs::Stat* st) override {
+        ENSURE(st, Error::Invalid);
+        st->set(vfs::NodeType::CharDevice, 0, 0);
+        return Error::None;
+    }
+
+    size_t written{};
+};
+
+}  // namespace
+
+// ============================================================================
+// Range checks
+// ============================================================================
+
+static void test_range_checks() {
+    TEST_START("User range checks");
+
+    uint32_t kernel_word = 0x12345678;
+    uint32_t val = 0;
+    char str[8]{};
+
+    TEST_ASSERT(uaccess::range_ok(USER_SPACE_TOP - 4, 4), "Range ending at USER_SPACE_TOP accepted");
+    TEST_ASSERT(!uaccess::range_ok(USER_SPACE_TOP - 4, 5), "Range crossing USER_SPACE_TOP rejected");
+    TEST_ASSERT(!uaccess::range_ok(4, ~static_cast<size_t>(0)), "Wrapping range rejected");
+    TEST_ASSERT(uaccess::get_user(val, &kernel_word) == Error::Fault && val == 0,
+                "get_user refuses a kernel address");
+    TEST_ASSERT(uaccess::put_user(val, &kernel_word) == Error::Fault && kernel_word == 0x12345678,
+                "put_user refuses a kernel address");
+    TEST_ASSERT(uaccess::strncpy_from_user(str, "kernel", sizeof(str)).error() == Error::Fault && str[0] == '\0',
+                "strncpy_from_user refuses a kernel address");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Copies through a user address space
+// ============================================================================
+
+static void test_user_copies() {
+    TEST_START("copy_to_user / copy_from_user round trip");
+
+    UserSpace space;
+    TEST_ASSERT(space.ok(), "User address space created");
+    if (!space.ok()) {
+        TEST_END();
+        return;
+    }
+
+    uint64_t word = 0;
+    TEST_ASSERT(uaccess::put_user(uint64_t{0xC0FFEE}, user_ptr<uint64_t>()) == Error::None,
+                "put_user faults a page in");
+    TEST_ASSERT(uaccess::get_user(word, user_ptr<const uint64_t>()) == Error::None && word == 0xC0FFEE,
+                "get_user reads it back");
+
+    // Odd offset and length: unaligned head, word body, byte tail, and
+    // three page crossings.
+    constexpr size_t LEN = 3 * PG_SIZE + 13;
+    auto* out = static_cast<uint8_t*>(kmalloc(LEN));
+    auto* in = static_cast<uint8_t*>(kmalloc(LEN));
+    bool bufs = out && in;
+    if (bufs) {
+        for (size_t i = 0; i < LEN; i++) {
+            out[i] = static_cast<uint8_t>(i * 7 + 1);
+        }
+        memset(in, 0, LEN);
+    }
+    bool copied = bufs && uaccess::copy_to_user(user_ptr<uint8_t>(PG_SIZE - 3), out, LEN) == Error::None &&
+                  uaccess::copy_from_user(in, user_ptr<const uint8_t>(PG_SIZE - 3), LEN) == Error::None;
+    TEST_ASSERT(copied && memcmp(in, out, LEN) == 0, "Unaligned multi-page copy round-trips");
+    kfree(out);
+    kfree(in);
+
+    char str[16]{};
+    static const char HELLO[] = "hello";
+    bool put = uaccess::copy_to_user(user_ptr<char>(), HELLO, sizeof(HELLO)) == Error::None;
+    auto len_r = uaccess::strncpy_from_user(str, user_ptr<const char>(), sizeof(str));
+    TEST_ASSERT(put && len_r.ok() && len_r.value() == 5 && memcmp(str, HELLO, sizeof(HELLO)) == 0,
+                "strncpy_from_user returns the length");
+    len_r = uaccess::strncpy_from_user(str, user_ptr<const char>(), 4);
+    TEST_ASSERT(len_r.error() == Error::Invalid && str[3] == '\0', "Too-long string rejected, still terminated");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Exception-table fixups
+// ============================================================================
+
+static void test_fault_fixup() {
+    TEST_START("Faulting user access returns Error::Fault");
+
+    if (!vdso::available()) {
+        cprintf("  (vDSO not initialised, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    UserSpace space;
+    TEST_ASSERT(space.ok(), "User address space created");
+    if (!space.ok()) {
+        TEST_END();
+        return;
+    }
+
+    // The vvar page is mapped read-only: reads succeed, a write faults in
+    // the copy routine and resumes at its fixup instead of panicking.
+    auto* vvar = reinterpret_cast<abi_vdso_data*>(vdso::VVAR_ADDR);
+    abi_vdso_data snapshot{};
+    TEST_ASSERT(uaccess::get_user(snapshot, vvar) == Error::None && snapshot.mult == vdso::data()->mult,
+                "Read-only user page readable");
+    TEST_ASSERT(uaccess::put_user(snapshot, vvar) == Error::Fault, "Write to a read-only page fails");
+    TEST_ASSERT(uaccess::copy_to_user(user_ptr<uint8_t>(), &snapshot, sizeof(snapshot)) == Error::None,
+                "Copies work again after the fault");
+    TEST_ASSERT(uaccess::search_extable(reinterpret_cast<uintptr_t>(test_fault_fixup)) == 0,
+                "Ordinary code has no fixup");
+
+    // A _nofault read leaves a missing page unmapped; get_user() faults it in.
+    const uint32_t* word = user_ptr<uint32_t>(4 * PG_SIZE);
+    uint32_t val = 1;
+    TEST_ASSERT(uaccess::get_user_nofault(val, word) == Error::Fault, "Nofault read of a missing page fails");
+    TEST_ASSERT(!uaccess::faults_disabled(), "Nofault depth restored");
+    TEST_ASSERT(uaccess::get_user(val, word) == Error::None && val == 0, "Ordinary read faults the page in");
+    TEST_ASSERT(uaccess::get_user_nofault(val, word) == Error::None, "Nofault read of a present page succeeds");
+
+    TEST_END();
+}
+
+static void test_partial_write() {
+    TEST_START("write() faulting partway reports the bytes written");
+
+    UserSpace space;
+    auto* sink = new SinkFile();
+    auto fd_r = sink ? sched::current()->files().alloc(sink) : Result<int>(Error::NoMem);
+    TEST_ASSERT(space.ok() && fd_r.ok(), "User address space and sink descriptor set up");
+    if (!space.ok() || !fd_r.ok()) {
+        if (fd_r.ok()) {
+            static_cast<void>(sched::current()->files().close(fd_r.value()));
+        } else {
+            vfs::close(sink);
+        }
+        TEST_END();
+        return;
+    }
+
+    // The first page is present; with paging-in disabled the second one
+    // faults once the first chunk has reached the file.
+    TEST_ASSERT(uaccess::put_user(uint8_t{1}, user_ptr<uint8_t>()) == Error::None, "First page faulted in");
+    TrapFrame tf{};
+    tf.set_syscall_nr(NR_WRITE);
+    tf.set_syscall_arg(0, static_cast<uint64_t>(fd_r.value()));
+    tf.set_syscall_arg(1, TEST_VA);
+    tf.set_syscall_arg(2, 2 * PG_SIZE);
+    bool handled = false;
+    {
+        uaccess::NofaultScope nofault;
+        handled = trap::handle_syscall(&tf);
+    }
+    TEST_ASSERT(handled && static_cast<long>(tf.return_value()) == static_cast<long>(PG_SIZE),
+                "Returns the first chunk, not -1");
+    TEST_ASSERT(sink->written == PG_SIZE, "Only the first chunk reached the file");
+
+    static_cast<void>(sched::current()->files().close(fd_r.value()));
+    TEST_END();
+}
+
+// ============================================================================
+// Bulk copy throughput
+// ============================================================================
+
+static void test_copy_throughput() {
+    TEST_START("Bulk copy throughput");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    UserSpace space;
+    auto* buf = static_cast<uint8_t*>(kmalloc(BENCH_BYTES));
+    auto* dst = static_cast<uint8_t*>(kmalloc(BENCH_BYTES));
+    TEST_ASSERT(space.ok() && buf && dst, "User address space and buffers allocated");
+    if (!space.ok() || !buf || !dst) {
+        kfree(buf);
+        kfree(dst);
+        TEST_END();
+        return;
+    }
+    memset(buf, 0x5A, BENCH_BYTES);
+
+    auto* user = user_ptr<uint8_t>();
+    static_cast<void>(uaccess::copy_to_user(user, buf, BENCH_BYTES));  // Fault the pages in
+
+    uint64_t kernel = copy_rate(BENCH_ITERS, BENCH_BYTES, [&] { return memcpy(dst, buf, BENCH_BYTES) != nullptr; });
+    uint64_t to_user = copy_rate(BENCH_ITERS, BENCH_BYTES,
+                                 [&] { return uaccess::copy_to_user(user, buf, BENCH_BYTES) == Error::None; });
+    uint64_t from_user = copy_rate(BENCH_ITERS, BENCH_BYTES,
+                                   [&] { return uaccess::copy_from_user(dst, user, BENCH_BYTES) == Error::None; });
+
+    cprintf("  (%lu KB x %d: memcpy %lu MB/s, to_user %lu MB/s, from_user %lu MB/s)\n", BENCH_BYTES / 1024,
+            BENCH_ITERS, kernel >> 20, to_user >> 20, from_user >> 20);
+    TEST_ASSERT(kernel > 0 && to_user > 0 && from_user > 0, "Every copy completed");
+    TEST_ASSERT(memcmp(dst, buf, BENCH_BYTES) == 0, "Data intact");
+
+    kfree(buf);
+    kfree(dst);
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace uaccess_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_range_checks();
+    test_user_copies();
+    test_fault_fixup();
+    test_partial_write();
+    test_copy_throughput();
+
+    TEST_SUMMARY("User access");
+}
+
+}  // namespace uaccess_test
@@ -0,0 +1,175 @@
+#include "test/test_defs.h"
+#include "sched/sched.h"
+#include "fs/vfs.h"
+#include "lib/rcu.h"
+#include "time/clocksource.h"
+#include "lib/stdio.h"
+
+#include <abi/syscall.h>
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int BENCH_ITERS = 500;
+
+vfs::File* volatile s_child_stdio[3]{};
+
+int exit_at_once(void*) {
+    return 0;
+}
+
+int record_stdio(void*) {
+    fd::Table& files = sched::current()->files();
+    for (int fd = 0; fd < 3; fd++) {
+        fd::Entry* entry = files.get(fd);
+        s_child_stdio[fd] = entry ? entry->file : nullptr;
+    }
+    return 0;
+}
+
+// fork+wait cycles per second; 0 if any cycle failed.
+uint64_t fork_wait_rate(int iters) {
+    uint64_t start = clocksource::read_cycles();
+    for (int i = 0; i < iters; i++) {
+        if (!reap(spawn(exit_at_once))) {
+            return 0;
+        }
+    }
+    uint64_t ns = clocksource::cycles_to_ns(clocksource::read_cycles() - start);
+    return ns ? static_cast<uint64_t>(iters) * clocksource::NSEC_PER_SEC / ns : 0;
+}
+
+void set_cache_limit(size_t limit) {
+    TaskManager::s_task_cache.set_limit(limit);
+    TaskManager::s_kstack_cache.set_limit(limit);
+    TaskManager::s_task_cache.reset_stats();
+    TaskManager::s_kstack_cache.reset_stats();
+}
+
+}  // namespace
+
+// ============================================================================
+// Shared console
+// ============================================================================
+
+static void test_shared_console() {
+    TEST_START("stdio shares one console file");
+
+    for (auto& file : s_child_stdio) {
+        file = nullptr;
+    }
+    bool reaped = reap(spawn(record_stdio));
+
+    fd::Entry* out = sched::current()->files().get(STDOUT_FD);
+    TEST_ASSERT(reaped, "Child reaped");
+    TEST_ASSERT(s_child_stdio[0] && s_child_stdio[0] == s_child_stdio[1] && s_child_stdio[1] == s_child_stdio[2],
+                "stdin, stdout and stderr are one open file");
+    TEST_ASSERT(out && out->file == s_child_stdio[STDOUT_FD], "Parent and child share it too");
+
+    // The child's exit dropped three references, not the file.
+    TEST_ASSERT(s_child_stdio[STDOUT_FD] && vfs::write(s_child_stdio[STDOUT_FD], "", 0, 0).ok(),
+                "Console file still usable after the child exited");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Object caches
+// ============================================================================
+
+static void test_cache_recycling() {
+    TEST_START("TaskStruct / kernel stack recycling");
+
+    ObjCache cache{"test", 64, 2};
+    void* a = cache.alloc();
+    void* b = cache.alloc();
+    void* c = cache.alloc();
+    TEST_ASSERT(a && b && c && cache.misses() == 3, "Empty cache falls back to kmalloc");
+
+    cache.free(a);
+    cache.free(b);
+    cache.free(c);
+    TEST_ASSERT(cache.cached() == 2, "Frees beyond the limit go back to the page allocator");
+    TEST_ASSERT(cache.alloc() == b && cache.hits() == 1, "Most recently freed object comes back first");
+
+    cache.shrink();
+    TEST_ASSERT(cache.cached() == 0, "shrink() empties the cache");
+    kfree(b);  // Cached objects are plain kmalloc blocks
+
+    // Steady state: the previous child's stack and (after a grace period)
+    // TaskStruct are on hand for the next fork.
+    set_cache_limit(TaskManager::TASK_CACHE_LIMIT);
+    bool ok = reap(spawn(exit_at_once));
+    rcu::barrier();
+    TaskManager::s_task_cache.reset_stats();
+    TaskManager::s_kstack_cache.reset_stats();
+    ok = reap(spawn(exit_at_once)) && ok;
+
+    TEST_ASSERT(ok, "Children reaped");
+    TEST_ASSERT(TaskManager::s_kstack_cache.hits() >= 1 && TaskManager::s_kstack_cache.misses() == 0,
+                "fork reused the last kernel stack");
+    TEST_ASSERT(TaskManager::s_task_cache.hits() >= 1 && TaskManager::s_task_cache.misses() == 0,
+                "fork reused the last TaskStruct");
+
+    TEST_END();
+}
+
+// ============================================================================
+// fork+wait throughput
+// ============================================================================
+
+static void test_fork_wait_throughput() {
+    TEST_START("fork+wait throughput");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    // Before: every TaskStruct and stack comes from the page allocator.
+    set_cache_limit(0);
+    uint64_t uncached = fork_wait_rate(BENCH_ITERS);
+    rcu::barrier();
+
+    // After: warm the caches once, then measure.
+    set_cache_limit(TaskManager::TASK_CACHE_LIMIT);
+    static_cast<void>(fork_wait_rate(1));
+    rcu::barrier();
+    TaskManager::s_task_cache.reset_stats();
+    TaskManager::s_kstack_cache.reset_stats();
+    uint64_t cached = fork_wait_rate(BENCH_ITERS);
+    rcu::barrier();
+
+    cprintf("  (%d cycles: uncached %lu/s, cached %lu/s)\n", BENCH_ITERS, uncached, cached);
+    TaskManager::s_task_cache.print();
+    TaskManager::s_kstack_cache.print();
+
+    TEST_ASSERT(uncached > 0 && cached > 0, "Every cycle forked and reaped");
+    TEST_ASSERT(TaskManager::s_kstack_cache.misses() == 0, "Cached run never allocated a kernel stack");
+    TEST_ASSERT(TaskManager::s_task_cache.hits() > 0, "Cached run recycled TaskStructs");
+    TEST_ASSERT(TaskManager::s_task_cache.cached() <= TaskManager::TASK_CACHE_LIMIT, "Cache stays within its limit");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace fork_bench_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_shared_console();
+    test_cache_recycling();
+    test_fork_wait_throughput();
+
+    TEST_SUMMARY("Fork bench");
+}
+
+}  // namespace fork_bench_test
@@ -0,0 +1,226 @@
+#include "test/test_defs.h"
+#include "sched/sched.h"
+#include "sched/preempt.h"
+#include "sched/sched_trace.h"
+#include "block/blk.h"
+#include "drivers/intr.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
+#include "lib/stdio.h"
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int WAKE_ROUNDS = 20;
+constexpr int DISK_BATCH = 64;  // Sectors per read in the background thread
+
+// Worst case tolerated between the timer ISR waking us and us running again.
+constexpr uint64_t MAX_LATENCY_NS = 2 * clocksource::NSEC_PER_TICK;
+
+volatile bool s_stop{};
+volatile int s_disk_rounds{};
+volatile uint64_t s_woken_ns{};
+
+uint8_t s_disk_buf[DISK_BATCH * BlockDevice::SIZE]{};
+
+// Background load: stream the first disk with PIO reads, or spin through
+// cond_resched() when no disk is present.
+int disk_hog(void*) {
+    BlockDevice* dev = BlockManager::get_device(blk::DeviceType::Disk);
+    uint32_t block = 0;
+
+    while (!s_stop) {
+        if (dev && dev->size > DISK_BATCH) {
+            if (block + DISK_BATCH > dev->size) {
+                block = 0;
+            }
+            static_cast<void>(dev->read(block, s_disk_buf, DISK_BATCH));
+            block += DISK_BATCH;
+        } else {
+            for (int i = 0; i < 100000; i++) {
+                preempt::barrier();
+            }
+            sched::cond_resched();
+        }
+        s_disk_rounds++;
+    }
+    return 0;
+}
+
+void record_wakeup(KernelTimer* timer) {
+    s_woken_ns = clocksource::now_ns();
+    static_cast<TaskStruct*>(timer->data)->wakeup();
+}
+
+}  // namespace
+
+// ============================================================================
+// Preempt counter
+// ============================================================================
+
+static void test_preempt_count() {
+    TEST_START("preempt_count nesting");
+
+    int base = preempt::count();
+    TEST_ASSERT(base == 0, "Count is zero in task context");
+    {
+        intr::Guard guard;
+        TEST_ASSERT(preempt::count() == base + 1, "intr::Guard holds one count");
+        TEST_ASSERT(!preempt::preemptible(), "Not preemptible under a guard");
+        {
+            intr::Guard inner;
+            TEST_ASSERT(preempt::count() == base + 2, "Nested guards stack");
+        }
+    }
+    TEST_ASSERT(preempt::count() == base, "Guards release their counts");
+    TEST_ASSERT(!preempt::in_irq(), "Not in hard-IRQ context");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Wakeup latency under disk load
+// ============================================================================
+
+static void test_wakeup_latency() {
+    TEST_START("Wakeup-to-run latency under disk load");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    TaskStruct* cur = sched::current();
+    int saved_prio = cur->priority;
+
+    s_stop = false;
+    s_disk_rounds = 0;
+    auto pid_r = sched::kernel_thread(disk_hog, nullptr);
+    TEST_ASSERT(pid_r.ok(), "Disk thread created");
+    if (!pid_r.ok()) {
+        TEST_END();
+        return;
+    }
+
+    TaskStruct* hog = sched::find_proc(pid_r.value());
+    if (hog) {
+        hog->priority = sched_prio::DEFAULT;
+    }
+    cur->priority = sched_prio::MAX_PRIO;
+
+    uint64_t max_ns = 0;
+    uint64_t total_ns = 0;
+    for (int round = 0; round < WAKE_ROUNDS; round++) {
+        KernelTimer t{};
+        t.fn = record_wakeup;
+        t.data = cur;
+        s_woken_ns = 0;
+
+        // Let the disk thread get going before each arm.
+        ktimer::add(&t, timer::ticks + 2);
+        while (true) {
+            {
+                intr::Guard guard;
+                if (!t.pending()) {
+                    break;
+                }
+                cur->sleep();
+            }
+            sched::schedule();
+        }
+
+        uint64_t latency = clocksource::now_ns() - s_woken_ns;
+        total_ns += latency;
+        if (latency > max_ns) {
+            max_ns = latency;
+        }
+    }
+
+    cur->priority = saved_prio;
+    s_stop = true;
+
+    int exit_code = -1;
+    auto wait_r = sched::wait(pid_r.value(), &exit_code);
+
+    cprintf("  (max %lu us, avg %lu us, %d disk rounds)\n", max_ns / clocksource::NSEC_PER_USEC,
+            total_ns / WAKE_ROUNDS / clocksource::NSEC_PER_USEC, s_disk_rounds);
+    TEST_ASSERT(s_disk_rounds > 0, "Disk thread made progress");
+    TEST_ASSERT(max_ns < MAX_LATENCY_NS, "Max wakeup latency below two ticks");
+    TEST_ASSERT(wait_r.ok() && exit_code == 0, "Disk thread reaped");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Per-task accounting and trace
+// ============================================================================
+
+static void test_task_accounting() {
+    TEST_START("Per-task accounting and sched trace");
+
+    TaskStruct* cur = sched::current();
+    SchedStats before = cur->stats;
+
+    sched_trace::reset();
+    for (int i = 0; i < 3; i++) {
+        ktimer::sleep_ticks(2);
+    }
+    SchedStats after = cur->stats;
+
+    TEST_ASSERT(after.nr_voluntary >= before.nr_voluntary + 3, "Each sleep counts a voluntary switch");
+    TEST_ASSERT(after.runtime_ns >= before.runtime_ns, "Runtime never decreases");
+    TEST_ASSERT(after.last_ns >= before.last_ns, "Interval start moves forward");
+
+    static sched_trace::Record recs[sched_trace::CAPACITY];
+    size_t n = sched_trace::snapshot(recs, sched_trace::CAPACITY);
+
+    int switched_out = 0;
+    int woken = 0;
+    bool ordered = true;
+    for (size_t i = 0; i < n; i++) {
+        if (recs[i].event == sched_trace::Event::Switch && recs[i].prev_pid == cur->pid) {
+            switched_out++;
+        }
+        if (recs[i].event == sched_trace::Event::Wakeup && recs[i].next_pid == cur->pid) {
+            woken++;
+        }
+        if (i > 0 && recs[i].ts_ns < recs[i - 1].ts_ns) {
+            ordered = false;
+        }
+    }
+    TEST_ASSERT(n > 0 && n <= sched_trace::total(), "Trace holds the events since reset");
+    TEST_ASSERT(switched_out >= 3, "sched_switch recorded for each sleep");
+    TEST_ASSERT(woken >= 3, "sched_wakeup recorded for each timer expiry");
+    TEST_ASSERT(ordered, "Trace timestamps are in order");
+
+    sched_trace::reset();
+    TEST_ASSERT(sched_trace::total() == 0, "reset() empties the trace");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace latency_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_preempt_count();
+    test_wakeup_latency();
+    test_task_accounting();
+
+    TEST_SUMMARY("Latency");
+}
+
+}  // namespace latency_test
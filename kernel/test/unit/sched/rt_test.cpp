@@ -0,0 +1,317 @@
+#include "test/test_defs.h"
+#include "sched/sched.h"
+#include "sched/preempt.h"
+#include "drivers/intr.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
+#include "lib/mutex.h"
+#include "lib/stdio.h"
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int RUNNER_PRIO = 90;  // Test thread outranks everything it spawns
+constexpr int PI_ROUNDS = 10;
+constexpr int HOLD_TICKS = 3;  // How long L keeps the mutex
+
+volatile bool s_stop{};
+volatile int s_order[2]{};
+volatile int s_order_next{};
+volatile uint64_t s_spins[2]{};
+
+Mutex s_mutex{};
+volatile bool s_l_locked{};
+volatile int s_l_best_prio{};
+volatile uint64_t s_hog_spins{};
+volatile uint64_t s_h_hog_before{};
+volatile uint64_t s_h_hog_after{};
+volatile uint64_t s_h_start_ns{};
+volatile uint64_t s_h_latency_ns{};
+
+void spin_a_little() {
+    for (int i = 0; i < 1000; i++) {
+        preempt::barrier();
+    }
+}
+
+// Create a kernel thread and move it to `policy` before it first runs.  The
+// child inherits RUNNER_PRIO FIFO, so it cannot preempt us in between.
+int spawn_policy(int (*fn)(void*), void* arg, SchedPolicy policy, int prio) {
+    int pid = spawn(fn, arg);
+    TaskStruct* task = pid > 0 ? sched::find_proc(pid) : nullptr;
+    if (!task || sched::set_scheduler(task, policy, prio) != Error::None) {
+        return -1;
+    }
+    return pid;
+}
+
+int record_order(void* arg) {
+    s_order[s_order_next++] = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+    return 0;
+}
+
+int count_spins(void* arg) {
+    auto idx = reinterpret_cast<intptr_t>(arg);
+    while (!s_stop) {
+        s_spins[idx]++;
+        spin_a_little();
+    }
+    return 0;
+}
+
+// L: take the mutex and hold it for HOLD_TICKS of CPU-bound work, noting the
+// best priority it ran at meanwhile.
+int low_task(void*) {
+    TaskStruct* self = sched::current();
+
+    s_mutex.lock();
+    s_l_locked = true;
+    int64_t until = timer::ticks + HOLD_TICKS;
+    while (timer::ticks < until) {
+        int prio = self->effective_prio();
+        if (prio < s_l_best_prio) {
+            s_l_best_prio = prio;
+        }
+        spin_a_little();
+    }
+    s_mutex.unlock();
+    return 0;
+}
+
+// M: pure CPU hog between L and H.
+int hog_task(void*) {
+    while (!s_stop) {
+        s_hog_spins++;
+        spin_a_little();
+    }
+    return 0;
+}
+
+// H: block on the mutex L holds.
+int high_task(void*) {
+    s_h_hog_before = s_hog_spins;
+    s_h_start_ns = clocksource::now_ns();
+    s_mutex.lock();
+    s_h_latency_ns = clocksource::now_ns() - s_h_start_ns;
+    s_h_hog_after = s_hog_spins;
+    s_mutex.unlock();
+    return 0;
+}
+
+struct SavedClass {
+    SchedPolicy policy;
+    int priority;
+    int rt_priority;
+};
+
+SavedClass enter_rt(TaskStruct* cur) {
+    SavedClass saved{cur->policy, cur->priority, cur->rt_priority};
+    static_cast<void>(sched::set_scheduler(cur, SchedPolicy::Fifo, RUNNER_PRIO));
+    return saved;
+}
+
+// The test thread may run at IDLE_PRIO, which set_scheduler() rejects.
+void leave_rt(TaskStruct* cur, const SavedClass& saved) {
+    intr::Guard guard;
+    cur->policy = saved.policy;
+    cur->priority = saved.priority;
+    cur->rt_priority = saved.rt_priority;
+}
+
+}  // namespace
+
+// ============================================================================
+// Classes
+// ============================================================================
+
+static void test_set_scheduler() {
+    TEST_START("set_scheduler validation and effective priority");
+
+    TaskStruct* cur = sched::current();
+    SavedClass saved{cur->policy, cur->priority, cur->rt_priority};
+
+    TEST_ASSERT(sched::set_scheduler(cur, SchedPolicy::Fifo, 0) == Error::Invalid, "RT priority 0 rejected");
+    TEST_ASSERT(sched::set_scheduler(cur, SchedPolicy::RoundRobin, 100) == Error::Invalid, "RT priority 100 rejected");
+    TEST_ASSERT(sched::set_scheduler(cur, SchedPolicy::Normal, sched_prio::IDLE_PRIO) == Error::Invalid,
+                "Normal priority past MIN_PRIO rejected");
+    TEST_ASSERT(sched::set_scheduler(nullptr, SchedPolicy::Fifo, 1) == Error::Invalid, "Null task rejected");
+
+    TEST_ASSERT(sched::set_scheduler(cur, SchedPolicy::Fifo, sched_prio::RT_PRIO_MIN) == Error::None, "FIFO 1 accepted");
+    TEST_ASSERT(cur->is_rt(), "Task is real-time");
+    TEST_ASSERT(cur->effective_prio() < sched_prio::MAX_PRIO, "Lowest RT priority beats the best normal one");
+
+    TEST_ASSERT(sched::set_scheduler(cur, SchedPolicy::RoundRobin, sched_prio::RT_PRIO_MAX) == Error::None,
+                "RR 99 accepted");
+    TEST_ASSERT(cur->effective_prio() == sched_prio::MAX_PRIO - sched_prio::RT_PRIO_MAX, "RT priorities map below 0");
+    TEST_ASSERT(cur->pi_prio == sched_prio::NO_BOOST, "No boost without a held mutex");
+
+    leave_rt(cur, saved);
+    TEST_ASSERT(!cur->is_rt(), "Class restored");
+
+    TEST_END();
+}
+
+static void test_rt_beats_normal() {
+    TEST_START("Real-time task runs before any normal task");
+
+    TaskStruct* cur = sched::current();
+    SavedClass saved = enter_rt(cur);
+
+    s_order_next = 0;
+    s_order[0] = s_order[1] = -1;
+
+    // Normal first in list order, so only the class can put the RT one ahead.
+    int normal_pid = spawn_policy(record_order, reinterpret_cast<void*>(0), SchedPolicy::Normal, sched_prio::MAX_PRIO);
+    int rt_pid = spawn_policy(record_order, reinterpret_cast<void*>(1), SchedPolicy::Fifo, sched_prio::RT_PRIO_MIN);
+    TEST_ASSERT(normal_pid > 0 && rt_pid > 0, "Threads created");
+
+    bool reaped = reap(rt_pid);
+    reaped = reap(normal_pid) && reaped;
+    leave_rt(cur, saved);
+
+    TEST_ASSERT(reaped, "Threads reaped");
+    TEST_ASSERT(s_order_next == 2, "Both threads ran");
+    TEST_ASSERT(s_order[0] == 1 && s_order[1] == 0, "FIFO 1 ran before normal MAX_PRIO");
+
+    TEST_END();
+}
+
+static void test_fifo_and_rr() {
+    TEST_START("FIFO keeps the CPU, RR rotates among equals");
+
+    TaskStruct* cur = sched::current();
+    SavedClass saved = enter_rt(cur);
+
+    // Two FIFO spinners at one priority: only the first ever runs.
+    s_stop = false;
+    s_spins[0] = s_spins[1] = 0;
+    int a = spawn_policy(count_spins, reinterpret_cast<void*>(0), SchedPolicy::Fifo, 5);
+    int b = spawn_policy(count_spins, reinterpret_cast<void*>(1), SchedPolicy::Fifo, 5);
+    ktimer::sleep_ticks(2 * sched_prio::BASE_TIMESLICE);
+    uint64_t fifo0 = s_spins[0];
+    uint64_t fifo1 = s_spins[1];
+    s_stop = true;
+    bool reaped = reap(a);
+    reaped = reap(b) && reaped;
+
+    // The same with RR: each slice hands the CPU to the other.
+    s_stop = false;
+    s_spins[0] = s_spins[1] = 0;
+    a = spawn_policy(count_spins, reinterpret_cast<void*>(0), SchedPolicy::RoundRobin, 5);
+    b = spawn_policy(count_spins, reinterpret_cast<void*>(1), SchedPolicy::RoundRobin, 5);
+    ktimer::sleep_ticks(3 * sched_prio::BASE_TIMESLICE);
+    uint64_t rr0 = s_spins[0];
+    uint64_t rr1 = s_spins[1];
+    s_stop = true;
+    reaped = reap(a) && reaped;
+    reaped = reap(b) && reaped;
+
+    leave_rt(cur, saved);
+
+    cprintf("  (FIFO %lu/%lu, RR %lu/%lu spins)\n", fifo0, fifo1, rr0, rr1);
+    TEST_ASSERT(reaped, "Spinners reaped");
+    TEST_ASSERT((fifo0 == 0) != (fifo1 == 0), "Exactly one FIFO spinner ran");
+    TEST_ASSERT(rr0 > 0 && rr1 > 0, "Both RR spinners ran");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Priority inheritance
+// ============================================================================
+
+// Classic inversion: L (FIFO 10) holds the mutex, a hog (FIFO 20) is
+// runnable, and H (FIFO 30) blocks on the mutex.  Without inheritance the hog
+// starves L and H with it; with it L runs at H's priority until unlock.
+static void test_priority_inversion() {
+    TEST_START("Priority inheritance bounds inversion");
+
+    TaskStruct* cur = sched::current();
+    SavedClass saved = enter_rt(cur);
+
+    bool timed = clocksource::available();
+    bool all_reaped = true;
+    bool all_boosted = true;
+    bool hog_never_ran = true;
+    bool handed_off = true;
+    uint64_t max_ns = 0;
+    uint64_t total_ns = 0;
+
+    for (int round = 0; round < PI_ROUNDS; round++) {
+        s_stop = false;
+        s_l_locked = false;
+        s_l_best_prio = sched_prio::NO_BOOST;
+        s_hog_spins = 0;
+        s_h_latency_ns = 0;
+
+        int l_pid = spawn_policy(low_task, nullptr, SchedPolicy::Fifo, 10);
+        while (!s_l_locked) {
+            ktimer::sleep_ticks(1);
+        }
+
+        int hog_pid = spawn_policy(hog_task, nullptr, SchedPolicy::Fifo, 20);
+        int h_pid = spawn_policy(high_task, nullptr, SchedPolicy::Fifo, 30);
+
+        all_reaped = reap(h_pid) && all_reaped;  // Runs H, then L boosted, then H again
+        s_stop = true;
+        all_reaped = reap(hog_pid) && all_reaped;
+        all_reaped = reap(l_pid) && all_reaped;
+
+        if (s_l_best_prio != sched_prio::MAX_PRIO - 30) {
+            all_boosted = false;
+        }
+        if (s_h_hog_after != s_h_hog_before) {
+            hog_never_ran = false;
+        }
+        if (s_mutex.is_locked()) {
+            handed_off = false;
+        }
+
+        total_ns += s_h_latency_ns;
+        if (s_h_latency_ns > max_ns) {
+            max_ns = s_h_latency_ns;
+        }
+    }
+
+    leave_rt(cur, saved);
+
+    TEST_ASSERT(all_reaped, "All threads reaped");
+    TEST_ASSERT(all_boosted, "L ran at H's priority while H waited");
+    TEST_ASSERT(hog_never_ran, "Hog never ran while H waited");
+    TEST_ASSERT(handed_off, "Mutex free after every round");
+    TEST_ASSERT(cur->pi_prio == sched_prio::NO_BOOST, "Runner never boosted");
+
+    if (timed) {
+        cprintf("  (H lock latency: max %lu us, avg %lu us)\n", max_ns / clocksource::NSEC_PER_USEC,
+                total_ns / PI_ROUNDS / clocksource::NSEC_PER_USEC);
+        TEST_ASSERT(max_ns < (HOLD_TICKS + 2) * clocksource::NSEC_PER_TICK, "Worst case bounded by L's hold time");
+    }
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace rt_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_set_scheduler();
+    test_rt_beats_normal();
+    test_fifo_and_rr();
+    test_priority_inversion();
+
+    TEST_SUMMARY("Real-time");
+}
+
+}  // namespace rt_test
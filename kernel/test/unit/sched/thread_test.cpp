@@ -0,0 +1,282 @@
+#include "test/test_defs.h"
+#include "sched/sched.h"
+#include "fs/vfs.h"
+#include "lib/futex.h"
+#include "mm/vmm.h"
+#include "time/timer_wheel.h"
+#include "lib/stdio.h"
+
+#include <abi/syscall.h>
+
+extern MemoryDesc init_mm;
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+constexpr int LOCK_THREADS = 4;
+constexpr int LOCK_ITERS = 2000;
+
+fd::Table* volatile s_child_files{};
+volatile int s_child_fd_ok{};
+volatile int s_close_fd{-1};
+MemoryDesc* volatile s_child_mm{};
+
+uint32_t s_word{};
+uint32_t s_other_word{};
+volatile int s_waiter_rc{-1};
+
+// Three-state futex mutex (0 free, 1 locked, 2 locked with sleepers), as
+// user space would build it: the kernel is entered only under contention.
+uint32_t s_lock_word{};
+volatile uint64_t s_counter{};
+volatile int s_nr_waits{};
+volatile int s_nr_wakes{};
+
+void futex_lock(uint32_t* word) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(word, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (c != 2) {
+        c = __atomic_exchange_n(word, 2, __ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        __atomic_add_fetch(&s_nr_waits, 1, __ATOMIC_RELAXED);
+        static_cast<void>(futex::wait(sched::current()->memory, word, 2));
+        c = __atomic_exchange_n(word, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void futex_unlock(uint32_t* word) {
+    if (__atomic_fetch_sub(word, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(word, 0, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&s_nr_wakes, 1, __ATOMIC_RELAXED);
+        futex::wake(sched::current()->memory, word, 1);
+    }
+}
+
+int record_files(void*) {
+    TaskStruct* self = sched::current();
+    s_child_files = &self->files();
+    s_child_mm = self->memory;
+    s_child_fd_ok = self->files().get(s_close_fd) != nullptr;
+    if (s_child_fd_ok && self->files().close(s_close_fd) != Error::None) {
+        return 1;
+    }
+    return 0;
+}
+
+int futex_waiter(void*) {
+    s_waiter_rc = static_cast<int>(futex::wait(sched::current()->memory, &s_word, 0));
+    return 0;
+}
+
+int lock_worker(void*) {
+    for (int i = 0; i < LOCK_ITERS; i++) {
+        futex_lock(&s_lock_word);
+        s_counter = s_counter + 1;
+        if ((i & 63) == 0) {
+            sched::cond_resched();  // Get preempted while holding it now and then
+        }
+        futex_unlock(&s_lock_word);
+    }
+    return 0;
+}
+
+}  // namespace
+
+// ============================================================================
+// clone flags
+// ============================================================================
+
+static void test_clone_files() {
+    TEST_START("CLONE_FILES shares the descriptor table");
+
+    TaskStruct* cur = sched::current();
+    vfs::File* file = nullptr;
+    bool opened = vfs::open("/dev/console", &file) == Error::None && file;
+    auto fd_r = opened ? cur->files().alloc(file) : Result<int>(Error::NotFound);
+    TEST_ASSERT(fd_r.ok(), "Opened a descriptor in the parent");
+    if (!fd_r.ok()) {
+        if (opened) {
+            vfs::close(file);
+        }
+        TEST_END();
+        return;
+    }
+    s_close_fd = fd_r.value();
+    TEST_ASSERT(s_close_fd > STDERR_FD, "New descriptor lies past stdio");
+
+    // A plain child gets its own table with just stdio.
+    s_child_files = nullptr;
+    bool reaped = reap(spawn(record_files));
+    TEST_ASSERT(s_child_files != &cur->files(), "Plain child has its own table");
+    TEST_ASSERT(!s_child_fd_ok, "Parent's descriptor not visible without CLONE_FILES");
+    TEST_ASSERT(cur->files().get(s_close_fd) != nullptr, "Child exit left the parent's table alone");
+
+    // A CLONE_FILES child sees it and its close() is the parent's.
+    s_child_files = nullptr;
+    reaped = reap(spawn(record_files, nullptr, CLONE_FILES)) && reaped;
+    TEST_ASSERT(s_child_files == &cur->files(), "Thread runs on the parent's table");
+    TEST_ASSERT(s_child_fd_ok, "Thread sees the parent's descriptor");
+    TEST_ASSERT(cur->files().get(s_close_fd) == nullptr, "Thread's close() is visible to the parent");
+    TEST_ASSERT(cur->files().get(STDOUT_FD) != nullptr, "Shared table survives the thread's exit");
+    TEST_ASSERT(reaped, "Children reaped");
+
+    TEST_END();
+}
+
+// What a sibling's close() does to a read or write blocked on the file.
+static void test_close_under_io() {
+    TEST_START("Closing a descriptor under an in-flight read");
+
+    fd::Table& files = sched::current()->files();
+    vfs::File* file = nullptr;
+    bool opened = vfs::open("/dev/console", &file) == Error::None && file;
+    auto fd_r = opened ? files.alloc(file) : Result<int>(Error::NotFound);
+    TEST_ASSERT(fd_r.ok(), "Opened a descriptor");
+    if (!fd_r.ok()) {
+        if (opened) {
+            vfs::close(file);
+        }
+        TEST_END();
+        return;
+    }
+    int fd = fd_r.value();
+
+    size_t offset = 1;
+    vfs::File* held = files.get_file(fd, &offset);
+    TEST_ASSERT(held == file && offset == 0, "get_file() returns the file and its offset");
+    TEST_ASSERT(files.close(fd) == Error::None, "Closed while held");
+
+    vfs::Stat st{};
+    TEST_ASSERT(held && held->stat(&st) == Error::None, "Held file outlives the close");
+
+    // The slot is reused; the old holder must not move the new file's offset.
+    vfs::File* other = nullptr;
+    opened = vfs::open("/dev/console", &other) == Error::None && other;
+    auto reuse_r = opened ? files.alloc(other) : Result<int>(Error::NotFound);
+    TEST_ASSERT(reuse_r.ok() && reuse_r.value() == fd, "Slot reused by the next open");
+    files.advance(fd, held, 16);
+    fd::Entry* entry = files.get(fd);
+    TEST_ASSERT(entry && entry->offset == 0, "Stale advance left the new file alone");
+
+    vfs::close(held);
+    if (reuse_r.ok()) {
+        static_cast<void>(files.close(reuse_r.value()));
+    } else if (opened) {
+        vfs::close(other);
+    }
+
+    TEST_END();
+}
+
+static void test_clone_vm() {
+    TEST_START("Threads share and refcount the MemoryDesc");
+
+    TaskStruct* cur = sched::current();
+
+    // A private address space over the kernel mappings: ours holds one
+    // reference, and the pgdir belongs to init_mm, so it is never freed here.
+    auto* mm = new MemoryDesc();
+    mm->pgdir = init_mm.pgdir;
+
+    MemoryDesc* saved = cur->memory;
+    cur->memory = mm;
+    s_close_fd = -1;
+    s_child_mm = nullptr;
+    int pid = spawn(record_files, nullptr, CLONE_VM | CLONE_FILES);
+    int users_while_running = mm->users;
+    cur->memory = saved;
+
+    bool reaped = reap(pid);
+    TEST_ASSERT(reaped, "Thread reaped");
+    TEST_ASSERT(s_child_mm == mm, "Thread runs in the parent's address space");
+    TEST_ASSERT(users_while_running == 2, "clone took a reference");
+    TEST_ASSERT(mm->users == 1, "Thread exit dropped its reference only");
+
+    mm->pgdir = nullptr;
+    delete mm;
+
+    TEST_END();
+}
+
+// ============================================================================
+// futex
+// ============================================================================
+
+static void test_futex_wait_wake() {
+    TEST_START("futex WAIT/WAKE");
+
+    const MemoryDesc* mm = sched::current()->memory;
+
+    s_word = 1;
+    TEST_ASSERT(futex::wait(mm, &s_word, 0) == Error::Busy, "WAIT returns at once if the word changed");
+    TEST_ASSERT(futex::wake(mm, &s_word, 1) == 0, "WAKE with no sleepers wakes nobody");
+
+    s_word = 0;
+    s_waiter_rc = -1;
+    int pid = spawn(futex_waiter);
+    ktimer::sleep_ticks(2);
+
+    TEST_ASSERT(s_waiter_rc == -1, "Waiter is asleep");
+    TEST_ASSERT(futex::wake(mm, &s_other_word, 1) == 0, "WAKE on another word leaves it asleep");
+    TEST_ASSERT(futex::wake(nullptr, &s_word, 1) == 0, "WAKE in another address space leaves it asleep");
+    TEST_ASSERT(futex::wake(mm, &s_word, 1) == 1, "WAKE on the word wakes it");
+    bool reaped = reap(pid);
+
+    TEST_ASSERT(reaped, "Waiter reaped");
+    TEST_ASSERT(s_waiter_rc == static_cast<int>(Error::None), "WAIT returned after the wakeup");
+
+    TEST_END();
+}
+
+static void test_futex_mutex() {
+    TEST_START("futex-based mutex");
+
+    s_lock_word = 0;
+    s_counter = 0;
+    s_nr_waits = 0;
+    s_nr_wakes = 0;
+
+    int pids[LOCK_THREADS]{};
+    for (int& pid : pids) {
+        pid = spawn(lock_worker, nullptr, CLONE_VM | CLONE_FILES);
+    }
+    bool reaped = true;
+    for (int pid : pids) {
+        reaped = reap(pid) && reaped;
+    }
+
+    uint64_t ops = static_cast<uint64_t>(LOCK_THREADS) * LOCK_ITERS;
+    cprintf("  (%lu lock/unlock pairs, %d futex waits, %d wakes)\n", ops, s_nr_waits, s_nr_wakes);
+    TEST_ASSERT(reaped, "Workers reaped");
+    TEST_ASSERT(s_counter == ops, "No lost updates");
+    TEST_ASSERT(s_lock_word == 0, "Lock free afterwards");
+    TEST_ASSERT(static_cast<uint64_t>(s_nr_wakes) < ops / 2, "Most lock/unlock pairs never entered the kernel");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace thread_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_clone_files();
+    test_close_under_io();
+    test_clone_vm();
+    test_futex_wait_wake();
+    test_futex_mutex();
+
+    TEST_SUMMARY("Threads");
+}
+
+}  // namespace thread_test
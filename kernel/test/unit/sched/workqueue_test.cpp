@@ -0,0 +1,148 @@
+#include "test/test_defs.h"
+#include "sched/sched.h"
+#include "sched/softirq.h"
+#include "sched/workqueue.h"
+#include "drivers/intr.h"
+#include "time/timer_wheel.h"
+#include "lib/stdio.h"
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+volatile int s_runs{};
+volatile int64_t s_run_tick{};
+TaskStruct* volatile s_ran_on{};
+
+void count_work(Work* work) {
+    static_cast<void>(work);
+    s_runs++;
+    s_run_tick = timer::ticks;
+    s_ran_on = sched::current();
+}
+
+void reset_counters() {
+    s_runs = 0;
+    s_run_tick = 0;
+    s_ran_on = nullptr;
+}
+
+}  // namespace
+
+// ============================================================================
+// Workqueue
+// ============================================================================
+
+static void test_queue_work() {
+    TEST_START("queue_work runs on the worker thread");
+
+    reset_counters();
+    Work work{};
+    work.fn = count_work;
+
+    TEST_ASSERT(workqueue::system().worker() != nullptr, "System worker is running");
+    TEST_ASSERT(workqueue::queue_work(&work), "queue_work accepts an idle item");
+    workqueue::flush();
+
+    TEST_ASSERT(s_runs == 1, "Work ran exactly once");
+    TEST_ASSERT(s_ran_on == workqueue::system().worker(), "Work ran in the worker's context");
+    TEST_ASSERT(!work.pending(), "Work is no longer pending");
+
+    TEST_END();
+}
+
+static void test_queue_pending() {
+    TEST_START("queue_work / cancel_work on a pending item");
+
+    reset_counters();
+    Work work{};
+    work.fn = count_work;
+
+    {
+        intr::Guard guard;  // Keep the worker from running in between
+        TEST_ASSERT(workqueue::queue_work(&work), "First queue succeeds");
+        TEST_ASSERT(!workqueue::queue_work(&work), "Second queue is rejected while pending");
+    }
+    workqueue::flush();
+    TEST_ASSERT(s_runs == 1, "Doubly queued work ran once");
+
+    reset_counters();
+    {
+        intr::Guard guard;
+        static_cast<void>(workqueue::queue_work(&work));
+        TEST_ASSERT(workqueue::cancel_work(&work), "Pending work cancels");
+    }
+    workqueue::flush();
+    TEST_ASSERT(s_runs == 0, "Cancelled work never ran");
+    TEST_ASSERT(!workqueue::cancel_work(&work), "Cancel of idle work reports false");
+
+    TEST_END();
+}
+
+static void test_delayed_work() {
+    TEST_START("queue_delayed_work / cancel_delayed_work");
+
+    reset_counters();
+    DelayedWork dwork{};
+    dwork.work.fn = count_work;
+
+    int64_t start = timer::ticks;
+    TEST_ASSERT(workqueue::queue_delayed_work(&dwork, 3), "Delayed work queued");
+    TEST_ASSERT(!workqueue::queue_delayed_work(&dwork, 3), "Re-queue rejected while timer pending");
+
+    for (int i = 0; i < 50 && s_runs == 0; i++) {
+        ktimer::sleep_ticks(1);
+    }
+    TEST_ASSERT(s_runs == 1, "Delayed work ran");
+    TEST_ASSERT(s_run_tick >= start + 3, "Delayed work did not run early");
+
+    reset_counters();
+    TEST_ASSERT(workqueue::queue_delayed_work(&dwork, 5), "Delayed work re-armed");
+    TEST_ASSERT(workqueue::cancel_delayed_work(&dwork), "Armed delayed work cancels");
+    ktimer::sleep_ticks(8);
+    workqueue::flush();
+    TEST_ASSERT(s_runs == 0, "Cancelled delayed work never ran");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Softirq
+// ============================================================================
+
+static void test_timer_softirq() {
+    TEST_START("TIMER softirq runs on IRQ exit");
+
+    uint64_t before = softirq::runs(softirq::TIMER);
+    ktimer::sleep_ticks(3);
+    uint64_t after = softirq::runs(softirq::TIMER);
+
+    TEST_ASSERT(after > before, "TIMER vector ran while we slept");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace workqueue_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_queue_work();
+    test_queue_pending();
+    test_delayed_work();
+    test_timer_softirq();
+
+    TEST_SUMMARY("Workqueue");
+}
+
+}  // namespace workqueue_test
@@ -0,0 +1,267 @@
+#include "test/test_defs.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
+#include "time/vdso.h"
+#include "exec/exec.h"
+#include "lib/stdio.h"
+
+#include <asm/arch.h>
+#include <asm/mmu.h>
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+namespace {
+
+volatile int s_fired{};
+
+void count_fire(KernelTimer* timer) {
+    static_cast<void>(timer);
+    s_fired++;
+}
+
+}  // namespace
+
+// ============================================================================
+// Clocksource
+// ============================================================================
+
+static void test_monotonic() {
+    TEST_START("Clocksource is monotonic");
+
+    uint64_t prev = clocksource::now_ns();
+    bool monotonic = true;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t now = clocksource::now_ns();
+        if (now < prev) {
+            monotonic = false;
+        }
+        prev = now;
+    }
+    TEST_ASSERT(monotonic, "now_ns() never goes backwards");
+    // Monotonic first: with no boot epoch (only x86 reads an RTC) the two
+    // clocks are equal, and sampling realtime first could see it behind.
+    uint64_t mono = clocksource::now_ns();
+    TEST_ASSERT(clocksource::realtime_ns() >= mono, "realtime is at or after monotonic");
+
+    TEST_END();
+}
+
+static void test_cycles_to_ns() {
+    TEST_START("Cycle to nanosecond conversion");
+
+    if (!clocksource::available()) {
+        cprintf("  (no cycle counter, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    uint64_t freq = clocksource::freq_hz();
+    uint64_t one_sec = clocksource::cycles_to_ns(freq);
+    TEST_ASSERT(one_sec > clocksource::NSEC_PER_SEC - 1000 && one_sec < clocksource::NSEC_PER_SEC + 1000,
+                "freq cycles convert to ~1 s");
+
+    uint64_t hour = clocksource::cycles_to_ns(freq * 3600);
+    TEST_ASSERT(hour / clocksource::NSEC_PER_SEC == 3600 || hour / clocksource::NSEC_PER_SEC == 3599,
+                "long intervals do not overflow");
+
+    TEST_END();
+}
+
+static void test_delay() {
+    TEST_START("Busy-wait delay");
+
+    uint64_t start = clocksource::now_ns();
+    clocksource::delay_us(2000);
+    uint64_t elapsed = clocksource::now_ns() - start;
+    TEST_ASSERT(!clocksource::available() || elapsed >= 2 * clocksource::NSEC_PER_MSEC, "delay_us(2000) >= 2 ms");
+
+    clocksource::Deadline deadline(1000);
+    int polls = 0;
+    while (!deadline.expired()) {
+        polls++;
+    }
+    TEST_ASSERT(polls > 0, "Deadline expires after polling");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Timer wheel
+// ============================================================================
+
+static void test_timer_fire() {
+    TEST_START("Timer wheel: root wheel expiry");
+
+    s_fired = 0;
+    KernelTimer t{};
+    t.fn = count_fire;
+    ktimer::add(&t, timer::ticks + 3);
+    TEST_ASSERT(t.pending(), "Timer is pending after add");
+
+    ktimer::sleep_ticks(5);
+    TEST_ASSERT(s_fired == 1, "Timer fired exactly once");
+    TEST_ASSERT(!t.pending(), "Timer is detached after firing");
+
+    TEST_END();
+}
+
+static void test_timer_cancel() {
+    TEST_START("Timer wheel: cancel");
+
+    s_fired = 0;
+    KernelTimer near{};
+    KernelTimer far{};
+    near.fn = count_fire;
+    far.fn = count_fire;
+    ktimer::add(&near, timer::ticks + 2);
+    ktimer::add(&far, timer::ticks + 100000);  // Lands in an outer wheel
+
+    TEST_ASSERT(ktimer::cancel(&near), "Pending timer cancels");
+    TEST_ASSERT(ktimer::cancel(&far), "Outer-wheel timer cancels");
+    TEST_ASSERT(!ktimer::cancel(&near), "Second cancel reports not pending");
+
+    ktimer::sleep_ticks(4);
+    TEST_ASSERT(s_fired == 0, "Cancelled timers never fire");
+
+    TEST_END();
+}
+
+static void test_timer_cascade() {
+    TEST_START("Timer wheel: cascade from outer wheel");
+
+    s_fired = 0;
+    KernelTimer t{};
+    t.fn = count_fire;
+    int64_t start = timer::ticks;
+    ktimer::add(&t, start + (1 << ktimer::ROOT_BITS) + 8);
+
+    while (t.pending()) {
+        ktimer::sleep_ticks(16);
+    }
+    TEST_ASSERT(s_fired == 1, "Timer beyond the root wheel fires");
+    TEST_ASSERT(timer::ticks >= start + (1 << ktimer::ROOT_BITS) + 8, "Timer did not fire early");
+
+    TEST_END();
+}
+
+static void test_sleep_ns() {
+    TEST_START("ktimer::sleep_ns");
+
+    uint64_t start = clocksource::now_ns();
+    ktimer::sleep_ns(25 * clocksource::NSEC_PER_MSEC);
+    uint64_t elapsed = clocksource::now_ns() - start;
+    cprintf("  (slept %lu us)\n", elapsed / clocksource::NSEC_PER_USEC);
+    TEST_ASSERT(elapsed >= 25 * clocksource::NSEC_PER_MSEC, "Sleep lasts at least the requested time");
+    TEST_ASSERT(elapsed < 25 * clocksource::NSEC_PER_MSEC + 5 * clocksource::NSEC_PER_TICK,
+                "Sleep does not overshoot by more than a few ticks");
+
+    TEST_END();
+}
+
+// ============================================================================
+// vDSO
+// ============================================================================
+
+// What the vDSO code computes, from a consistent snapshot of the vvar page.
+static uint64_t vvar_now_ns(const abi_vdso_data* vd) {
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        while ((seq = __atomic_load_n(&vd->seq, __ATOMIC_ACQUIRE)) & 1) {
+        }
+        ns = vd->base_ns;
+        if (vd->freq != 0) {
+            ns += ((arch_read_counter() - vd->base_cycles) * vd->mult + vd->frac) >> vd->shift;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&vd->seq, __ATOMIC_RELAXED) != seq);
+    return ns;
+}
+
+static void test_vdso_clock() {
+    TEST_START("vvar page mirrors the clocksource");
+
+    abi_vdso_data* vd = vdso::data();
+    if (!vd) {
+        cprintf("  (vDSO not initialised, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    TEST_ASSERT(vd->freq == clocksource::freq_hz(), "Counter frequency published");
+    TEST_ASSERT((vd->seq & 1) == 0, "No update left open");
+
+    uint32_t seq = vd->seq;
+    ktimer::sleep_ticks(2);
+    TEST_ASSERT(vd->seq != seq, "Timer tick republishes");
+
+    uint64_t before = clocksource::now_ns();
+    uint64_t user = vvar_now_ns(vd);
+    uint64_t after = clocksource::now_ns();
+    TEST_ASSERT(user >= before && user <= after, "vvar time matches now_ns()");
+    TEST_ASSERT(vd->boot_ns + user <= clocksource::realtime_ns(), "Realtime offset published");
+
+    TEST_END();
+}
+
+static void test_vdso_mapping() {
+    TEST_START("vDSO mapped into user address spaces");
+
+    if (!vdso::available()) {
+        cprintf("  (vDSO not initialised, skipped)\n");
+        TEST_END();
+        return;
+    }
+
+    pde_t* pgdir = exec::create_user_pgdir();
+    TEST_ASSERT(pgdir != nullptr, "User page directory created");
+    if (!pgdir) {
+        TEST_END();
+        return;
+    }
+
+    pte_t* vvar = pmm::get_pte(pgdir, vdso::VVAR_ADDR, false);
+    pte_t* text = pmm::get_pte(pgdir, vdso::TEXT_ADDR, false);
+    bool mapped = vvar && text && (*vvar & VM_PRESENT) && (*text & VM_PRESENT);
+    TEST_ASSERT(mapped, "vvar and text pages present");
+    TEST_ASSERT(mapped && phys_to_virt<abi_vdso_data>(pte_addr(*vvar)) == vdso::data(),
+                "vvar is the kernel's page, not a copy");
+    TEST_ASSERT(mapped && *vvar == make_pte_page(pte_addr(*vvar), VM_USER_RO), "vvar is read-only to user space");
+
+    Page* page = mapped ? pmm::phys_to_page(pte_addr(*vvar)) : nullptr;
+    int refs = page ? page->ref : 0;
+    pmm::free_user_pgdir(pgdir);
+    TEST_ASSERT(page && page->ref == refs - 1 && page->ref >= 1, "Teardown drops only its own reference");
+
+    TEST_END();
+}
+
+// ============================================================================
+// Test Runner
+// ============================================================================
+
+namespace time_test {
+
+void test() {
+    tests_passed = 0;
+    tests_failed = 0;
+
+    test_monotonic();
+    test_cycles_to_ns();
+    test_delay();
+    test_timer_fire();
+    test_timer_cancel();
+    test_timer_cascade();
+    test_sleep_ns();
+    test_vdso_clock();
+    test_vdso_mapping();
+
+    TEST_SUMMARY("Time");
+}
+
+}  // namespace time_test
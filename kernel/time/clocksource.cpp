@@ -0,0 +1,225 @@
+#include "clocksource.h"
+#include "vdso.h"
+
+#include "lib/seqlock.h"
+#include "lib/stdio.h"
+
+#include <asm/arch.h>
+
+namespace {
+
+constexpr uint64_t MAX_FOLD_SEC = 600;  // Longest reader delta that must not overflow
+constexpr uint64_t POLLS_PER_USEC = 10;
+
+struct ClockState {
+    uint64_t freq{};         // Counter frequency in Hz (0 = tick clock only)
+    uint32_t mult{};         // ns = (cycles * mult) >> shift
+    uint32_t shift{};
+    uint64_t base_cycles{};  // Counter value at the last fold
+    uint64_t base_ns{};      // Monotonic time at the last fold
+    uint64_t frac{};         // Sub-nanosecond remainder of base_ns, scaled by 2^shift
+};
+
+// Written by the timer ISR each tick, read lock-free by now_ns().
+ClockState s_clock{};
+SeqLock s_clock_seq{};
+uint64_t s_boot_epoch_ns{};
+
+bool calc_mult_shift(uint64_t freq, uint32_t* mult, uint32_t* shift) {
+    const uint64_t max_cycles = freq * MAX_FOLD_SEC;
+
+    for (uint32_t sft = 32; sft > 0; sft--) {
+        uint64_t m = ((clocksource::NSEC_PER_SEC << sft) + freq / 2) / freq;
+        if (m == 0 || m > __UINT32_MAX__) {
+            continue;
+        }
+        if (max_cycles > __UINT64_MAX__ / m) {
+            continue;
+        }
+        *mult = static_cast<uint32_t>(m);
+        *shift = sft;
+        return true;
+    }
+
+    return false;
+}
+
+uint64_t delta_ns(const ClockState& c, uint64_t cycles) {
+    return ((cycles - c.base_cycles) * c.mult + c.frac) >> c.shift;
+}
+
+// Copy s_clock to the vvar page; caller holds s_clock_seq for writing.
+// The page has its own sequence count, bumped the same way, since user
+// space cannot see the kernel's SeqLock.
+void publish_vdso() {
+    abi_vdso_data* vd = vdso::data();
+    if (!vd) {
+        return;
+    }
+
+    __atomic_store_n(&vd->seq, vd->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    vd->mult = s_clock.mult;
+    vd->shift = s_clock.shift;
+    vd->freq = s_clock.freq;
+    vd->base_cycles = s_clock.base_cycles;
+    vd->base_ns = s_clock.base_ns;
+    vd->frac = s_clock.frac;
+    vd->boot_ns = s_boot_epoch_ns;
+
+    __atomic_store_n(&vd->seq, vd->seq + 1, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+namespace clocksource {
+
+int init() {
+    uint64_t freq = arch_counter_freq();
+    uint32_t mult{};
+    uint32_t shift{};
+
+    if (freq == 0 || !calc_mult_shift(freq, &mult, &shift)) {
+        cprintf("clocksource: no usable cycle counter, using %lu Hz tick clock\n", TICK_HZ);
+        return 0;
+    }
+
+    uint64_t flags = s_clock_seq.write_lock_irqsave();
+    s_clock.mult = mult;
+    s_clock.shift = shift;
+    s_clock.base_cycles = arch_read_counter();
+    s_clock.frac = 0;
+    s_clock.freq = freq;
+    publish_vdso();
+    s_clock_seq.write_unlock_irqrestore(flags);
+
+    cprintf("clocksource: %lu.%03lu MHz counter, mult=%u shift=%u\n", freq / 1000000, (freq / 1000) % 1000, mult,
+            shift);
+    return 0;
+}
+
+void tick() {
+    ClockState& c = s_clock;
+
+    s_clock_seq.write_lock();
+    if (c.freq == 0) {
+        c.base_ns += NSEC_PER_TICK;
+    } else {
+        uint64_t now = arch_read_counter();
+        uint64_t prod = (now - c.base_cycles) * c.mult + c.frac;
+        c.base_ns += prod >> c.shift;
+        c.frac = prod & ((1ULL << c.shift) - 1);
+        c.base_cycles = now;
+    }
+    publish_vdso();
+    s_clock_seq.write_unlock();
+}
+
+bool available() {
+    return s_clock.freq != 0;
+}
+
+uint64_t freq_hz() {
+    return s_clock.freq;
+}
+
+uint64_t read_cycles() {
+    return arch_read_counter();
+}
+
+uint64_t cycles_to_ns(uint64_t cycles) {
+    if (s_clock.freq == 0) {
+        return 0;
+    }
+
+    // Split to keep the product in range for arbitrarily long intervals.
+    uint64_t sec = cycles / s_clock.freq;
+    uint64_t rem = cycles % s_clock.freq;
+    return sec * NSEC_PER_SEC + ((rem * s_clock.mult) >> s_clock.shift);
+}
+
+uint64_t now_ns() {
+    uint64_t ns;
+    uint32_t seq;
+
+    do {
+        seq = s_clock_seq.read_begin();
+        ns = s_clock.base_ns;
+        if (s_clock.freq != 0) {
+            ns += delta_ns(s_clock, arch_read_counter());
+        }
+    } while (s_clock_seq.read_retry(seq));
+
+    return ns;
+}
+
+uint64_t realtime_ns() {
+    return s_boot_epoch_ns + now_ns();
+}
+
+void set_boot_time(uint64_t epoch_sec) {
+    uint64_t flags = s_clock_seq.write_lock_irqsave();
+    s_boot_epoch_ns = epoch_sec * NSEC_PER_SEC;
+    publish_vdso();
+    s_clock_seq.write_unlock_irqrestore(flags);
+}
+
+void sync_vdso() {
+    uint64_t flags = s_clock_seq.write_lock_irqsave();
+    publish_vdso();
+    s_clock_seq.write_unlock_irqrestore(flags);
+}
+
+void delay_ns(uint64_t ns) {
+    if (!available()) {
+        for (uint64_t i = 0; i < ns / 4; i++) {
+            arch_spin_hint();
+        }
+        return;
+    }
+
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+        arch_spin_hint();
+    }
+}
+
+void delay_us(uint64_t us) {
+    delay_ns(us * NSEC_PER_USEC);
+}
+
+void print() {
+    uint64_t up = now_ns();
+    uint64_t wall = realtime_ns() / NSEC_PER_SEC;
+
+    if (available()) {
+        cprintf("clocksource: counter %lu Hz, mult=%u shift=%u\n", s_clock.freq, s_clock.mult, s_clock.shift);
+    } else {
+        cprintf("clocksource: tick clock (%lu Hz)\n", TICK_HZ);
+    }
+    cprintf("uptime: %lu.%09lu s\n", up / NSEC_PER_SEC, up % NSEC_PER_SEC);
+    cprintf("realtime: %lu s since epoch\n", wall);
+}
+
+Deadline::Deadline(uint64_t timeout_us) {
+    if (available()) {
+        expires_ns_ = now_ns() + timeout_us * NSEC_PER_USEC;
+    } else {
+        polls_left_ = timeout_us * POLLS_PER_USEC;
+    }
+}
+
+bool Deadline::expired() {
+    if (available()) {
+        return now_ns() >= expires_ns_;
+    }
+
+    if (polls_left_ == 0) {
+        return true;
+    }
+    polls_left_--;
+    return false;
+}
+
+}  // namespace clocksource
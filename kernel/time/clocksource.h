@@ -0,0 +1,57 @@
+#pragma once
+
+#include <base/types.h>
+
+// Monotonic high-resolution time built on the architecture cycle counter
+// (TSC on x86, CNTVCT_EL0 on AArch64, the `time` CSR on RISC-V).
+//
+// Cycles are converted with a fixed-point (mult, shift) pair.  The timer
+// tick folds elapsed cycles into a nanosecond base so that the delta seen
+// by readers stays small and the multiplication never overflows.  Readers
+// take no lock; a seqlock makes them retry across a concurrent fold.  Each
+// update is mirrored into the vDSO's vvar page for user-space readers.
+
+namespace clocksource {
+
+inline constexpr uint64_t NSEC_PER_USEC = 1000ULL;
+inline constexpr uint64_t NSEC_PER_MSEC = 1000000ULL;
+inline constexpr uint64_t NSEC_PER_SEC = 1000000000ULL;
+
+inline constexpr uint64_t TICK_HZ = 100;  // Periodic timer interrupt rate
+inline constexpr uint64_t NSEC_PER_TICK = NSEC_PER_SEC / TICK_HZ;
+
+int init();
+void tick();  // Called from the timer ISR each tick
+
+[[nodiscard]] bool available();
+[[nodiscard]] uint64_t freq_hz();
+[[nodiscard]] uint64_t read_cycles();
+[[nodiscard]] uint64_t cycles_to_ns(uint64_t cycles);
+
+[[nodiscard]] uint64_t now_ns();       // Monotonic, since clocksource::init()
+[[nodiscard]] uint64_t realtime_ns();  // Wall clock, since the Unix epoch
+
+void set_boot_time(uint64_t epoch_sec);  // Wall clock at boot (from the RTC)
+
+void sync_vdso();  // Publish the current state to the vvar page (vdso::init)
+
+// Busy-wait; usable with interrupts disabled.
+void delay_ns(uint64_t ns);
+void delay_us(uint64_t us);
+
+void print();
+
+// Polling timeout for driver wait loops.  Without a usable clocksource
+// the budget degrades to a fixed number of polls per microsecond.
+class Deadline {
+public:
+    explicit Deadline(uint64_t timeout_us);
+
+    [[nodiscard]] bool expired();
+
+private:
+    uint64_t expires_ns_{};
+    uint64_t polls_left_{};
+};
+
+}  // namespace clocksource
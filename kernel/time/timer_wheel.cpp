@@ -0,0 +1,183 @@
+#include "timer_wheel.h"
+
+#include "clocksource.h"
+#include "drivers/intr.h"
+#include "sched/sched.h"
+#include "sched/softirq.h"
+
+namespace timer {
+extern volatile int64_t ticks;
+}
+
+namespace {
+
+constexpr int ROOT_SIZE = 1 << ktimer::ROOT_BITS;
+constexpr int LEVEL_SIZE = 1 << ktimer::LEVEL_BITS;
+constexpr int64_t ROOT_MASK = ROOT_SIZE - 1;
+constexpr int64_t LEVEL_MASK = LEVEL_SIZE - 1;
+
+ListNode s_root[ROOT_SIZE]{};
+ListNode s_outer[ktimer::OUTER_LEVELS][LEVEL_SIZE]{};
+int64_t s_base{};  // Next tick the wheel will process
+
+void enqueue(KernelTimer* timer) {
+    int64_t delta = timer->expires - s_base;
+    ListNode* slot = nullptr;
+
+    if (delta < 0) {
+        // Already due: fire on the next run().
+        slot = &s_root[s_base & ROOT_MASK];
+    } else if (delta < ROOT_SIZE) {
+        slot = &s_root[timer->expires & ROOT_MASK];
+    } else {
+        if (delta > ktimer::MAX_TIMEOUT) {
+            delta = ktimer::MAX_TIMEOUT;
+            timer->expires = s_base + delta;
+        }
+
+        int level = 0;
+        int bits = ktimer::ROOT_BITS + ktimer::LEVEL_BITS;
+        while (delta >= (1LL << bits)) {
+            level++;
+            bits += ktimer::LEVEL_BITS;
+        }
+        slot = &s_outer[level][(timer->expires >> (bits - ktimer::LEVEL_BITS)) & LEVEL_MASK];
+    }
+
+    slot->add_before(timer->node);
+}
+
+// Re-file every timer of an outer slot into the wheels below.  Each timer
+// lands strictly lower than `level`, so the slot drains.
+void cascade(int level, int64_t index) {
+    ListNode& head = s_outer[level][index];
+
+    while (!head.empty()) {
+        KernelTimer* timer = KernelTimer::from_node(head.get_next());
+        timer->detach();
+        enqueue(timer);
+    }
+}
+
+void wake_task(KernelTimer* timer) {
+    static_cast<TaskStruct*>(timer->data)->wakeup();
+}
+
+void timer_softirq() {
+    ktimer::run(timer::ticks);
+}
+
+}  // namespace
+
+namespace ktimer {
+
+int init() {
+    softirq::open(softirq::TIMER, timer_softirq);
+    return 0;
+}
+
+void add(KernelTimer* timer, int64_t expires) {
+    if (!timer || !timer->fn) {
+        return;
+    }
+
+    intr::Guard guard;
+    if (timer->pending()) {
+        timer->detach();
+    }
+    timer->expires = expires;
+    enqueue(timer);
+}
+
+bool cancel(KernelTimer* timer) {
+    if (!timer) {
+        return false;
+    }
+
+    intr::Guard guard;
+    if (!timer->pending()) {
+        return false;
+    }
+    timer->detach();
+    return true;
+}
+
+void run(int64_t now) {
+    intr::Guard guard;
+
+    while (s_base <= now) {
+        int64_t index = s_base & ROOT_MASK;
+
+        if (index == 0) {
+            for (int level = 0; level < OUTER_LEVELS; level++) {
+                int64_t slot = (s_base >> (ROOT_BITS + level * LEVEL_BITS)) & LEVEL_MASK;
+                cascade(level, slot);
+                if (slot != 0) {
+                    break;
+                }
+            }
+        }
+
+        s_base++;
+
+        ListNode& head = s_root[index];
+        while (!head.empty()) {
+            KernelTimer* timer = KernelTimer::from_node(head.get_next());
+            timer->detach();
+            timer->fn(timer);
+        }
+    }
+}
+
+int64_t ns_to_ticks(uint64_t ns) {
+    return static_cast<int64_t>((ns + clocksource::NSEC_PER_TICK - 1) / clocksource::NSEC_PER_TICK);
+}
+
+void sleep_ticks(int64_t count) {
+    if (count <= 0) {
+        return;
+    }
+
+    TaskStruct* cur = sched::current();
+    KernelTimer timer{};
+    timer.fn = wake_task;
+    timer.data = cur;
+    add(&timer, timer::ticks + count);
+
+    while (true) {
+        {
+            intr::Guard guard;
+            if (!timer.pending()) {
+                break;
+            }
+            cur->sleep();
+        }
+        sched::schedule();
+    }
+}
+
+void sleep_ns(uint64_t ns) {
+    if (ns == 0) {
+        return;
+    }
+
+    if (!clocksource::available()) {
+        sleep_ticks(ns_to_ticks(ns));
+        return;
+    }
+
+    uint64_t end = clocksource::now_ns() + ns;
+    sleep_ticks(static_cast<int64_t>(ns / clocksource::NSEC_PER_TICK));
+
+    // The wheel may wake us up to one tick early, and a sub-tick remainder
+    // costs a whole tick: oversleeping beats spinning while runnable.
+    while (true) {
+        uint64_t now = clocksource::now_ns();
+        if (now >= end) {
+            break;
+        }
+        sleep_ticks(ns_to_ticks(end - now));
+    }
+}
+
+}  // namespace ktimer
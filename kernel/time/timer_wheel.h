@@ -0,0 +1,53 @@
+#pragma once
+
+#include <base/types.h>
+
+#include "lib/list.h"
+
+// One-shot kernel timer.  Callbacks run from the TIMER softirq with
+// interrupts disabled, so they must not sleep; waking a task is fine.
+struct KernelTimer {
+    using Callback = void (*)(KernelTimer* timer);
+
+    ListNode node{};
+    int64_t expires{};  // Absolute tick (timer::ticks) at which the timer fires
+    Callback fn{};
+    void* data{};
+
+    [[nodiscard]] bool pending() const { return !node.empty(); }
+
+    void detach() {
+        node.unlink();
+        node.prev = node.next = &node;
+    }
+
+    static KernelTimer* from_node(ListNode* n) {
+        return reinterpret_cast<KernelTimer*>(reinterpret_cast<char*>(n) - offset_of(&KernelTimer::node));
+    }
+};
+
+// Hierarchical timing wheel: a 256-slot root wheel at tick resolution and
+// three 64-slot outer wheels, each 64x coarser.  Timers in an outer wheel
+// cascade down one level whenever the wheel below wraps, so add/cancel are
+// O(1) and each expiry is touched at most once per level.
+namespace ktimer {
+
+inline constexpr int ROOT_BITS = 8;
+inline constexpr int LEVEL_BITS = 6;
+inline constexpr int OUTER_LEVELS = 3;
+inline constexpr int64_t MAX_TIMEOUT = (1LL << (ROOT_BITS + LEVEL_BITS * OUTER_LEVELS)) - 1;
+
+int init();  // Registers the TIMER softirq
+
+void add(KernelTimer* timer, int64_t expires);
+bool cancel(KernelTimer* timer);  // Returns true if the timer was still pending
+void run(int64_t now);            // Expire everything due at or before `now`
+
+[[nodiscard]] int64_t ns_to_ticks(uint64_t ns);  // Rounded up
+
+// Block the calling task.  sleep_ns() sleeps whole ticks on the wheel,
+// rounding the remainder up to a tick rather than busy-waiting it.
+void sleep_ticks(int64_t ticks);
+void sleep_ns(uint64_t ns);
+
+}  // namespace ktimer
@@ -0,0 +1,79 @@
+#include "vdso.h"
+#include "clocksource.h"
+
+#include "lib/memory.h"
+#include "lib/stdio.h"
+
+#include <asm/arch.h>
+
+extern "C" const uint8_t vdso_start[];
+extern "C" const uint8_t vdso_end[];
+
+namespace {
+
+Page* s_vvar_page{};
+Page* s_text_page{};
+
+}  // namespace
+
+namespace vdso {
+
+int init() {
+    size_t text_size = static_cast<size_t>(vdso_end - vdso_start);
+    if (text_size > PG_SIZE) {
+        cprintf("vdso: text is %lu bytes, more than a page\n", text_size);
+        return -1;
+    }
+
+    Page* vvar = pmm::alloc_pages(1);
+    Page* text = pmm::alloc_pages(1);
+    if (!vvar || !text) {
+        cprintf("vdso: out of memory\n");
+        if (vvar) {
+            pmm::free_pages(vvar);
+        }
+        if (text) {
+            pmm::free_pages(text);
+        }
+        return -1;
+    }
+
+    // The kernel's reference keeps both pages alive across every user
+    // address space teardown.
+    vvar->ref = 1;
+    text->ref = 1;
+    memset(pmm::page_to_kva(vvar), 0, PG_SIZE);
+    memset(pmm::page_to_kva(text), 0, PG_SIZE);
+    memcpy(pmm::page_to_kva(text), vdso_start, text_size);
+
+    arch_enable_user_counter();
+
+    s_text_page = text;
+    __atomic_store_n(&s_vvar_page, vvar, __ATOMIC_RELEASE);
+    clocksource::sync_vdso();
+
+    cprintf("vdso: %lu bytes of text at 0x%lx, vvar at 0x%lx\n", text_size, TEXT_ADDR, VVAR_ADDR);
+    return 0;
+}
+
+bool available() {
+    return __atomic_load_n(&s_vvar_page, __ATOMIC_ACQUIRE) != nullptr;
+}
+
+Error map(pde_t* pgdir) {
+    ENSURE(pgdir, Error::Invalid);
+    if (!available()) {
+        return Error::None;
+    }
+
+    TRY(pmm::page_insert(pgdir, s_vvar_page, VVAR_ADDR, VM_USER_RO));
+    TRY(pmm::page_insert(pgdir, s_text_page, TEXT_ADDR, VM_USER_RX));
+    return Error::None;
+}
+
+abi_vdso_data* data() {
+    Page* vvar = __atomic_load_n(&s_vvar_page, __ATOMIC_ACQUIRE);
+    return vvar ? static_cast<abi_vdso_data*>(pmm::page_to_kva(vvar)) : nullptr;
+}
+
+}  // namespace vdso
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <base/types.h>
+#include <asm/page.h>
+#include <abi/vdso.h>
+
+#include "lib/result.h"
+#include "mm/pmm.h"
+
+// User-readable clock.  Two kernel pages are mapped read-only into every
+// user address space: the vvar page, a struct abi_vdso_data that the
+// clocksource keeps current under a sequence count, and above it the vDSO
+// text (arch/<arch>/kernel/vdso.S), which turns it and the cycle counter
+// into clock_gettime() without entering the kernel.
+
+namespace vdso {
+
+// One guard page below the user stack, then vvar, then text.
+inline constexpr uintptr_t VVAR_ADDR = USER_STACK_TOP - USER_STACK_SIZE - 3 * PG_SIZE;
+inline constexpr uintptr_t TEXT_ADDR = VVAR_ADDR + PG_SIZE;
+
+int init();  // Needs pmm; publishes the current clock
+
+[[nodiscard]] bool available();
+
+// Map both pages into a new user address space (no-op before init()).
+[[nodiscard]] Error map(pde_t* pgdir);
+
+// Kernel view of the vvar page; null before init().  Written only by the
+// clocksource.
+[[nodiscard]] abi_vdso_data* data();
+
+}  // namespace vdso
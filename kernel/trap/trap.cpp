@@ -3,13 +3,24 @@
 #include "lib/unistd.h"
 #include "lib/stdio.h"
 
+#include <abi/time.h>
 #include <asm/page.h>
 
 #include "drivers/fbcons.h"
+#include "exec/exec.h"
 #include "fs/vfs.h"
+#include "debug/assert.h"
+#include "lib/futex.h"
+#include "lib/math.h"
 #include "lib/result.h"
+#include "mm/objcache.h"
+#include "mm/uaccess.h"
 #include "mm/vmm.h"
+#include "sched/preempt.h"
 #include "sched/sched.h"
+#include "sched/softirq.h"
+#include "time/clocksource.h"
+#include "time/timer_wheel.h"
 
 namespace timer {
 extern volatile int64_t ticks;
@@ -19,42 +30,10 @@ namespace {
 
 constexpr size_t SYSCALL_PATH_MAX = 128;
 
-bool user_range_valid(uintptr_t addr, size_t size) {
-    if (addr >= USER_SPACE_TOP) {
-        return false;
-    }
-    if (size > USER_SPACE_TOP - addr) {
-        return false;
-    }
-    return true;
-}
-
-int copy_user_cstr(const char* user, char* out, size_t out_size) {
-    if (!user || !out || out_size == 0) {
-        return -1;
-    }
-
-    uintptr_t base = reinterpret_cast<uintptr_t>(user);
-    if (base >= USER_SPACE_TOP) {
-        return -1;
-    }
-
-    for (size_t i = 0; i < out_size; i++) {
-        uintptr_t cur = base + i;
-        if (cur >= USER_SPACE_TOP) {
-            return -1;
-        }
-
-        char ch = user[i];
-        out[i] = ch;
-        if (ch == '\0') {
-            return 0;
-        }
-    }
-
-    out[out_size - 1] = '\0';
-    return -1;
-}
+// read() and write() move file data through a kernel buffer, a chunk at a
+// time: the file systems and drivers below vfs never see a user pointer.
+constexpr size_t IO_CHUNK = PG_SIZE;
+ObjCache s_io_bounce{"io_bounce", IO_CHUNK, 2};
 
 long sys_open(TaskStruct* cur, const char* user_path, int flags, int mode) {
     static_cast<void>(flags);
@@ -65,7 +44,7 @@ long sys_open(TaskStruct* cur, const char* user_path, int flags, int mode) {
     }
 
     char path[SYSCALL_PATH_MAX]{};
-    if (copy_user_cstr(user_path, path, sizeof(path)) != 0) {
+    if (!uaccess::strncpy_from_user(path, user_path, sizeof(path)).ok()) {
         return -1;
     }
 
@@ -92,27 +71,50 @@ long sys_read(TaskStruct* cur, int fd, void* user_buf, size_t count) {
         return 0;
     }
 
-    if (!user_buf) {
+    if (!user_buf || !uaccess::range_ok(reinterpret_cast<uintptr_t>(user_buf), count)) {
         return -1;
     }
 
-    uintptr_t buf_addr = reinterpret_cast<uintptr_t>(user_buf);
-    if (!user_range_valid(buf_addr, count)) {
+    size_t offset{};
+    vfs::File* file = cur->files().get_file(fd, &offset);
+    if (!file) {
         return -1;
     }
 
-    fd::Entry* entry = cur->files().get(fd);
-    if (!entry) {
+    auto* bounce = static_cast<char*>(s_io_bounce.alloc());
+    if (!bounce) {
+        vfs::close(file);
         return -1;
     }
 
-    auto bytes_r = vfs::read(entry->file, user_buf, count, entry->offset);
-    if (!bytes_r.ok()) {
-        return -1;
+    // Stops at the first short read: end of file, or a console line.
+    auto* dst = static_cast<char*>(user_buf);
+    long total = 0;
+    while (static_cast<size_t>(total) < count) {
+        size_t chunk = min(count - static_cast<size_t>(total), IO_CHUNK);
+        auto bytes_r = vfs::read(file, bounce, chunk, offset);
+        if (!bytes_r.ok()) {
+            total = total > 0 ? total : -1;
+            break;
+        }
+
+        auto bytes = static_cast<size_t>(bytes_r.value());
+        // Earlier chunks already moved the offset; report them, not -1.
+        if (uaccess::copy_to_user(dst + total, bounce, bytes) != Error::None) {
+            total = total > 0 ? total : -1;
+            break;
+        }
+        offset += bytes;
+        cur->files().advance(fd, file, bytes);
+        total += static_cast<long>(bytes);
+        if (bytes < chunk) {
+            break;
+        }
     }
 
-    entry->offset += static_cast<size_t>(bytes_r.value());
-    return bytes_r.value();
+    s_io_bounce.free(bounce);
+    vfs::close(file);
+    return total;
 }
 
 long sys_close(TaskStruct* cur, int fd) {
@@ -128,31 +130,348 @@ long sys_write(TaskStruct* cur, int fd, const char* user_buf, size_t count) {
         return 0;
     }
 
-    if (!user_buf) {
+    if (!user_buf || !uaccess::range_ok(reinterpret_cast<uintptr_t>(user_buf), count)) {
         return -1;
     }
 
-    uintptr_t buf_addr = reinterpret_cast<uintptr_t>(user_buf);
-    if (!user_range_valid(buf_addr, count)) {
+    if (!cur) {
         return -1;
     }
 
-    if (!cur) {
+    size_t offset{};
+    vfs::File* file = cur->files().get_file(fd, &offset);
+    if (!file) {
+        return -1;
+    }
+
+    auto* bounce = static_cast<char*>(s_io_bounce.alloc());
+    if (!bounce) {
+        vfs::close(file);
+        return -1;
+    }
+
+    long total = 0;
+    while (static_cast<size_t>(total) < count) {
+        size_t chunk = min(count - static_cast<size_t>(total), IO_CHUNK);
+        // Earlier chunks are already written; report them, not -1.
+        if (uaccess::copy_from_user(bounce, user_buf + total, chunk) != Error::None) {
+            total = total > 0 ? total : -1;
+            break;
+        }
+
+        auto bytes_r = vfs::write(file, bounce, chunk, offset);
+        if (!bytes_r.ok()) {
+            total = total > 0 ? total : -1;
+            break;
+        }
+
+        auto bytes = static_cast<size_t>(bytes_r.value());
+        offset += bytes;
+        cur->files().advance(fd, file, bytes);
+        total += static_cast<long>(bytes);
+        if (bytes < chunk) {
+            break;
+        }
+    }
+
+    s_io_bounce.free(bounce);
+    vfs::close(file);
+    return total;
+}
+
+long sys_clock_gettime(int clock_id, abi_timespec* user_ts) {
+    if (!user_ts) {
+        return -1;
+    }
+
+    uint64_t ns = 0;
+    switch (clock_id) {
+        case CLOCK_REALTIME: ns = clocksource::realtime_ns(); break;
+        case CLOCK_MONOTONIC: ns = clocksource::now_ns(); break;
+        default: return -1;
+    }
+
+    abi_timespec ts{};
+    ts.tv_sec = static_cast<long long>(ns / clocksource::NSEC_PER_SEC);
+    ts.tv_nsec = static_cast<long long>(ns % clocksource::NSEC_PER_SEC);
+    return uaccess::put_user(ts, user_ts) == Error::None ? 0 : -1;
+}
+
+long sys_nanosleep(const abi_timespec* user_req, abi_timespec* user_rem) {
+    abi_timespec req{};
+    if (!user_req || uaccess::get_user(req, user_req) != Error::None) {
+        return -1;
+    }
+    if (user_rem && !uaccess::range_ok(reinterpret_cast<uintptr_t>(user_rem), sizeof(*user_rem))) {
+        return -1;
+    }
+
+    if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= static_cast<long long>(clocksource::NSEC_PER_SEC)) {
+        return -1;
+    }
+
+    // Clamp instead of wrapping to a short sleep.  Half the range keeps
+    // sleep_ns()'s deadline and tick count from overflowing too; 292 years
+    // is as good as forever.
+    constexpr uint64_t MAX_SEC = (~uint64_t{0} >> 1) / clocksource::NSEC_PER_SEC - 1;
+    uint64_t sec = min(static_cast<uint64_t>(req.tv_sec), MAX_SEC);
+    ktimer::sleep_ns(sec * clocksource::NSEC_PER_SEC + static_cast<uint64_t>(req.tv_nsec));
+
+    // No signals, so the sleep always runs to completion.
+    if (user_rem && uaccess::put_user(abi_timespec{}, user_rem) != Error::None) {
+        return -1;
+    }
+    return 0;
+}
+
+// Threads only: without copy-on-fork address spaces, a child that does not
+// share its parent's would have nothing to run in.  The child resumes from
+// the same syscall on `child_stack` and sees 0.
+long sys_clone(TrapFrame* tf, uint32_t flags, uintptr_t child_stack) {
+    if (!(flags & CLONE_VM) || (flags & ~static_cast<uint32_t>(CLONE_VM | CLONE_FILES)) != 0) {
+        return -1;
+    }
+    if (child_stack == 0 || child_stack > USER_SPACE_TOP) {
+        return -1;
+    }
+
+    auto pid_r = sched::fork(flags, child_stack, tf);
+    return pid_r.ok() ? pid_r.value() : -1;
+}
+
+// spawn()'s argv and envp, copied in: the strings are packed into
+// `strings` and the arrays point into it.
+struct SpawnArgs {
+    const char* argv[exec::MAX_ARGS + 1]{};
+    const char* envp[exec::MAX_ARGS + 1]{};
+    char strings[exec::MAX_ARG_BYTES]{};
+    size_t used{};
+};
+
+int copy_user_args(const char* const* user_vec, const char** out, SpawnArgs& args) {
+    if (!user_vec) {
+        return 0;
+    }
+
+    for (int i = 0;; i++) {
+        const char* user_str = nullptr;
+        if (uaccess::get_user(user_str, &user_vec[i]) != Error::None) {
+            return -1;
+        }
+        if (!user_str) {
+            out[i] = nullptr;
+            return 0;
+        }
+        if (i == exec::MAX_ARGS) {
+            return -1;
+        }
+
+        char* dst = args.strings + args.used;
+        auto len_r = uaccess::strncpy_from_user(dst, user_str, sizeof(args.strings) - args.used);
+        if (!len_r.ok()) {
+            return -1;
+        }
+        out[i] = dst;
+        args.used += len_r.value() + 1;
+    }
+}
+
+// A new process straight from an ELF file: no fork of the caller's address
+// space, which the child would discard anyway.
+long sys_spawn(const char* user_path, const char* const* user_argv, const char* const* user_envp) {
+    char path[SYSCALL_PATH_MAX]{};
+    if (!uaccess::strncpy_from_user(path, user_path, sizeof(path)).ok()) {
+        return -1;
+    }
+
+    auto* args = new SpawnArgs();
+    if (!args) {
+        return -1;
+    }
+
+    long rc = -1;
+    if (copy_user_args(user_argv, args->argv, *args) == 0 && copy_user_args(user_envp, args->envp, *args) == 0) {
+        auto pid_r = exec::spawn(path, args->argv, args->envp);
+        rc = pid_r.ok() ? pid_r.value() : -1;
+    }
+
+    delete args;
+    return rc;
+}
+
+// pid <= 0 waits for any child (there are no process groups).  No options
+// are supported yet.
+long sys_waitpid(int pid, int* user_status, int options) {
+    if (options != 0) {
+        return -1;
+    }
+    if (user_status && !uaccess::range_ok(reinterpret_cast<uintptr_t>(user_status), sizeof(*user_status))) {
         return -1;
     }
 
-    fd::Entry* entry = cur->files().get(fd);
-    if (!entry) {
+    int exit_code = 0;
+    auto pid_r = sched::wait(pid > 0 ? pid : 0, &exit_code);
+    if (!pid_r.ok()) {
         return -1;
     }
 
-    auto bytes_r = vfs::write(entry->file, user_buf, count, entry->offset);
-    if (!bytes_r.ok()) {
+    if (user_status && uaccess::put_user(exit_code, user_status) != Error::None) {
         return -1;
     }
+    return pid_r.value();
+}
+
+long sys_futex(TaskStruct* cur, uint32_t* uaddr, int op, uint32_t val) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(uaddr);
+    if (!cur || !cur->memory || (addr & (sizeof(*uaddr) - 1)) != 0 || !uaccess::range_ok(addr, sizeof(*uaddr))) {
+        return -1;
+    }
+
+    switch (op) {
+        case FUTEX_WAIT: return futex::wait(cur->memory, uaddr, val) == Error::None ? 0 : -1;
+        case FUTEX_WAKE: return futex::wake(cur->memory, uaddr, static_cast<int>(val));
+        default: return -1;
+    }
+}
+
+// Table entries unpack the arguments from the TrapFrame; the return value
+// goes back in the return register.
+using SyscallFn = long (*)(TrapFrame* tf);
+
+constexpr int NR_SYSCALLS = NR_CLOCK_GETTIME + 1;  // Highest syscall number + 1
+
+long do_exit(TrapFrame* tf) {
+    TaskStruct* cur = sched::current();
+    cprintf("[PID %d] exited with code %ld\n", cur ? cur->pid : -1, tf->syscall_arg(0));
+    sched::exit(static_cast<int>(tf->syscall_arg(0)));
+    return 0;
+}
+
+long do_read(TrapFrame* tf) {
+    int fd = static_cast<int>(tf->syscall_arg(0));
+    auto* buf = reinterpret_cast<void*>(tf->syscall_arg(1));
+    size_t count = static_cast<size_t>(tf->syscall_arg(2));
+    return sys_read(sched::current(), fd, buf, count);
+}
+
+long do_write(TrapFrame* tf) {
+    int fd = static_cast<int>(tf->syscall_arg(0));
+    const auto* buf = reinterpret_cast<const char*>(tf->syscall_arg(1));
+    size_t count = static_cast<size_t>(tf->syscall_arg(2));
+    return sys_write(sched::current(), fd, buf, count);
+}
+
+long do_open(TrapFrame* tf) {
+    const auto* path = reinterpret_cast<const char*>(tf->syscall_arg(0));
+    int flags = static_cast<int>(tf->syscall_arg(1));
+    int mode = static_cast<int>(tf->syscall_arg(2));
+    return sys_open(sched::current(), path, flags, mode);
+}
+
+long do_close(TrapFrame* tf) {
+    return sys_close(sched::current(), static_cast<int>(tf->syscall_arg(0)));
+}
+
+long do_waitpid(TrapFrame* tf) {
+    int pid = static_cast<int>(tf->syscall_arg(0));
+    auto* status = reinterpret_cast<int*>(tf->syscall_arg(1));
+    int options = static_cast<int>(tf->syscall_arg(2));
+    return sys_waitpid(pid, status, options);
+}
+
+long do_spawn(TrapFrame* tf) {
+    const auto* path = reinterpret_cast<const char*>(tf->syscall_arg(0));
+    const auto* argv = reinterpret_cast<const char* const*>(tf->syscall_arg(1));
+    const auto* envp = reinterpret_cast<const char* const*>(tf->syscall_arg(2));
+    return sys_spawn(path, argv, envp);
+}
+
+// Does no work: the cheapest round trip, for measuring entry/exit cost.
+long do_getpid(TrapFrame* tf) {
+    static_cast<void>(tf);
+    TaskStruct* cur = sched::current();
+    return cur ? cur->pid : -1;
+}
+
+long do_clone(TrapFrame* tf) {
+    uint32_t flags = static_cast<uint32_t>(tf->syscall_arg(0));
+    uintptr_t child_stack = static_cast<uintptr_t>(tf->syscall_arg(1));
+    return sys_clone(tf, flags, child_stack);
+}
+
+long do_nanosleep(TrapFrame* tf) {
+    const auto* req = reinterpret_cast<const abi_timespec*>(tf->syscall_arg(0));
+    auto* rem = reinterpret_cast<abi_timespec*>(tf->syscall_arg(1));
+    return sys_nanosleep(req, rem);
+}
+
+long do_futex(TrapFrame* tf) {
+    auto* uaddr = reinterpret_cast<uint32_t*>(tf->syscall_arg(0));
+    int op = static_cast<int>(tf->syscall_arg(1));
+    uint32_t val = static_cast<uint32_t>(tf->syscall_arg(2));
+    return sys_futex(sched::current(), uaddr, op, val);
+}
+
+long do_clock_gettime(TrapFrame* tf) {
+    int clock_id = static_cast<int>(tf->syscall_arg(0));
+    auto* ts = reinterpret_cast<abi_timespec*>(tf->syscall_arg(1));
+    return sys_clock_gettime(clock_id, ts);
+}
+
+struct SyscallTable {
+    SyscallFn fn[NR_SYSCALLS]{};
+
+    constexpr SyscallTable() {
+        fn[NR_EXIT] = do_exit;
+        fn[NR_READ] = do_read;
+        fn[NR_WRITE] = do_write;
+        fn[NR_OPEN] = do_open;
+        fn[NR_CLOSE] = do_close;
+        fn[NR_WAITPID] = do_waitpid;
+        fn[NR_SPAWN] = do_spawn;
+        fn[NR_GETPID] = do_getpid;
+        fn[NR_CLONE] = do_clone;
+        fn[NR_NANOSLEEP] = do_nanosleep;
+        fn[NR_FUTEX] = do_futex;
+        fn[NR_CLOCK_GETTIME] = do_clock_gettime;
+    }
+};
+
+constexpr SyscallTable s_syscalls{};
+
+void unknown_syscall(TrapFrame* tf) {
+    cprintf("unknown syscall %d\n", static_cast<int>(tf->syscall_nr()));
+    tf->set_return(static_cast<uint64_t>(-1));
+}
+
+// A fault the page tables cannot satisfy.  A uaccess routine resumes at its
+// fixup and reports the fault to its caller; a user task is killed; any
+// other kernel fault is a bug.
+void bad_page_fault(TrapFrame* tf, uint32_t err) {
+    bool user_mode = (err & 4) != 0;
+    if (!user_mode) {
+        if (uintptr_t fixup = uaccess::search_extable(tf->ip())) {
+            tf->set_ip(fixup);
+            return;
+        }
+    }
 
-    entry->offset += static_cast<size_t>(bytes_r.value());
-    return bytes_r.value();
+    tf->print();
+    tf->print_pgfault();
+    if (!user_mode) {
+        panic("unhandled page fault in kernel mode");
+    }
+
+    TaskStruct* cur = sched::current();
+    cprintf("[PID %d] killed by page fault\n", cur ? cur->pid : -1);
+    sched::exit(-1);
+}
+
+void preempt_point() {
+    TaskStruct* cur = sched::current();
+    if (cur && cur->need_resched && preempt::preemptible()) {
+        sched::schedule();
+    }
 }
 
 }  // namespace
@@ -161,6 +480,8 @@ namespace trap {
 
 void handle_timer_tick() {
     timer::ticks++;
+    clocksource::tick();
+    softirq::raise(softirq::TIMER);
     sched::tick();
     fbcons::tick();
 }
@@ -170,8 +491,10 @@ int handle_page_fault(TrapFrame* tf, uint32_t err, uintptr_t fault_addr) {
         return -1;
     }
 
-    tf->print();
-    tf->print_pgfault();
+    // Paging in may sleep; a _nofault copy takes its fixup instead.
+    if (uaccess::faults_disabled() && uaccess::search_extable(tf->ip())) {
+        return -1;
+    }
 
     TaskStruct* current = sched::current();
     if (!current || !current->memory) {
@@ -186,46 +509,13 @@ bool handle_syscall(TrapFrame* tf) {
         return false;
     }
 
-    int nr = static_cast<int>(tf->syscall_nr());
-    TaskStruct* cur = sched::current();
-
-    switch (nr) {
-        case NR_EXIT:
-            cprintf("[PID %d] exited with code %ld\n", cur ? cur->pid : -1, tf->syscall_arg(0));
-            sched::exit(static_cast<int>(tf->syscall_arg(0)));
-            return true;
-        case NR_OPEN: {
-            const auto* path = reinterpret_cast<const char*>(tf->syscall_arg(0));
-            int flags = static_cast<int>(tf->syscall_arg(1));
-            int mode = static_cast<int>(tf->syscall_arg(2));
-            long rc = sys_open(cur, path, flags, mode);
-            tf->set_return(static_cast<uint64_t>(rc));
-            return true;
-        }
-        case NR_READ: {
-            int fd = static_cast<int>(tf->syscall_arg(0));
-            auto* buf = reinterpret_cast<void*>(tf->syscall_arg(1));
-            size_t count = static_cast<size_t>(tf->syscall_arg(2));
-            long rc = sys_read(cur, fd, buf, count);
-            tf->set_return(static_cast<uint64_t>(rc));
-            return true;
-        }
-        case NR_CLOSE: {
-            int fd = static_cast<int>(tf->syscall_arg(0));
-            long rc = sys_close(cur, fd);
-            tf->set_return(static_cast<uint64_t>(rc));
-            return true;
-        }
-        case NR_WRITE: {
-            int fd = static_cast<int>(tf->syscall_arg(0));
-            const auto* buf = reinterpret_cast<const char*>(tf->syscall_arg(1));
-            size_t count = static_cast<size_t>(tf->syscall_arg(2));
-            long rc = sys_write(cur, fd, buf, count);
-            tf->set_return(static_cast<uint64_t>(rc));
-            return true;
-        }
-        default: return false;
+    uint64_t nr = tf->syscall_nr();
+    if (nr >= NR_SYSCALLS || !s_syscalls.fn[nr]) {
+        return false;
     }
+
+    tf->set_return(static_cast<uint64_t>(s_syscalls.fn[nr](tf)));
+    return true;
 }
 
 }  // namespace trap
@@ -235,19 +525,24 @@ extern "C" void trap_dispatch(TrapFrame* tf) {
         return;
     }
 
-    if (trap::arch_try_handle_irq(tf)) {
+    preempt::irq_enter();
+    bool handled_irq = trap::arch_try_handle_irq(tf);
+    preempt::irq_exit();
+
+    if (handled_irq) {
         trap::arch_post_dispatch(tf);
+        softirq::run();
     } else if (trap::arch_is_page_fault(tf)) {
         uint32_t err = trap::arch_page_fault_error(tf);
         uintptr_t fault_addr = trap::arch_page_fault_addr(tf);
-        trap::handle_page_fault(tf, err, fault_addr);
+        if (trap::handle_page_fault(tf, err, fault_addr) != 0) {
+            bad_page_fault(tf, err);
+        }
         trap::arch_post_dispatch(tf);
     } else if (trap::arch_is_syscall(tf)) {
         trap::arch_on_syscall_entry(tf);
         if (!trap::handle_syscall(tf)) {
-            int nr = static_cast<int>(tf->syscall_nr());
-            cprintf("unknown syscall %d\n", nr);
-            tf->set_return(static_cast<uint64_t>(-1));
+            unknown_syscall(tf);
         }
         trap::arch_post_dispatch(tf);
     } else {
@@ -255,8 +550,18 @@ extern "C" void trap_dispatch(TrapFrame* tf) {
         trap::arch_post_dispatch(tf);
     }
 
-    TaskStruct* cur = sched::current();
-    if (cur && cur->need_resched) {
-        sched::schedule();
+    // Preemption point: taken on return to user mode and, when no lock or
+    // outer handler holds the preempt count, on return to kernel mode too.
+    preempt_point();
+}
+
+// Dedicated syscall entries (SYSCALL on x86_64, the EL0 synchronous vector
+// on aarch64, user ecall on riscv64) come here directly: the trap is known
+// to be a syscall, so none of trap_dispatch's IRQ and fault checks apply.
+extern "C" void syscall_dispatch(TrapFrame* tf) {
+    trap::arch_on_syscall_entry(tf);
+    if (!trap::handle_syscall(tf)) {
+        unknown_syscall(tf);
     }
+    preempt_point();
 }
@@ -65,11 +65,11 @@ QEMU_CMD=(
     -display none
     -no-reboot
     -serial "file:${SERIAL_LOG}"
-    -drive "file=${BINDIR}/zonix-uefi.img,format=raw,if=none,id=sys"
-    -device "virtio-blk-pci,drive=sys"
     -drive "file=${BINDIR}/sdcard.img,format=raw,if=none,id=sdcard"
     -device sdhci-pci
     -device "sd-card,drive=sdcard"
+    -drive "file=${BINDIR}/zonix-uefi.img,format=raw,if=none,id=sys"
+    -device "virtio-blk-pci,drive=sys"
 )
 
 echo "Starting QEMU (aarch64 UEFI mode)..."
@@ -5,6 +5,7 @@
 # Environment:
 #   BINDIR   — directory containing the boot binary and kernel (required)
 #   ARCH     — x86 or aarch64 (auto-detected from BINDIR if omitted)
+#   RAMDISK  — optional image the loader preloads as ramdisk ram0
 set -e
 
 BINDIR="${BINDIR:-bin}"
@@ -42,6 +43,7 @@ KERNEL="${BINDIR}/kernel"
 
 [ -f "$BOOTLOADER" ] || { echo "Error: $BOOTLOADER not found"; exit 1; }
 [ -f "$KERNEL" ] || { echo "Error: $KERNEL not found"; exit 1; }
+[ -z "$RAMDISK" ] || [ -f "$RAMDISK" ] || { echo "Error: $RAMDISK not found"; exit 1; }
 
 echo "[1] Creating ${IMAGE_SIZE}MB image..."
 dd if=/dev/zero of="$IMAGE" bs=1M count=$IMAGE_SIZE 2>/dev/null
@@ -69,6 +71,9 @@ echo "[6] Copying files..."
 mcopy -i "$MTOOLS_IMG" "$BOOTLOADER" "::/EFI/BOOT/${EFI_BOOT_NAME}"
 mcopy -i "$MTOOLS_IMG" "$KERNEL" ::/EFI/ZONIX/KERNEL.ELF
 mcopy -i "$MTOOLS_IMG" "$KERNEL" ::/KERNEL.ELF
+if [ -n "$RAMDISK" ]; then
+    mcopy -i "$MTOOLS_IMG" "$RAMDISK" ::/EFI/ZONIX/RAMDISK.IMG
+fi
 
 echo "[7] Creating startup.nsh..."
 TMPNSH=$(mktemp)